@@ -105,6 +105,313 @@ expect(@options[:rwmix]).to eq(0.5)
 expect(@options[:json]).to eq(true)
     end
 
+    it "should split groups at ':' on invoke" do
+      cmdline = nil
+      @iocommand.define_singleton_method(:run_cmd) {|args| cmdline = args.join(" ")}
+
+      @iocommand.invoke(["-R", __FILE__])
+      expect(cmdline).not_to match(/ : /)
+      expect(cmdline).to match(/ -R /)
+
+      @iocommand.invoke(["-t", "10", "-W", "-m", "2", __FILE__, ":", "-R", "-b", "8kb", __FILE__, __FILE__])
+      groups = cmdline.split(" : ")
+      expect(groups.size).to eq(2)
+      expect(groups[0]).to match(/-m 2 -t 10 -S /)
+      expect(groups[0]).to match(/ -W -b 4096 /)
+      expect(groups[0]).to match(/ -j #{Regexp.quote(__FILE__)}\z/)
+      expect(groups[1]).to match(/\A-m 1 -R /)
+      expect(groups[1]).to match(/ -b 8192 /)
+      expect(groups[1]).to match(/ #{Regexp.quote(__FILE__)} #{Regexp.quote(__FILE__)}\z/)
+
+      # options of the whole run are given to the first group only
+      expect(groups[1]).not_to match(/ -t | -j\b/)
+      expect { @iocommand.invoke([__FILE__, ":", "-t", "10", __FILE__]) }.to raise_error(ArgumentError)
+      expect { @iocommand.invoke([__FILE__, ":", "--warmup", "1", __FILE__]) }.to raise_error(ArgumentError)
+      expect { @iocommand.invoke([__FILE__, ":", "--sysstat", __FILE__]) }.to raise_error(ArgumentError)
+    end
+
+    it "should parse rate limits of files" do
+      @iocommand.parse_args([])
+      expect(@iocommand.gen_args([__FILE__]).last).to eq(__FILE__)
+      expect(@iocommand.gen_args(["#{__FILE__},iops=100"]).last).to eq("#{__FILE__},iops=100")
+      expect(@iocommand.gen_args(["#{__FILE__},iops=100,bw=1mb"]).last).to eq("#{__FILE__},iops=100,bw=#{2 ** 20}")
+      expect(@iocommand.gen_args(["#{__FILE__},bw=4kb,iops=8"]).last).to eq("#{__FILE__},bw=4096,iops=8")
+
+      expect { @iocommand.gen_args(["#{__FILE__},iops=abc"]) }.to raise_error(ArgumentError)
+      expect { @iocommand.gen_args(["#{__FILE__},iops=-1"]) }.to raise_error(ArgumentError)
+      expect { @iocommand.gen_args(["#{__FILE__},bw=fast"]) }.to raise_error(ArgumentError)
+      expect { @iocommand.gen_args(["#{__FILE__},rate=10"]) }.to raise_error(ArgumentError)
+      $stderr = StringIO.new
+      $stdout = StringIO.new
+      begin
+        expect { @iocommand.gen_args(["#{__FILE__}.none,iops=100"]) }.to raise_error(SystemExit)
+      ensure
+        $stderr = STDERR
+        $stdout = STDOUT
+      end
+    end
+
+    it "should parse flush options" do
+      @iocommand.parse_args([])
+      expect(@options[:fsync_every]).to eq(0)
+      expect(@options[:fsync_interval]).to eq(0)
+      expect(@options[:flush_op]).to be_nil
+      expect(@options[:dsync]).to eq(false)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/--fsync|--flush-op|--dsync/)
+
+      @iocommand.parse_args(%w|-W --fsync-every 8 --flush-op fdatasync|)
+      expect(@options[:fsync_every]).to eq(8)
+      expect(@options[:flush_op]).to eq("fdatasync")
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --fsync-every 8 --flush-op fdatasync /)
+
+      @iocommand.parse_args(%w|-M 0.5 --fsync-interval 100 --dsync|)
+      expect(@options[:fsync_interval]).to eq(100)
+      expect(@options[:dsync]).to eq(true)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --fsync-interval 100 --dsync /)
+
+      @iocommand.parse_args(%w|-W -A -g io_uring --fsync-every 8 --flush-op sync_file_range|)
+      expect(@options[:flush_op]).to eq("sync_file_range")
+    end
+
+    it "should reject invalid flush options" do
+      expect { @iocommand.parse_args(%w|--fsync-every 8|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--fsync-interval 100|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|-W --fsync-every -1|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|-W -A --fsync-every 8 --flush-op sync_file_range|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--dsync|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|-W --flush-op msync|) }.to raise_error(OptionParser::InvalidArgument)
+    end
+
+    it "should parse WAL options" do
+      @iocommand.parse_args([])
+      expect(@options[:wal_record]).to eq([512, 512])
+      expect(@options[:commit_delay]).to eq(0)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/--wal|--commit-delay/)
+
+      @iocommand.parse_args(%w|--wal|)
+      expect(@options[:pattern]).to eq(:wal)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --wal --wal-record 512,512 --commit-delay 0 /)
+
+      @iocommand.parse_args(%w|-m 8 --wal --wal-record 128,4kb --commit-delay 100|)
+      expect(@options[:wal_record]).to eq([128, 4096])
+      expect(@options[:commit_delay]).to eq(100)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --wal --wal-record 128,4096 --commit-delay 100 /)
+
+      @iocommand.parse_args(%w|--wal --wal-record 1kb|)
+      expect(@options[:wal_record]).to eq([1024, 1024])
+    end
+
+    it "should reject invalid WAL options" do
+      expect { @iocommand.parse_args(%w|--wal -A|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--wal --replay log|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--wal --wal-record 4kb,128|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--wal --wal-record 0|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--wal --commit-delay soon|) }.to raise_error(OptionParser::InvalidArgument)
+    end
+
+    it "should parse small file options" do
+      @iocommand.parse_args([])
+      expect(@options[:small_files]).to eq(0)
+      expect(@options[:small_file_size]).to eq([4096, 4096])
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/--small-file/)
+
+      @iocommand.parse_args(%w|--small-files 100|)
+      expect(@options[:pattern]).to eq(:smallfile)
+      expect(@options[:small_files]).to eq(100)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --small-files 100 --small-file-size 4096,4096 /)
+
+      @iocommand.parse_args(%w|--small-files 10 --small-file-size 512,1mb|)
+      expect(@options[:small_file_size]).to eq([512, 1024 * 1024])
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --small-files 10 --small-file-size 512,1048576 /)
+
+      @iocommand.parse_args(%w|--small-files 10 --small-file-size 8kb|)
+      expect(@options[:small_file_size]).to eq([8192, 8192])
+
+      @iocommand.parse_args(%w|--small-files 10 -A -g io_uring|)
+      expect(@options[:async]).to eq(true)
+    end
+
+    it "should reject invalid small file options" do
+      expect { @iocommand.parse_args(%w|--small-files 0|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--small-files -1|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--small-files many|) }.to raise_error(OptionParser::InvalidArgument)
+      expect { @iocommand.parse_args(%w|--small-files 10 --small-file-size 0|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--small-files 10 --small-file-size 1mb,4kb|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--small-files 10 --small-file-size big|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--small-files 10 -A|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--small-files 10 -A -g libaio|) }.to raise_error(ArgumentError)
+    end
+
+    it "should parse page cache options" do
+      @iocommand.parse_args([])
+      expect(@options[:drop_cache]).to eq(false)
+      expect(@options[:prefetch]).to eq(false)
+      expect(@options[:fadvise]).to be_nil
+      expect(@options[:readahead]).to be_nil
+      expect(@options[:cache_sample]).to eq(0)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/--drop-cache|--prefetch|--fadvise|--readahead|--cache-sample/)
+
+      @iocommand.parse_args(%w|--drop-cache --prefetch|)
+      expect(@options[:drop_cache]).to eq(true)
+      expect(@options[:prefetch]).to eq(true)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --drop-cache --prefetch /)
+
+      %w|normal random sequential noreuse|.each do |advice|
+        @iocommand.parse_args(["--fadvise", advice])
+        expect(@options[:fadvise]).to eq(advice)
+        expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --fadvise #{advice} /)
+      end
+
+      @iocommand.parse_args(%w|--readahead 0|)
+      expect(@options[:readahead]).to eq(0)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --readahead 0 /)
+
+      @iocommand.parse_args(%w|--cache-sample 100|)
+      expect(@options[:cache_sample]).to eq(100)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --cache-sample 100 /)
+      @iocommand.parse_args(%w|-M 0.5 --cache-sample 100|)
+      expect(@options[:cache_sample]).to eq(100)
+    end
+
+    it "should reject invalid page cache options" do
+      $stderr = StringIO.new
+      $stdout = StringIO.new
+      begin
+        expect { @iocommand.parse_args(%w|--fadvise willneed|) }.to raise_error(SystemExit)
+        expect { @iocommand.parse_args(%w|--readahead -1|) }.to raise_error(SystemExit)
+        expect { @iocommand.parse_args(%w|--readahead 128k|) }.to raise_error(OptionParser::InvalidArgument)
+        expect { @iocommand.parse_args(%w|--cache-sample -1|) }.to raise_error(SystemExit)
+      ensure
+        $stderr = STDERR
+        $stdout = STDOUT
+      end
+      expect { @iocommand.parse_args(%w|-W --cache-sample 100|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--small-files 10 --drop-cache|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--replay log --readahead 128|) }.to raise_error(ArgumentError)
+    end
+
+    it "should parse --trim-ratio, --zero-ratio and --alloc-ratio options" do
+      @iocommand.parse_args([])
+      expect(@options[:trim_ratio]).to eq(0.0)
+      expect(@options[:zero_ratio]).to eq(0.0)
+      expect(@options[:alloc_ratio]).to eq(0.0)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/-ratio/)
+
+      @iocommand.parse_args(%w|-W --trim-ratio 0.2 --zero-ratio 0.1|)
+      expect(@options[:trim_ratio]).to eq(0.2)
+      expect(@options[:zero_ratio]).to eq(0.1)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --trim-ratio 0.2 --zero-ratio 0.1 /)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/--alloc-ratio/)
+
+      @iocommand.parse_args(%w|-M 0.5 --alloc-ratio 0.3|)
+      expect(@options[:alloc_ratio]).to eq(0.3)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --alloc-ratio 0.3 /)
+
+      # all requests may be space operations
+      @iocommand.parse_args(%w|-W --trim-ratio 0.5 --zero-ratio 0.25 --alloc-ratio 0.25|)
+      expect(@options[:alloc_ratio]).to eq(0.25)
+    end
+
+    it "should reject invalid --trim-ratio, --zero-ratio and --alloc-ratio options" do
+      expect { @iocommand.parse_args(%w|--trim-ratio 0.2|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|-W --zero-ratio -0.1|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|-W --trim-ratio 0.6 --alloc-ratio 0.6|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|-W --alloc-ratio half|) }.to raise_error(OptionParser::InvalidArgument)
+    end
+
+    it "should parse --steady-state options" do
+      @iocommand.parse_args([])
+      expect(@options[:steady_state]).to eq(false)
+      expect(@options[:ss_round]).to eq(10)
+      expect(@options[:ss_window]).to eq(5)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/--steady-state/)
+
+      @iocommand.parse_args(%w|-t 60 --steady-state --ss-round 5 --ss-window 4|)
+      expect(@options[:steady_state]).to eq(true)
+      expect(@options[:ss_round]).to eq(5)
+      expect(@options[:ss_window]).to eq(4)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --steady-state --ss-round 5 --ss-window 4 /)
+
+      # the window just fits in the timeout
+      @iocommand.parse_args(%w|-t 20 --steady-state --ss-round 5 --ss-window 4|)
+      expect(@options[:timeout]).to eq(20)
+    end
+
+    it "should parse --warmup and --rampdown options" do
+      @iocommand.parse_args([])
+      expect(@options[:warmup]).to eq(0)
+      expect(@options[:rampdown]).to eq(0)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/--warmup|--rampdown/)
+
+      @iocommand.parse_args(%w|-t 10 --warmup 2.5 --rampdown 1|)
+      expect(@options[:warmup]).to eq(2.5)
+      expect(@options[:rampdown]).to eq(1.0)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --warmup 2.5 --rampdown 1.0 /)
+    end
+
+    it "should reject invalid --warmup and --rampdown options" do
+      expect { @iocommand.parse_args(%w|--warmup -1|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--rampdown -0.5|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|-t 10 --warmup 6 --rampdown 4|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|-t 10 --warmup 12|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--warmup soon|) }.to raise_error(OptionParser::InvalidArgument)
+    end
+
+    it "should parse sysstat options" do
+      @iocommand.parse_args([])
+      expect(@options[:sysstat]).to eq(false)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/--sysstat/)
+
+      @iocommand.parse_args(%w|--sysstat|)
+      expect(@options[:sysstat]).to eq(true)
+      expect(@options[:sysstat_interval]).to eq(0)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --sysstat /)
+
+      @iocommand.parse_args(%w|--sysstat-interval 100|)
+      expect(@options[:sysstat]).to eq(true)
+      expect(@options[:sysstat_interval]).to eq(100)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --sysstat-interval 100 /)
+
+      # samples are taken by the first group
+      expect(@iocommand.gen_args([__FILE__], false).join(" ")).not_to match(/--sysstat/)
+
+      $stderr = StringIO.new
+      $stdout = StringIO.new
+      begin
+        expect { @iocommand.parse_args(%w|--sysstat-interval -1|) }.to raise_error(SystemExit)
+      ensure
+        $stderr = STDERR
+        $stdout = STDOUT
+      end
+      expect { @iocommand.parse_args(%w|--sysstat-interval often|) }.to raise_error(OptionParser::InvalidArgument)
+    end
+
+    it "should parse --thread-iops and --thread-bw options" do
+      @iocommand.parse_args([])
+      expect(@options[:thread_iops]).to eq(0)
+      expect(@options[:thread_bw]).to eq(0)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).not_to match(/--thread-/)
+
+      @iocommand.parse_args(%w|--thread-iops 20000 --thread-bw 200mb|)
+      expect(@options[:thread_iops]).to eq(20000)
+      expect(@options[:thread_bw]).to eq(200 * 2 ** 20)
+      expect(@iocommand.gen_args([__FILE__]).join(" ")).to match(/ --thread-iops 20000 --thread-bw #{200 * 2 ** 20} /)
+    end
+
+    it "should reject invalid --thread-iops and --thread-bw options" do
+      expect { @iocommand.parse_args(%w|--thread-iops abc|) }.to raise_error(OptionParser::InvalidArgument)
+      expect { @iocommand.parse_args(%w|--thread-iops 100x|) }.to raise_error(OptionParser::InvalidArgument)
+      expect { @iocommand.parse_args(%w|--thread-iops -100|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--thread-bw fast|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--thread-bw 200x|) }.to raise_error(ArgumentError)
+    end
+
+    it "should reject invalid --steady-state options" do
+      expect { @iocommand.parse_args(%w|-t 19 --steady-state --ss-round 5 --ss-window 4|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--steady-state --ss-round 0|) }.to raise_error(ArgumentError)
+      expect { @iocommand.parse_args(%w|--steady-state --ss-window 1|) }.to raise_error(ArgumentError)
+    end
+
   end
 end
 
@@ -138,6 +445,8 @@ describe "io subcommand" do
     "direct": false,
     "aio": false,
     "aio_nr_events": 64,
+    "aio_engine": "libaio",
+    "hugepage": false,
     "timeout_sec": 60,
     "bogus_comp": 0,
     "iosleep": 0,
@@ -169,6 +478,8 @@ EOS
     "direct": false,
     "aio": false,
     "aio_nr_events": 64,
+    "aio_engine": "libaio",
+    "hugepage": false,
     "timeout_sec": 1,
     "bogus_comp": 0,
     "iosleep": 0,
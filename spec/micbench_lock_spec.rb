@@ -0,0 +1,74 @@
+# encoding: utf-8
+
+require 'spec_helper'
+
+describe LockCommand do
+  it "should return the right name" do
+    expect(LockCommand.command_name).to eq("lock")
+  end
+
+  it "should return the right desc" do
+    expect(LockCommand.description).to match(/lock and sync/i)
+  end
+
+  describe "option parser" do
+    before(:each) do
+      @lockcommand = LockCommand.new
+      @parser = @lockcommand.instance_eval('@parser')
+      @options = @lockcommand.instance_eval('@options')
+    end
+
+    it "should return right default options" do
+      @lockcommand.parse_args([])
+      expect(@options[:multi]).to eq(1)
+      expect(@options[:mode]).to eq("spinlock")
+      expect(@options[:affinity]).to eq([])
+      expect(@options[:count]).to eq(1000000)
+      expect(@options[:critical_job_size]).to eq(10)
+      expect(@options[:noncritical_job_size]).to eq(1000)
+      expect(@options[:all_pairs]).to eq(false)
+      expect(@options[:verbose]).to eq(false)
+    end
+
+    it "should parse --mode option" do
+      %w|spinlock mutex mfence pingpong pingpong-cas|.each do |mode|
+        @lockcommand.parse_args(["-M", mode])
+        expect(@options[:mode]).to eq(mode)
+        expect(@lockcommand.gen_cmd([])).to match(/ -M #{mode} /)
+      end
+
+      @lockcommand.parse_args(%w|--mode mutex|)
+      expect(@options[:mode]).to eq("mutex")
+    end
+
+    it "should parse --all-pairs option" do
+      @lockcommand.parse_args([])
+      expect(@lockcommand.gen_cmd([])).not_to match(/ -A\b/)
+
+      @lockcommand.parse_args(%w|-m 2 -M pingpong -A|)
+      expect(@options[:all_pairs]).to eq(true)
+      expect(@lockcommand.gen_cmd([])).to match(/ -m 2 -M pingpong .* -A\b/)
+
+      @lockcommand.parse_args(%w|-m 2 --mode pingpong-cas --all-pairs|)
+      expect(@options[:mode]).to eq("pingpong-cas")
+      expect(@options[:all_pairs]).to eq(true)
+
+      # options do not leak into the next parse
+      @lockcommand.parse_args(%w|-m 2 -M pingpong|)
+      expect(@options[:all_pairs]).to eq(false)
+    end
+
+    it "should reject invalid options" do
+      $stderr = StringIO.new
+      $stdout = StringIO.new
+      begin
+        expect { @lockcommand.parse_args(%w|-M ticketlock|) }.to raise_error(SystemExit)
+        expect { @lockcommand.parse_args(%w|-c many|) }.to raise_error(SystemExit)
+        expect { @lockcommand.parse_args(%w|-w -1|) }.to raise_error(SystemExit)
+      ensure
+        $stderr = STDERR
+        $stdout = STDOUT
+      end
+    end
+  end
+end
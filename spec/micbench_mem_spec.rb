@@ -0,0 +1,184 @@
+# encoding: utf-8
+
+require 'spec_helper'
+
+describe MemoryCommand do
+  it "should return the right name" do
+    expect(MemoryCommand.command_name).to eq("mem")
+  end
+
+  it "should return the right desc" do
+    expect(MemoryCommand.description).to match(/memory latency and bandwidth/i)
+  end
+
+  describe "option parser" do
+    before(:each) do
+      @memcommand = MemoryCommand.new
+      @parser = @memcommand.instance_eval('@parser')
+      @options = @memcommand.instance_eval('@options')
+    end
+
+    it "should return right default options" do
+      @memcommand.parse_args([])
+      expect(@options[:multi]).to eq(1)
+      expect(@options[:timeout]).to eq(10)
+      expect(@options[:mode]).to eq(:seq)
+      expect(@options[:size]).to eq(2 ** 20)
+      expect(@options[:perf]).to eq(false)
+      expect(@options[:verbose]).to eq(false)
+    end
+
+    it "should parse --perf option" do
+      @memcommand.parse_args(%w|-P|)
+      expect(@options[:perf]).to eq(true)
+      expect(@memcommand.gen_cmd([])).to match(/ -P\b/)
+
+      @memcommand.parse_args(%w|--perf|)
+      expect(@options[:perf]).to eq(true)
+
+      @memcommand.parse_args([])
+      expect(@memcommand.gen_cmd([])).not_to match(/ -P\b/)
+    end
+
+    it "should parse --kernel option" do
+      @memcommand.parse_args([])
+      expect(@options[:kernel]).to eq(:incr)
+
+      %w|incr read write copy scale add triad|.each do |kernel|
+        @memcommand.parse_args(["-k", kernel])
+        expect(@options[:kernel]).to eq(kernel.to_sym)
+        expect(@memcommand.gen_cmd([])).to match(/ -k #{kernel}\b/)
+      end
+
+      @memcommand.parse_args(%w|--kernel triad|)
+      expect(@options[:kernel]).to eq(:triad)
+    end
+
+    it "should parse --simd and --nontemporal options" do
+      @memcommand.parse_args([])
+      expect(@options[:simd]).to eq(:auto)
+      expect(@options[:nontemporal]).to eq(false)
+      expect(@memcommand.gen_cmd([])).not_to match(/ -N\b/)
+
+      %w|auto scalar sse2 avx2 avx512|.each do |width|
+        @memcommand.parse_args(["-W", width])
+        expect(@options[:simd]).to eq(width.to_sym)
+        expect(@memcommand.gen_cmd([])).to match(/ -W #{width}\b/)
+      end
+
+      @memcommand.parse_args(%w|--simd sse2 --nontemporal -k copy|)
+      expect(@options[:simd]).to eq(:sse2)
+      expect(@options[:nontemporal]).to eq(true)
+      expect(@memcommand.gen_cmd([])).to match(/ -N\b/)
+    end
+
+    it "should parse --chains option" do
+      @memcommand.parse_args([])
+      expect(@options[:chains]).to eq(1)
+      expect(@memcommand.gen_cmd([])).not_to match(/ -c\b/)
+
+      @memcommand.parse_args(%w|-R -c 8|)
+      expect(@options[:chains]).to eq(8)
+      expect(@memcommand.gen_cmd([])).to match(/ -R -c 8\b/)
+
+      @memcommand.parse_args(%w|--chains 32|)
+      expect(@options[:chains]).to eq(32)
+    end
+
+    it "should parse --loaded-latency option" do
+      @memcommand.parse_args([])
+      expect(@options[:loaded_latency]).to be_nil
+      expect(@memcommand.gen_cmd([])).not_to match(/ -l\b/)
+
+      @memcommand.parse_args(%w|-m 4 -l 0,100,2000|)
+      expect(@options[:loaded_latency]).to eq("0,100,2000")
+      expect(@memcommand.gen_cmd([])).to match(/ -l 0,100,2000\b/)
+
+      @memcommand.parse_args(%w|--loaded-latency 50|)
+      expect(@options[:loaded_latency]).to eq("50")
+    end
+
+    it "should parse --sweep option" do
+      @memcommand.parse_args([])
+      expect(@options[:sweep]).to be_nil
+      expect(@memcommand.gen_cmd([])).not_to match(/ -x\b/)
+
+      @memcommand.parse_args(%w|-R -x 4kb -s 64mb|)
+      expect(@options[:sweep]).to eq(4096)
+      expect(@memcommand.gen_cmd([])).to match(/ -x 4096\b/)
+
+      @memcommand.parse_args(%w|--sweep 32kb|)
+      expect(@options[:sweep]).to eq(32 * 1024)
+    end
+
+    it "should parse --granularity option" do
+      @memcommand.parse_args([])
+      expect(@options[:granularity]).to be_nil
+      expect(@memcommand.gen_cmd([])).not_to match(/ -g\b/)
+
+      @memcommand.parse_args(%w|-g 8b,64b,4kb|)
+      expect(@options[:granularity]).to eq([8, 64, 4096])
+      expect(@memcommand.gen_cmd([])).to match(/ -g 8,64,4096\b/)
+
+      @memcommand.parse_args(%w|-R --granularity 64,128|)
+      expect(@options[:granularity]).to eq([64, 128])
+      expect(@memcommand.gen_cmd([])).to match(/ -R .*-g 64,128\b/)
+    end
+
+    it "should parse --pages option" do
+      @memcommand.parse_args([])
+      expect(@options[:pages]).to eq(:default)
+      expect(@memcommand.gen_cmd([])).to match(/ -p default\b/)
+
+      %w|default 4k thp hugetlb|.each do |pages|
+        @memcommand.parse_args(["-p", pages])
+        expect(@options[:pages]).to eq(pages.to_sym)
+        expect(@memcommand.gen_cmd([])).to match(/ -p #{pages}\b/)
+      end
+
+      @memcommand.parse_args(%w|--pages hugetlb -z 1gb|)
+      expect(@options[:pages]).to eq(:hugetlb)
+      expect(@memcommand.gen_cmd([])).to match(/ -z #{2 ** 30} -p hugetlb\b/)
+    end
+
+    it "should parse --numa-matrix and --json options" do
+      @memcommand.parse_args([])
+      expect(@options[:numa_matrix]).to eq(false)
+      expect(@options[:json]).to eq(false)
+      expect(@memcommand.gen_cmd([])).not_to match(/ -n\b/)
+      expect(@memcommand.gen_cmd([])).not_to match(/ -j\b/)
+
+      @memcommand.parse_args(%w|-n|)
+      expect(@options[:numa_matrix]).to eq(true)
+      expect(@options[:json]).to eq(false)
+      expect(@memcommand.gen_cmd([])).to match(/ -n\b/)
+      expect(@memcommand.gen_cmd([])).not_to match(/ -j\b/)
+
+      @memcommand.parse_args(%w|--numa-matrix --json -m 4 -k triad|)
+      expect(@options[:numa_matrix]).to eq(true)
+      expect(@options[:json]).to eq(true)
+      expect(@memcommand.gen_cmd([])).to match(/ -n -j\b/)
+
+      @memcommand.parse_args(%w|-n -j|)
+      expect(@options[:json]).to eq(true)
+    end
+
+    it "should reject invalid options" do
+      $stderr = StringIO.new
+      $stdout = StringIO.new
+      begin
+        expect { @memcommand.parse_args(%w|-k daxpy|) }.to raise_error(OptionParser::InvalidArgument)
+        expect { @memcommand.parse_args(%w|-W neon|) }.to raise_error(OptionParser::InvalidArgument)
+        expect { @memcommand.parse_args(%w|-c 0|) }.to raise_error(SystemExit)
+        expect { @memcommand.parse_args(%w|-c 33|) }.to raise_error(SystemExit)
+        expect { @memcommand.parse_args(%w|-l 10,,20|) }.to raise_error(SystemExit)
+        expect { @memcommand.parse_args(%w|-l -5|) }.to raise_error(SystemExit)
+        expect { @memcommand.parse_args(%w|-x big|) }.to raise_error(ArgumentError)
+        expect { @memcommand.parse_args(%w|-p 2m|) }.to raise_error(OptionParser::InvalidArgument)
+      ensure
+        $stderr = STDERR
+        $stdout = STDOUT
+      end
+    end
+  end
+end
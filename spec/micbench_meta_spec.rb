@@ -0,0 +1,82 @@
+# encoding: utf-8
+
+require 'spec_helper'
+
+describe MetaCommand do
+  it "should return the right name" do
+    expect(MetaCommand.command_name).to eq("meta")
+  end
+
+  it "should return the right desc" do
+    expect(MetaCommand.description).to match(/metadata benchmark/i)
+  end
+
+  describe "option parser" do
+    before(:each) do
+      @metacommand = MetaCommand.new
+      @parser = @metacommand.instance_eval('@parser')
+      @options = @metacommand.instance_eval('@options')
+    end
+
+    it "should have the right banner" do
+      expect(@parser.banner).to match(/\bmeta\b.*directory/)
+    end
+
+    it "should return right default options" do
+      @metacommand.parse_args([])
+      expect(@options[:multi]).to eq(1)
+      expect(@options[:affinity]).to eq([])
+      expect(@options[:depth]).to eq(2)
+      expect(@options[:fanout]).to eq(16)
+      expect(@options[:files]).to eq(1000)
+      expect(@options[:file_size]).to eq(0)
+      expect(@options[:mix]).to eq("create=1,open=1,stat=4,rename=1,unlink=1,readdir=1")
+      expect(@options[:timeout]).to eq(10)
+      expect(@options[:warmup]).to eq(0)
+      expect(@options[:rampdown]).to eq(0)
+      expect(@options[:verbose]).to eq(false)
+    end
+
+    it "should parse directory tree options" do
+      @metacommand.parse_args(%w|-d 0 -f 4|)
+      expect(@options[:depth]).to eq(0)
+      expect(@options[:fanout]).to eq(4)
+
+      @metacommand.parse_args(%w|--depth 3 --fanout 8|)
+      expect(@options[:depth]).to eq(3)
+      expect(@options[:fanout]).to eq(8)
+    end
+
+    it "should parse --files and --file-size options" do
+      @metacommand.parse_args(%w|-n 10 -s 4096|)
+      expect(@options[:files]).to eq(10)
+      expect(@options[:file_size]).to eq(4096)
+
+      @metacommand.parse_args(%w|--files 0 --file-size 4kb|)
+      expect(@options[:files]).to eq(0)
+      expect(@options[:file_size]).to eq(4096)
+    end
+
+    it "should parse --mix option" do
+      @metacommand.parse_args(%w|-x stat=4,unlink=1|)
+      expect(@options[:mix]).to eq("stat=4,unlink=1")
+
+      @metacommand.parse_args(%w|--mix readdir=1|)
+      expect(@options[:mix]).to eq("readdir=1")
+    end
+
+    it "should reject invalid options" do
+      $stderr = StringIO.new
+      $stdout = StringIO.new
+      begin
+        expect { @metacommand.parse_args(%w|-x chmod=1|) }.to raise_error(SystemExit)
+        expect { @metacommand.parse_args(%w|-x stat=-1|) }.to raise_error(SystemExit)
+        expect { @metacommand.parse_args(%w|-f 0|) }.to raise_error(SystemExit)
+        expect { @metacommand.parse_args(%w|-t 0|) }.to raise_error(SystemExit)
+      ensure
+        $stderr = STDERR
+        $stdout = STDOUT
+      end
+    end
+  end
+end
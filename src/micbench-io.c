@@ -5,24 +5,64 @@
 
 #include "micbench-io.h"
 
+#include <sys/sysmacros.h>
+#include <sys/resource.h>
+
 typedef struct {
     pid_t thread_id;
     cpu_set_t mask;
     unsigned long nodemask;
 } thread_assignment_t;
 
-static micbench_io_option_t option;
+// options of the group the calling thread belongs to; the main
+// thread has those of the first group, which also hold options of
+// the whole run such as timeout
+static __thread micbench_io_option_t option;
+
+// thread groups of heterogeneous workloads, separated by ':' in argv
+static micbench_io_option_t *groups;
+static unsigned int nr_groups;
+static int nr_threads; // of all groups
 static FILE *aio_tracefile;
 static __thread pid_t tid;
+static __thread unsigned long nodemask;
+
+// warm-up, measurement and ramp-down of the run
+static mb_epoch_t epoch;
+
+// workers and the main thread meet here after preconditioning
+static pthread_barrier_t start_barrier;
+static int nr_finished_workers;
 
+/* updated by workers while running; read by the main thread in
+ * steady state detection */
 typedef struct {
     // accumulated iowait time
     double iowait_time;
 
     // io count (in blocks)
     int64_t count;
+
+    // io size (in bytes)
+    int64_t bytes;
+
+    // flushes and their accumulated latency
+    int64_t flush_count;
+    double flush_time;
+
+    // space operations, indexed by MB_SPACE_OP_IDX
+    int64_t space_count[MB_NR_SPACE_OPS];
+    double space_time[MB_NR_SPACE_OPS];
+
+    // pages sampled before reads and those in page cache
+    int64_t cache_pages;
+    int64_t cache_hits;
 } meter_t;
 
+// sum of meters of each group at the start and the end of measurement
+static meter_t *meter_begin;
+static meter_t *meter_end;
+
 typedef struct {
     long io_count;
     long io_bytes;
@@ -34,14 +74,49 @@ typedef struct {
     double response_time;       /* in second */
     double iops;
     double bandwidth;           /* in bytes/sec */
+
+    long flush_count;
+    double flush_time;          /* accumulated, in second */
+
+    long space_count[MB_NR_SPACE_OPS];
+    double space_time[MB_NR_SPACE_OPS];
+
+    long cache_pages;
+    long cache_hits;
+
+    // latency of each commit (WAL mode) or file (small file mode)
+    // in nsec, NULL otherwise
+    mb_hist_t *lat_hist;
+
+    // steady state detection trace
+    bool ss_reached;
+    int ss_nr_rounds;
+    double *ss_round_iops;
+    double ss_excursion;
+    double ss_slope_excursion;
 } result_t;
 
+// directory of small files owned by a thread
+typedef struct {
+    int dirfd;
+    char dirname[32];   // in the target directory
+    int64_t *sizes;     // current size of each file
+} fileset_t;
+
 typedef struct {
     int id;
     pthread_t *self;
     meter_t *meter;
     long common_seed;
+    struct timeval common_start_tv;
     int tid;
+    int group;  // id is the index in this group
+
+    // latency in measurement (WAL and small file mode)
+    mb_hist_t *lat_hist;
+
+    // files owned by this thread (small file mode)
+    fileset_t *fileset;
 
     int *fd_list;
 } th_arg_t;
@@ -49,630 +124,2356 @@ typedef struct {
 
 
 static void mb_log_io_activity(struct timeval *issue_tv, struct timeval *complete_tv,
-                               const char *file, int64_t blockaddr, int blocksz);
+                               const char *file, int64_t blockaddr, int blocksz,
+                               mb_io_mode_t mode);
 
+/* whether workers should keep issuing I/O */
+static inline bool
+mb_io_continue(void)
+{
+    return mb_epoch_phase(&epoch) != MB_EPOCH_DONE;
+}
 
-mb_aiom_t *
-mb_aiom_make(int nr_events)
+/* size of each I/O buffer, large enough for any replayed request */
+static int
+mb_io_buf_size(void)
 {
-    mb_aiom_t *aiom;
-    int i;
-    aiom_cb_t *aiom_cb;
-    int ret;
+    if (option.replay_max_sz > option.blk_sz) {
+        return option.replay_max_sz;
+    }
+    return option.blk_sz;
+}
 
-    aiom = malloc(sizeof(mb_aiom_t));
+// tolerance of token buckets for late wakeups
+#define THROTTLE_BURST_NSEC 1000000
 
-    aiom->nr_events = nr_events;
-    aiom->nr_pending = 0;
-    aiom->nr_inflight = 0;
+// rate limits applied to a thread: its own and its share of each file's
+typedef struct {
+    mb_tbucket_t iops;
+    mb_tbucket_t bw;
+    mb_tbucket_t *file_iops;
+    mb_tbucket_t *file_bw;
+} throttle_t;
+
+static bool
+mb_throttle_enabled(micbench_io_option_t *option)
+{
+    int i;
 
-    aiom->iocount = 0;
+    if (option->thread_iops > 0 || option->thread_bw > 0) {
+        return true;
+    }
+    for (i = 0; i < option->nr_files; i++) {
+        if (option->file_iops_list[i] > 0 || option->file_bw_list[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    aiom->pending = malloc(sizeof(aiom_cb_t *) * nr_events);
-    if (aiom->pending == NULL) {
-        perror("malloc failed");
+/* NULL if no rate limit is given */
+static throttle_t *
+mb_throttle_make(void)
+{
+    throttle_t *throttle;
+    int i;
+
+    if (! mb_throttle_enabled(&option)) {
+        return NULL;
+    }
+    throttle = malloc(sizeof(throttle_t));
+    throttle->file_iops = malloc(sizeof(mb_tbucket_t) * option.nr_files);
+    throttle->file_bw = malloc(sizeof(mb_tbucket_t) * option.nr_files);
+    if (throttle->file_iops == NULL || throttle->file_bw == NULL) {
+        perror("mb_throttle_make:malloc failed");
         exit(EXIT_FAILURE);
     }
-    bzero(aiom->pending, sizeof(aiom_cb_t *) * nr_events);
 
-    aiom->events = malloc(sizeof(struct io_event) * nr_events);
-    if (aiom->events == NULL) {
-        perror("malloc failed");
-        exit(EXIT_FAILURE);
+    mb_tbucket_init(&throttle->iops, option.thread_iops, THROTTLE_BURST_NSEC);
+    mb_tbucket_init(&throttle->bw, option.thread_bw, THROTTLE_BURST_NSEC);
+    for (i = 0; i < option.nr_files; i++) {
+        mb_tbucket_init(&throttle->file_iops[i],
+                        (double) option.file_iops_list[i] / option.multi,
+                        THROTTLE_BURST_NSEC);
+        mb_tbucket_init(&throttle->file_bw[i],
+                        (double) option.file_bw_list[i] / option.multi,
+                        THROTTLE_BURST_NSEC);
     }
-    bzero(aiom->events, sizeof(struct io_event) * nr_events);
 
-    aiom->vecs = malloc(sizeof(struct iovec) * nr_events);
-    if (aiom->vecs == NULL) {
-        perror("malloc failed");
-        exit(EXIT_FAILURE);
+    return throttle;
+}
+
+static void
+mb_throttle_destroy(throttle_t *throttle)
+{
+    if (throttle == NULL) return;
+    free(throttle->file_iops);
+    free(throttle->file_bw);
+    free(throttle);
+}
+
+/* nsec to wait until an I/O to @file_idx may be issued */
+static int64_t
+mb_throttle_delay(throttle_t *throttle, int file_idx, int64_t now)
+{
+    int64_t delay;
+    int64_t d;
+
+    delay = mb_tbucket_delay(&throttle->iops, now);
+    if ((d = mb_tbucket_delay(&throttle->bw, now)) > delay) delay = d;
+    if ((d = mb_tbucket_delay(&throttle->file_iops[file_idx], now)) > delay) delay = d;
+    if ((d = mb_tbucket_delay(&throttle->file_bw[file_idx], now)) > delay) delay = d;
+
+    return delay;
+}
+
+static void
+mb_throttle_take(throttle_t *throttle, int file_idx, int64_t bytes, int64_t now)
+{
+    mb_tbucket_take(&throttle->iops, 1, now);
+    mb_tbucket_take(&throttle->bw, bytes, now);
+    mb_tbucket_take(&throttle->file_iops[file_idx], 1, now);
+    mb_tbucket_take(&throttle->file_bw[file_idx], bytes, now);
+}
+
+/* block until an I/O of @bytes to @file_idx may be issued */
+static void
+mb_throttle_wait(throttle_t *throttle, int file_idx, int64_t bytes)
+{
+    int64_t now;
+    int64_t delay;
+
+    now = mb_clock_nsec();
+    while ((delay = mb_throttle_delay(throttle, file_idx, now)) > 0) {
+        mb_sleep_until_nsec(now + delay);
+        now = mb_clock_nsec();
     }
-    bzero(aiom->vecs, sizeof(struct iovec) * nr_events);
+    mb_throttle_take(throttle, file_idx, bytes, now);
+}
 
-    aiom->cbpool = mb_res_pool_make(nr_events);
+// flush cadence of a thread
+typedef struct {
+    int nr_writes;      // since the last flush
+    int64_t last_nsec;  // time of the last flush
+    bool *dirty;        // files written since the last flush
+} flusher_t;
 
-    for(i = 0; i < nr_events; i++) {
-        aiom_cb = malloc(sizeof(aiom_cb_t));
-        if (aiom_cb == NULL) {
-            perror("malloc failed");
-            exit(EXIT_FAILURE);
-        }
-        bzero(aiom_cb, sizeof(aiom_cb_t));
-        if ((void *) aiom_cb != (void *) &aiom_cb->iocb)
-        {
-            fprintf(stderr, "Pointer mismatch: aiom_cb != &aiom_cb->iocb\n");
-            exit(EXIT_FAILURE);
-        }
+static bool
+mb_flush_enabled(micbench_io_option_t *option)
+{
+    return option->flush_every > 0 || option->flush_interval > 0;
+}
 
-        /* prepare buffer and iovec */
-        aiom_cb->iovec_idx = i;
-        aiom_cb->vec = &aiom->vecs[i];
-        aiom_cb->vec->iov_len = option.blk_sz;
-        aiom_cb->vec->iov_base = memalign(512, option.blk_sz);
-        if (aiom_cb->vec->iov_base == NULL) {
-            perror("malloc failed.");
-            exit(EXIT_FAILURE);
-        }
-        bzero(aiom_cb->vec->iov_base, option.blk_sz);
+/* NULL if files are never flushed */
+static flusher_t *
+mb_flusher_make(void)
+{
+    flusher_t *flusher;
 
-        mb_res_pool_push(aiom->cbpool, aiom_cb);
+    if (! mb_flush_enabled(&option)) {
+        return NULL;
+    }
+    flusher = malloc(sizeof(flusher_t));
+    if (flusher == NULL) {
+        perror("mb_flusher_make:malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    flusher->dirty = calloc(option.nr_files, sizeof(bool));
+    if (flusher->dirty == NULL) {
+        perror("mb_flusher_make:calloc failed");
+        exit(EXIT_FAILURE);
     }
+    flusher->nr_writes = 0;
+    flusher->last_nsec = mb_clock_nsec();
 
-    bzero(&aiom->context, sizeof(io_context_t));
-    #ifdef HAVE_IO_URING
-    bzero(&aiom->uring, sizeof(struct io_uring));
-    #endif
+    return flusher;
+}
 
-    switch(option.aio_engine) {
-    case AIO_LIBAIO:
-        if ((ret = io_setup(nr_events, &aiom->context)) != 0) {
-            perror("io_setup failed.");
-            return NULL;
-        }
-        break;
-    #ifdef HAVE_IO_URING
-    case AIO_IOURING:
-        ret = io_uring_queue_init(nr_events, &aiom->uring, 0);
-        if (ret != 0) {
-            perror("io_uring_queue_init failed.");
-            return NULL;
-        }
-        ret = io_uring_register_buffers(&aiom->uring, aiom->vecs, aiom->nr_events);
-        if (ret != 0) {
-            perror("io_uring_register_buffers failed.");
-            return NULL;
-        }
-        break;
-    #endif
+static void
+mb_flusher_destroy(flusher_t *flusher)
+{
+    if (flusher == NULL) return;
+    free(flusher->dirty);
+    free(flusher);
+}
+
+/* record a write to @file_idx and return whether a flush is due */
+static bool
+mb_flusher_note_write(flusher_t *flusher, int file_idx)
+{
+    flusher->dirty[file_idx] = true;
+    flusher->nr_writes++;
+
+    if (option.flush_every > 0 && flusher->nr_writes >= option.flush_every) {
+        return true;
     }
+    if (option.flush_interval > 0
+        && mb_clock_nsec() - flusher->last_nsec >= option.flush_interval * 1000000L) {
+        return true;
+    }
+    return false;
+}
 
-    return aiom;
+static void
+mb_flusher_reset(flusher_t *flusher)
+{
+    flusher->nr_writes = 0;
+    flusher->last_nsec = mb_clock_nsec();
 }
 
-void
-mb_aiom_destroy (mb_aiom_t *aiom)
+static const char *
+mb_flush_op_str(mb_flush_op_t flush_op)
 {
-    aiom_cb_t *aiom_cb;
+    switch (flush_op) {
+    case FLUSH_FSYNC:
+        return "fsync";
+    case FLUSH_FDATASYNC:
+        return "fdatasync";
+    case FLUSH_SYNC_FILE_RANGE:
+        return "sync_file_range";
+    default:
+        return "(unknown)";
+    }
+}
 
-    free(aiom->pending);
-    free(aiom->events);
+/* flush the whole file with option.flush_op */
+static void
+mb_flush_fd(int fd)
+{
+    int ret;
 
-    switch(option.aio_engine) {
-    case AIO_LIBAIO:
-        io_destroy(aiom->context);
+    switch (option.flush_op) {
+    case FLUSH_FSYNC:
+        ret = fsync(fd);
         break;
-#ifdef HAVE_IO_URING
-    case AIO_IOURING:
-        io_uring_queue_exit(&aiom->uring);
+    case FLUSH_FDATASYNC:
+        ret = fdatasync(fd);
+        break;
+    case FLUSH_SYNC_FILE_RANGE:
+        ret = sync_file_range(fd, 0, 0,
+                              SYNC_FILE_RANGE_WAIT_BEFORE
+                              | SYNC_FILE_RANGE_WRITE
+                              | SYNC_FILE_RANGE_WAIT_AFTER);
+        break;
+    default:
+        ret = 0;
         break;
-#endif
     }
-
-    while((aiom_cb = mb_res_pool_pop(aiom->cbpool)) != NULL) {
-        free(aiom_cb->vec->iov_base);
-        free(aiom_cb);
+    if (ret == -1) {
+        perror("mb_flush_fd:flush failed");
+        if (! option.continue_on_error)
+            exit(EXIT_FAILURE);
     }
-    mb_res_pool_destroy(aiom->cbpool);
-    free(aiom->vecs);
-    free(aiom);
 }
 
-void
-mb_aiom_submit(mb_aiom_t *aiom)
+/* flush dirty files synchronously; latency goes to flush meters */
+static void
+mb_flush_sync(flusher_t *flusher, int *fd_list, meter_t *meter)
 {
+    struct timeval t0;
     int i;
-    int ret = 0;
-    struct timeval submit_time;
 
-    if (aiom->nr_pending == 0) {
-        return;
-    }
+    for (i = 0; i < option.nr_files; i++) {
+        if (! flusher->dirty[i]) continue;
 
-    GETTIMEOFDAY(&submit_time);
-    for (i = 0; i < aiom->nr_pending; i++) {
-        aiom_cb_t *cb;
-        cb = aiom->pending[i];
-        cb->submit_time = submit_time;
+        GETTIMEOFDAY(&t0);
+        mb_flush_fd(fd_list[i]);
+        meter->flush_time += mb_elapsed_time_from(&t0);
+        meter->flush_count++;
+        flusher->dirty[i] = false;
     }
+    mb_flusher_reset(flusher);
+}
 
-    switch(option.aio_engine) {
-    case AIO_LIBAIO:
-        ret = io_submit(aiom->context, aiom->nr_pending,
-                        (struct iocb **) aiom->pending);
-        if (ret != aiom->nr_pending) {
-            fprintf(stderr, "mb_aiom_submit:io_submit only %d of %d succeeded\n",
-                    ret, aiom->nr_pending);
-            exit(EXIT_FAILURE);
-        } else if (ret < 0) {
-            perror("mb_aiom_submit:io_submit failed");
-        }
-        break;
-#ifdef HAVE_IO_URING
-    case AIO_IOURING:
-        ret = io_uring_submit(&aiom->uring);
-        if (ret != aiom->nr_pending) {
-            fprintf(stderr, "mb_aiom_submit:io_uring_submit only %d of %d succeeded\n",
-                    ret, aiom->nr_pending);
-            exit(EXIT_FAILURE);
-        } else if (ret < 0) {
-            perror("mb_aiom_submit:io_uring_submit failed");
+/*
+ * Flush dirty files asynchronously. Writes in flight are waited for
+ * first so that the flush covers them; later writes overlap with it.
+ */
+static void
+mb_flush_async(flusher_t *flusher, mb_aiom_t *aiom, int *fd_list)
+{
+    aiom_cb_t *aiom_cb;
+    int i;
+
+    mb_aiom_submit(aiom);
+    mb_aiom_waitall(aiom);
+    for (i = 0; i < option.nr_files; i++) {
+        if (! flusher->dirty[i]) continue;
+
+        if (NULL == (aiom_cb = mb_res_pool_pop(aiom->cbpool))) {
+            fprintf(stderr, "mb_flush_async: no free aiom_cb for flushing file %d\n", i);
             exit(EXIT_FAILURE);
         }
-        break;
-#endif
+        mb_aiom_prep_flush(aiom, fd_list[i], i, aiom_cb);
+        flusher->dirty[i] = false;
     }
+    mb_flusher_reset(flusher);
+}
 
-    if (aio_tracefile != NULL) {
-        fprintf(aio_tracefile,
-                "[%d] submit: %d req\n",
-                tid, ret);
+// of each group (unused for non-WAL groups)
+static wal_t *wals;
+
+void
+mb_wal_init(wal_t *wal, micbench_io_option_t *option)
+{
+    struct drand48_data rand;
+    size_t buf_sz;
+
+    pthread_mutex_init(&wal->mutex, NULL);
+    pthread_cond_init(&wal->cond, NULL);
+    wal->appended_lsn = 0;
+    wal->durable_lsn = 0;
+    wal->committing = false;
+    wal->pending_bytes = 0;
+
+    wal->ofst_min = (option->ofst_start >= 0 ? option->ofst_start : 0) * option->blk_sz;
+    wal->ofst_max = (option->ofst_end >= 0 ?
+                     option->ofst_end * option->blk_sz : option->file_size_list[0]);
+    wal->offset = wal->ofst_min;
+
+    // a group holds at most one record of each thread and padding
+    buf_sz = (size_t) option->wal_rec_max * option->multi + option->blk_sz;
+    if (posix_memalign((void **) &wal->buf, PAGE_SIZE, buf_sz) != 0) {
+        perror("mb_wal_init:posix_memalign failed");
+        exit(EXIT_FAILURE);
     }
+    srand48_r(0, &rand);
+    mb_rand_buf(&rand, wal->buf, buf_sz);
+}
 
-    aiom->nr_inflight += aiom->nr_pending;
-    aiom->nr_pending = 0;
+void
+mb_wal_destroy(wal_t *wal)
+{
+    pthread_mutex_destroy(&wal->mutex);
+    pthread_cond_destroy(&wal->cond);
+    free(wal->buf);
 }
 
-aiom_cb_t *
-mb_aiom_prep_pread   (mb_aiom_t *aiom, int fd, int file_idx,
-                      aiom_cb_t *aiom_cb, size_t count, long long offset)
+/*
+ * Append a record of @rec_sz bytes to @wal and return its LSN. Called
+ * with wal->mutex held.
+ */
+int64_t
+mb_wal_append(wal_t *wal, int rec_sz)
 {
-#ifdef HAVE_IO_URING
-    struct io_uring_sqe *sqe;
-#endif
+    wal->pending_bytes += rec_sz;
+    return ++wal->appended_lsn;
+}
 
-    switch(option.aio_engine) {
-    case AIO_LIBAIO:
-        io_prep_pread(&aiom_cb->iocb, fd,
-                      aiom_cb->vec->iov_base, aiom_cb->vec->iov_len, offset);
-        break;
-#ifdef HAVE_IO_URING
-    case AIO_IOURING:
-        sqe = io_uring_get_sqe(&aiom->uring);
-        io_uring_prep_read_fixed(sqe, fd, aiom_cb->vec->iov_base,
-                                 aiom_cb->vec->iov_len,
-                                 offset, aiom_cb->iovec_idx);
-        io_uring_sqe_set_data(sqe, aiom_cb);
-        break;
-#endif
+/*
+ * Take all the records appended so far as a group of @size bytes
+ * written at @offset, and return the LSN of its last record. The group
+ * is padded to blocks with O_DIRECT and goes back to the start of the
+ * log area if it does not fit in the rest. Called with wal->mutex held.
+ */
+int64_t
+mb_wal_take_group(wal_t *wal, int64_t *size, int64_t *offset)
+{
+    *size = wal->pending_bytes;
+    wal->pending_bytes = 0;
+    if (option.direct) {
+        *size = (*size + option.blk_sz - 1) / option.blk_sz * option.blk_sz;
     }
-    GETTIMEOFDAY(&aiom_cb->queue_time);
-    aiom_cb->file_idx = file_idx;
-
-    aiom->pending[aiom->nr_pending++] = aiom_cb;
+    if (wal->offset + *size > wal->ofst_max) {
+        wal->offset = wal->ofst_min;
+    }
+    *offset = wal->offset;
+    wal->offset += *size;
 
-    return aiom_cb;
+    return wal->appended_lsn;
 }
 
-aiom_cb_t *
-mb_aiom_prep_pwrite  (mb_aiom_t *aiom, int fd, int file_idx,
-                      aiom_cb_t *aiom_cb, size_t count, long long offset)
+/*
+ * Append a record of @rec_sz bytes and return when it is durable. If
+ * no group commit is going on, the caller becomes the leader, which
+ * writes all the records appended so far at once and flushes them.
+ * Others wait for the leader meanwhile.
+ */
+static void
+mb_wal_commit(wal_t *wal, int fd, int rec_sz, meter_t *meter)
 {
-#ifdef HAVE_IO_URING
-    struct io_uring_sqe *sqe;
-#endif
+    struct timeval t0;
+    struct timeval t1;
+    int64_t lsn;
+    int64_t group_lsn;
+    int64_t size;
+    int64_t offset;
+
+    pthread_mutex_lock(&wal->mutex);
+    lsn = mb_wal_append(wal, rec_sz);
+
+    while (wal->durable_lsn < lsn) {
+        if (wal->committing) {
+            pthread_cond_wait(&wal->cond, &wal->mutex);
+            continue;
+        }
 
-    switch(option.aio_engine) {
-    case AIO_LIBAIO:
-        io_prep_pwrite(&aiom_cb->iocb, fd,
-                       aiom_cb->vec->iov_base, aiom_cb->vec->iov_len, offset);
-        break;
-#ifdef HAVE_IO_URING
-    case AIO_IOURING:
-        sqe = io_uring_get_sqe(&aiom->uring);
-        io_uring_prep_write_fixed(sqe, fd, aiom_cb->vec->iov_base,
-                                  aiom_cb->vec->iov_len,
-                                  offset, aiom_cb->iovec_idx);
-        io_uring_sqe_set_data(sqe, aiom_cb);
-        break;
-#endif
+        wal->committing = true;
+        if (option.commit_delay > 0) {
+            // let followers join this group
+            pthread_mutex_unlock(&wal->mutex);
+            usleep(option.commit_delay);
+            pthread_mutex_lock(&wal->mutex);
+        }
+        group_lsn = mb_wal_take_group(wal, &size, &offset);
+        pthread_mutex_unlock(&wal->mutex);
+
+        GETTIMEOFDAY(&t0);
+        mb_pwriteall(fd, wal->buf, size, offset, option.continue_on_error);
+        mb_flush_fd(fd);
+        GETTIMEOFDAY(&t1);
+        meter->flush_time += (TV2LONG(t1) - TV2LONG(t0))/1.0e6;
+        meter->flush_count++;
+        mb_log_io_activity(&t0, &t1, option.file_path_list[0], offset, size,
+                           MB_DO_WRITE);
+
+        pthread_mutex_lock(&wal->mutex);
+        wal->durable_lsn = group_lsn;
+        wal->committing = false;
+        pthread_cond_broadcast(&wal->cond);
     }
-    GETTIMEOFDAY(&aiom_cb->queue_time);
-    aiom_cb->file_idx = file_idx;
+    pthread_mutex_unlock(&wal->mutex);
+}
 
-    aiom->pending[aiom->nr_pending++] = aiom_cb;
+/* trim, zero or allocate by their ratios, or do @mode otherwise */
+mb_io_mode_t
+mb_choose_op(struct drand48_data *rand, mb_io_mode_t mode)
+{
+    double r;
 
-    return aiom_cb;
+    if (option.trim_ratio + option.zero_ratio + option.alloc_ratio == 0) {
+        return mode;
+    }
+    drand48_r(rand, &r);
+    if ((r -= option.trim_ratio) < 0) {
+        return MB_DO_TRIM;
+    }
+    if ((r -= option.zero_ratio) < 0) {
+        return MB_DO_ZERO;
+    }
+    if ((r -= option.alloc_ratio) < 0) {
+        return MB_DO_ALLOC;
+    }
+    return mode;
 }
 
-int
-__mb_aiom_wait(mb_aiom_t *aiom, long min_nr, long nr,
-               struct io_event *events, struct timespec *timeout){
-    int i;
-    int nr_completed = 0;
-    aiom_cb_t *aiom_cb = NULL;
-    struct io_event *event = NULL;
+/* block devices accept fallocate(2) only with FALLOC_FL_KEEP_SIZE */
+static int
+mb_fallocate_mode(mb_io_mode_t mode)
+{
+    switch (mode) {
+    case MB_DO_TRIM:
+        return FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+    case MB_DO_ZERO:
+        return FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE;
+    default:
+        return FALLOC_FL_KEEP_SIZE;
+    }
+}
 
+/*
+ * Whether a space operation can be queued to the AIO engine. Discard
+ * of block devices is only available as ioctl(2), and libaio has no
+ * space operations at all.
+ */
+bool
+mb_space_op_async(mb_io_mode_t mode, int file_idx)
+{
 #ifdef HAVE_IO_URING
-    int ret;
-    struct io_uring_cqe *cqe = NULL;
+    if (option.aio_engine == AIO_IOURING) {
+        return ! (mode == MB_DO_TRIM && option.file_blkdev_list[file_idx]);
+    }
 #endif
+    return false;
+}
 
-    switch(option.aio_engine) {
-    case AIO_LIBAIO:
-        nr_completed = io_getevents(aiom->context, min_nr, nr, events, timeout);
-        if (nr_completed < 0) {
-            perror("__mb_aiom_wait:io_getevents failed");
+/* do a space operation on a block at @addr and account it to @counts and @times */
+static void
+mb_space_sync(int fd, int file_idx, mb_io_mode_t mode, int64_t addr,
+              int64_t *counts, double *times)
+{
+    struct timeval t0;
+    uint64_t range[2];
+    int ret;
+
+    range[0] = addr;
+    range[1] = option.blk_sz;
+
+    GETTIMEOFDAY(&t0);
+    if (option.file_blkdev_list[file_idx] && mode == MB_DO_TRIM) {
+        ret = ioctl(fd, BLKDISCARD, range);
+    } else if (option.file_blkdev_list[file_idx] && mode == MB_DO_ZERO) {
+        ret = ioctl(fd, BLKZEROOUT, range);
+    } else {
+        ret = fallocate(fd, mb_fallocate_mode(mode), addr, option.blk_sz);
+    }
+    if (ret == -1) {
+        perror("mb_space_sync:space operation failed");
+        if (! option.continue_on_error)
             exit(EXIT_FAILURE);
-        }
-        aiom->nr_inflight -= nr_completed;
-        aiom->iocount += nr_completed;
-        break;
-#ifdef HAVE_IO_URING
-    case AIO_IOURING:
-        nr_completed = min_nr;
-        break;
-#endif
     }
+    times[MB_SPACE_OP_IDX(mode)] += mb_elapsed_time_from(&t0);
+    counts[MB_SPACE_OP_IDX(mode)]++;
+}
 
-    if (aio_tracefile != NULL) {
-        fprintf(aio_tracefile,
-                "[%d] %d infl %d comp\n",
-                tid, aiom->nr_inflight, nr_completed);
+static const char *
+mb_fadvise_str(int advice)
+{
+    switch (advice) {
+    case POSIX_FADV_NORMAL:
+        return "normal";
+    case POSIX_FADV_RANDOM:
+        return "random";
+    case POSIX_FADV_SEQUENTIAL:
+        return "sequential";
+    case POSIX_FADV_NOREUSE:
+        return "noreuse";
+    default:
+        return "(unknown)";
     }
+}
 
-    for(i = 0; i < nr_completed; i++){
-        struct timeval t1;
-        const char *file_path;
+/* read_ahead_kb in sysfs of the disk holding @path */
+static int
+mb_readahead_sysfs(const char *path, char *buf, size_t size)
+{
+    struct stat statbuf;
+    dev_t dev;
 
-        switch(option.aio_engine) {
-        case AIO_LIBAIO:
-            event = &aiom->events[i];
-            aiom_cb = (aiom_cb_t *) event->obj;
-            if (!(event->res == option.blk_sz && event->res2 == 0)){
-                fprintf(stderr, "__mb_aiom_wait: fatal error on completion: res = %ld, res2 = %ld\n",
-                        (long) event->res, (long) event->res2);
+    if (stat(path, &statbuf) == -1) {
+        return -1;
+    }
+    dev = (S_ISBLK(statbuf.st_mode) ? statbuf.st_rdev : statbuf.st_dev);
+    snprintf(buf, size, "/sys/dev/block/%u:%u/queue/read_ahead_kb",
+             major(dev), minor(dev));
+    if (access(buf, F_OK) == 0) {
+        return 0;
+    }
+    // partitions share the queue of their disk
+    snprintf(buf, size, "/sys/dev/block/%u:%u/../queue/read_ahead_kb",
+             major(dev), minor(dev));
+    if (access(buf, F_OK) == 0) {
+        return 0;
+    }
+    return -1;
+}
+
+/* set readahead of the disk holding @path to @kb; return the old one */
+static int
+mb_set_readahead(const char *path, int kb)
+{
+    char sysfs[PATH_MAX];
+    FILE *f;
+    int old;
+
+    if (mb_readahead_sysfs(path, sysfs, sizeof(sysfs)) != 0) {
+        fprintf(stderr, "No readahead setting of the device of %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if ((f = fopen(sysfs, "r")) == NULL || fscanf(f, "%d", &old) != 1) {
+        perror("mb_set_readahead:failed to read read_ahead_kb");
+        exit(EXIT_FAILURE);
+    }
+    fclose(f);
+    if ((f = fopen(sysfs, "w")) == NULL || fprintf(f, "%d\n", kb) < 0
+        || fclose(f) != 0) {
+        perror("mb_set_readahead:failed to write read_ahead_kb");
+        exit(EXIT_FAILURE);
+    }
+    return old;
+}
+
+/*
+ * Put page cache of the targets in a known state before measurement:
+ * write back and drop their cached pages, set readahead of their
+ * devices and prefetch the target range, as requested. Old readahead
+ * sizes are saved in @ra_saved for mb_cache_restore.
+ */
+static void
+mb_cache_prepare(int *ra_saved)
+{
+    int64_t start;
+    int64_t end;
+    int ret;
+    int fd;
+    int i;
+
+    for (i = 0; i < option.nr_files; i++) {
+        ra_saved[i] = -1;
+        if ((fd = open(option.file_path_list[i], O_RDONLY)) == -1) {
+            perror("mb_cache_prepare:open(2) failed");
+            exit(EXIT_FAILURE);
+        }
+        if (option.drop_cache) {
+            // dirty pages are not dropped
+            if (fdatasync(fd) == -1) {
+                perror("mb_cache_prepare:fdatasync(2) failed");
+                exit(EXIT_FAILURE);
             }
-            break;
-#ifdef HAVE_IO_URING
-        case AIO_IOURING:
-            ret = io_uring_wait_cqe(&aiom->uring, &cqe);
-            if (ret != 0) {
-                perror("__mb_aiom_wait:io_uring_wait_cqe_nr failed");
+            if ((ret = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED)) != 0) {
+                fprintf(stderr, "mb_cache_prepare:posix_fadvise(2) failed: %s\n",
+                        strerror(ret));
                 exit(EXIT_FAILURE);
             }
-            aiom_cb = (aiom_cb_t *) io_uring_cqe_get_data(cqe);
-            io_uring_cqe_seen(&aiom->uring, cqe);
-            break;
-#endif
         }
+        if (option.readahead_kb >= 0) {
+            ra_saved[i] = mb_set_readahead(option.file_path_list[i], option.readahead_kb);
+        }
+        if (option.prefetch) {
+            start = (option.ofst_start >= 0 ? option.ofst_start * option.blk_sz : 0);
+            end = (option.ofst_end >= 0 ? option.ofst_end * option.blk_sz
+                   : option.file_size_list[i]);
+            if (readahead(fd, start, end - start) == -1) {
+                perror("mb_cache_prepare:readahead(2) failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        close(fd);
+    }
+}
 
-        // TODO: callback or something
-        GETTIMEOFDAY(&t1);
-
-        aiom->iowait += mb_elapsed_time_from(&aiom_cb->submit_time);
+/* restore readahead changed by mb_cache_prepare, in reverse order
+ * as targets may share a device */
+static void
+mb_cache_restore(int *ra_saved)
+{
+    int i;
 
-        if (aiom_cb->file_idx == -1) {
-            file_path = "(null)";
-        } else {
-            file_path = option.file_path_list[aiom_cb->file_idx];
+    for (i = option.nr_files - 1; i >= 0; i--) {
+        if (ra_saved[i] >= 0) {
+            mb_set_readahead(option.file_path_list[i], ra_saved[i]);
         }
-        mb_log_io_activity(&aiom_cb->submit_time, &t1,
-                           file_path, aiom_cb->iocb.u.c.offset, option.blk_sz);
-
-        mb_res_pool_push(aiom->cbpool, aiom_cb);
     }
-
-    return nr_completed;
 }
 
-int
-mb_aiom_wait(mb_aiom_t *aiom, struct timespec *timeout)
+// page cache residency of pages to be read, sampled with mincore(2)
+typedef struct {
+    char **maps;        // targets mapped read-only, NULL if empty
+    unsigned char *vec;
+    long pagesize;
+    long nr_reads;      // since the last sample
+} cacheprobe_t;
+
+static cacheprobe_t *
+mb_cacheprobe_make(int *fd_list)
 {
-    return __mb_aiom_wait(aiom, 1, aiom->nr_inflight, aiom->events, timeout);
+    cacheprobe_t *probe;
+    void *map;
+    int i;
+
+    if (option.cache_sample == 0) {
+        return NULL;
+    }
+    probe = malloc(sizeof(cacheprobe_t));
+    probe->maps = malloc(sizeof(char *) * option.nr_files);
+    probe->pagesize = sysconf(_SC_PAGESIZE);
+    probe->vec = malloc(option.blk_sz / probe->pagesize + 2);
+    probe->nr_reads = 0;
+    for (i = 0; i < option.nr_files; i++) {
+        probe->maps[i] = NULL;
+        if (option.file_size_list[i] <= 0) {
+            continue;
+        }
+        map = mmap(NULL, option.file_size_list[i], PROT_READ, MAP_SHARED,
+                   fd_list[i], 0);
+        if (map == MAP_FAILED) {
+            perror("mb_cacheprobe_make:mmap(2) failed");
+            exit(EXIT_FAILURE);
+        }
+        probe->maps[i] = map;
+    }
+    return probe;
 }
 
-int
-mb_aiom_waitall(mb_aiom_t *aiom)
+static void
+mb_cacheprobe_destroy(cacheprobe_t *probe)
 {
-    return __mb_aiom_wait(aiom, aiom->nr_inflight, aiom->nr_inflight,
-                               aiom->events, NULL);
+    int i;
+
+    if (probe == NULL) {
+        return;
+    }
+    for (i = 0; i < option.nr_files; i++) {
+        if (probe->maps[i] != NULL) {
+            munmap(probe->maps[i], option.file_size_list[i]);
+        }
+    }
+    free(probe->maps);
+    free(probe->vec);
+    free(probe);
 }
 
-int
-mb_aiom_nr_submittable(mb_aiom_t *aiom)
+/* every option.cache_sample reads, count pages of a read of @size
+ * bytes at @addr which are in page cache */
+static void
+mb_cacheprobe_sample(cacheprobe_t *probe, int file_idx, int64_t addr,
+                     int64_t size, meter_t *meter)
 {
-    return aiom->cbpool->nr_avail;
+    int64_t start;
+    int64_t nr_pages;
+    int64_t i;
+
+    if (++probe->nr_reads < option.cache_sample) {
+        return;
+    }
+    probe->nr_reads = 0;
+    if (probe->maps[file_idx] == NULL || addr + size > option.file_size_list[file_idx]) {
+        return;
+    }
+    start = addr & ~(probe->pagesize - 1);
+    nr_pages = (addr + size - start + probe->pagesize - 1) / probe->pagesize;
+    if (mincore(probe->maps[file_idx] + start, addr + size - start, probe->vec) == -1) {
+        perror("mb_cacheprobe_sample:mincore(2) failed");
+        return;
+    }
+    meter->cache_pages += nr_pages;
+    for (i = 0; i < nr_pages; i++) {
+        meter->cache_hits += probe->vec[i] & 1;
+    }
 }
 
-mb_res_pool_t *
-mb_res_pool_make(int nr_elems)
+#define HUGEPAGE_SIZE (2 * MEBI)
+
+/*
+ * Allocate @nr_slots buffers of @slot_size bytes in one region. The
+ * region is bound to @nodemask (if not 0) and touched here, so it
+ * should be called by the thread which uses the buffers after its
+ * affinity is set.
+ */
+mb_iobuf_arena_t *
+mb_iobuf_arena_make(int nr_slots, size_t slot_size, unsigned long nodemask)
 {
-    mb_res_pool_t *pool;
-    mb_res_pool_cell_t *next_cell;
-    mb_res_pool_cell_t *cell;
-    int i;
+    mb_iobuf_arena_t *arena;
+    size_t size;
+    void *base;
 
-    pool = malloc(sizeof(mb_res_pool_t));
-    if (pool == NULL) {
+    arena = malloc(sizeof(mb_iobuf_arena_t));
+    if (arena == NULL) {
         perror("malloc failed");
         exit(EXIT_FAILURE);
     }
-    bzero(pool, sizeof(mb_res_pool_t));
-
-    pool->nr_elems = nr_elems;
-    pool->nr_avail = 0;
 
-    for(cell = NULL, i = 0; i < nr_elems; i++) {
-        next_cell = cell;
-        cell = malloc(sizeof(mb_res_pool_cell_t));
-        if (cell == NULL) {
-            perror("malloc failed");
+    // each slot is page-aligned for O_DIRECT
+    if (slot_size % PAGE_SIZE != 0) {
+        slot_size += PAGE_SIZE - slot_size % PAGE_SIZE;
+    }
+    size = slot_size * nr_slots;
+
+    base = MAP_FAILED;
+    arena->hugepage = false;
+    if (option.hugepage) {
+        size_t hsize = size;
+        if (hsize % HUGEPAGE_SIZE != 0) {
+            hsize += HUGEPAGE_SIZE - hsize % HUGEPAGE_SIZE;
+        }
+        base = mmap(NULL, hsize, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED) {
+            size = hsize;
+            arena->hugepage = true;
+        } else if (option.verbose) {
+            fprintf(stderr, "*info* no free huge pages, falling back to normal pages\n");
+        }
+    }
+    if (base == MAP_FAILED) {
+        base = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            perror("mb_iobuf_arena_make:mmap(2) failed");
             exit(EXIT_FAILURE);
         }
-        bzero(cell, sizeof(mb_res_pool_cell_t));
-        cell->data = NULL;
+#ifdef MADV_HUGEPAGE
+        if (option.hugepage) {
+            madvise(base, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
 
-        if (pool->tail == NULL)
-            pool->tail = cell;
-        cell->next = next_cell;
+    if (nodemask != 0) {
+#ifdef NUMA_ARCH
+        if (mbind(base, size, MPOL_BIND, &nodemask,
+                  numa_max_node()+2, MPOL_MF_STRICT) != 0) {
+            perror("mb_iobuf_arena_make:mbind(2) failed");
+            exit(EXIT_FAILURE);
+        }
+#else
+        fprintf(stderr, "NUMA specific operation specified, but not operated");
+#endif
     }
 
-    // make ring
-    pool->ring = pool->head = cell;
-    pool->tail->next = pool->head;
+    // force allocation of physical memory
+    memset(base, 0, size);
 
-    return pool;
+    arena->vec.iov_base = base;
+    arena->vec.iov_len = size;
+    arena->slot_size = slot_size;
+    arena->nr_slots = nr_slots;
+
+    return arena;
 }
 
 void
-mb_res_pool_destroy(mb_res_pool_t *pool)
+mb_iobuf_arena_destroy(mb_iobuf_arena_t *arena)
 {
-    mb_res_pool_cell_t *cell;
-    mb_res_pool_cell_t *cell_next;
-
-    for(cell_next = NULL, cell = pool->ring;
-        cell_next != pool->ring; cell = cell_next){
-        cell_next = cell->next;
-        free(cell);
-    }
-    free(pool);
+    munmap(arena->vec.iov_base, arena->vec.iov_len);
+    free(arena);
 }
 
-/* return NULL on empty */
 void *
-mb_res_pool_pop(mb_res_pool_t *pool)
+mb_iobuf_arena_slot(mb_iobuf_arena_t *arena, int idx)
 {
-    void *ret;
-    if (pool->nr_avail == 0) {
-        return NULL;
-    }
-    ret = pool->head->data;
-    pool->head = pool->head->next;
-    pool->nr_avail --;
-
-    return ret;
+    return (char *) arena->vec.iov_base + arena->slot_size * idx;
 }
 
-/* return -1 on error, 0 on success */
-int
-mb_res_pool_push(mb_res_pool_t *pool, void *elem)
+mb_aiom_t *
+mb_aiom_make(int nr_events)
 {
-    if (pool->nr_avail == pool->nr_elems) {
-        return -1;
-    }
-    pool->tail = pool->tail->next;
-    pool->tail->data = elem;
-    pool->nr_avail ++;
+    mb_aiom_t *aiom;
+    int i;
+    aiom_cb_t *aiom_cb;
+    int ret;
 
-    return 0;
-}
+    aiom = malloc(sizeof(mb_aiom_t));
 
+    aiom->nr_events = nr_events;
+    aiom->nr_pending = 0;
+    aiom->nr_inflight = 0;
 
-void
-print_option()
-{
-    const char *pattern_str;
+    aiom->iocount = 0;
+    aiom->iobytes = 0;
+    aiom->iowait = 0;
+    aiom->flushcount = 0;
+    aiom->flushwait = 0;
+    bzero(aiom->spacecount, sizeof(aiom->spacecount));
+    bzero(aiom->spacewait, sizeof(aiom->spacewait));
 
-    switch(option.pattern) {
-    case PATTERN_SEQ:
-        pattern_str = "sequential";
-        break;
-    case PATTERN_RAND:
-        pattern_str = "random";
-        break;
-    case PATTERN_SEEKDIST:
-        pattern_str = "seekdist";
-        break;
-    case PATTERN_SEEKINCR:
-        pattern_str = "seekincr";
-        break;
-    default:
-        pattern_str = "(unknown)";
-        break;
+    aiom->pending = malloc(sizeof(aiom_cb_t *) * nr_events);
+    if (aiom->pending == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
     }
+    bzero(aiom->pending, sizeof(aiom_cb_t *) * nr_events);
 
-    printf("{\n\
-  \"params\": {\n\
-    \"threads\": %d,\n\
-    \"mode\": \"%s\",\n\
-    \"pattern\": \"%s\",\n\
-    \"blocksize_byte\": %d,\n\
-    \"offset_start_blk\": %ld,\n\
-    \"offset_end_blk\": %ld,\n\
-    \"direct\": %s,\n\
-    \"aio\": %s,\n\
-    \"timeout_sec\": %d,\n\
-    \"bogus_comp\": %ld,\n\
-    \"iosleep\": %d\n\
-  }\n\
-}\n",
-           option.multi,
-           (option.read ? "read" :
-            option.write ? "write" : "mix"),
-           pattern_str,
-           option.blk_sz,
-           option.ofst_start,
-           option.ofst_end,
-           (option.direct ? "true" : "false"),
-           (option.aio ? "true" : "false"),
-           option.timeout,
-           option.bogus_comp,
-           option.iosleep
-        );
+    aiom->events = malloc(sizeof(struct io_event) * nr_events);
+    if (aiom->events == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    bzero(aiom->events, sizeof(struct io_event) * nr_events);
+
+    aiom->vecs = malloc(sizeof(struct iovec) * nr_events);
+    if (aiom->vecs == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    bzero(aiom->vecs, sizeof(struct iovec) * nr_events);
+
+    aiom->cbpool = mb_res_pool_make(nr_events, sizeof(aiom_cb_t));
+    aiom->arena = mb_iobuf_arena_make(nr_events, mb_io_buf_size(), nodemask);
+
+    for(i = 0; i < nr_events; i++) {
+        aiom_cb = (aiom_cb_t *) (aiom->cbpool->elembase
+                                 + aiom->cbpool->elemsize * i);
+        if ((void *) aiom_cb != (void *) &aiom_cb->iocb)
+        {
+            fprintf(stderr, "Pointer mismatch: aiom_cb != &aiom_cb->iocb\n");
+            exit(EXIT_FAILURE);
+        }
+
+        /* prepare buffer and iovec. each slot of the arena is
+         * registered as its own fixed buffer for io_uring, since the
+         * kernel refuses a registered buffer larger than 1 GiB. */
+        aiom_cb->iovec_idx = i;
+        aiom_cb->vec = &aiom->vecs[i];
+        aiom_cb->vec->iov_len = mb_io_buf_size();
+        aiom_cb->vec->iov_base = mb_iobuf_arena_slot(aiom->arena, i);
+    }
+
+    bzero(&aiom->context, sizeof(io_context_t));
+    #ifdef HAVE_IO_URING
+    bzero(&aiom->uring, sizeof(struct io_uring));
+    #endif
+
+    switch(option.aio_engine) {
+    case AIO_LIBAIO:
+        if ((ret = io_setup(nr_events, &aiom->context)) != 0) {
+            perror("io_setup failed.");
+            return NULL;
+        }
+        break;
+    #ifdef HAVE_IO_URING
+    case AIO_IOURING:
+        ret = io_uring_queue_init(nr_events, &aiom->uring, 0);
+        if (ret != 0) {
+            perror("io_uring_queue_init failed.");
+            return NULL;
+        }
+        ret = io_uring_register_buffers(&aiom->uring, aiom->vecs, nr_events);
+        if (ret != 0) {
+            perror("io_uring_register_buffers failed.");
+            return NULL;
+        }
+        break;
+    #endif
+    }
+
+    return aiom;
 }
 
 void
-print_result(result_t *result)
+mb_aiom_destroy (mb_aiom_t *aiom)
 {
-    printf("== result ==\n\
-exec_time     %lf [sec]\n\
-iops          %lf [blocks/sec]\n\
-response_time %lf [sec]\n\
-transfer_rate %lf [MiB/sec]\n\
-accum_io_time %lf [sec]\n\
-",
-           result->exec_time,
-           result->iops,
-           result->response_time,
-           result->bandwidth / MEBI,
-           result->iowait_time);
+    free(aiom->pending);
+    free(aiom->events);
+
+    switch(option.aio_engine) {
+    case AIO_LIBAIO:
+        io_destroy(aiom->context);
+        break;
+#ifdef HAVE_IO_URING
+    case AIO_IOURING:
+        io_uring_queue_exit(&aiom->uring);
+        break;
+#endif
+    }
+
+    mb_res_pool_destroy(aiom->cbpool);
+    mb_iobuf_arena_destroy(aiom->arena);
+    free(aiom->vecs);
+    free(aiom);
 }
 
 void
-print_result_json(result_t *result, bool only_params)
+mb_aiom_submit(mb_aiom_t *aiom)
 {
-    const char *pattern_str;
-    char *files_str;
-    char *files_str_ptr;
-    size_t files_str_len;
+    int i;
+    int ret = 0;
+    struct timeval submit_time;
 
-    switch(option.pattern) {
-    case PATTERN_SEQ:
-        pattern_str = "sequential";
-        break;
-    case PATTERN_RAND:
-        pattern_str = "random";
-        break;
-    case PATTERN_SEEKDIST:
-        pattern_str = "seekdist";
-        break;
-    case PATTERN_SEEKINCR:
-        pattern_str = "seekincr";
-        break;
-    default:
-        pattern_str = "(unknown)";
-        break;
+    if (aiom->nr_pending == 0) {
+        return;
     }
 
-    files_str_len = 4;
-    if (NULL == (files_str = malloc(files_str_len))) {
-        perror("malloc failed.");
-        exit(EXIT_FAILURE);
+    GETTIMEOFDAY(&submit_time);
+    for (i = 0; i < aiom->nr_pending; i++) {
+        aiom_cb_t *cb;
+        cb = aiom->pending[i];
+        cb->submit_time = submit_time;
     }
-    files_str[0] = '[';
-    files_str_ptr = files_str + 1;
-    for (int i = 0; i < option.nr_files; i++) {
-        int n;
-        if (i == 0) {
-            n = snprintf(files_str_ptr, files_str_len - 2 - (files_str_ptr - files_str),
-                         "\"%s\"", option.file_path_list[i]);
-        } else {
-            n = snprintf(files_str_ptr, files_str_len - 2 - (files_str_ptr - files_str),
-                         ", \"%s\"", option.file_path_list[i]);
-        }
-        if (n >= files_str_len - 2 - (files_str_ptr - files_str)) {
-            size_t ofst = files_str_ptr - files_str;
 
-            files_str_len *= 2;
-            files_str = realloc(files_str, files_str_len);
-            files_str_ptr = files_str + ofst;
-            i--;
-            continue;
-        } else {
-            files_str_ptr += n;
+    switch(option.aio_engine) {
+    case AIO_LIBAIO:
+        ret = io_submit(aiom->context, aiom->nr_pending,
+                        (struct iocb **) aiom->pending);
+        if (ret != aiom->nr_pending) {
+            fprintf(stderr, "mb_aiom_submit:io_submit only %d of %d succeeded\n",
+                    ret, aiom->nr_pending);
+            exit(EXIT_FAILURE);
+        } else if (ret < 0) {
+            perror("mb_aiom_submit:io_submit failed");
+        }
+        break;
+#ifdef HAVE_IO_URING
+    case AIO_IOURING:
+        ret = io_uring_submit(&aiom->uring);
+        if (ret != aiom->nr_pending) {
+            fprintf(stderr, "mb_aiom_submit:io_uring_submit only %d of %d succeeded\n",
+                    ret, aiom->nr_pending);
+            exit(EXIT_FAILURE);
+        } else if (ret < 0) {
+            perror("mb_aiom_submit:io_uring_submit failed");
+            exit(EXIT_FAILURE);
         }
+        break;
+#endif
     }
-    *files_str_ptr = ']';
-    *(files_str_ptr + 1) = '\0';
-
-    printf("{\n\
-  \"params\": {\n\
-    \"threads\": %d,\n\
-    \"mode\": \"%s\",\n\
-    \"pattern\": \"%s\",\n\
-    \"blocksize_byte\": %d,\n\
-    \"offset_start_blk\": %ld,\n\
-    \"offset_end_blk\": %ld,\n\
-    \"direct\": %s,\n\
-    \"aio\": %s,\n\
-    \"aio_nr_events\": %d,\n\
-    \"aio_engine\": \"%s\",\n\
-    \"timeout_sec\": %d,\n\
-    \"bogus_comp\": %ld,\n\
-    \"iosleep\": %d,\n\
-    \"files\": %s\n\
-  }",
-           option.multi,
-           (option.read ? "read" :
-            option.write ? "write" : "mix"),
-           pattern_str,
-           option.blk_sz,
-           option.ofst_start,
-           option.ofst_end,
-           (option.direct ? "true" : "false"),
-           (option.aio ? "true" : "false"),
-           option.aio_nr_events,
-           (option.aio_engine == AIO_LIBAIO ? "libaio" : "io_uring" ),
-           option.timeout,
-           option.bogus_comp,
-           option.iosleep,
-           files_str
-        );
 
-    if (only_params == true) {
-        printf("\n}\n");
-    } else {
-        printf(",\n\
-  \"counters\": {\n\
-    \"io_count\": %ld,\n\
-    \"io_bytes\": %ld\n\
-  },\n\
-  \"metrics\": {\n\
-    \"start_time_unix\": %lf,\n\
-    \"exec_time_sec\": %lf,\n\
-    \"iops\": %lf,\n\
-    \"transfer_rate_mbps\": %lf,\n\
-    \"response_time_msec\": %lf,\n\
-    \"accum_io_time_sec\": %lf\n\
-  }\n\
-}\n",
-               result->io_count,
-               result->io_bytes,
-               result->start_time,
-               result->exec_time,
-               result->iops,
-               result->bandwidth / MEBI,
-               result->response_time * 1000.0,
-               result->iowait_time
-            );
+    if (aio_tracefile != NULL) {
+        fprintf(aio_tracefile,
+                "[%d] submit: %d req\n",
+                tid, ret);
     }
+
+    aiom->nr_inflight += aiom->nr_pending;
+    aiom->nr_pending = 0;
 }
 
-int
-parse_args(int argc, char **argv, micbench_io_option_t *option)
+aiom_cb_t *
+mb_aiom_prep_pread   (mb_aiom_t *aiom, int fd, int file_idx,
+                      aiom_cb_t *aiom_cb, size_t count, long long offset)
 {
-    char optchar;
-    int idx;
+#ifdef HAVE_IO_URING
+    struct io_uring_sqe *sqe;
+#endif
+
+    switch(option.aio_engine) {
+    case AIO_LIBAIO:
+        io_prep_pread(&aiom_cb->iocb, fd,
+                      aiom_cb->vec->iov_base, count, offset);
+        break;
+#ifdef HAVE_IO_URING
+    case AIO_IOURING:
+        sqe = io_uring_get_sqe(&aiom->uring);
+        io_uring_prep_read_fixed(sqe, fd, aiom_cb->vec->iov_base,
+                                 count,
+                                 offset, aiom_cb->iovec_idx);
+        io_uring_sqe_set_data(sqe, aiom_cb);
+        break;
+#endif
+    }
+    GETTIMEOFDAY(&aiom_cb->queue_time);
+    aiom_cb->file_idx = file_idx;
+    aiom_cb->count = count;
+    aiom_cb->mode = MB_DO_READ;
+    aiom_cb->offset = offset;
+
+    aiom->pending[aiom->nr_pending++] = aiom_cb;
+
+    return aiom_cb;
+}
+
+aiom_cb_t *
+mb_aiom_prep_pwrite  (mb_aiom_t *aiom, int fd, int file_idx,
+                      aiom_cb_t *aiom_cb, size_t count, long long offset)
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_sqe *sqe;
+#endif
+
+    switch(option.aio_engine) {
+    case AIO_LIBAIO:
+        io_prep_pwrite(&aiom_cb->iocb, fd,
+                       aiom_cb->vec->iov_base, count, offset);
+        break;
+#ifdef HAVE_IO_URING
+    case AIO_IOURING:
+        sqe = io_uring_get_sqe(&aiom->uring);
+        io_uring_prep_write_fixed(sqe, fd, aiom_cb->vec->iov_base,
+                                  count,
+                                  offset, aiom_cb->iovec_idx);
+        io_uring_sqe_set_data(sqe, aiom_cb);
+        break;
+#endif
+    }
+    GETTIMEOFDAY(&aiom_cb->queue_time);
+    aiom_cb->file_idx = file_idx;
+    aiom_cb->count = count;
+    aiom_cb->mode = MB_DO_WRITE;
+    aiom_cb->offset = offset;
+
+    aiom->pending[aiom->nr_pending++] = aiom_cb;
+
+    return aiom_cb;
+}
+
+/* queue a flush of the whole file with option.flush_op */
+aiom_cb_t *
+mb_aiom_prep_flush   (mb_aiom_t *aiom, int fd, int file_idx,
+                      aiom_cb_t *aiom_cb)
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_sqe *sqe;
+#endif
+
+    switch(option.aio_engine) {
+    case AIO_LIBAIO:
+        // no sync_file_range in libaio; rejected by parse_args
+        if (option.flush_op == FLUSH_FDATASYNC) {
+            io_prep_fdsync(&aiom_cb->iocb, fd);
+        } else {
+            io_prep_fsync(&aiom_cb->iocb, fd);
+        }
+        break;
+#ifdef HAVE_IO_URING
+    case AIO_IOURING:
+        sqe = io_uring_get_sqe(&aiom->uring);
+        if (option.flush_op == FLUSH_SYNC_FILE_RANGE) {
+            io_uring_prep_sync_file_range(sqe, fd, 0, 0,
+                                          SYNC_FILE_RANGE_WAIT_BEFORE
+                                          | SYNC_FILE_RANGE_WRITE
+                                          | SYNC_FILE_RANGE_WAIT_AFTER);
+        } else {
+            io_uring_prep_fsync(sqe, fd,
+                                (option.flush_op == FLUSH_FDATASYNC ?
+                                 IORING_FSYNC_DATASYNC : 0));
+        }
+        io_uring_sqe_set_data(sqe, aiom_cb);
+        break;
+#endif
+    }
+    GETTIMEOFDAY(&aiom_cb->queue_time);
+    aiom_cb->file_idx = file_idx;
+    aiom_cb->count = 0;
+    aiom_cb->mode = MB_DO_FLUSH;
+    aiom_cb->offset = 0;
+
+    aiom->pending[aiom->nr_pending++] = aiom_cb;
+
+    return aiom_cb;
+}
+
+/* queue a space operation; only io_uring supports it */
+aiom_cb_t *
+mb_aiom_prep_space   (mb_aiom_t *aiom, int fd, int file_idx,
+                      aiom_cb_t *aiom_cb, mb_io_mode_t mode,
+                      size_t count, long long offset)
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_sqe *sqe;
+
+    sqe = io_uring_get_sqe(&aiom->uring);
+    io_uring_prep_fallocate(sqe, fd, mb_fallocate_mode(mode), offset, count);
+    io_uring_sqe_set_data(sqe, aiom_cb);
+#endif
+    GETTIMEOFDAY(&aiom_cb->queue_time);
+    aiom_cb->file_idx = file_idx;
+    aiom_cb->count = 0;
+    aiom_cb->mode = mode;
+    aiom_cb->offset = offset;
+
+    aiom->pending[aiom->nr_pending++] = aiom_cb;
+
+    return aiom_cb;
+}
+
+int
+__mb_aiom_wait(mb_aiom_t *aiom, long min_nr, long nr,
+               struct io_event *events, struct timespec *timeout){
+    int i;
+    int nr_completed = 0;
+    aiom_cb_t *aiom_cb = NULL;
+    struct io_event *event = NULL;
+
+#ifdef HAVE_IO_URING
+    int ret;
+    struct io_uring_cqe *cqe = NULL;
+    struct __kernel_timespec ts;
+#endif
+
+    switch(option.aio_engine) {
+    case AIO_LIBAIO:
+        nr_completed = io_getevents(aiom->context, min_nr, nr, events, timeout);
+        if (nr_completed < 0) {
+            perror("__mb_aiom_wait:io_getevents failed");
+            exit(EXIT_FAILURE);
+        }
+        break;
+#ifdef HAVE_IO_URING
+    case AIO_IOURING:
+        nr_completed = min_nr;
+        if (timeout != NULL && min_nr > 0) {
+            // wait for the first completion only until timeout expires
+            ts.tv_sec = timeout->tv_sec;
+            ts.tv_nsec = timeout->tv_nsec;
+            ret = io_uring_wait_cqe_timeout(&aiom->uring, &cqe, &ts);
+            if (ret == -ETIME) {
+                nr_completed = 0;
+            } else if (ret != 0) {
+                errno = -ret;
+                perror("__mb_aiom_wait:io_uring_wait_cqe_timeout failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        break;
+#endif
+    }
+    aiom->nr_inflight -= nr_completed;
+
+    if (aio_tracefile != NULL) {
+        fprintf(aio_tracefile,
+                "[%d] %d infl %d comp\n",
+                tid, aiom->nr_inflight, nr_completed);
+    }
+
+    for(i = 0; i < nr_completed; i++){
+        struct timeval t1;
+        const char *file_path;
+
+        switch(option.aio_engine) {
+        case AIO_LIBAIO:
+            event = &aiom->events[i];
+            aiom_cb = (aiom_cb_t *) event->obj;
+            if (!(event->res == aiom_cb->count && event->res2 == 0)){
+                fprintf(stderr, "__mb_aiom_wait: fatal error on completion: res = %ld, res2 = %ld\n",
+                        (long) event->res, (long) event->res2);
+            }
+            break;
+#ifdef HAVE_IO_URING
+        case AIO_IOURING:
+            ret = io_uring_wait_cqe(&aiom->uring, &cqe);
+            if (ret != 0) {
+                perror("__mb_aiom_wait:io_uring_wait_cqe_nr failed");
+                exit(EXIT_FAILURE);
+            }
+            aiom_cb = (aiom_cb_t *) io_uring_cqe_get_data(cqe);
+            if (cqe->res != aiom_cb->count) {
+                fprintf(stderr, "__mb_aiom_wait: fatal error on completion: res = %d\n",
+                        cqe->res);
+            }
+            io_uring_cqe_seen(&aiom->uring, cqe);
+            break;
+#endif
+        }
+
+        // TODO: callback or something
+        GETTIMEOFDAY(&t1);
+
+        if (aiom_cb->mode == MB_DO_FLUSH) {
+            aiom->flushcount++;
+            aiom->flushwait += mb_elapsed_time_from(&aiom_cb->submit_time);
+            mb_res_pool_push(aiom->cbpool, aiom_cb);
+            continue;
+        }
+        if (MB_IS_SPACE_OP(aiom_cb->mode)) {
+            aiom->spacecount[MB_SPACE_OP_IDX(aiom_cb->mode)]++;
+            aiom->spacewait[MB_SPACE_OP_IDX(aiom_cb->mode)]
+                += mb_elapsed_time_from(&aiom_cb->submit_time);
+            mb_res_pool_push(aiom->cbpool, aiom_cb);
+            continue;
+        }
+        aiom->iocount++;
+        aiom->iowait += mb_elapsed_time_from(&aiom_cb->submit_time);
+        aiom->iobytes += aiom_cb->count;
+
+        if (aiom_cb->file_idx == -1) {
+            file_path = "(null)";
+        } else {
+            file_path = option.file_path_list[aiom_cb->file_idx];
+        }
+        mb_log_io_activity(&aiom_cb->submit_time, &t1,
+                           file_path, aiom_cb->offset, aiom_cb->count,
+                           aiom_cb->mode);
+
+        mb_res_pool_push(aiom->cbpool, aiom_cb);
+    }
+
+    return nr_completed;
+}
+
+int
+mb_aiom_wait(mb_aiom_t *aiom, struct timespec *timeout)
+{
+    return __mb_aiom_wait(aiom, 1, aiom->nr_inflight, aiom->events, timeout);
+}
+
+int
+mb_aiom_waitall(mb_aiom_t *aiom)
+{
+    return __mb_aiom_wait(aiom, aiom->nr_inflight, aiom->nr_inflight,
+                               aiom->events, NULL);
+}
+
+int
+mb_aiom_nr_submittable(mb_aiom_t *aiom)
+{
+    return aiom->cbpool->nr_avail;
+}
+
+/*
+ * Make a pool of @nr_elems elements. If @elemsize is not 0, the pool
+ * allocates storage for the elements, each aligned to a cache line,
+ * and is initially full. Otherwise the pool is initially empty and
+ * holds pointers pushed by the caller.
+ */
+mb_res_pool_t *
+mb_res_pool_make(int nr_elems, size_t elemsize)
+{
+    mb_res_pool_t *pool;
+    int i;
+
+    pool = malloc(sizeof(mb_res_pool_t));
+    if (pool == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    bzero(pool, sizeof(mb_res_pool_t));
+
+    pool->nr_elems = nr_elems;
+    pool->nr_avail = 0;
+    pool->avail = malloc(sizeof(void *) * nr_elems);
+    if (pool->avail == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (elemsize > 0) {
+        if (elemsize % CACHELINE_SIZE != 0) {
+            elemsize += CACHELINE_SIZE - elemsize % CACHELINE_SIZE;
+        }
+        pool->elemsize = elemsize;
+        if (posix_memalign((void **) &pool->elembase, CACHELINE_SIZE,
+                           elemsize * nr_elems) != 0) {
+            perror("posix_memalign failed");
+            exit(EXIT_FAILURE);
+        }
+        bzero(pool->elembase, elemsize * nr_elems);
+
+        // push in reverse order so that pop returns element 0 first
+        for(i = nr_elems - 1; i >= 0; i--) {
+            pool->avail[pool->nr_avail++] = pool->elembase + elemsize * i;
+        }
+    }
+
+    return pool;
+}
+
+void
+mb_res_pool_destroy(mb_res_pool_t *pool)
+{
+    free(pool->elembase);
+    free(pool->avail);
+    free(pool);
+}
+
+/* return NULL on empty */
+void *
+mb_res_pool_pop(mb_res_pool_t *pool)
+{
+    if (pool->nr_avail == 0) {
+        return NULL;
+    }
+    return pool->avail[--pool->nr_avail];
+}
+
+/* return -1 on error, 0 on success */
+int
+mb_res_pool_push(mb_res_pool_t *pool, void *elem)
+{
+    if (pool->nr_avail == pool->nr_elems) {
+        return -1;
+    }
+    pool->avail[pool->nr_avail++] = elem;
+
+    return 0;
+}
+
+/* return index of @elem in the pool's storage, -1 if not in it */
+int64_t
+mb_res_pool_idx(mb_res_pool_t *pool, void *elem)
+{
+    ptrdiff_t diff;
+
+    if (pool->elembase == NULL) {
+        return -1;
+    }
+    diff = (char *) elem - pool->elembase;
+    if (diff < 0 || diff >= (ptrdiff_t) (pool->elemsize * pool->nr_elems)
+        || diff % pool->elemsize != 0) {
+        return -1;
+    }
+
+    return diff / pool->elemsize;
+}
+
+/*
+ * Counters of devices holding targets and CPU time, sampled at the
+ * start and the end of measurement, and every option.sysstat_interval
+ * msec if given.
+ */
+
+typedef struct {
+    dev_t dev;
+    char name[32];
+} sysstat_dev_t;
+
+typedef struct {
+    double time;        // in sec of mb_clock_nsec()
+    int64_t count;      // I/Os of all workers
+
+    // CPU time of workers and the whole process in sec
+    double utime;
+    double stime;
+    double ru_utime;
+    double ru_stime;
+
+    int64_t (*devstat)[DS_NR_FIELDS];
+} sysstat_t;
+
+static sysstat_dev_t *sysstat_devs;
+static int nr_sysstat_devs;
+static sysstat_t sysstat_begin;
+static sysstat_t sysstat_end;
+static sysstat_t *sysstat_samples;  // every option.sysstat_interval
+static int nr_sysstat_samples;
+static pthread_t sysstat_sampler;
+static pthread_t sysstat_boundary_sampler;
+
+// finished workers stay alive until sysstat_end is taken
+static bool sysstat_end_taken;
+static pthread_mutex_t sysstat_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sysstat_cond = PTHREAD_COND_INITIALIZER;
+
+/* add the device holding @path to devices to be sampled */
+static void
+mb_sysstat_add_dev(const char *path)
+{
+    struct stat statbuf;
+    char sysfs[64];
+    char link[PATH_MAX];
+    char *name;
+    sysstat_dev_t *devs;
+    dev_t dev;
+    ssize_t len;
+    int i;
+
+    if (stat(path, &statbuf) == -1) {
+        return;
+    }
+    dev = (S_ISBLK(statbuf.st_mode) ? statbuf.st_rdev : statbuf.st_dev);
+    for (i = 0; i < nr_sysstat_devs; i++) {
+        if (sysstat_devs[i].dev == dev) {
+            return;
+        }
+    }
+    // file systems without a block device, such as tmpfs
+    snprintf(sysfs, sizeof(sysfs), "/sys/dev/block/%u:%u", major(dev), minor(dev));
+    if ((len = readlink(sysfs, link, sizeof(link) - 1)) == -1) {
+        if (option.verbose) {
+            fprintf(stderr, "*info* no block device holding %s\n", path);
+        }
+        return;
+    }
+    link[len] = '\0';
+    name = strrchr(link, '/');
+    name = (name == NULL ? link : name + 1);
+
+    if ((devs = realloc(sysstat_devs, sizeof(sysstat_dev_t) * (nr_sysstat_devs + 1))) == NULL) {
+        perror("mb_sysstat_add_dev:realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    sysstat_devs = devs;
+    sysstat_devs[nr_sysstat_devs].dev = dev;
+    strncpy(sysstat_devs[nr_sysstat_devs].name, name,
+            sizeof(sysstat_devs[nr_sysstat_devs].name) - 1);
+    sysstat_devs[nr_sysstat_devs].name[sizeof(sysstat_devs[nr_sysstat_devs].name) - 1] = '\0';
+    nr_sysstat_devs++;
+}
+
+/*
+ * Read counters into @fields from @line of /proc/diskstats if it is of
+ * device @maj:@min. Returns 0 on success, -1 for lines of other devices.
+ */
+int
+mb_diskstats_parse(const char *line, unsigned int maj, unsigned int min,
+                   int64_t *fields)
+{
+    unsigned int line_maj;
+    unsigned int line_min;
+    int n;
+    int m;
+    int i;
+
+    if (sscanf(line, "%u %u %*s%n", &line_maj, &line_min, &n) != 2
+        || line_maj != maj || line_min != min) {
+        return -1;
+    }
+    bzero(fields, sizeof(int64_t) * DS_NR_FIELDS);
+    for (i = 0; i < DS_NR_FIELDS; i++) {
+        if (sscanf(line + n, "%" SCNd64 "%n", &fields[i], &m) != 1) {
+            break;
+        }
+        n += m;
+    }
+    return 0;
+}
+
+/* activity of a device from counters @s to @e taken @dt sec apart */
+void
+mb_devstat_rate(const int64_t *s, const int64_t *e, double dt, devstat_rate_t *rate)
+{
+    rate->read_iops = (e[DS_READS] - s[DS_READS]) / dt;
+    rate->write_iops = (e[DS_WRITES] - s[DS_WRITES]) / dt;
+    rate->read_merges = (e[DS_READ_MERGES] - s[DS_READ_MERGES]) / dt;
+    rate->write_merges = (e[DS_WRITE_MERGES] - s[DS_WRITE_MERGES]) / dt;
+    // sectors of the counters are 512 bytes whatever the device uses
+    rate->read_mbps = (e[DS_READ_SECTORS] - s[DS_READ_SECTORS]) * 512.0 / MEBI / dt;
+    rate->write_mbps = (e[DS_WRITE_SECTORS] - s[DS_WRITE_SECTORS]) * 512.0 / MEBI / dt;
+    rate->queue_depth = (e[DS_TIME_IN_QUEUE] - s[DS_TIME_IN_QUEUE]) / (dt * 1000.0);
+    rate->utilization = (e[DS_IO_TICKS] - s[DS_IO_TICKS]) / (dt * 1000.0);
+}
+
+/* read counters of @dev from sysfs, or /proc/diskstats without it */
+static void
+mb_sysstat_read_dev(dev_t dev, int64_t *fields)
+{
+    char path[64];
+    char line[512];
+    int i;
+    FILE *f;
+
+    bzero(fields, sizeof(int64_t) * DS_NR_FIELDS);
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/stat", major(dev), minor(dev));
+    if ((f = fopen(path, "r")) != NULL) {
+        for (i = 0; i < DS_NR_FIELDS; i++) {
+            if (fscanf(f, "%" SCNd64, &fields[i]) != 1) {
+                break;
+            }
+        }
+        fclose(f);
+        return;
+    }
+
+    if ((f = fopen("/proc/diskstats", "r")) == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (mb_diskstats_parse(line, major(dev), minor(dev), fields) == 0) {
+            break;
+        }
+    }
+    fclose(f);
+}
+
+/* add user and system CPU time of thread @tid in sec */
+static void
+mb_sysstat_read_task(pid_t tid, double *utime, double *stime)
+{
+    char path[64];
+    char buf[1024];
+    char *p;
+    unsigned long ut;
+    unsigned long st;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    if ((f = fopen(path, "r")) == NULL) {
+        return;
+    }
+    if (fgets(buf, sizeof(buf), f) != NULL
+        // fields after the command name, which may contain spaces
+        && (p = strrchr(buf, ')')) != NULL
+        && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                  &ut, &st) == 2) {
+        *utime += (double) ut / sysconf(_SC_CLK_TCK);
+        *stime += (double) st / sysconf(_SC_CLK_TCK);
+    }
+    fclose(f);
+}
+
+static void
+mb_sysstat_sample(sysstat_t *sample, th_arg_t *th_args)
+{
+    struct rusage ru;
+    int i;
+
+    sample->time = mb_clock_nsec() / 1.0e9;
+    sample->count = 0;
+    sample->utime = 0;
+    sample->stime = 0;
+    for (i = 0; i < nr_threads; i++) {
+        sample->count += ((volatile meter_t *) th_args[i].meter)->count;
+        mb_sysstat_read_task(th_args[i].tid, &sample->utime, &sample->stime);
+    }
+    getrusage(RUSAGE_SELF, &ru);
+    sample->ru_utime = TV2DOUBLE(ru.ru_utime);
+    sample->ru_stime = TV2DOUBLE(ru.ru_stime);
+
+    if ((sample->devstat = malloc(sizeof(int64_t) * DS_NR_FIELDS * (nr_sysstat_devs + 1))) == NULL) {
+        perror("mb_sysstat_sample:malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < nr_sysstat_devs; i++) {
+        mb_sysstat_read_dev(sysstat_devs[i].dev, sample->devstat[i]);
+    }
+}
+
+/*
+ * Take sysstat_begin and sysstat_end once the phase reaches measurement
+ * and ramp-down. Reading /proc and /sys is too slow to be done in the
+ * epoch hook, which runs with the epoch mutex held.
+ */
+static void *
+mb_sysstat_boundary(void *arg)
+{
+    th_arg_t *th_args = arg;
+
+    option = groups[0];
+    mb_epoch_wait(&epoch, MB_EPOCH_MEASURE);
+    mb_sysstat_sample(&sysstat_begin, th_args);
+    mb_epoch_wait(&epoch, MB_EPOCH_RAMPDOWN);
+    mb_sysstat_sample(&sysstat_end, th_args);
+
+    pthread_mutex_lock(&sysstat_mutex);
+    sysstat_end_taken = true;
+    pthread_cond_broadcast(&sysstat_cond);
+    pthread_mutex_unlock(&sysstat_mutex);
+    return NULL;
+}
+
+/* block a finished worker until its CPU time is in sysstat_end */
+static void
+mb_sysstat_wait_end(void)
+{
+    pthread_mutex_lock(&sysstat_mutex);
+    while (! sysstat_end_taken) {
+        pthread_cond_wait(&sysstat_cond, &sysstat_mutex);
+    }
+    pthread_mutex_unlock(&sysstat_mutex);
+}
+
+/* take samples every option.sysstat_interval msec until the run ends */
+static void *
+mb_sysstat_sampler(void *arg)
+{
+    th_arg_t *th_args = arg;
+    sysstat_t *samples;
+    int64_t next;
+    int cap;
+
+    option = groups[0];
+    cap = 0;
+    next = mb_clock_nsec();
+    while (mb_epoch_phase(&epoch) != MB_EPOCH_DONE) {
+        if (nr_sysstat_samples == cap) {
+            cap = (cap == 0 ? 64 : cap * 2);
+            if ((samples = realloc(sysstat_samples, sizeof(sysstat_t) * cap)) == NULL) {
+                perror("mb_sysstat_sampler:realloc failed");
+                exit(EXIT_FAILURE);
+            }
+            sysstat_samples = samples;
+        }
+        mb_sysstat_sample(&sysstat_samples[nr_sysstat_samples], th_args);
+        // workers may have exited in the sample
+        if (mb_epoch_phase(&epoch) == MB_EPOCH_DONE) {
+            free(sysstat_samples[nr_sysstat_samples].devstat);
+            break;
+        }
+        nr_sysstat_samples++;
+        next += option.sysstat_interval * 1000000L;
+        mb_sleep_until_nsec(next);
+    }
+    return NULL;
+}
+
+/* members of a device between samples @a and @b, without braces */
+static void
+print_sysstat_dev_json(int idx, sysstat_t *a, sysstat_t *b, const char *indent)
+{
+    devstat_rate_t rate;
+
+    mb_devstat_rate(a->devstat[idx], b->devstat[idx], b->time - a->time, &rate);
+    printf("%s\"name\": \"%s\",\n\
+%s\"read_iops\": %lf,\n\
+%s\"write_iops\": %lf,\n\
+%s\"read_merges_per_sec\": %lf,\n\
+%s\"write_merges_per_sec\": %lf,\n\
+%s\"read_mbps\": %lf,\n\
+%s\"write_mbps\": %lf,\n\
+%s\"in_flight\": %" PRId64 ",\n\
+%s\"avg_queue_depth\": %lf,\n\
+%s\"utilization\": %lf",
+           indent, sysstat_devs[idx].name,
+           indent, rate.read_iops,
+           indent, rate.write_iops,
+           indent, rate.read_merges,
+           indent, rate.write_merges,
+           indent, rate.read_mbps,
+           indent, rate.write_mbps,
+           indent, b->devstat[idx][DS_IN_FLIGHT],
+           indent, rate.queue_depth,
+           indent, rate.utilization);
+}
+
+/* members of CPU time between samples @a and @b, without braces */
+static void
+print_sysstat_cpu_json(sysstat_t *a, sysstat_t *b, const char *indent)
+{
+    int64_t count = b->count - a->count;
+
+    printf("%s\"iops\": %lf,\n\
+%s\"user_sec\": %lf,\n\
+%s\"sys_sec\": %lf,\n\
+%s\"user_usec_per_io\": %lf,\n\
+%s\"sys_usec_per_io\": %lf,\n\
+%s\"process_user_sec\": %lf,\n\
+%s\"process_sys_sec\": %lf",
+           indent, count / (b->time - a->time),
+           indent, b->utime - a->utime,
+           indent, b->stime - a->stime,
+           indent, (count > 0 ? (b->utime - a->utime) * 1.0e6 / count : 0.0),
+           indent, (count > 0 ? (b->stime - a->stime) * 1.0e6 / count : 0.0),
+           indent, b->ru_utime - a->ru_utime,
+           indent, b->ru_stime - a->ru_stime);
+}
+
+/* "sysstat" member of JSON output, without a leading separator */
+static void
+print_sysstat_json(void)
+{
+    int i;
+    int d;
+
+    printf("  \"sysstat\": {\n");
+    print_sysstat_cpu_json(&sysstat_begin, &sysstat_end, "    ");
+    printf(",\n    \"devices\": [");
+    for (d = 0; d < nr_sysstat_devs; d++) {
+        printf("%s\n      {\n", (d == 0 ? "" : ","));
+        print_sysstat_dev_json(d, &sysstat_begin, &sysstat_end, "        ");
+        printf("\n      }");
+    }
+    printf("\n    ]");
+    if (nr_sysstat_samples > 1) {
+        printf(",\n    \"intervals\": [");
+        for (i = 1; i < nr_sysstat_samples; i++) {
+            sysstat_t *a = &sysstat_samples[i - 1];
+            sysstat_t *b = &sysstat_samples[i];
+
+            printf("%s\n      {\n\
+        \"time_sec\": %lf,\n",
+                   (i == 1 ? "" : ","),
+                   b->time - sysstat_samples[0].time);
+            print_sysstat_cpu_json(a, b, "        ");
+            printf(",\n        \"devices\": [");
+            for (d = 0; d < nr_sysstat_devs; d++) {
+                printf("%s\n          {\n", (d == 0 ? "" : ","));
+                print_sysstat_dev_json(d, a, b, "            ");
+                printf("\n          }");
+            }
+            printf("\n        ]\n      }");
+        }
+        printf("\n    ]");
+    }
+    printf("\n  }");
+}
+
+static void
+print_sysstat(void)
+{
+    sysstat_t *a = &sysstat_begin;
+    sysstat_t *b = &sysstat_end;
+    int64_t count = b->count - a->count;
+    devstat_rate_t rate;
+    int d;
+
+    printf("== sysstat ==\n");
+    printf("cpu_user      %lf [usec/io]\n\
+cpu_sys       %lf [usec/io]\n",
+           (count > 0 ? (b->utime - a->utime) * 1.0e6 / count : 0.0),
+           (count > 0 ? (b->stime - a->stime) * 1.0e6 / count : 0.0));
+    for (d = 0; d < nr_sysstat_devs; d++) {
+        mb_devstat_rate(a->devstat[d], b->devstat[d], b->time - a->time, &rate);
+        printf("%-14s%lf [iops] %lf [merges/sec] %lf [queue] %lf [util]\n",
+               sysstat_devs[d].name,
+               rate.read_iops + rate.write_iops,
+               rate.read_merges + rate.write_merges,
+               rate.queue_depth,
+               rate.utilization);
+    }
+}
+
+void
+print_option()
+{
+    const char *pattern_str;
+
+    switch(option.pattern) {
+    case PATTERN_SEQ:
+        pattern_str = "sequential";
+        break;
+    case PATTERN_RAND:
+        pattern_str = "random";
+        break;
+    case PATTERN_SEEKDIST:
+        pattern_str = "seekdist";
+        break;
+    case PATTERN_SEEKINCR:
+        pattern_str = "seekincr";
+        break;
+    case PATTERN_WAL:
+        pattern_str = "wal";
+        break;
+    case PATTERN_SMALLFILE:
+        pattern_str = "smallfile";
+        break;
+    default:
+        pattern_str = "(unknown)";
+        break;
+    }
+
+    printf("{\n\
+  \"params\": {\n\
+    \"threads\": %d,\n\
+    \"mode\": \"%s\",\n\
+    \"pattern\": \"%s\",\n\
+    \"blocksize_byte\": %d,\n\
+    \"offset_start_blk\": %ld,\n\
+    \"offset_end_blk\": %ld,\n\
+    \"direct\": %s,\n\
+    \"aio\": %s,\n\
+    \"timeout_sec\": %d,\n\
+    \"bogus_comp\": %ld,\n\
+    \"iosleep\": %d\n\
+  }\n\
+}\n",
+           option.multi,
+           (option.read ? "read" :
+            option.write ? "write" : "mix"),
+           pattern_str,
+           option.blk_sz,
+           option.ofst_start,
+           option.ofst_end,
+           (option.direct ? "true" : "false"),
+           (option.aio ? "true" : "false"),
+           option.timeout,
+           option.bogus_comp,
+           option.iosleep
+        );
+}
+
+static const char *space_op_names[MB_NR_SPACE_OPS] = {"trim", "zero", "alloc"};
+
+void
+print_result(result_t *result, const char *title)
+{
+    int i;
+
+    printf("== %s ==\n", title);
+    printf("exec_time     %lf [sec]\n\
+iops          %lf [blocks/sec]\n\
+response_time %lf [sec]\n\
+transfer_rate %lf [MiB/sec]\n\
+accum_io_time %lf [sec]\n\
+",
+           result->exec_time,
+           result->iops,
+           result->response_time,
+           result->bandwidth / MEBI,
+           result->iowait_time);
+    if (result->flush_count > 0) {
+        printf("flush_count   %ld\n\
+flush_latency %lf [sec]\n",
+               result->flush_count,
+               result->flush_time / result->flush_count);
+    }
+    for (i = 0; i < MB_NR_SPACE_OPS; i++) {
+        char label[16];
+
+        if (result->space_count[i] == 0) continue;
+        snprintf(label, sizeof(label), "%s_count", space_op_names[i]);
+        printf("%-14s%ld\n", label, result->space_count[i]);
+        snprintf(label, sizeof(label), "%s_latency", space_op_names[i]);
+        printf("%-14s%lf [sec]\n", label, result->space_time[i] / result->space_count[i]);
+    }
+    if (result->cache_pages > 0) {
+        printf("cache_hit     %lf [%ld/%ld pages]\n",
+               (double) result->cache_hits / result->cache_pages,
+               result->cache_hits,
+               result->cache_pages);
+    }
+    if (result->lat_hist != NULL && result->lat_hist->count > 0) {
+        mb_hist_t *hist = result->lat_hist;
+
+        printf("%-14savg %.1lf p50 %.1lf p90 %.1lf p99 %.1lf p99.9 %.1lf max %.1lf [usec]\n",
+               (option.pattern == PATTERN_WAL ? "commit_lat" : "file_lat"),
+               (double) hist->sum / hist->count / 1000.0,
+               mb_hist_percentile(hist, 50) / 1000.0,
+               mb_hist_percentile(hist, 90) / 1000.0,
+               mb_hist_percentile(hist, 99) / 1000.0,
+               mb_hist_percentile(hist, 99.9) / 1000.0,
+               hist->max / 1000.0);
+    }
+    if (option.steady_state) {
+        printf("steady_state  %s [%d rounds]\n",
+               (result->ss_reached ? "reached" : "not reached"),
+               result->ss_nr_rounds);
+    }
+}
+
+/* member @name of metrics with percentiles of @hist in usec */
+static void
+print_hist_json(const char *name, mb_hist_t *hist)
+{
+    printf(",\n\
+    \"%s\": {\n\
+      \"min\": %lf,\n\
+      \"avg\": %lf,\n\
+      \"p50\": %lf,\n\
+      \"p90\": %lf,\n\
+      \"p99\": %lf,\n\
+      \"p99.9\": %lf,\n\
+      \"max\": %lf\n\
+    }",
+           name,
+           hist->min / 1000.0,
+           (double) hist->sum / hist->count / 1000.0,
+           mb_hist_percentile(hist, 50) / 1000.0,
+           mb_hist_percentile(hist, 90) / 1000.0,
+           mb_hist_percentile(hist, 99) / 1000.0,
+           mb_hist_percentile(hist, 99.9) / 1000.0,
+           hist->max / 1000.0);
+}
+
+/* counters and metrics members of JSON output */
+static void
+print_metrics_json(result_t *result)
+{
+    int i;
+
+    printf("\
+  \"counters\": {\n\
+    \"io_count\": %ld,\n\
+    \"io_bytes\": %ld\n\
+  },\n\
+  \"metrics\": {\n\
+    \"start_time_unix\": %lf,\n\
+    \"exec_time_sec\": %lf,\n\
+    \"iops\": %lf,\n\
+    \"transfer_rate_mbps\": %lf,\n\
+    \"response_time_msec\": %lf,\n\
+    \"accum_io_time_sec\": %lf",
+           result->io_count,
+           result->io_bytes,
+           result->start_time,
+           result->exec_time,
+           result->iops,
+           result->bandwidth / MEBI,
+           result->response_time * 1000.0,
+           result->iowait_time
+        );
+    if (result->flush_count > 0) {
+        printf(",\n\
+    \"flush_count\": %ld,\n\
+    \"flush_latency_msec\": %lf",
+               result->flush_count,
+               result->flush_time * 1000.0 / result->flush_count);
+    }
+    for (i = 0; i < MB_NR_SPACE_OPS; i++) {
+        if (result->space_count[i] == 0) continue;
+        printf(",\n\
+    \"%s_count\": %ld,\n\
+    \"%s_latency_msec\": %lf",
+               space_op_names[i], result->space_count[i],
+               space_op_names[i], result->space_time[i] * 1000.0 / result->space_count[i]);
+    }
+    if (result->cache_pages > 0) {
+        printf(",\n\
+    \"cache_sampled_pages\": %ld,\n\
+    \"cache_hit_ratio\": %lf",
+               result->cache_pages,
+               (double) result->cache_hits / result->cache_pages);
+    }
+    if (result->lat_hist != NULL && result->lat_hist->count > 0
+        && option.pattern == PATTERN_WAL) {
+        printf(",\n\
+    \"commits_per_sec\": %lf,\n\
+    \"records_per_group_commit\": %lf",
+               result->iops,
+               (result->flush_count > 0 ?
+                (double) result->io_count / result->flush_count : 0.0));
+        print_hist_json("commit_latency_usec", result->lat_hist);
+    } else if (result->lat_hist != NULL && result->lat_hist->count > 0) {
+        printf(",\n\
+    \"files_per_sec\": %lf",
+               result->iops);
+        print_hist_json("file_latency_usec", result->lat_hist);
+    }
+    printf("\n  }");
+}
+
+/* members of JSON output of a group, without enclosing braces */
+static void
+print_result_json_members(result_t *result, bool only_params)
+{
+    const char *pattern_str;
+    char *files_str;
+    char *files_str_ptr;
+    size_t files_str_len;
+
+    switch(option.pattern) {
+    case PATTERN_SEQ:
+        pattern_str = "sequential";
+        break;
+    case PATTERN_RAND:
+        pattern_str = "random";
+        break;
+    case PATTERN_SEEKDIST:
+        pattern_str = "seekdist";
+        break;
+    case PATTERN_SEEKINCR:
+        pattern_str = "seekincr";
+        break;
+    case PATTERN_WAL:
+        pattern_str = "wal";
+        break;
+    case PATTERN_SMALLFILE:
+        pattern_str = "smallfile";
+        break;
+    default:
+        pattern_str = "(unknown)";
+        break;
+    }
+
+    files_str_len = 4;
+    if (NULL == (files_str = malloc(files_str_len))) {
+        perror("malloc failed.");
+        exit(EXIT_FAILURE);
+    }
+    files_str[0] = '[';
+    files_str_ptr = files_str + 1;
+    for (int i = 0; i < option.nr_files; i++) {
+        int n;
+        if (i == 0) {
+            n = snprintf(files_str_ptr, files_str_len - 2 - (files_str_ptr - files_str),
+                         "\"%s\"", option.file_path_list[i]);
+        } else {
+            n = snprintf(files_str_ptr, files_str_len - 2 - (files_str_ptr - files_str),
+                         ", \"%s\"", option.file_path_list[i]);
+        }
+        if (n >= files_str_len - 2 - (files_str_ptr - files_str)) {
+            size_t ofst = files_str_ptr - files_str;
+
+            files_str_len *= 2;
+            files_str = realloc(files_str, files_str_len);
+            files_str_ptr = files_str + ofst;
+            i--;
+            continue;
+        } else {
+            files_str_ptr += n;
+        }
+    }
+    *files_str_ptr = ']';
+    *(files_str_ptr + 1) = '\0';
+
+    printf("\
+  \"params\": {\n\
+    \"threads\": %d,\n\
+    \"mode\": \"%s\",\n\
+    \"pattern\": \"%s\",\n\
+    \"blocksize_byte\": %d,\n\
+    \"offset_start_blk\": %ld,\n\
+    \"offset_end_blk\": %ld,\n\
+    \"direct\": %s,\n\
+    \"aio\": %s,\n\
+    \"aio_nr_events\": %d,\n\
+    \"aio_engine\": \"%s\",\n\
+    \"hugepage\": %s,\n\
+    \"timeout_sec\": %d,\n\
+    \"bogus_comp\": %ld,\n\
+    \"iosleep\": %d,\n\
+    \"files\": %s",
+           option.multi,
+           (option.read ? "read" :
+            option.write ? "write" : "mix"),
+           pattern_str,
+           option.blk_sz,
+           option.ofst_start,
+           option.ofst_end,
+           (option.direct ? "true" : "false"),
+           (option.aio ? "true" : "false"),
+           option.aio_nr_events,
+           (option.aio_engine == AIO_LIBAIO ? "libaio" : "io_uring" ),
+           (option.hugepage ? "true" : "false"),
+           option.timeout,
+           option.bogus_comp,
+           option.iosleep,
+           files_str
+        );
+    if (option.replay_path != NULL) {
+        printf(",\n\
+    \"replay\": \"%s\",\n\
+    \"replay_afap\": %s,\n\
+    \"replay_requests\": %d",
+               option.replay_path,
+               (option.replay_afap ? "true" : "false"),
+               option.nr_replay_recs);
+    }
+    if (option.precondition > 0) {
+        printf(",\n\
+    \"precondition\": %d",
+               option.precondition);
+    }
+    if (option.warmup > 0 || option.rampdown > 0) {
+        printf(",\n\
+    \"warmup_sec\": %lf,\n\
+    \"rampdown_sec\": %lf",
+               option.warmup,
+               option.rampdown);
+    }
+    if (option.thread_iops > 0 || option.thread_bw > 0) {
+        printf(",\n\
+    \"thread_iops_limit\": %ld,\n\
+    \"thread_bw_limit_byte\": %ld",
+               option.thread_iops,
+               option.thread_bw);
+    }
+    if (mb_throttle_enabled(&option)) {
+        printf(",\n\
+    \"file_limits\": [");
+        for (int i = 0; i < option.nr_files; i++) {
+            printf("%s{\"iops\": %ld, \"bw_byte\": %ld}",
+                   (i == 0 ? "" : ", "),
+                   option.file_iops_list[i],
+                   option.file_bw_list[i]);
+        }
+        printf("]");
+    }
+    if (mb_flush_enabled(&option)) {
+        printf(",\n\
+    \"flush_every\": %d,\n\
+    \"flush_interval_msec\": %d,\n\
+    \"flush_op\": \"%s\"",
+               option.flush_every,
+               option.flush_interval,
+               mb_flush_op_str(option.flush_op));
+    }
+    if (option.dsync) {
+        printf(",\n\
+    \"dsync\": true");
+    }
+    if (option.drop_cache) {
+        printf(",\n\
+    \"drop_cache\": true");
+    }
+    if (option.prefetch) {
+        printf(",\n\
+    \"prefetch\": true");
+    }
+    if (option.fadvise >= 0) {
+        printf(",\n\
+    \"fadvise\": \"%s\"",
+               mb_fadvise_str(option.fadvise));
+    }
+    if (option.readahead_kb >= 0) {
+        printf(",\n\
+    \"readahead_kb\": %d",
+               option.readahead_kb);
+    }
+    if (option.cache_sample > 0) {
+        printf(",\n\
+    \"cache_sample_every\": %d",
+               option.cache_sample);
+    }
+    if (option.trim_ratio > 0 || option.zero_ratio > 0 || option.alloc_ratio > 0) {
+        printf(",\n\
+    \"trim_ratio\": %lf,\n\
+    \"zero_ratio\": %lf,\n\
+    \"alloc_ratio\": %lf",
+               option.trim_ratio,
+               option.zero_ratio,
+               option.alloc_ratio);
+    }
+    if (option.pattern == PATTERN_WAL) {
+        printf(",\n\
+    \"wal_record_min_byte\": %d,\n\
+    \"wal_record_max_byte\": %d,\n\
+    \"commit_delay_usec\": %d,\n\
+    \"flush_op\": \"%s\"",
+               option.wal_rec_min,
+               option.wal_rec_max,
+               option.commit_delay,
+               mb_flush_op_str(option.flush_op));
+    }
+    if (option.pattern == PATTERN_SMALLFILE) {
+        printf(",\n\
+    \"small_files\": %d,\n\
+    \"small_file_min_byte\": %ld,\n\
+    \"small_file_max_byte\": %ld",
+               option.nr_small_files,
+               option.small_file_min,
+               option.small_file_max);
+        if (! option.read) {
+            printf(",\n\
+    \"flush_op\": \"%s\"",
+                   mb_flush_op_str(option.flush_op));
+        }
+    }
+    if (option.steady_state) {
+        printf(",\n\
+    \"steady_state_round_sec\": %d,\n\
+    \"steady_state_window\": %d",
+               option.ss_round,
+               option.ss_window);
+    }
+    printf("\n  }");
+    free(files_str);
+
+    if (only_params == false) {
+        printf(",\n");
+        print_metrics_json(result);
+        if (option.steady_state) {
+            printf(",\n\
+  \"steady_state\": {\n\
+    \"reached\": %s,\n\
+    \"rounds\": %d,\n\
+    \"window_start_round\": %d,\n\
+    \"excursion\": %lf,\n\
+    \"slope_excursion\": %lf,\n\
+    \"round_iops\": [",
+                   (result->ss_reached ? "true" : "false"),
+                   result->ss_nr_rounds,
+                   result->ss_nr_rounds - option.ss_window,
+                   result->ss_excursion,
+                   result->ss_slope_excursion);
+            for (int i = 0; i < result->ss_nr_rounds; i++) {
+                printf("%s%lf", (i == 0 ? "" : ", "), result->ss_round_iops[i]);
+            }
+            printf("]\n  }");
+        }
+    }
+}
+
+void
+print_result_json(result_t *result, bool only_params)
+{
+    printf("{\n");
+    print_result_json_members(result, only_params);
+    if (only_params == false && option.sysstat) {
+        printf(",\n");
+        print_sysstat_json();
+    }
+    printf("\n}\n");
+}
+
+/*
+ * JSON output of a multi-group run: each group as in a single-group
+ * run, followed by counters and metrics of all groups combined.
+ */
+static void
+print_groups_json(result_t *results, result_t *total, bool only_params)
+{
+    int g;
+
+    printf("{\n  \"groups\": [\n");
+    for (g = 0; g < nr_groups; g++) {
+        option = groups[g];
+        printf("{\n");
+        print_result_json_members((results == NULL ? NULL : &results[g]),
+                                  only_params);
+        printf("\n}%s\n", (g < nr_groups - 1 ? "," : ""));
+    }
+    option = groups[0];
+    printf("  ]");
+    if (only_params == false) {
+        printf(",\n");
+        print_metrics_json(total);
+        if (option.sysstat) {
+            printf(",\n");
+            print_sysstat_json();
+        }
+    }
+    printf("\n}\n");
+}
+
+enum {
+    OPT_REPLAY = 256,
+    OPT_REPLAY_AFAP,
+    OPT_HUGEPAGE,
+    OPT_PRECONDITION,
+    OPT_STEADY_STATE,
+    OPT_SS_ROUND,
+    OPT_SS_WINDOW,
+    OPT_WARMUP,
+    OPT_RAMPDOWN,
+    OPT_THREAD_IOPS,
+    OPT_THREAD_BW,
+    OPT_FSYNC_EVERY,
+    OPT_FSYNC_INTERVAL,
+    OPT_FLUSH_OP,
+    OPT_DSYNC,
+    OPT_WAL,
+    OPT_WAL_RECORD,
+    OPT_COMMIT_DELAY,
+    OPT_TRIM_RATIO,
+    OPT_ZERO_RATIO,
+    OPT_ALLOC_RATIO,
+    OPT_SMALL_FILES,
+    OPT_SMALL_FILE_SIZE,
+    OPT_DROP_CACHE,
+    OPT_PREFETCH,
+    OPT_FADVISE,
+    OPT_READAHEAD,
+    OPT_CACHE_SAMPLE,
+    OPT_SYSSTAT,
+    OPT_SYSSTAT_INTERVAL,
+};
+
+static struct option long_options[] = {
+    {"replay",      required_argument, NULL, OPT_REPLAY},
+    {"replay-afap", no_argument,       NULL, OPT_REPLAY_AFAP},
+    {"hugepage",    no_argument,       NULL, OPT_HUGEPAGE},
+    {"precondition", required_argument, NULL, OPT_PRECONDITION},
+    {"steady-state", no_argument,       NULL, OPT_STEADY_STATE},
+    {"ss-round",    required_argument, NULL, OPT_SS_ROUND},
+    {"ss-window",   required_argument, NULL, OPT_SS_WINDOW},
+    {"warmup",      required_argument, NULL, OPT_WARMUP},
+    {"rampdown",    required_argument, NULL, OPT_RAMPDOWN},
+    {"thread-iops", required_argument, NULL, OPT_THREAD_IOPS},
+    {"thread-bw",   required_argument, NULL, OPT_THREAD_BW},
+    {"fsync-every", required_argument, NULL, OPT_FSYNC_EVERY},
+    {"fsync-interval", required_argument, NULL, OPT_FSYNC_INTERVAL},
+    {"flush-op",    required_argument, NULL, OPT_FLUSH_OP},
+    {"dsync",       no_argument,       NULL, OPT_DSYNC},
+    {"wal",         no_argument,       NULL, OPT_WAL},
+    {"wal-record",  required_argument, NULL, OPT_WAL_RECORD},
+    {"commit-delay", required_argument, NULL, OPT_COMMIT_DELAY},
+    {"trim-ratio",  required_argument, NULL, OPT_TRIM_RATIO},
+    {"zero-ratio",  required_argument, NULL, OPT_ZERO_RATIO},
+    {"alloc-ratio", required_argument, NULL, OPT_ALLOC_RATIO},
+    {"small-files", required_argument, NULL, OPT_SMALL_FILES},
+    {"small-file-size", required_argument, NULL, OPT_SMALL_FILE_SIZE},
+    {"drop-cache",  no_argument,       NULL, OPT_DROP_CACHE},
+    {"prefetch",    no_argument,       NULL, OPT_PREFETCH},
+    {"fadvise",     required_argument, NULL, OPT_FADVISE},
+    {"readahead",   required_argument, NULL, OPT_READAHEAD},
+    {"cache-sample", required_argument, NULL, OPT_CACHE_SAMPLE},
+    {"sysstat",     no_argument,       NULL, OPT_SYSSTAT},
+    {"sysstat-interval", required_argument, NULL, OPT_SYSSTAT_INTERVAL},
+    {NULL, 0, NULL, 0},
+};
+
+/*
+ * Parse a device or file argument: PATH[,iops=NUM][,bw=BYTES]. Rate
+ * limits are for the file as a whole, shared by all threads.
+ */
+static int
+mb_parse_file_spec(const char *arg, char **path, int64_t *iops, int64_t *bw)
+{
+    const char *spec;
+    char *endptr;
+
+    *iops = 0;
+    *bw = 0;
+    if ((spec = strchr(arg, ',')) == NULL) {
+        *path = strdup(arg);
+        return 0;
+    }
+    *path = strndup(arg, spec - arg);
+
+    while (*spec == ',') {
+        spec++;
+        if (strncmp(spec, "iops=", 5) == 0) {
+            *iops = strtoll(spec + 5, &endptr, 10);
+        } else if (strncmp(spec, "bw=", 3) == 0) {
+            *bw = strtoll(spec + 3, &endptr, 10);
+        } else {
+            return -1;
+        }
+        if (endptr == spec || (*endptr != ',' && *endptr != '\0')) {
+            return -1;
+        }
+        if (*iops < 0 || *bw < 0) {
+            return -1;
+        }
+        spec = endptr;
+    }
+
+    return 0;
+}
+
+// remember the first option of the whole run given in @option
+#define MB_RUN_OPT(option, name)                \
+    do {                                        \
+        if ((option)->run_opt == NULL) {        \
+            (option)->run_opt = (name);         \
+        }                                       \
+    } while (0)
+
+int
+parse_args(int argc, char **argv, micbench_io_option_t *option)
+{
+    int optchar;
+    int idx;
+    bool flush_op_given = false;
 
     // default values
     option->noop = false;
@@ -681,6 +2482,22 @@ parse_args(int argc, char **argv, micbench_io_option_t *option)
     option->timeout = 60;
     option->bogus_comp = 0;
     option->iosleep = 0;
+    option->thread_iops = 0;
+    option->thread_bw = 0;
+    option->flush_every = 0;
+    option->flush_interval = 0;
+    option->flush_op = FLUSH_FSYNC;
+    option->dsync = false;
+    option->drop_cache = false;
+    option->prefetch = false;
+    option->fadvise = -1;
+    option->readahead_kb = -1;
+    option->cache_sample = 0;
+    option->sysstat = false;
+    option->sysstat_interval = 0;
+    option->trim_ratio = 0.0;
+    option->zero_ratio = 0.0;
+    option->alloc_ratio = 0.0;
     option->read = true;
     option->write = false;
     option->rwmix = 0.0;
@@ -690,630 +2507,2036 @@ parse_args(int argc, char **argv, micbench_io_option_t *option)
     option->aio_engine = AIO_LIBAIO;
     option->aio_nr_events = 64;
     option->aio_tracefile = NULL;
+    option->hugepage = false;
+    option->precondition = 0;
+    option->steady_state = false;
+    option->ss_round = 10;
+    option->ss_window = 5;
+    option->warmup = 0;
+    option->rampdown = 0;
     option->blk_sz = 4 * KIBI;
     option->seekdist_stride = 16 * 1024;
+    option->wal_rec_min = 512;
+    option->wal_rec_max = 512;
+    option->commit_delay = 0;
+    option->nr_small_files = 0;
+    option->small_file_min = 4 * KIBI;
+    option->small_file_max = 4 * KIBI;
     option->ofst_start = -1;
     option->ofst_end = -1;
     option->misalign = 0;
     option->continue_on_error = false;
     option->logfile = NULL;
     option->logfile_path = NULL;
+    option->replay_path = NULL;
+    option->replay_afap = false;
+    option->nr_replay_recs = 0;
+    option->replay_max_sz = 0;
+    option->replay_recs = NULL;
     option->json = false;
     option->verbose = false;
+    option->run_opt = NULL;
     option->open_flags = O_RDONLY;
 
-    option->file_path_list = NULL;
-    option->file_size_list = NULL;
+    option->file_path_list = NULL;
+    option->file_size_list = NULL;
+    option->file_iops_list = NULL;
+    option->file_bw_list = NULL;
+    option->file_blkdev_list = NULL;
+
+    optind = 1;
+    while ((optchar = getopt_long(argc, argv, "+Nm:a:t:RSDIdAg:E:T:WM:b:s:e:B:z:c:i:Cl:jv",
+                                  long_options, NULL)) != -1){
+        switch(optchar){
+        case 'N': // noop
+            option->noop = true;
+            MB_RUN_OPT(option, "-N");
+            break;
+        case 'm': // multiplicity
+            option->multi = strtol(optarg, NULL, 10);
+            break;
+        case 'a': // affinity
+        {
+            mb_affinity_t *aff;
+
+            // check for -m option
+            for(idx = optind; idx < argc; idx++){
+                if (strcmp("-m", argv[idx]) == 0) {
+                    perror("-m option must be specified before -a.\n");
+                    goto error;
+                }
+            }
+            if (option->affinities == NULL){
+                option->affinities = malloc(sizeof(mb_affinity_t *) * option->multi);
+                bzero(option->affinities, sizeof(mb_affinity_t *) * option->multi);
+            }
+            if ((aff = mb_parse_affinity(NULL, optarg)) == NULL){
+                fprintf(stderr, "Invalid argument for -a: %s\n", optarg);
+                goto error;
+            }
+            aff->optarg = strdup(optarg);
+            option->affinities[aff->tid] = aff;
+        }
+            break;
+        case 't': // timeout
+            option->timeout = strtol(optarg, NULL, 10);
+            MB_RUN_OPT(option, "-t");
+            break;
+        case 'R': // random
+            option->pattern = PATTERN_RAND;
+            break;
+        case 'S': // sequential
+            option->pattern = PATTERN_SEQ;
+            break;
+        case 'D': // constant seek distance
+            option->pattern = PATTERN_SEEKDIST;
+            break;
+        case 'I': // increasing seek distance
+            option->pattern = PATTERN_SEEKINCR;
+            break;
+        case 'd': // direct IO
+            option->direct = true;
+            break;
+        case 'A': // Asynchronous IO
+            option->aio = true;
+            break;
+        case 'g': // AIO engine
+            if (strcmp(optarg, "libaio") == 0) {
+                option->aio_engine = AIO_LIBAIO;
+            } else if (strcmp(optarg, "io_uring") == 0) {
+#ifdef HAVE_IO_URING
+                option->aio_engine = AIO_IOURING;
+#else
+                fprintf(stderr, "[ERROR] io_uring is not avaiable on this platform\n");
+                goto error;
+#endif
+            } else {
+                fprintf(stderr, "[ERROR] no such AIO engine: %s\n", optarg);
+                goto error;
+            }
+            break;
+        case 'E': // AIO nr_events for each thread
+            option->aio_nr_events = strtol(optarg, NULL, 10);
+            break;
+        case 'T': // AIO trace log file
+            option->aio_tracefile = strdup(optarg);
+            MB_RUN_OPT(option, "-T");
+            break;
+        case 'W': // write
+            option->write = true;
+            option->read = false;
+            break;
+        case 'M': // read/write mixture (0 = 100% read, 1.0 = 100% write)
+            option->rwmix = strtod(optarg, NULL);
+            option->read = false;
+            option->write = false;
+            if (option->rwmix < 0)   option->rwmix = 0.0;
+            if (option->rwmix > 1.0) option->rwmix = 1.0;
+            break;
+        case 'b': // block size
+            option->blk_sz = strtol(optarg, NULL, 10);
+            break;
+        case 's': // start block
+            option->ofst_start = strtol(optarg, NULL, 10);
+            break;
+        case 'e': // end block
+            option->ofst_end = strtol(optarg, NULL, 10);
+            break;
+        case 'B': // stride size of seekdist
+            option->seekdist_stride = strtol(optarg, NULL, 10);
+            break;
+        case 'z': // misalignment
+            option->misalign = strtol(optarg, NULL, 10);
+            break;
+        case 'c': // # of computation operated between each IO
+            option->bogus_comp = strtol(optarg, NULL, 10);
+            break;
+        case 'i': // call usleep(3) for each I/O submission
+            option->iosleep = strtol(optarg, NULL, 10);
+            break;
+        case 'C': // ontinue on error
+            option->continue_on_error = true;
+            break;
+        case 'l': // logfile
+            option->logfile_path = strdup(optarg);
+            break;
+        case 'j': // json print mode
+            option->json = true;
+            MB_RUN_OPT(option, "-j");
+            break;
+        case 'v': // verbose
+            option->verbose = true;
+            break;
+        case OPT_REPLAY: // replay I/O activity log
+            option->replay_path = strdup(optarg);
+            break;
+        case OPT_REPLAY_AFAP: // replay as fast as possible
+            option->replay_afap = true;
+            break;
+        case OPT_HUGEPAGE: // huge page backed I/O buffers
+            option->hugepage = true;
+            break;
+        case OPT_PRECONDITION: // # of sequential fill passes
+            option->precondition = strtol(optarg, NULL, 10);
+            break;
+        case OPT_STEADY_STATE: // steady state detection
+            option->steady_state = true;
+            break;
+        case OPT_SS_ROUND: // length of a round in steady state detection
+            option->ss_round = strtol(optarg, NULL, 10);
+            break;
+        case OPT_SS_WINDOW: // # of rounds in measurement window
+            option->ss_window = strtol(optarg, NULL, 10);
+            break;
+        case OPT_WARMUP: // warm-up period not accounted
+            option->warmup = strtod(optarg, NULL);
+            MB_RUN_OPT(option, "--warmup");
+            break;
+        case OPT_RAMPDOWN: // ramp-down period not accounted
+            option->rampdown = strtod(optarg, NULL);
+            MB_RUN_OPT(option, "--rampdown");
+            break;
+        case OPT_THREAD_IOPS: // IOPS limit of each thread
+        {
+            char *endptr;
+
+            option->thread_iops = strtoll(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0') {
+                fprintf(stderr, "Invalid --thread-iops: %s\n", optarg);
+                goto error;
+            }
+            break;
+        }
+        case OPT_THREAD_BW: // bandwidth limit of each thread
+        {
+            char *endptr;
+
+            option->thread_bw = strtoll(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0') {
+                fprintf(stderr, "Invalid --thread-bw: %s\n", optarg);
+                goto error;
+            }
+            break;
+        }
+        case OPT_FSYNC_EVERY: // flush after every N writes
+            option->flush_every = strtol(optarg, NULL, 10);
+            break;
+        case OPT_FSYNC_INTERVAL: // flush every N msec
+            option->flush_interval = strtol(optarg, NULL, 10);
+            break;
+        case OPT_FLUSH_OP: // system call used to flush
+            if (strcmp(optarg, "fsync") == 0) {
+                option->flush_op = FLUSH_FSYNC;
+            } else if (strcmp(optarg, "fdatasync") == 0) {
+                option->flush_op = FLUSH_FDATASYNC;
+            } else if (strcmp(optarg, "sync_file_range") == 0) {
+                option->flush_op = FLUSH_SYNC_FILE_RANGE;
+            } else {
+                fprintf(stderr, "Invalid --flush-op: %s\n", optarg);
+                goto error;
+            }
+            flush_op_given = true;
+            break;
+        case OPT_DSYNC: // open with O_DSYNC
+            option->dsync = true;
+            break;
+        case OPT_DROP_CACHE: // drop cached pages of targets
+            option->drop_cache = true;
+            break;
+        case OPT_PREFETCH: // read targets into page cache
+            option->prefetch = true;
+            break;
+        case OPT_FADVISE: // access pattern hint
+            if (strcmp(optarg, "normal") == 0) {
+                option->fadvise = POSIX_FADV_NORMAL;
+            } else if (strcmp(optarg, "random") == 0) {
+                option->fadvise = POSIX_FADV_RANDOM;
+            } else if (strcmp(optarg, "sequential") == 0) {
+                option->fadvise = POSIX_FADV_SEQUENTIAL;
+            } else if (strcmp(optarg, "noreuse") == 0) {
+                option->fadvise = POSIX_FADV_NOREUSE;
+            } else {
+                fprintf(stderr, "Invalid --fadvise: %s\n", optarg);
+                goto error;
+            }
+            break;
+        case OPT_READAHEAD: // readahead of devices in KiB
+        {
+            char *endptr;
+
+            option->readahead_kb = strtol(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0') {
+                fprintf(stderr, "Invalid --readahead: %s\n", optarg);
+                goto error;
+            }
+            if (option->readahead_kb < 0) {
+                fprintf(stderr, "--readahead must not be negative.\n");
+                goto error;
+            }
+            break;
+        }
+        case OPT_CACHE_SAMPLE: // sample page cache residency every N reads
+        {
+            char *endptr;
+
+            option->cache_sample = strtol(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0') {
+                fprintf(stderr, "Invalid --cache-sample: %s\n", optarg);
+                goto error;
+            }
+            break;
+        }
+        case OPT_SYSSTAT: // sample device and CPU counters
+            option->sysstat = true;
+            break;
+        case OPT_SYSSTAT_INTERVAL: // and also every N msec
+        {
+            char *endptr;
+
+            option->sysstat = true;
+            option->sysstat_interval = strtol(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0') {
+                fprintf(stderr, "Invalid --sysstat-interval: %s\n", optarg);
+                goto error;
+            }
+            if (option->sysstat_interval < 0) {
+                fprintf(stderr, "--sysstat-interval must not be negative.\n");
+                goto error;
+            }
+            break;
+        }
+        case OPT_WAL: // write-ahead log with group commit
+            option->pattern = PATTERN_WAL;
+            break;
+        case OPT_WAL_RECORD: // record size range MIN[,MAX] in bytes
+        {
+            char *endptr;
+
+            option->wal_rec_min = strtol(optarg, &endptr, 10);
+            if (*endptr == ',') {
+                option->wal_rec_max = strtol(endptr + 1, &endptr, 10);
+            } else {
+                option->wal_rec_max = option->wal_rec_min;
+            }
+            if (*endptr != '\0') {
+                fprintf(stderr, "Invalid --wal-record: %s\n", optarg);
+                goto error;
+            }
+            break;
+        }
+        case OPT_COMMIT_DELAY: // leader waits for followers
+            option->commit_delay = strtol(optarg, NULL, 10);
+            break;
+        case OPT_TRIM_RATIO: // ratio of trims
+            option->trim_ratio = strtod(optarg, NULL);
+            break;
+        case OPT_ZERO_RATIO: // ratio of zeroings
+            option->zero_ratio = strtod(optarg, NULL);
+            break;
+        case OPT_ALLOC_RATIO: // ratio of allocations
+            option->alloc_ratio = strtod(optarg, NULL);
+            break;
+        case OPT_SMALL_FILES: // # of small files of each thread
+            option->pattern = PATTERN_SMALLFILE;
+        {
+            char *endptr;
+
+            option->nr_small_files = strtol(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0') {
+                fprintf(stderr, "Invalid --small-files: %s\n", optarg);
+                goto error;
+            }
+            break;
+        }
+        case OPT_SMALL_FILE_SIZE: // file size range MIN[,MAX] in bytes
+        {
+            char *endptr;
+
+            option->small_file_min = strtoll(optarg, &endptr, 10);
+            if (*endptr == ',') {
+                option->small_file_max = strtoll(endptr + 1, &endptr, 10);
+            } else {
+                option->small_file_max = option->small_file_min;
+            }
+            if (*endptr != '\0') {
+                fprintf(stderr, "Invalid --small-file-size: %s\n", optarg);
+                goto error;
+            }
+            break;
+        }
+        default:
+            fprintf(stderr, "Unknown option '-%c'\n", optchar);
+            goto error;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "Device or file is not specified.\n");
+        goto error;
+    }
+
+    option->nr_files = argc - optind;
+    option->file_path_list = malloc(sizeof(char *) * option->nr_files);
+    option->file_size_list = malloc(sizeof(int64_t) * option->nr_files);
+    option->file_iops_list = malloc(sizeof(int64_t) * option->nr_files);
+    option->file_bw_list = malloc(sizeof(int64_t) * option->nr_files);
+    option->file_blkdev_list = malloc(sizeof(bool) * option->nr_files);
+
+    for (idx = 0; idx + optind < argc; idx++) {
+        char *path;
+
+        if (mb_parse_file_spec(argv[optind + idx], &path,
+                               &option->file_iops_list[idx],
+                               &option->file_bw_list[idx]) != 0) {
+            fprintf(stderr, "Invalid device or file: %s\n", argv[optind + idx]);
+            goto error;
+        }
+        option->file_path_list[idx] = path;
+
+        struct stat statbuf;
+        // small files are created in the directory; it has no size to check
+        if (option->pattern == PATTERN_SMALLFILE) {
+            if (! (stat(path, &statbuf) == 0 && S_ISDIR(statbuf.st_mode))) {
+                fprintf(stderr, "--small-files requires a directory: %s\n", path);
+                goto error;
+            }
+            option->file_size_list[idx] = 0;
+            option->file_blkdev_list[idx] = false;
+            continue;
+        }
+
+        int64_t path_sz = mb_getsize(path);
+        if (option->blk_sz * option->ofst_start > path_sz){
+            fprintf(stderr, "Too big --offset-start. Maximum: %ld\n",
+                    path_sz / option->blk_sz);
+            goto error;
+        }
+        if (option->blk_sz * option->ofst_end > path_sz) {
+            fprintf(stderr, "Too big --offset-end. Maximum: %ld\n",
+                    path_sz / option->blk_sz);
+            goto error;
+        }
+
+        option->file_size_list[idx] = path_sz;
+
+        option->file_blkdev_list[idx] = (stat(path, &statbuf) == 0
+                                         && S_ISBLK(statbuf.st_mode));
+    }
+
+    // a log is only appended
+    if (option->pattern == PATTERN_WAL) {
+        option->read = false;
+        option->write = true;
+        if (! flush_op_given) {
+            option->flush_op = FLUSH_FDATASYNC;
+        }
+    }
+
+    // replayed requests decide whether reads and/or writes are issued
+    if (option->replay_path != NULL) {
+        if (mb_replay_load(option->replay_path, option) != 0) {
+            goto error;
+        }
+    }
+
+    // files in directories of small file mode are checked on creation
+    for (idx = 0; idx < option->nr_files && option->noop == false
+             && option->pattern != PATTERN_SMALLFILE; idx++) {
+        int fd;
+        char *path;
+
+        path = option->file_path_list[idx];
+        if (option->precondition > 0) {
+            if ((fd = open(path, O_WRONLY)) == -1) {
+                fprintf(stderr, "Cannot open %s with O_WRONLY for preconditioning\n", path);
+                goto error;
+            }
+            close(fd);
+        }
+        if (option->read) {
+            if ((fd = open(path, O_RDONLY)) == -1) {
+                fprintf(stderr, "Cannot open %s with O_RDONLY\n", path);
+                goto error;
+            }
+            close(fd);
+        } else if (option->write) {
+            if ((fd = open(path, O_WRONLY)) == -1) {
+                fprintf(stderr, "Cannot open %s with O_WRONLY\n", path);
+                goto error;
+            }
+            close(fd);
+        } else {
+            if ((fd = open(path, O_RDWR)) == -1) {
+                fprintf(stderr, "Cannot open %s with O_RDWR\n", path);
+                goto error;
+            }
+            close(fd);
+        }
+    }
+
+    if (option->direct && option->blk_sz % 512) {
+        fprintf(stderr, "--direct specified. Block size must be multiples of block size of devices.\n");
+        goto error;
+    }
+    if (option->direct && getuid() != 0) {
+        fprintf(stderr, "You must be root to use --direct\n");
+        goto error;
+    }
+
+    // check device
+
+    if (option->warmup < 0 || option->rampdown < 0) {
+        fprintf(stderr, "--warmup and --rampdown must not be negative.\n");
+        goto error;
+    }
+    if (option->warmup + option->rampdown >= option->timeout) {
+        fprintf(stderr, "--warmup plus --rampdown must be shorter than the timeout.\n");
+        goto error;
+    }
+    if (option->replay_path != NULL && (option->warmup > 0 || option->rampdown > 0)) {
+        fprintf(stderr, "--warmup and --rampdown cannot be used with --replay.\n");
+        goto error;
+    }
+    if (option->thread_iops < 0 || option->thread_bw < 0) {
+        fprintf(stderr, "--thread-iops and --thread-bw must not be negative.\n");
+        goto error;
+    }
+    if (option->replay_path != NULL && mb_throttle_enabled(option)) {
+        fprintf(stderr, "Rate limits cannot be used with --replay.\n");
+        goto error;
+    }
+    if (option->flush_every < 0 || option->flush_interval < 0) {
+        fprintf(stderr, "--fsync-every and --fsync-interval must not be negative.\n");
+        goto error;
+    }
+    if (option->dsync && option->read) {
+        fprintf(stderr, "--dsync needs write or mix mode.\n");
+        goto error;
+    }
+    if (mb_flush_enabled(option)) {
+        if (option->read) {
+            fprintf(stderr, "--fsync-every and --fsync-interval need write mode.\n");
+            goto error;
+        }
+        if (option->replay_path != NULL) {
+            fprintf(stderr, "--fsync-every and --fsync-interval cannot be used with --replay.\n");
+            goto error;
+        }
+        if (option->aio && option->aio_engine == AIO_LIBAIO
+            && option->flush_op == FLUSH_SYNC_FILE_RANGE) {
+            fprintf(stderr, "--flush-op=sync_file_range is not supported by libaio.\n");
+            goto error;
+        }
+    }
+    if (option->trim_ratio < 0 || option->zero_ratio < 0 || option->alloc_ratio < 0
+        || option->trim_ratio + option->zero_ratio + option->alloc_ratio > 1.0) {
+        fprintf(stderr, "--trim-ratio, --zero-ratio and --alloc-ratio must not be negative"
+                " and must sum up to 1.0 or less.\n");
+        goto error;
+    }
+    if (option->trim_ratio > 0 || option->zero_ratio > 0 || option->alloc_ratio > 0) {
+        if (option->read) {
+            fprintf(stderr, "Trims, zeroings and allocations need write or mix mode.\n");
+            goto error;
+        }
+        if (option->replay_path != NULL || option->pattern == PATTERN_WAL) {
+            fprintf(stderr, "Trims, zeroings and allocations cannot be used with --replay or --wal.\n");
+            goto error;
+        }
+        for (idx = 0; idx < option->nr_files; idx++) {
+            if (option->alloc_ratio > 0 && option->file_blkdev_list[idx]) {
+                fprintf(stderr, "--alloc-ratio is not supported on block device: %s\n",
+                        option->file_path_list[idx]);
+                goto error;
+            }
+            if (option->misalign != 0 && option->file_blkdev_list[idx]) {
+                fprintf(stderr, "--misalign cannot be used with trims or zeroings"
+                        " on block device: %s\n",
+                        option->file_path_list[idx]);
+                goto error;
+            }
+        }
+    }
+    if (option->pattern == PATTERN_WAL) {
+        if (option->wal_rec_min <= 0 || option->wal_rec_max < option->wal_rec_min) {
+            fprintf(stderr, "--wal-record must be MIN[,MAX] with 0 < MIN <= MAX.\n");
+            goto error;
+        }
+        if (option->nr_files != 1) {
+            fprintf(stderr, "--wal requires exactly one device or file.\n");
+            goto error;
+        }
+        if ((option->ofst_end >= 0 ? option->ofst_end * option->blk_sz : option->file_size_list[0])
+            - (option->ofst_start >= 0 ? option->ofst_start * option->blk_sz : 0)
+            < (int64_t) option->wal_rec_max * option->multi + option->blk_sz) {
+            fprintf(stderr, "Too small log area for --wal.\n");
+            goto error;
+        }
+        if (option->aio || option->replay_path != NULL || option->steady_state
+            || mb_flush_enabled(option)) {
+            fprintf(stderr, "--wal cannot be used with -A, --replay, --steady-state,"
+                    " --fsync-every or --fsync-interval.\n");
+            goto error;
+        }
+    }
+    if (option->pattern == PATTERN_SMALLFILE) {
+        if (option->nr_small_files <= 0) {
+            fprintf(stderr, "--small-files must be positive.\n");
+            goto error;
+        }
+        if (option->small_file_min <= 0 || option->small_file_max < option->small_file_min) {
+            fprintf(stderr, "--small-file-size must be MIN[,MAX] with 0 < MIN <= MAX.\n");
+            goto error;
+        }
+        if (option->nr_files != 1) {
+            fprintf(stderr, "--small-files requires exactly one directory.\n");
+            goto error;
+        }
+        if (option->aio && option->aio_engine == AIO_LIBAIO) {
+            fprintf(stderr, "--small-files with -A requires -g io_uring.\n");
+            goto error;
+        }
+        if (option->replay_path != NULL || option->precondition > 0
+            || mb_flush_enabled(option)
+            || option->trim_ratio > 0 || option->zero_ratio > 0 || option->alloc_ratio > 0) {
+            fprintf(stderr, "--small-files cannot be used with --replay, --precondition,"
+                    " --fsync-every, --fsync-interval or trims, zeroings and allocations.\n");
+            goto error;
+        }
+    }
+    if (option->cache_sample < 0) {
+        fprintf(stderr, "--cache-sample must not be negative.\n");
+        goto error;
+    }
+    if (option->cache_sample > 0 && option->write) {
+        fprintf(stderr, "--cache-sample needs read or mix mode.\n");
+        goto error;
+    }
+    if ((option->drop_cache || option->prefetch || option->readahead_kb >= 0
+         || option->cache_sample > 0)
+        && (option->pattern == PATTERN_SMALLFILE || option->replay_path != NULL)) {
+        fprintf(stderr, "--drop-cache, --prefetch, --readahead and --cache-sample"
+                " cannot be used with --small-files or --replay.\n");
+        goto error;
+    }
+    if (option->precondition < 0) {
+        fprintf(stderr, "--precondition must be 0 or more.\n");
+        goto error;
+    }
+    if (option->steady_state) {
+        if (option->ss_round <= 0 || option->ss_window < 2) {
+            fprintf(stderr, "--ss-round must be positive and --ss-window must be 2 or more.\n");
+            goto error;
+        }
+        if (option->timeout < option->ss_round * option->ss_window) {
+            fprintf(stderr, "Timeout must be longer than --ss-round * --ss-window.\n");
+            goto error;
+        }
+        if (option->replay_path != NULL) {
+            fprintf(stderr, "Steady state detection cannot be used with --replay.\n");
+            goto error;
+        }
+    }
+
+    // aio trace log
+    if (option->aio_tracefile != NULL && option->aio == false) {
+        fprintf(stderr, "AIO trace log should not be recorded without async mode.\n");
+        goto error;
+    }
+
+    if (option->logfile_path != NULL) {
+        option->logfile = fopen(option->logfile_path, "w");
+        if (option->logfile == NULL) {
+            fprintf(stderr, "Failed to open log file for write: %s\n", option->logfile_path);
+            goto error;
+        }
+    }
+
+    return 0;
+
+error:
+    if (option->file_path_list != NULL) {
+        free(option->file_path_list);
+        option->file_path_list = NULL;
+    }
+    if (option->file_size_list != NULL) {
+        free(option->file_size_list);
+        option->file_size_list = NULL;
+    }
+    if (option->file_iops_list != NULL) {
+        free(option->file_iops_list);
+        option->file_iops_list = NULL;
+    }
+    if (option->file_bw_list != NULL) {
+        free(option->file_bw_list);
+        option->file_bw_list = NULL;
+    }
+    if (option->file_blkdev_list != NULL) {
+        free(option->file_blkdev_list);
+        option->file_blkdev_list = NULL;
+    }
+
+    return 1;
+}
+
+void
+mb_set_option(micbench_io_option_t *option_)
+{
+    memcpy(&option, option_, sizeof(micbench_io_option_t));
+}
+
+static int
+mb_replay_rec_cmp(const void *ptr1, const void *ptr2)
+{
+    const mb_replay_rec_t *rec1 = (const mb_replay_rec_t *) ptr1;
+    const mb_replay_rec_t *rec2 = (const mb_replay_rec_t *) ptr2;
+
+    if (rec1->issue_usec < rec2->issue_usec) {
+        return -1;
+    } else if (rec1->issue_usec > rec2->issue_usec) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Load an I/O activity log written by mb_log_io_activity. Lines are
+ * "issue_usec complete_usec rel_usec rt file addr size [R|W]"; logs
+ * without the last column are replayed with the mode given by
+ * -W/-M. Files not in @option->file_path_list are mapped onto it in
+ * the order of appearance. Blank lines and lines beginning with '#'
+ * are ignored.
+ *
+ * return -1 on error, 0 on success
+ */
+int
+mb_replay_load(const char *path, micbench_io_option_t *option)
+{
+    FILE *file;
+    char line[4096];
+    char file_path[4096];
+    char **log_files;
+    int nr_log_files;
+    mb_replay_rec_t *recs;
+    int nr_recs;
+    int nr_alloc;
+    long lineno;
+    int nr_writes;
+    int64_t base_usec;
+    int i;
+
+    if ((file = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Failed to open I/O log for replay: %s\n", path);
+        return -1;
+    }
+
+    log_files = NULL;
+    nr_log_files = 0;
+    recs = NULL;
+    nr_recs = 0;
+    nr_alloc = 0;
+    nr_writes = 0;
+    lineno = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        long issue_usec, complete_usec, rel_usec;
+        double rt;
+        long addr;
+        int size;
+        char op;
+        int n;
+        mb_replay_rec_t *rec;
+
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+
+        n = sscanf(line, "%ld %ld %ld %lf %4095s %ld %d %c",
+                   &issue_usec, &complete_usec, &rel_usec, &rt,
+                   file_path, &addr, &size, &op);
+        if (n < 7) {
+            fprintf(stderr, "%s:%ld: malformed I/O log entry\n", path, lineno);
+            goto error;
+        }
+
+        if (nr_recs == nr_alloc) {
+            nr_alloc = (nr_alloc == 0 ? 1024 : nr_alloc * 2);
+            recs = realloc(recs, sizeof(mb_replay_rec_t) * nr_alloc);
+            if (recs == NULL) {
+                perror("realloc failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        rec = &recs[nr_recs];
+
+        rec->issue_usec = issue_usec;
+        rec->addr = addr;
+        rec->size = size;
+
+        if (n == 8 && op == 'R') {
+            rec->mode = MB_DO_READ;
+        } else if (n == 8 && op == 'W') {
+            rec->mode = MB_DO_WRITE;
+        } else if (n == 8) {
+            fprintf(stderr, "%s:%ld: unknown I/O mode '%c'\n", path, lineno, op);
+            goto error;
+        } else {
+            rec->mode = (option->read == true ? MB_DO_READ :
+                         option->write == true ? MB_DO_WRITE :
+                         (option->rwmix < drand48() ? MB_DO_READ :
+                          MB_DO_WRITE));
+        }
+
+        // map the file in the log onto target files
+        rec->file_idx = -1;
+        for (i = 0; i < option->nr_files; i++) {
+            if (strcmp(option->file_path_list[i], file_path) == 0) {
+                rec->file_idx = i;
+                break;
+            }
+        }
+        if (rec->file_idx == -1) {
+            for (i = 0; i < nr_log_files; i++) {
+                if (strcmp(log_files[i], file_path) == 0) {
+                    break;
+                }
+            }
+            if (i == nr_log_files) {
+                log_files = realloc(log_files, sizeof(char *) * (nr_log_files + 1));
+                log_files[nr_log_files++] = strdup(file_path);
+            }
+            rec->file_idx = i % option->nr_files;
+        }
+
+        if (rec->addr < 0 || rec->size <= 0 ||
+            rec->addr + rec->size > option->file_size_list[rec->file_idx]) {
+            fprintf(stderr, "%s:%ld: request out of range of %s\n",
+                    path, lineno, option->file_path_list[rec->file_idx]);
+            goto error;
+        }
+        if (option->direct && (rec->addr % 512 || rec->size % 512)) {
+            fprintf(stderr, "%s:%ld: request is not aligned for --direct\n", path, lineno);
+            goto error;
+        }
+
+        if (rec->size > option->replay_max_sz) {
+            option->replay_max_sz = rec->size;
+        }
+        if (rec->mode == MB_DO_WRITE) {
+            nr_writes++;
+        }
+        nr_recs++;
+    }
+
+    if (nr_recs == 0) {
+        fprintf(stderr, "No I/O request in %s\n", path);
+        goto error;
+    }
+
+    // the log is written in order of completion, not of issue
+    qsort(recs, nr_recs, sizeof(mb_replay_rec_t), mb_replay_rec_cmp);
+    base_usec = recs[0].issue_usec;
+    for (i = 0; i < nr_recs; i++) {
+        recs[i].issue_usec -= base_usec;
+    }
+
+    option->replay_recs = recs;
+    option->nr_replay_recs = nr_recs;
+
+    if (nr_writes == 0) {
+        option->read = true;
+        option->write = false;
+    } else if (nr_writes == nr_recs) {
+        option->read = false;
+        option->write = true;
+    } else {
+        option->read = false;
+        option->write = false;
+        option->rwmix = (double) nr_writes / nr_recs;
+    }
+
+    for (i = 0; i < nr_log_files; i++) {
+        free(log_files[i]);
+    }
+    free(log_files);
+    fclose(file);
+
+    return 0;
+
+error:
+    for (i = 0; i < nr_log_files; i++) {
+        free(log_files[i]);
+    }
+    free(log_files);
+    free(recs);
+    fclose(file);
+
+    return -1;
+}
+
+static char buf[1024];
+static long logcount = 0;
+static long log_start_usec;
+
+static void
+mb_log_io_activity(struct timeval *issue_tv, struct timeval *complete_tv,
+                   const char *file, int64_t blockaddr, int blocksz,
+                   mb_io_mode_t mode)
+{
+    long issue_usec, complete_usec;
+    double rt;
+
+    if (option.logfile == NULL) {
+        return;
+    }
+
+    issue_usec = TVPTR2LONG(issue_tv);
+    complete_usec = TVPTR2LONG(complete_tv);
+    rt = TVPTR2DOUBLE(complete_tv) - TVPTR2DOUBLE(issue_tv);
+
+    if (logcount == 0) {
+        log_start_usec = issue_usec;
+    }
+
+    sprintf(buf, "%ld\t%ld\t%ld\t%lf\t%s\t%ld\t%d\t%c\n",
+            issue_usec, complete_usec, issue_usec - log_start_usec, rt, file, blockaddr, blocksz,
+            (mode == MB_DO_READ ? 'R' : 'W'));
+
+    if (fputs(buf, option.logfile) == EOF) {
+        perror("fputs(3) failed.");
+    }
+
+    logcount++;
+}
+
+/* publish counters of @aiom */
+static void
+mb_aiom_meter(mb_aiom_t *aiom, meter_t *meter)
+{
+    meter->count = aiom->iocount;
+    meter->bytes = aiom->iobytes;
+    meter->iowait_time = aiom->iowait;
+    meter->flush_count = aiom->flushcount;
+    meter->flush_time = aiom->flushwait;
+    memcpy(meter->space_count, aiom->spacecount, sizeof(meter->space_count));
+    memcpy(meter->space_time, aiom->spacewait, sizeof(meter->space_time));
+}
+
+void
+do_async_io(th_arg_t *arg, int *fd_list)
+{
+    meter_t *meter;
+    int64_t addr;
+    int n;
+    int i;
+    mb_aiom_t *aiom;
+    struct drand48_data  rand;
+
+    int file_idx;
+    int64_t *ofst_list;
+    int64_t *ofst_min_list;
+    int64_t *ofst_max_list;
+
+    throttle_t *throttle;
+    bool file_held;     // file_idx is selected but throttled
+    int64_t now;
+    int64_t delay;
+    struct timespec timeout;
+    flusher_t *flusher;
+    cacheprobe_t *probe;
+    mb_io_mode_t mode;
+
+    srand48_r(arg->common_seed ^ arg->tid, &rand);
+
+    meter = arg->meter;
+    throttle = mb_throttle_make();
+    flusher = mb_flusher_make();
+    probe = mb_cacheprobe_make(fd_list);
+    aiom = mb_aiom_make(option.aio_nr_events);
+    if (aiom == NULL) {
+        perror("do_async_io:mb_aiom_make failed");
+        exit(EXIT_FAILURE);
+    }
+
+#ifdef HAVE_IO_URING
+    int ret;
+
+    if (option.aio_engine == AIO_IOURING) {
+        ret = io_uring_register_files(&aiom->uring, fd_list, option.nr_files);
+        if (ret != 0) {
+            perror("do_async_io:io_uring_register_files failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+#endif
+
+    // offset handling
+    ofst_list = malloc(sizeof(int64_t) * option.nr_files);
+    ofst_min_list = malloc(sizeof(int64_t) * option.nr_files);
+    ofst_max_list = malloc(sizeof(int64_t) * option.nr_files);
 
-    optind = 1;
-    while ((optchar = getopt(argc, argv, "+Nm:a:t:RSDIdAg:E:T:WM:b:s:e:B:z:c:i:Cl:jv")) != -1){
-        switch(optchar){
-        case 'N': // noop
-            option->noop = true;
-            break;
-        case 'm': // multiplicity
-            option->multi = strtol(optarg, NULL, 10);
-            break;
-        case 'a': // affinity
-        {
-            mb_affinity_t *aff;
+    for (i = 0; i < option.nr_files; i++) {
+        if (option.ofst_start >= 0) {
+            ofst_min_list[i] = option.ofst_start;
+        } else {
+            ofst_min_list[i] = 0;
+        }
 
-            // check for -m option
-            for(idx = optind; idx < argc; idx++){
-                if (strcmp("-m", argv[idx]) == 0) {
-                    perror("-m option must be specified before -a.\n");
-                    goto error;
+        if (option.ofst_end >= 0) {
+            ofst_max_list[i] = option.ofst_end;
+        } else {
+            ofst_max_list[i] = option.file_size_list[i] / option.blk_sz;
+        }
+
+        if (option.pattern == PATTERN_SEQ) {
+            ofst_list[i] = ofst_min_list[i] + (ofst_max_list[i] - ofst_min_list[i]) * arg->id / option.multi;
+        } else {
+            ofst_list[i] = ofst_min_list[i];
+        }
+    }
+
+    if (option.read == false && option.write == false) {
+        fprintf(stderr, "Only read or write can be specified in sync. mode\n");
+        exit(EXIT_FAILURE);
+    }
+
+    file_idx = 0;
+    file_held = false;
+    now = 0;
+
+    while(mb_io_continue()) {
+        delay = 0;
+        // space operations done synchronously do not use up the pool
+        while(mb_aiom_nr_submittable(aiom) > 0 && mb_io_continue()) {
+            // select file and operation; a held file keeps its operation
+            if (file_held) {
+                file_held = false;
+            } else {
+                if (option.pattern == PATTERN_RAND) {
+                    long ret;
+                    lrand48_r(&rand, &ret);
+                    file_idx = ret % option.nr_files;
+                } else {
+                    file_idx++;
+                    file_idx %= option.nr_files;
                 }
+                mode = mb_choose_op(&rand, mb_read_or_write());
             }
-            if (option->affinities == NULL){
-                option->affinities = malloc(sizeof(mb_affinity_t *) * option->multi);
-                bzero(option->affinities, sizeof(mb_affinity_t *) * option->multi);
+
+            // space operations are not charged to the I/O rate limit
+            if (throttle != NULL && ! MB_IS_SPACE_OP(mode)) {
+                now = mb_clock_nsec();
+                if ((delay = mb_throttle_delay(throttle, file_idx, now)) > 0) {
+                    file_held = true;
+                    break;
+                }
+                mb_throttle_take(throttle, file_idx, option.blk_sz, now);
             }
-            if ((aff = mb_parse_affinity(NULL, optarg)) == NULL){
-                fprintf(stderr, "Invalid argument for -a: %s\n", optarg);
-                goto error;
+
+            if (option.pattern == PATTERN_RAND) {
+                ofst_list[file_idx] = (int64_t) mb_rand_range_long(&rand,
+                                                                   ofst_min_list[file_idx],
+                                                                   ofst_max_list[file_idx]);
+            } else {
+                ofst_list[file_idx]++;
+                if (ofst_list[file_idx] >= ofst_max_list[file_idx]) {
+                    ofst_list[file_idx] = ofst_min_list[file_idx];
+                }
             }
-            aff->optarg = strdup(optarg);
-            option->affinities[aff->tid] = aff;
-        }
-            break;
-        case 't': // timeout
-            option->timeout = strtol(optarg, NULL, 10);
-            break;
-        case 'R': // random
-            option->pattern = PATTERN_RAND;
-            break;
-        case 'S': // sequential
-            option->pattern = PATTERN_SEQ;
-            break;
-        case 'D': // constant seek distance
-            option->pattern = PATTERN_SEEKDIST;
-            break;
-        case 'I': // increasing seek distance
-            option->pattern = PATTERN_SEEKINCR;
-            break;
-        case 'd': // direct IO
-            option->direct = true;
-            break;
-        case 'A': // Asynchronous IO
-            option->aio = true;
-            break;
-        case 'g': // AIO engine
-            if (strcmp(optarg, "libaio") == 0) {
-                option->aio_engine = AIO_LIBAIO;
-            } else if (strcmp(optarg, "io_uring") == 0) {
-#ifdef HAVE_IO_URING
-                option->aio_engine = AIO_IOURING;
-#else
-                fprintf(stderr, "[ERROR] io_uring is not avaiable on this platform\n");
-                goto error;
-#endif
+            addr = ofst_list[file_idx] * option.blk_sz + option.misalign;
+
+            if (MB_IS_SPACE_OP(mode)) {
+                aiom_cb_t *aiom_cb;
+                if (! mb_space_op_async(mode, file_idx)) {
+                    mb_space_sync(fd_list[file_idx], file_idx, mode, addr,
+                                  aiom->spacecount, aiom->spacewait);
+                    mb_aiom_meter(aiom, meter);
+                    continue;
+                }
+                if (NULL == (aiom_cb = mb_res_pool_pop(aiom->cbpool))) {
+                    fprintf(stderr, "do_async_io: no free aiom_cb for %s on file %d\n",
+                            space_op_names[MB_SPACE_OP_IDX(mode)], file_idx);
+                    exit(EXIT_FAILURE);
+                }
+                mb_aiom_prep_space(aiom, fd_list[file_idx], file_idx,
+                                   aiom_cb, mode, option.blk_sz, addr);
+            } else if (mode == MB_DO_READ) {
+                aiom_cb_t *aiom_cb;
+                if (NULL == (aiom_cb = mb_res_pool_pop(aiom->cbpool))) {
+                    exit(EXIT_FAILURE);
+                }
+                if (probe != NULL) {
+                    mb_cacheprobe_sample(probe, file_idx, addr, option.blk_sz, meter);
+                }
+                mb_aiom_prep_pread(aiom, fd_list[file_idx], file_idx,
+                                   aiom_cb, option.blk_sz, addr);
             } else {
-                fprintf(stderr, "[ERROR] no such AIO engine: %s\n", optarg);
-                goto error;
+                aiom_cb_t *aiom_cb;
+                if (NULL == (aiom_cb = mb_res_pool_pop(aiom->cbpool))) {
+                    exit(EXIT_FAILURE);
+                }
+                mb_rand_buf(&rand, aiom_cb->vec->iov_base, option.blk_sz);
+                mb_aiom_prep_pwrite(aiom, fd_list[file_idx], file_idx,
+                                    aiom_cb, option.blk_sz, addr);
+                if (flusher != NULL && mb_flusher_note_write(flusher, file_idx)) {
+                    // go on after submitting the flush
+                    mb_flush_async(flusher, aiom, fd_list);
+                    break;
+                }
             }
-            break;
-        case 'E': // AIO nr_events for each thread
-            option->aio_nr_events = strtol(optarg, NULL, 10);
-            break;
-        case 'T': // AIO trace log file
-            option->aio_tracefile = strdup(optarg);
-            break;
-        case 'W': // write
-            option->write = true;
-            option->read = false;
-            break;
-        case 'M': // read/write mixture (0 = 100% read, 1.0 = 100% write)
-            option->rwmix = strtod(optarg, NULL);
-            option->read = false;
-            option->write = false;
-            if (option->rwmix < 0)   option->rwmix = 0.0;
-            if (option->rwmix > 1.0) option->rwmix = 1.0;
-            break;
-        case 'b': // block size
-            option->blk_sz = strtol(optarg, NULL, 10);
-            break;
-        case 's': // start block
-            option->ofst_start = strtol(optarg, NULL, 10);
-            break;
-        case 'e': // end block
-            option->ofst_end = strtol(optarg, NULL, 10);
-            break;
-        case 'B': // stride size of seekdist
-            option->seekdist_stride = strtol(optarg, NULL, 10);
-            break;
-        case 'z': // misalignment
-            option->misalign = strtol(optarg, NULL, 10);
-            break;
-        case 'c': // # of computation operated between each IO
-            option->bogus_comp = strtol(optarg, NULL, 10);
-            break;
-        case 'i': // call usleep(3) for each I/O submission
-            option->iosleep = strtol(optarg, NULL, 10);
-            break;
-        case 'C': // ontinue on error
-            option->continue_on_error = true;
-            break;
-        case 'l': // logfile
-            option->logfile_path = strdup(optarg);
-            break;
-        case 'j': // json print mode
-            option->json = true;
-            break;
-        case 'v': // verbose
-            option->verbose = true;
-            break;
-        default:
-            fprintf(stderr, "Unknown option '-%c'\n", optchar);
-            goto error;
         }
-    }
+        mb_aiom_submit(aiom);
+
+        if (aiom->nr_inflight == 0) {
+            mb_aiom_meter(aiom, meter);
+            if (delay > 0) {
+                mb_sleep_until_nsec(now + delay);
+            }
+            continue;
+        }
+
+        // wake up when the throttled I/O is allowed
+        if (delay > 0) {
+            timeout.tv_sec = delay / 1000000000L;
+            timeout.tv_nsec = delay % 1000000000L;
+            n = mb_aiom_wait(aiom, &timeout);
+        } else {
+            n = mb_aiom_wait(aiom, NULL);
+        }
+        if ((delay == 0 && n == 0) || n < 0) {
+            perror("do_async_io:mb_aiom_wait failed");
+            exit(EXIT_FAILURE);
+        }
+
+        for(i = 0; i < n; i++) {
+            /* do bogus comp after I/O completion */
+            long idx;
+            volatile double dummy = 0.0;
+            for(idx = 0; idx < option.bogus_comp; idx++){
+                dummy += idx;
+            }
+            if (option.iosleep > 0) {
+                usleep(option.iosleep);
+            }
+        }
+
+        mb_aiom_meter(aiom, meter);
+    }
+
+    mb_aiom_waitall(aiom);
+
+    mb_aiom_meter(aiom, meter);
+
+    mb_aiom_destroy(aiom);
+    mb_throttle_destroy(throttle);
+    mb_flusher_destroy(flusher);
+    mb_cacheprobe_destroy(probe);
+
+    free(ofst_list);
+    free(ofst_min_list);
+    free(ofst_max_list);
+}
+
+void
+do_sync_io(th_arg_t *th_arg, int *fd_list)
+{
+    struct timeval       t0;
+    struct timeval       t1;
+    meter_t             *meter;
+    struct drand48_data  rand;
+    int64_t              addr;
+    mb_iobuf_arena_t    *arena;
+    void                *buf;
+    int                  i;
+    mb_io_mode_t         mode;
+
+    int file_idx;
+    int64_t *ofst_list;
+    int64_t *ofst_min_list;
+    int64_t *ofst_max_list;
+    int64_t *seekdist_side_list; // 0:lower LBA side, 1:upper LBA side
+
+    throttle_t *throttle;
+    flusher_t *flusher;
+    cacheprobe_t *probe;
+
+    meter = th_arg->meter;
+    srand48_r(th_arg->common_seed ^ th_arg->tid, &rand);
+    throttle = mb_throttle_make();
+    flusher = mb_flusher_make();
+    probe = mb_cacheprobe_make(fd_list);
+
+    arena = mb_iobuf_arena_make(1, option.blk_sz, nodemask);
+    buf = mb_iobuf_arena_slot(arena, 0);
+
+    // offset handling
+    ofst_list = malloc(sizeof(int64_t) * option.nr_files);
+    ofst_min_list = malloc(sizeof(int64_t) * option.nr_files);
+    ofst_max_list = malloc(sizeof(int64_t) * option.nr_files);
+    seekdist_side_list = malloc(sizeof(int64_t) * option.nr_files);
+
+    for (i = 0; i < option.nr_files; i++) {
+        if (option.ofst_start >= 0) {
+            ofst_min_list[i] = option.ofst_start;
+        } else {
+            ofst_min_list[i] = 0;
+        }
+
+        if (option.ofst_end >= 0) {
+            ofst_max_list[i] = option.ofst_end;
+        } else {
+            ofst_max_list[i] = option.file_size_list[i] / option.blk_sz;
+        }
 
-    if (optind >= argc) {
-        fprintf(stderr, "Device or file is not specified.\n");
-        goto error;
+        if (option.pattern == PATTERN_SEQ) {
+            ofst_list[i] = ofst_min_list[i]
+                + (ofst_max_list[i] - ofst_min_list[i]) * th_arg->id / option.multi;
+        } else if (option.pattern == PATTERN_SEEKDIST) {
+            ofst_list[i] = ofst_max_list[i] - option.seekdist_stride;
+        } else {
+            ofst_list[i] = ofst_min_list[i];
+        }
+
+        if (option.pattern == PATTERN_SEEKDIST) {
+            seekdist_side_list[i] = 0;
+        }
     }
 
-    option->nr_files = argc - optind;
-    option->file_path_list = malloc(sizeof(char *) * option->nr_files);
-    option->file_size_list = malloc(sizeof(int64_t) * option->nr_files);
+    file_idx = 0;
 
-    for (idx = 0; idx + optind < argc; idx++) {
-        int fd;
-        char *path;
+    if (option.pattern == PATTERN_RAND){
+        while (mb_io_continue()) {
+            for(i = 0;i < 100; i++){
+                // select file
+                long ret;
+                lrand48_r(&rand, &ret);
+                file_idx = ret % option.nr_files;
 
-        path = strdup(argv[optind + idx]);
-        option->file_path_list[idx] = path;
+                ofst_list[file_idx] = (int64_t) mb_rand_range_long(&rand,
+                                                                   ofst_min_list[file_idx],
+                                                                   ofst_max_list[file_idx]);
 
-        if (option->noop == false) {
-            if (option->read) {
-                if ((fd = open(path, O_RDONLY)) == -1) {
-                    fprintf(stderr, "Cannot open %s with O_RDONLY\n", path);
-                    goto error;
+                addr = ofst_list[file_idx] * option.blk_sz + option.misalign;
+
+                mode = mb_choose_op(&rand, mb_read_or_write());
+                // space operations are not charged to the I/O rate limit
+                if (MB_IS_SPACE_OP(mode)) {
+                    mb_space_sync(fd_list[file_idx], file_idx, mode, addr,
+                                  meter->space_count, meter->space_time);
+                    continue;
                 }
-                close(fd);
-            } else if (option->write) {
-                if ((fd = open(path, O_WRONLY)) == -1) {
-                    fprintf(stderr, "Cannot open %s with O_WRONLY\n", path);
-                    goto error;
+                if (throttle != NULL) {
+                    mb_throttle_wait(throttle, file_idx, option.blk_sz);
                 }
-                close(fd);
-            } else {
-                if ((fd = open(path, O_RDWR)) == -1) {
-                    fprintf(stderr, "Cannot open %s with O_RDWR\n", path);
-                    goto error;
+                if (probe != NULL && mode == MB_DO_READ) {
+                    mb_cacheprobe_sample(probe, file_idx, addr, option.blk_sz, meter);
+                }
+                GETTIMEOFDAY(&t0);
+                if (mode == MB_DO_READ) {
+                    mb_preadall(fd_list[file_idx], buf, option.blk_sz, addr, option.continue_on_error);
+                } else {
+                    mb_rand_buf(&rand, buf, option.blk_sz);
+                    mb_pwriteall(fd_list[file_idx], buf, option.blk_sz, addr, option.continue_on_error);
+                }
+                GETTIMEOFDAY(&t1);
+                meter->iowait_time += (TV2LONG(t1) - TV2LONG(t0))/1.0e6;
+                meter->count ++;
+                meter->bytes += option.blk_sz;
+
+                mb_log_io_activity(&t0, &t1, option.file_path_list[file_idx], addr, option.blk_sz,
+                                   mode);
+
+                if (flusher != NULL && mode == MB_DO_WRITE
+                    && mb_flusher_note_write(flusher, file_idx)) {
+                    mb_flush_sync(flusher, fd_list, meter);
+                }
+
+                long idx;
+                volatile double dummy = 0.0;
+                for(idx = 0; idx < option.bogus_comp; idx++){
+                    dummy += idx;
+                }
+                if (option.iosleep > 0) {
+                    usleep(option.iosleep);
                 }
-                close(fd);
             }
         }
+    } else if (option.pattern == PATTERN_SEQ) {
+        while (mb_io_continue()) {
+            for(i = 0;i < 100; i++){
+                // select file
+                file_idx++;
+                file_idx %= option.nr_files;
 
-        int64_t path_sz = mb_getsize(path);
-        if (option->blk_sz * option->ofst_start > path_sz){
-            fprintf(stderr, "Too big --offset-start. Maximum: %ld\n",
-                    path_sz / option->blk_sz);
-            goto error;
-        }
-        if (option->blk_sz * option->ofst_end > path_sz) {
-            fprintf(stderr, "Too big --offset-end. Maximum: %ld\n",
-                    path_sz / option->blk_sz);
-            goto error;
+                // incr offset
+                ofst_list[file_idx]++;
+                if (ofst_list[file_idx] >= ofst_max_list[file_idx]) {
+                    ofst_list[file_idx] = ofst_min_list[file_idx];
+                }
+                addr = ofst_list[file_idx] * option.blk_sz + option.misalign;
+                if (lseek64(fd_list[file_idx], addr, SEEK_SET) == -1){
+                    perror("do_sync_io:lseek64");
+                    exit(EXIT_FAILURE);
+                }
+
+                mode = mb_choose_op(&rand, (option.read ? MB_DO_READ : MB_DO_WRITE));
+                // space operations are not charged to the I/O rate limit
+                if (MB_IS_SPACE_OP(mode)) {
+                    mb_space_sync(fd_list[file_idx], file_idx, mode, addr,
+                                  meter->space_count, meter->space_time);
+                    continue;
+                }
+                if (throttle != NULL) {
+                    mb_throttle_wait(throttle, file_idx, option.blk_sz);
+                }
+                if (probe != NULL && option.read) {
+                    mb_cacheprobe_sample(probe, file_idx, addr, option.blk_sz, meter);
+                }
+                GETTIMEOFDAY(&t0);
+                if (option.read) {
+                    mb_readall(fd_list[file_idx], buf, option.blk_sz, option.continue_on_error);
+                } else if (option.write) {
+                    mb_rand_buf(&rand, buf, option.blk_sz);
+                    mb_writeall(fd_list[file_idx], buf, option.blk_sz, option.continue_on_error);
+                } else {
+                    fprintf(stderr, "Only read or write can be specified in seq.");
+                    exit(EXIT_FAILURE);
+                }
+                GETTIMEOFDAY(&t1);
+                meter->iowait_time += (TV2LONG(t1) - TV2LONG(t0))/1.0e6;
+                meter->count ++;
+                meter->bytes += option.blk_sz;
+
+                mb_log_io_activity(&t0, &t1, option.file_path_list[file_idx], addr, option.blk_sz,
+                                   (option.read ? MB_DO_READ : MB_DO_WRITE));
+
+                if (flusher != NULL && option.write
+                    && mb_flusher_note_write(flusher, file_idx)) {
+                    mb_flush_sync(flusher, fd_list, meter);
+                }
+
+                long idx;
+                volatile double dummy = 0.0;
+                for(idx = 0; idx < option.bogus_comp; idx++){
+                    dummy += idx;
+                }
+                if (option.iosleep > 0) {
+                    usleep(option.iosleep);
+                }
+            }
         }
+    } else if (option.pattern == PATTERN_SEEKDIST) {
+        while (mb_io_continue()) {
+            for(i = 0;i < 100; i++){
+                int64_t ofst;
 
-        option->file_size_list[idx] = path_sz;
-    }
+                // select file
+                file_idx++;
+                file_idx %= option.nr_files;
 
-    if (option->direct && option->blk_sz % 512) {
-        fprintf(stderr, "--direct specified. Block size must be multiples of block size of devices.\n");
-        goto error;
-    }
-    if (option->direct && getuid() != 0) {
-        fprintf(stderr, "You must be root to use --direct\n");
-        goto error;
-    }
+                // change offset
 
-    // check device
+                if (seekdist_side_list[file_idx] == 0) {
+                    // move to upper LBA side
+                    ofst =
+                        (int64_t) mb_rand_range_long(&rand,
+                                                     ofst_max_list[file_idx] - option.seekdist_stride,
+                                                     ofst_max_list[file_idx]);
+                } else {
+                    // move to lower LBA side
+                    ofst =
+                        (int64_t) mb_rand_range_long(&rand,
+                                                     ofst_min_list[file_idx],
+                                                     ofst_min_list[file_idx] + option.seekdist_stride);
+                }
+                seekdist_side_list[file_idx] ^= 1;
 
-    // aio trace log
-    if (option->aio_tracefile != NULL && option->aio == false) {
-        fprintf(stderr, "AIO trace log should not be recorded without async mode.\n");
-        goto error;
-    }
+                addr = ofst * option.blk_sz + option.misalign;
 
-    if (option->logfile_path != NULL) {
-        option->logfile = fopen(option->logfile_path, "w");
-        if (option->logfile == NULL) {
-            fprintf(stderr, "Failed to open log file for write: %s\n", option->logfile_path);
-            goto error;
+                // printf("%d\t%ld\n", file_idx, addr);
+
+                if (lseek64(fd_list[file_idx], addr, SEEK_SET) == -1){
+                    perror("do_sync_io:lseek64");
+                    exit(EXIT_FAILURE);
+                }
+
+                mode = mb_choose_op(&rand, (option.read ? MB_DO_READ : MB_DO_WRITE));
+                // space operations are not charged to the I/O rate limit
+                if (MB_IS_SPACE_OP(mode)) {
+                    mb_space_sync(fd_list[file_idx], file_idx, mode, addr,
+                                  meter->space_count, meter->space_time);
+                    continue;
+                }
+                if (throttle != NULL) {
+                    mb_throttle_wait(throttle, file_idx, option.blk_sz);
+                }
+                if (probe != NULL && option.read) {
+                    mb_cacheprobe_sample(probe, file_idx, addr, option.blk_sz, meter);
+                }
+                GETTIMEOFDAY(&t0);
+                if (option.read) {
+                    mb_readall(fd_list[file_idx], buf, option.blk_sz, option.continue_on_error);
+                } else if (option.write) {
+                    mb_rand_buf(&rand, buf, option.blk_sz);
+                    mb_writeall(fd_list[file_idx], buf, option.blk_sz, option.continue_on_error);
+                } else {
+                    fprintf(stderr, "Only read or write can be specified in seq.");
+                    exit(EXIT_FAILURE);
+                }
+                GETTIMEOFDAY(&t1);
+                meter->iowait_time += (TV2LONG(t1) - TV2LONG(t0))/1.0e6;
+                meter->count ++;
+                meter->bytes += option.blk_sz;
+
+                mb_log_io_activity(&t0, &t1, option.file_path_list[file_idx], addr, option.blk_sz,
+                                   (option.read ? MB_DO_READ : MB_DO_WRITE));
+
+                if (flusher != NULL && option.write
+                    && mb_flusher_note_write(flusher, file_idx)) {
+                    mb_flush_sync(flusher, fd_list, meter);
+                }
+
+                long idx;
+                volatile double dummy = 0.0;
+                for(idx = 0; idx < option.bogus_comp; idx++){
+                    dummy += idx;
+                }
+                if (option.iosleep > 0) {
+                    usleep(option.iosleep);
+                }
+            }
         }
     }
 
-    return 0;
+    mb_iobuf_arena_destroy(arena);
+    mb_throttle_destroy(throttle);
+    mb_flusher_destroy(flusher);
+    mb_cacheprobe_destroy(probe);
+}
 
-error:
-    if (option->file_path_list != NULL) {
-        free(option->file_path_list);
-        option->file_path_list = NULL;
+/* commit records of random sizes to the log of the group one by one */
+void
+do_wal_io(th_arg_t *th_arg, int *fd_list)
+{
+    meter_t             *meter;
+    struct drand48_data  rand;
+    wal_t               *wal;
+    throttle_t          *throttle;
+    int                  rec_sz;
+    int64_t              t0;
+    int64_t              latency;
+
+    meter = th_arg->meter;
+    srand48_r(th_arg->common_seed ^ th_arg->tid, &rand);
+    wal = &wals[th_arg->group];
+    throttle = mb_throttle_make();
+
+    while (mb_io_continue()) {
+        rec_sz = mb_rand_range_long(&rand, option.wal_rec_min, option.wal_rec_max + 1);
+        if (throttle != NULL) {
+            mb_throttle_wait(throttle, 0, rec_sz);
+        }
+
+        t0 = mb_clock_nsec();
+        mb_wal_commit(wal, fd_list[0], rec_sz, meter);
+        latency = mb_clock_nsec() - t0;
+
+        meter->iowait_time += latency / 1.0e9;
+        meter->count ++;
+        meter->bytes += rec_sz;
+        if (mb_epoch_phase(&epoch) == MB_EPOCH_MEASURE) {
+            mb_hist_add(th_arg->lat_hist, latency);
+        }
     }
-    if (option->file_size_list != NULL) {
-        free(option->file_size_list);
-        option->file_size_list = NULL;
+
+    mb_throttle_destroy(throttle);
+}
+
+/*
+ * Size of a new small file. Octaves from option.small_file_min are
+ * equally likely and sizes are uniform within an octave, so smaller
+ * files dominate as in usual file size distributions.
+ */
+static int64_t
+mb_small_file_size(struct drand48_data *rand)
+{
+    int64_t lo;
+    int64_t hi;
+    int64_t size;
+    int nr_octaves;
+    int k;
+
+    nr_octaves = 0;
+    for (lo = option.small_file_min; lo * 2 <= option.small_file_max; lo *= 2) {
+        nr_octaves++;
     }
+    k = mb_rand_range_long(rand, 0, nr_octaves + 1);
+    lo = option.small_file_min << k;
+    hi = (k == nr_octaves ? option.small_file_max + 1 : lo * 2);
+    size = mb_rand_range_long(rand, lo, hi);
 
-    return 1;
+    // O_DIRECT transfers whole blocks
+    if (option.direct) {
+        size = (size + option.blk_sz - 1) / option.blk_sz * option.blk_sz;
+    }
+    return size;
 }
 
-void
-mb_set_option(micbench_io_option_t *option_)
+static void
+mb_small_file_name(char *buf, size_t size, int idx)
 {
-    memcpy(&option, option_, sizeof(micbench_io_option_t));
+    snprintf(buf, size, "f%d", idx);
 }
 
-static char buf[1024];
-static long logcount = 0;
-static long log_start_usec;
+/* a read opens an existing file; a write replaces it */
+static int
+mb_small_file_flags(mb_io_mode_t mode)
+{
+    int flags;
+
+    if (mode == MB_DO_READ) {
+        flags = O_RDONLY;
+    } else {
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+        if (option.dsync) {
+            flags |= O_DSYNC;
+        }
+    }
+    if (option.direct) {
+        flags |= O_DIRECT;
+    }
+    return flags;
+}
 
+/* read or write a whole small file of @size bytes by blocks */
 static void
-mb_log_io_activity(struct timeval *issue_tv, struct timeval *complete_tv,
-                   const char *file, int64_t blockaddr, int blocksz)
+mb_small_file_rw(int fd, mb_io_mode_t mode, char *buf, int64_t size)
 {
-    long issue_usec, complete_usec;
-    double rt;
+    int64_t ofst;
+    int64_t n;
 
-    if (option.logfile == NULL) {
-        return;
+    for (ofst = 0; ofst < size; ofst += n) {
+        n = (size - ofst < option.blk_sz ? size - ofst : option.blk_sz);
+        if (mode == MB_DO_READ) {
+            mb_preadall(fd, buf, n, ofst, option.continue_on_error);
+        } else {
+            mb_pwriteall(fd, buf, n, ofst, option.continue_on_error);
+        }
     }
+}
 
-    issue_usec = TVPTR2LONG(issue_tv);
-    complete_usec = TVPTR2LONG(complete_tv);
-    rt = TVPTR2DOUBLE(complete_tv) - TVPTR2DOUBLE(issue_tv);
+/* make a directory of files of the thread in the target directory @dirfd */
+static fileset_t *
+mb_fileset_make(th_arg_t *th_arg, int dirfd)
+{
+    fileset_t *fileset;
+    struct drand48_data rand;
+    mb_iobuf_arena_t *arena;
+    char *buf;
+    char name[16];
+    int fd;
+    int i;
+
+    srand48_r(th_arg->common_seed ^ th_arg->tid, &rand);
+    arena = mb_iobuf_arena_make(1, option.blk_sz, nodemask);
+    buf = mb_iobuf_arena_slot(arena, 0);
+    mb_rand_buf(&rand, buf, option.blk_sz);
+
+    fileset = malloc(sizeof(fileset_t));
+    fileset->sizes = malloc(sizeof(int64_t) * option.nr_small_files);
+    snprintf(fileset->dirname, sizeof(fileset->dirname),
+             "mb-%d-%d", th_arg->group, th_arg->id);
+    if (mkdirat(dirfd, fileset->dirname, 0755) == -1 && errno != EEXIST) {
+        perror("mb_fileset_make:mkdirat(2) failed");
+        exit(EXIT_FAILURE);
+    }
+    if ((fileset->dirfd = openat(dirfd, fileset->dirname,
+                                 O_RDONLY | O_DIRECTORY)) == -1) {
+        perror("mb_fileset_make:openat(2) failed");
+        exit(EXIT_FAILURE);
+    }
 
-    if (logcount == 0) {
-        log_start_usec = issue_usec;
+    for (i = 0; i < option.nr_small_files; i++) {
+        fileset->sizes[i] = mb_small_file_size(&rand);
+        mb_small_file_name(name, sizeof(name), i);
+        if ((fd = openat(fileset->dirfd, name,
+                         mb_small_file_flags(MB_DO_WRITE), 0644)) == -1) {
+            perror("mb_fileset_make:openat(2) failed");
+            exit(EXIT_FAILURE);
+        }
+        mb_small_file_rw(fd, MB_DO_WRITE, buf, fileset->sizes[i]);
+        close(fd);
     }
 
-    sprintf(buf, "%ld\t%ld\t%ld\t%lf\t%s\t%ld\t%d\n",
-            issue_usec, complete_usec, issue_usec - log_start_usec, rt, file, blockaddr, blocksz);
+    mb_iobuf_arena_destroy(arena);
+    return fileset;
+}
 
-    if (fputs(buf, option.logfile) == EOF) {
-        perror("fputs(3) failed.");
-    }
+/* remove the files and the directory */
+static void
+mb_fileset_destroy(fileset_t *fileset, int dirfd)
+{
+    char name[16];
+    int i;
 
-    logcount++;
+    for (i = 0; i < option.nr_small_files; i++) {
+        mb_small_file_name(name, sizeof(name), i);
+        unlinkat(fileset->dirfd, name, 0);
+    }
+    close(fileset->dirfd);
+    if (unlinkat(dirfd, fileset->dirname, AT_REMOVEDIR) == -1) {
+        perror("mb_fileset_destroy:unlinkat(2) failed");
+    }
+    free(fileset->sizes);
+    free(fileset);
 }
 
+/* open, read or rewrite and close a whole file one by one */
 void
-do_async_io(th_arg_t *arg, int *fd_list)
+do_smallfile_io(th_arg_t *th_arg, int *fd_list)
 {
-    meter_t *meter;
-    struct timeval start_tv;
-    int64_t addr;
-    int n;
-    int i;
-    mb_aiom_t *aiom;
+    meter_t             *meter;
+    fileset_t           *fileset;
     struct drand48_data  rand;
+    mb_iobuf_arena_t    *arena;
+    char                *buf;
+    throttle_t          *throttle;
+    mb_io_mode_t         mode;
+    char                 name[16];
+    int64_t              size;
+    int64_t              t0;
+    int64_t              t1;
+    int64_t              latency;
+    int                  idx;
+    int                  fd;
 
-    int file_idx;
-    int64_t *ofst_list;
-    int64_t *ofst_min_list;
-    int64_t *ofst_max_list;
-
-    srand48_r(arg->common_seed ^ arg->tid, &rand);
+    meter = th_arg->meter;
+    fileset = th_arg->fileset;
+    srand48_r(th_arg->common_seed ^ th_arg->tid, &rand);
+    throttle = mb_throttle_make();
+    arena = mb_iobuf_arena_make(1, option.blk_sz, nodemask);
+    buf = mb_iobuf_arena_slot(arena, 0);
+    mb_rand_buf(&rand, buf, option.blk_sz);
+
+    while (mb_io_continue()) {
+        idx = mb_rand_range_long(&rand, 0, option.nr_small_files);
+        mode = mb_read_or_write();
+        if (mode == MB_DO_WRITE) {
+            fileset->sizes[idx] = mb_small_file_size(&rand);
+        }
+        size = fileset->sizes[idx];
+        if (throttle != NULL) {
+            mb_throttle_wait(throttle, 0, size);
+        }
+        mb_small_file_name(name, sizeof(name), idx);
 
-    meter = arg->meter;
-    aiom = mb_aiom_make(option.aio_nr_events);
-    if (aiom == NULL) {
-        perror("do_async_io:mb_aiom_make failed");
-        exit(EXIT_FAILURE);
+        t0 = mb_clock_nsec();
+        if ((fd = openat(fileset->dirfd, name, mb_small_file_flags(mode), 0644)) == -1) {
+            perror("do_smallfile_io:openat(2) failed");
+            exit(EXIT_FAILURE);
+        }
+        mb_small_file_rw(fd, mode, buf, size);
+        if (mode == MB_DO_WRITE) {
+            t1 = mb_clock_nsec();
+            mb_flush_fd(fd);
+            meter->flush_count ++;
+            meter->flush_time += (mb_clock_nsec() - t1) / 1.0e9;
+        }
+        close(fd);
+        latency = mb_clock_nsec() - t0;
+
+        meter->iowait_time += latency / 1.0e9;
+        meter->count ++;
+        meter->bytes += size;
+        if (mb_epoch_phase(&epoch) == MB_EPOCH_MEASURE) {
+            mb_hist_add(th_arg->lat_hist, latency);
+        }
     }
 
+    mb_iobuf_arena_destroy(arena);
+    mb_throttle_destroy(throttle);
+}
+
 #ifdef HAVE_IO_URING
+// tags of io_uring requests in small file mode
+enum {
+    SMALL_FILE_OPEN = 1,
+    SMALL_FILE_CLOSE,
+    SMALL_FILE_IO,
+    SMALL_FILE_FLUSH,
+};
+
+/* wait for @nr completions; return the result of openat if any */
+static int
+mb_small_file_reap(struct io_uring *ring, int nr)
+{
+    struct io_uring_cqe *cqe;
+    int fd;
     int ret;
 
-    if (option.aio_engine == AIO_IOURING) {
-        ret = io_uring_register_files(&aiom->uring, fd_list, option.nr_files);
-        if (ret != 0) {
-            perror("do_async_io:io_uring_register_files failed");
+    fd = -1;
+    for (; nr > 0; nr--) {
+        if ((ret = io_uring_wait_cqe(ring, &cqe)) < 0) {
+            fprintf(stderr, "mb_small_file_reap:io_uring_wait_cqe failed: %s\n",
+                    strerror(-ret));
             exit(EXIT_FAILURE);
         }
-    }
-#endif
-
-    // offset handling
-    ofst_list = malloc(sizeof(int64_t) * option.nr_files);
-    ofst_min_list = malloc(sizeof(int64_t) * option.nr_files);
-    ofst_max_list = malloc(sizeof(int64_t) * option.nr_files);
-
-    for (i = 0; i < option.nr_files; i++) {
-        if (option.ofst_start >= 0) {
-            ofst_min_list[i] = option.ofst_start;
-        } else {
-            ofst_min_list[i] = 0;
-        }
-
-        if (option.ofst_end >= 0) {
-            ofst_max_list[i] = option.ofst_end;
-        } else {
-            ofst_max_list[i] = option.file_size_list[i] / option.blk_sz;
+        if (cqe->res < 0) {
+            fprintf(stderr, "mb_small_file_reap: request %d failed: %s\n",
+                    (int) (uintptr_t) io_uring_cqe_get_data(cqe), strerror(-cqe->res));
+            if (! option.continue_on_error
+                || (uintptr_t) io_uring_cqe_get_data(cqe) == SMALL_FILE_OPEN)
+                exit(EXIT_FAILURE);
         }
-
-        if (option.pattern == PATTERN_SEQ) {
-            ofst_list[i] = ofst_min_list[i] + (ofst_max_list[i] - ofst_min_list[i]) * arg->id / option.multi;
-        } else {
-            ofst_list[i] = ofst_min_list[i];
+        if ((uintptr_t) io_uring_cqe_get_data(cqe) == SMALL_FILE_OPEN) {
+            fd = cqe->res;
         }
+        io_uring_cqe_seen(ring, cqe);
     }
+    return fd;
+}
 
-    if (option.read == false && option.write == false) {
-        fprintf(stderr, "Only read or write can be specified in sync. mode\n");
+static void
+mb_small_file_submit(struct io_uring *ring)
+{
+    int ret;
+
+    if ((ret = io_uring_submit(ring)) < 0) {
+        fprintf(stderr, "mb_small_file_submit:io_uring_submit failed: %s\n",
+                strerror(-ret));
         exit(EXIT_FAILURE);
     }
+}
 
-    file_idx = 0;
+/*
+ * Small file I/O with openat, reads or writes, flush and close all
+ * issued via io_uring. Blocks of a file are in flight together, up to
+ * option.aio_nr_events, and the latency of a file covers its own open
+ * through its own close.
+ */
+void
+do_smallfile_uring(th_arg_t *th_arg, int *fd_list)
+{
+    meter_t             *meter;
+    fileset_t           *fileset;
+    struct drand48_data  rand;
+    struct io_uring      ring;
+    struct io_uring_sqe *sqe;
+    mb_iobuf_arena_t    *arena;
+    throttle_t          *throttle;
+    mb_io_mode_t         mode;
+    char                 name[16];
+    int64_t              size;
+    int64_t              ofst;
+    int64_t              n;
+    int64_t              t0;
+    int64_t              t1;
+    int64_t              latency;
+    int                  nr_events;
+    int                  nr;
+    int                  idx;
+    int                  fd;
+    int                  ret;
 
-    GETTIMEOFDAY(&start_tv);
-    while(mb_elapsed_time_from(&start_tv) < option.timeout) {
-        while(mb_aiom_nr_submittable(aiom) > 0) {
-            // select file
-            if (option.pattern == PATTERN_RAND) {
-                long ret;
-                lrand48_r(&rand, &ret);
-                file_idx = ret % option.nr_files;
-            } else {
-                file_idx++;
-                file_idx %= option.nr_files;
-            }
+    meter = th_arg->meter;
+    fileset = th_arg->fileset;
+    srand48_r(th_arg->common_seed ^ th_arg->tid, &rand);
+    throttle = mb_throttle_make();
 
-            if (option.pattern == PATTERN_RAND) {
-                ofst_list[file_idx] = (int64_t) mb_rand_range_long(&rand,
-                                                                   ofst_min_list[file_idx],
-                                                                   ofst_max_list[file_idx]);
-            } else {
-                ofst_list[file_idx]++;
-                if (ofst_list[file_idx] >= ofst_max_list[file_idx]) {
-                    ofst_list[file_idx] = ofst_min_list[file_idx];
-                }
-            }
-            addr = ofst_list[file_idx] * option.blk_sz + option.misalign;
+    nr_events = (option.aio_nr_events > 1 ? option.aio_nr_events : 1);
+    if ((ret = io_uring_queue_init(nr_events, &ring, 0)) < 0) {
+        fprintf(stderr, "do_smallfile_uring:io_uring_queue_init failed: %s\n",
+                strerror(-ret));
+        exit(EXIT_FAILURE);
+    }
+    arena = mb_iobuf_arena_make(nr_events, option.blk_sz, nodemask);
+    for (nr = 0; nr < nr_events; nr++) {
+        mb_rand_buf(&rand, mb_iobuf_arena_slot(arena, nr), option.blk_sz);
+    }
 
-            if (mb_read_or_write() == MB_DO_READ) {
-                aiom_cb_t *aiom_cb;
-                if (NULL == (aiom_cb = mb_res_pool_pop(aiom->cbpool))) {
-                    exit(EXIT_FAILURE);
-                }
-                mb_aiom_prep_pread(aiom, fd_list[file_idx], file_idx,
-                                   aiom_cb, option.blk_sz, addr);
-            } else {
-                aiom_cb_t *aiom_cb;
-                if (NULL == (aiom_cb = mb_res_pool_pop(aiom->cbpool))) {
-                    exit(EXIT_FAILURE);
+    while (mb_io_continue()) {
+        idx = mb_rand_range_long(&rand, 0, option.nr_small_files);
+        mode = mb_read_or_write();
+        if (mode == MB_DO_WRITE) {
+            fileset->sizes[idx] = mb_small_file_size(&rand);
+        }
+        size = fileset->sizes[idx];
+        if (throttle != NULL) {
+            mb_throttle_wait(throttle, 0, size);
+        }
+        mb_small_file_name(name, sizeof(name), idx);
+
+        t0 = mb_clock_nsec();
+        sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_openat(sqe, fileset->dirfd, name, mb_small_file_flags(mode), 0644);
+        io_uring_sqe_set_data(sqe, (void *) (uintptr_t) SMALL_FILE_OPEN);
+        mb_small_file_submit(&ring);
+        fd = mb_small_file_reap(&ring, 1);
+
+        for (ofst = 0; ofst < size; ) {
+            for (nr = 0; nr < nr_events && ofst < size; nr++, ofst += n) {
+                n = (size - ofst < option.blk_sz ? size - ofst : option.blk_sz);
+                sqe = io_uring_get_sqe(&ring);
+                if (mode == MB_DO_READ) {
+                    io_uring_prep_read(sqe, fd, mb_iobuf_arena_slot(arena, nr), n, ofst);
+                } else {
+                    io_uring_prep_write(sqe, fd, mb_iobuf_arena_slot(arena, nr), n, ofst);
                 }
-                mb_rand_buf(&rand, aiom_cb->vec->iov_base, option.blk_sz);
-                mb_aiom_prep_pwrite(aiom, fd_list[file_idx], file_idx,
-                                    aiom_cb, option.blk_sz, addr);
+                io_uring_sqe_set_data(sqe, (void *) (uintptr_t) SMALL_FILE_IO);
             }
-        }
-        mb_aiom_submit(aiom);
-
-        if (0 >= (n = mb_aiom_wait(aiom, NULL))) {
-            perror("do_async_io:mb_aiom_wait failed");
-            exit(EXIT_FAILURE);
+            mb_small_file_submit(&ring);
+            mb_small_file_reap(&ring, nr);
         }
 
-        for(i = 0; i < n; i++) {
-            /* do bogus comp after I/O completion */
-            long idx;
-            volatile double dummy = 0.0;
-            for(idx = 0; idx < option.bogus_comp; idx++){
-                dummy += idx;
-            }
-            if (option.iosleep > 0) {
-                usleep(option.iosleep);
+        if (mode == MB_DO_WRITE) {
+            t1 = mb_clock_nsec();
+            sqe = io_uring_get_sqe(&ring);
+            if (option.flush_op == FLUSH_SYNC_FILE_RANGE) {
+                io_uring_prep_sync_file_range(sqe, fd, 0, 0,
+                                              SYNC_FILE_RANGE_WAIT_BEFORE
+                                              | SYNC_FILE_RANGE_WRITE
+                                              | SYNC_FILE_RANGE_WAIT_AFTER);
+            } else {
+                io_uring_prep_fsync(sqe, fd,
+                                    (option.flush_op == FLUSH_FDATASYNC ?
+                                     IORING_FSYNC_DATASYNC : 0));
             }
+            io_uring_sqe_set_data(sqe, (void *) (uintptr_t) SMALL_FILE_FLUSH);
+            mb_small_file_submit(&ring);
+            mb_small_file_reap(&ring, 1);
+            meter->flush_count ++;
+            meter->flush_time += (mb_clock_nsec() - t1) / 1.0e9;
+        }
+        sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_close(sqe, fd);
+        io_uring_sqe_set_data(sqe, (void *) (uintptr_t) SMALL_FILE_CLOSE);
+        mb_small_file_submit(&ring);
+        mb_small_file_reap(&ring, 1);
+        latency = mb_clock_nsec() - t0;
+
+        meter->iowait_time += latency / 1.0e9;
+        meter->count ++;
+        meter->bytes += size;
+        if (mb_epoch_phase(&epoch) == MB_EPOCH_MEASURE) {
+            mb_hist_add(th_arg->lat_hist, latency);
         }
     }
 
-    mb_aiom_waitall(aiom);
-
-    meter->count = aiom->iocount;
-    meter->iowait_time = aiom->iowait;
+    io_uring_queue_exit(&ring);
+    mb_iobuf_arena_destroy(arena);
+    mb_throttle_destroy(throttle);
+}
+#endif
 
-    mb_aiom_destroy(aiom);
+/* sleep until the issue time of @rec unless replaying as fast as possible */
+static void
+mb_replay_wait(struct timeval *start_tv, mb_replay_rec_t *rec)
+{
+    long delta;
 
-    free(ofst_list);
-    free(ofst_min_list);
-    free(ofst_max_list);
+    if (option.replay_afap) {
+        return;
+    }
+    delta = rec->issue_usec - mb_elapsed_usec_from(start_tv);
+    if (delta > 0) {
+        usleep(delta);
+    }
 }
 
 void
-do_sync_io(th_arg_t *th_arg, int *fd_list)
+do_replay_sync_io(th_arg_t *th_arg, int *fd_list)
 {
-    struct timeval       start_tv;
     struct timeval       t0;
     struct timeval       t1;
     meter_t             *meter;
     struct drand48_data  rand;
-    int64_t              addr;
+    mb_replay_rec_t     *rec;
+    mb_iobuf_arena_t    *arena;
     void                *buf;
     int                  i;
 
-    int file_idx;
-    int64_t *ofst_list;
-    int64_t *ofst_min_list;
-    int64_t *ofst_max_list;
-    int64_t *seekdist_side_list; // 0:lower LBA side, 1:upper LBA side
-
     meter = th_arg->meter;
     srand48_r(th_arg->common_seed ^ th_arg->tid, &rand);
 
-    register double iowait_time = 0;
-    register int64_t io_count = 0;
-
-    buf = memalign(option.blk_sz, option.blk_sz);
-
-    // offset handling
-    ofst_list = malloc(sizeof(int64_t) * option.nr_files);
-    ofst_min_list = malloc(sizeof(int64_t) * option.nr_files);
-    ofst_max_list = malloc(sizeof(int64_t) * option.nr_files);
-    seekdist_side_list = malloc(sizeof(int64_t) * option.nr_files);
-
-    for (i = 0; i < option.nr_files; i++) {
-        if (option.ofst_start >= 0) {
-            ofst_min_list[i] = option.ofst_start;
-        } else {
-            ofst_min_list[i] = 0;
-        }
+    arena = mb_iobuf_arena_make(1, mb_io_buf_size(), nodemask);
+    buf = mb_iobuf_arena_slot(arena, 0);
 
-        if (option.ofst_end >= 0) {
-            ofst_max_list[i] = option.ofst_end;
-        } else {
-            ofst_max_list[i] = option.file_size_list[i] / option.blk_sz;
+    // requests are distributed over threads in round-robin
+    for (i = th_arg->id; i < option.nr_replay_recs; i += option.multi) {
+        if (! mb_io_continue()) {
+            break;
         }
+        rec = &option.replay_recs[i];
+        mb_replay_wait(&th_arg->common_start_tv, rec);
 
-        if (option.pattern == PATTERN_SEQ) {
-            ofst_list[i] = ofst_min_list[i]
-                + (ofst_max_list[i] - ofst_min_list[i]) * th_arg->id / option.multi;
-        } else if (option.pattern == PATTERN_SEEKDIST) {
-            ofst_list[i] = ofst_max_list[i] - option.seekdist_stride;
+        GETTIMEOFDAY(&t0);
+        if (rec->mode == MB_DO_READ) {
+            mb_preadall(fd_list[rec->file_idx], buf, rec->size, rec->addr, option.continue_on_error);
         } else {
-            ofst_list[i] = ofst_min_list[i];
+            mb_rand_buf(&rand, buf, rec->size);
+            mb_pwriteall(fd_list[rec->file_idx], buf, rec->size, rec->addr, option.continue_on_error);
         }
+        GETTIMEOFDAY(&t1);
+        meter->iowait_time += (TV2LONG(t1) - TV2LONG(t0))/1.0e6;
+        meter->count ++;
+        meter->bytes += rec->size;
 
-        if (option.pattern == PATTERN_SEEKDIST) {
-            seekdist_side_list[i] = 0;
-        }
+        mb_log_io_activity(&t0, &t1, option.file_path_list[rec->file_idx],
+                           rec->addr, rec->size, rec->mode);
     }
 
-    file_idx = 0;
-
-    GETTIMEOFDAY(&start_tv);
-    if (option.pattern == PATTERN_RAND){
-        while (mb_elapsed_time_from(&start_tv) < option.timeout) {
-            for(i = 0;i < 100; i++){
-                // select file
-                long ret;
-                lrand48_r(&rand, &ret);
-                file_idx = ret % option.nr_files;
-
-                ofst_list[file_idx] = (int64_t) mb_rand_range_long(&rand,
-                                                                   ofst_min_list[file_idx],
-                                                                   ofst_max_list[file_idx]);
-
-                addr = ofst_list[file_idx] * option.blk_sz + option.misalign;
-
-                GETTIMEOFDAY(&t0);
-                if (mb_read_or_write() == MB_DO_READ) {
-                    mb_preadall(fd_list[file_idx], buf, option.blk_sz, addr, option.continue_on_error);
-                } else {
-                    mb_rand_buf(&rand, buf, option.blk_sz);
-                    mb_pwriteall(fd_list[file_idx], buf, option.blk_sz, addr, option.continue_on_error);
-                }
-                GETTIMEOFDAY(&t1);
-                iowait_time += (TV2LONG(t1) - TV2LONG(t0))/1.0e6;
-                io_count ++;
+    mb_iobuf_arena_destroy(arena);
+}
 
-                mb_log_io_activity(&t0, &t1, option.file_path_list[file_idx], addr, option.blk_sz);
+void
+do_replay_async_io(th_arg_t *arg, int *fd_list)
+{
+    meter_t *meter;
+    mb_aiom_t *aiom;
+    struct drand48_data rand;
+    mb_replay_rec_t *rec;
+    aiom_cb_t *aiom_cb;
+    struct timespec timeout;
+    long delta;
+    int next;
 
-                long idx;
-                volatile double dummy = 0.0;
-                for(idx = 0; idx < option.bogus_comp; idx++){
-                    dummy += idx;
-                }
-                if (option.iosleep > 0) {
-                    usleep(option.iosleep);
-                }
-            }
-        }
-    } else if (option.pattern == PATTERN_SEQ) {
-        while (mb_elapsed_time_from(&start_tv) < option.timeout) {
-            for(i = 0;i < 100; i++){
-                // select file
-                file_idx++;
-                file_idx %= option.nr_files;
+    srand48_r(arg->common_seed ^ arg->tid, &rand);
 
-                // incr offset
-                ofst_list[file_idx]++;
-                if (ofst_list[file_idx] >= ofst_max_list[file_idx]) {
-                    ofst_list[file_idx] = ofst_min_list[file_idx];
-                }
-                addr = ofst_list[file_idx] * option.blk_sz + option.misalign;
-                if (lseek64(fd_list[file_idx], addr, SEEK_SET) == -1){
-                    perror("do_sync_io:lseek64");
-                    exit(EXIT_FAILURE);
-                }
+    meter = arg->meter;
+    aiom = mb_aiom_make(option.aio_nr_events);
+    if (aiom == NULL) {
+        perror("do_replay_async_io:mb_aiom_make failed");
+        exit(EXIT_FAILURE);
+    }
 
-                GETTIMEOFDAY(&t0);
-                if (option.read) {
-                    mb_readall(fd_list[file_idx], buf, option.blk_sz, option.continue_on_error);
-                } else if (option.write) {
-                    mb_rand_buf(&rand, buf, option.blk_sz);
-                    mb_writeall(fd_list[file_idx], buf, option.blk_sz, option.continue_on_error);
-                } else {
-                    fprintf(stderr, "Only read or write can be specified in seq.");
-                    exit(EXIT_FAILURE);
+    next = arg->id;
+    while (mb_io_continue()) {
+        delta = 0;
+        while (next < option.nr_replay_recs && mb_aiom_nr_submittable(aiom) > 0) {
+            rec = &option.replay_recs[next];
+            if (! option.replay_afap) {
+                delta = rec->issue_usec - mb_elapsed_usec_from(&arg->common_start_tv);
+                if (delta > 0) {
+                    break;
                 }
-                GETTIMEOFDAY(&t1);
-                iowait_time += (TV2LONG(t1) - TV2LONG(t0))/1.0e6;
-                io_count ++;
+            }
 
-                mb_log_io_activity(&t0, &t1, option.file_path_list[file_idx], addr, option.blk_sz);
+            aiom_cb = mb_res_pool_pop(aiom->cbpool);
+            if (rec->mode == MB_DO_READ) {
+                mb_aiom_prep_pread(aiom, fd_list[rec->file_idx], rec->file_idx,
+                                   aiom_cb, rec->size, rec->addr);
+            } else {
+                mb_rand_buf(&rand, aiom_cb->vec->iov_base, rec->size);
+                mb_aiom_prep_pwrite(aiom, fd_list[rec->file_idx], rec->file_idx,
+                                    aiom_cb, rec->size, rec->addr);
+            }
+            next += option.multi;
+        }
+        mb_aiom_submit(aiom);
 
-                long idx;
-                volatile double dummy = 0.0;
-                for(idx = 0; idx < option.bogus_comp; idx++){
-                    dummy += idx;
-                }
-                if (option.iosleep > 0) {
-                    usleep(option.iosleep);
-                }
+        if (aiom->nr_inflight == 0) {
+            if (next >= option.nr_replay_recs) {
+                break;
             }
+            if (delta > 0) {
+                usleep(delta);
+            }
+            continue;
         }
-    } else if (option.pattern == PATTERN_SEEKDIST) {
-        while (mb_elapsed_time_from(&start_tv) < option.timeout) {
-            for(i = 0;i < 100; i++){
-                int64_t ofst;
 
-                // select file
-                file_idx++;
-                file_idx %= option.nr_files;
+        // wake up for the next request if it is not due yet
+        if (delta > 0) {
+            timeout.tv_sec = delta / 1000000;
+            timeout.tv_nsec = (delta % 1000000) * 1000;
+            mb_aiom_wait(aiom, &timeout);
+        } else {
+            mb_aiom_wait(aiom, NULL);
+        }
 
-                // change offset
+        mb_aiom_meter(aiom, meter);
+    }
 
-                if (seekdist_side_list[file_idx] == 0) {
-                    // move to upper LBA side
-                    ofst =
-                        (int64_t) mb_rand_range_long(&rand,
-                                                     ofst_max_list[file_idx] - option.seekdist_stride,
-                                                     ofst_max_list[file_idx]);
-                } else {
-                    // move to lower LBA side
-                    ofst =
-                        (int64_t) mb_rand_range_long(&rand,
-                                                     ofst_min_list[file_idx],
-                                                     ofst_min_list[file_idx] + option.seekdist_stride);
-                }
-                seekdist_side_list[file_idx] ^= 1;
+    mb_aiom_waitall(aiom);
 
-                addr = ofst * option.blk_sz + option.misalign;
+    mb_aiom_meter(aiom, meter);
 
-                // printf("%d\t%ld\n", file_idx, addr);
+    mb_aiom_destroy(aiom);
+}
 
-                if (lseek64(fd_list[file_idx], addr, SEEK_SET) == -1){
-                    perror("do_sync_io:lseek64");
-                    exit(EXIT_FAILURE);
-                }
+#define PRECOND_BLK_SZ (128 * KIBI)
 
-                GETTIMEOFDAY(&t0);
-                if (option.read) {
-                    mb_readall(fd_list[file_idx], buf, option.blk_sz, option.continue_on_error);
-                } else if (option.write) {
-                    mb_rand_buf(&rand, buf, option.blk_sz);
-                    mb_writeall(fd_list[file_idx], buf, option.blk_sz, option.continue_on_error);
-                } else {
-                    fprintf(stderr, "Only read or write can be specified in seq.");
-                    exit(EXIT_FAILURE);
-                }
-                GETTIMEOFDAY(&t1);
-                iowait_time += (TV2LONG(t1) - TV2LONG(t0))/1.0e6;
-                io_count ++;
+/*
+ * Fill the target range sequentially option.precondition times and
+ * then overwrite it randomly once. Each thread fills its own slice
+ * of the range and does 1/multi of the random overwrite.
+ */
+static void
+mb_precondition(th_arg_t *th_arg)
+{
+    struct drand48_data  rand;
+    mb_iobuf_arena_t    *arena;
+    void                *buf;
+    size_t               sz;
+    int64_t              ofst_min;
+    int64_t              ofst_max;
+    int64_t              addr;
+    int64_t              end;
+    int64_t              n;
+    int                  pass;
+    int                  flags;
+    int                  fd;
+    int                  i;
 
-                mb_log_io_activity(&t0, &t1, option.file_path_list[file_idx], addr, option.blk_sz);
+    srand48_r(th_arg->common_seed ^ th_arg->tid, &rand);
 
-                long idx;
-                volatile double dummy = 0.0;
-                for(idx = 0; idx < option.bogus_comp; idx++){
-                    dummy += idx;
-                }
-                if (option.iosleep > 0) {
-                    usleep(option.iosleep);
-                }
+    sz = (option.blk_sz > PRECOND_BLK_SZ ? option.blk_sz : PRECOND_BLK_SZ);
+    arena = mb_iobuf_arena_make(1, sz, nodemask);
+    buf = mb_iobuf_arena_slot(arena, 0);
+
+    flags = O_WRONLY;
+    if (option.direct) {
+        flags |= O_DIRECT;
+    }
+
+    for (i = 0; i < option.nr_files; i++) {
+        if ((fd = open(option.file_path_list[i], flags)) == -1) {
+            perror("mb_precondition:open(2)");
+            exit(EXIT_FAILURE);
+        }
+
+        // in blocks, same as workers
+        ofst_min = (option.ofst_start >= 0 ? option.ofst_start : 0);
+        ofst_max = (option.ofst_end >= 0 ? option.ofst_end
+                    : option.file_size_list[i] / option.blk_sz);
+
+        addr = (ofst_min + (ofst_max - ofst_min) * th_arg->id / option.multi)
+            * option.blk_sz;
+        end = (ofst_min + (ofst_max - ofst_min) * (th_arg->id + 1) / option.multi)
+            * option.blk_sz;
+        for (pass = 0; pass < option.precondition; pass++) {
+            int64_t ofst;
+            for (ofst = addr; ofst < end; ofst += n) {
+                n = (end - ofst < sz ? end - ofst : sz);
+                mb_rand_buf(&rand, buf, n);
+                mb_pwriteall(fd, buf, n, ofst, option.continue_on_error);
             }
         }
-    }
 
-    meter->iowait_time = iowait_time;
-    meter->count = io_count;
+        for (n = (ofst_max - ofst_min) / option.multi; n > 0; n--) {
+            addr = mb_rand_range_long(&rand, ofst_min, ofst_max) * option.blk_sz;
+            mb_rand_buf(&rand, buf, option.blk_sz);
+            mb_pwriteall(fd, buf, option.blk_sz, addr, option.continue_on_error);
+        }
+
+        if (fsync(fd) == -1) {
+            perror("mb_precondition:fsync(2)");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
 
-    free(buf);
+    mb_iobuf_arena_destroy(arena);
 }
 
 void *
@@ -1325,6 +4548,7 @@ thread_handler(void *arg)
     int fd;
     int *fd_list;
 
+    option = groups[th_arg->group];
     tid = syscall(SYS_gettid);
     th_arg->tid = tid;
 
@@ -1334,6 +4558,7 @@ thread_handler(void *arg)
             sched_setaffinity(tid,
                               sizeof(cpu_set_t),
                               &aff->cpumask);
+            nodemask = aff->nodemask;
         }
     }
 
@@ -1343,10 +4568,49 @@ thread_handler(void *arg)
             perror("main:open(2)");
             exit(EXIT_FAILURE);
         }
+        // access pattern hints are of each open file
+        if (option.fadvise >= 0) {
+            posix_fadvise(fd, 0, 0, option.fadvise);
+        }
         fd_list[i] = fd;
     }
 
-    if (option.aio == true) {
+    if (option.precondition > 0) {
+        if (option.verbose) fprintf(stderr, "*info* mb_precondition\n");
+        mb_precondition(th_arg);
+    }
+    if (option.pattern == PATTERN_SMALLFILE) {
+        th_arg->fileset = mb_fileset_make(th_arg, fd_list[0]);
+    }
+
+    // wait for all threads to finish preconditioning, and then for
+    // the main thread to set common_start_tv
+    pthread_barrier_wait(&start_barrier);
+    pthread_barrier_wait(&start_barrier);
+
+    if (option.replay_recs != NULL) {
+        if (option.aio == true) {
+            if (option.verbose) fprintf(stderr, "*info* do_replay_async_io\n");
+            do_replay_async_io(th_arg, fd_list);
+        } else {
+            if (option.verbose) fprintf(stderr, "*info* do_replay_sync_io\n");
+            do_replay_sync_io(th_arg, fd_list);
+        }
+    } else if (option.pattern == PATTERN_WAL) {
+        if (option.verbose) fprintf(stderr, "*info* do_wal_io\n");
+        do_wal_io(th_arg, fd_list);
+    } else if (option.pattern == PATTERN_SMALLFILE) {
+#ifdef HAVE_IO_URING
+        if (option.aio == true) {
+            if (option.verbose) fprintf(stderr, "*info* do_smallfile_uring\n");
+            do_smallfile_uring(th_arg, fd_list);
+        } else
+#endif
+        {
+            if (option.verbose) fprintf(stderr, "*info* do_smallfile_io\n");
+            do_smallfile_io(th_arg, fd_list);
+        }
+    } else if (option.aio == true) {
         if (option.verbose) fprintf(stderr, "*info* do_async_io\n");
         do_async_io(th_arg, fd_list);
     } else {
@@ -1354,6 +4618,17 @@ thread_handler(void *arg)
         do_sync_io(th_arg, fd_list);
     }
 
+    // replay may end before the timeout
+    if (__sync_add_and_fetch(&nr_finished_workers, 1) == nr_threads) {
+        mb_epoch_end_measure(&epoch);
+    }
+    if (groups[0].sysstat) {
+        mb_sysstat_wait_end();
+    }
+
+    if (th_arg->fileset != NULL) {
+        mb_fileset_destroy(th_arg->fileset, fd_list[0]);
+    }
     for (i = 0; i < option.nr_files; i++) {
         if (close(fd_list[i]) == -1){
             perror("main:close(2)");
@@ -1365,17 +4640,294 @@ thread_handler(void *arg)
     return NULL;
 }
 
+/*
+ * Check whether the last @window rounds of @iops are in steady state
+ * in the manner of SNIA SSS PTS: the range of IOPS and the range of
+ * their least-squares linear fit across the window are within
+ * MB_SS_MAX_EXCURSION and MB_SS_MAX_SLOPE_EXCURSION of the average.
+ */
+bool
+mb_ss_check(const double *iops, int nr_rounds, int window,
+            double *excursion, double *slope_excursion)
+{
+    const double *y;
+    double avg;
+    double min;
+    double max;
+    double xavg;
+    double sxy;
+    double sxx;
+    double slope;
+    int i;
+
+    if (window < 2 || nr_rounds < window) {
+        return false;
+    }
+    y = iops + nr_rounds - window;
+
+    avg = 0;
+    min = max = y[0];
+    for (i = 0; i < window; i++) {
+        avg += y[i];
+        if (y[i] < min) min = y[i];
+        if (y[i] > max) max = y[i];
+    }
+    avg /= window;
+
+    xavg = (window - 1) / 2.0;
+    sxy = sxx = 0;
+    for (i = 0; i < window; i++) {
+        sxy += (i - xavg) * (y[i] - avg);
+        sxx += (i - xavg) * (i - xavg);
+    }
+    slope = sxy / sxx;
+    if (slope < 0) {
+        slope = -slope;
+    }
+
+    if (avg <= 0) {
+        *excursion = *slope_excursion = 0;
+        return false;
+    }
+    *excursion = (max - min) / avg;
+    *slope_excursion = slope * (window - 1) / avg;
+
+    return (*excursion <= MB_SS_MAX_EXCURSION
+            && *slope_excursion <= MB_SS_MAX_SLOPE_EXCURSION);
+}
+
+static void
+mb_meter_sum(th_arg_t *th_args, int nr, meter_t *sum)
+{
+    volatile meter_t *meter;
+    int i;
+    int j;
+
+    bzero(sum, sizeof(meter_t));
+    for (i = 0; i < nr; i++) {
+        meter = th_args[i].meter;
+        sum->iowait_time += meter->iowait_time;
+        sum->count += meter->count;
+        sum->bytes += meter->bytes;
+        sum->flush_count += meter->flush_count;
+        sum->flush_time += meter->flush_time;
+        for (j = 0; j < MB_NR_SPACE_OPS; j++) {
+            sum->space_count[j] += meter->space_count[j];
+            sum->space_time[j] += meter->space_time[j];
+        }
+        sum->cache_pages += meter->cache_pages;
+        sum->cache_hits += meter->cache_hits;
+    }
+}
+
+static void
+mb_io_epoch_hook(mb_epoch_phase_t phase, void *arg)
+{
+    th_arg_t *th_args = arg;
+    meter_t *sums;
+    int g;
+
+    if (phase == MB_EPOCH_MEASURE) {
+        sums = meter_begin;
+    } else if (phase == MB_EPOCH_RAMPDOWN) {
+        sums = meter_end;
+    } else {
+        return;
+    }
+    for (g = 0; g < nr_groups; g++) {
+        mb_meter_sum(th_args, groups[g].multi, &sums[g]);
+        th_args += groups[g].multi;
+    }
+}
+
+/*
+ * Sample interval IOPS every option.ss_round seconds from the start of
+ * measurement until the last option.ss_window rounds get steady or
+ * the timeout expires, then end the measurement. Only I/Os in the
+ * measurement window are counted. @begin is meters at the start.
+ */
+static void
+mb_ss_run(th_arg_t *th_args, meter_t *begin, result_t *result)
+{
+    struct timeval *start_tv = &epoch.measure_start_tv;
+    meter_t *samples;   // accumulated at the end of each round
+    double *times;
+    int nr_rounds;
+    int k;
+    int w;
+    int i;
+    long delta;
+
+    nr_rounds = option.timeout / option.ss_round;
+    samples = calloc(nr_rounds + 1, sizeof(meter_t));
+    times = calloc(nr_rounds + 1, sizeof(double));
+    result->ss_round_iops = calloc(nr_rounds, sizeof(double));
+    if (samples == NULL || times == NULL || result->ss_round_iops == NULL) {
+        perror("calloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    samples[0] = *begin;
+    result->ss_reached = false;
+    result->ss_excursion = 0;
+    result->ss_slope_excursion = 0;
+    for (k = 1; k <= nr_rounds; k++) {
+        delta = k * option.ss_round * 1000000L - mb_elapsed_usec_from(start_tv);
+        if (delta > 0) {
+            usleep(delta);
+        }
+        times[k] = mb_elapsed_time_from(start_tv);
+        mb_meter_sum(th_args, option.multi, &samples[k]);
+        result->ss_round_iops[k - 1] =
+            (samples[k].count - samples[k - 1].count) / (times[k] - times[k - 1]);
+        result->ss_nr_rounds = k;
+
+        if (option.verbose) {
+            fprintf(stderr, "*info* round %d: %lf iops\n",
+                    k, result->ss_round_iops[k - 1]);
+        }
+        if (mb_ss_check(result->ss_round_iops, k, option.ss_window,
+                        &result->ss_excursion, &result->ss_slope_excursion)) {
+            result->ss_reached = true;
+            break;
+        }
+    }
+    mb_epoch_end_measure(&epoch);
+
+    k = result->ss_nr_rounds;
+    w = option.ss_window;
+    result->io_count = samples[k].count - samples[k - w].count;
+    result->io_bytes = samples[k].bytes - samples[k - w].bytes;
+    result->iowait_time = (samples[k].iowait_time - samples[k - w].iowait_time)
+        / option.multi;
+    result->exec_time = times[k] - times[k - w];
+    result->flush_count = samples[k].flush_count - samples[k - w].flush_count;
+    result->flush_time = samples[k].flush_time - samples[k - w].flush_time;
+    for (i = 0; i < MB_NR_SPACE_OPS; i++) {
+        result->space_count[i] = samples[k].space_count[i] - samples[k - w].space_count[i];
+        result->space_time[i] = samples[k].space_time[i] - samples[k - w].space_time[i];
+    }
+    result->cache_pages = samples[k].cache_pages - samples[k - w].cache_pages;
+    result->cache_hits = samples[k].cache_hits - samples[k - w].cache_hits;
+
+    free(samples);
+    free(times);
+}
+
+/*
+ * Parse groups of options separated by ':' in @argv into @groups_ of
+ * @nr_groups_. Each group is parsed as a whole command line of its
+ * own. Options of the whole run (-t, --warmup, --rampdown, -j, -N and
+ * -T) and counters of the whole process (--sysstat) are only taken
+ * from the first group.
+ */
+int
+mb_parse_groups(int argc, char **argv,
+                micbench_io_option_t **groups_, unsigned int *nr_groups_)
+{
+    micbench_io_option_t *groups;
+    unsigned int nr_groups;
+    char **group_argv;
+    int group_argc;
+    struct stat st1, st2;
+    int g;
+    int h;
+    int i;
+
+    nr_groups = 1;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], ":") == 0) {
+            nr_groups++;
+        }
+    }
+    groups = calloc(nr_groups, sizeof(micbench_io_option_t));
+    group_argv = malloc(sizeof(char *) * (argc + 1));
+    if (groups == NULL || group_argv == NULL) {
+        perror("mb_parse_groups:malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    *groups_ = groups;
+    *nr_groups_ = nr_groups;
+
+    i = 1;
+    for (g = 0; g < nr_groups; g++) {
+        group_argv[0] = argv[0];
+        for (group_argc = 1; i < argc && strcmp(argv[i], ":") != 0; i++) {
+            group_argv[group_argc++] = argv[i];
+        }
+        group_argv[group_argc] = NULL;
+        i++; // skip ':'
+
+        if (parse_args(group_argc, group_argv, &groups[g]) != 0) {
+            if (nr_groups > 1) {
+                fprintf(stderr, "Invalid options in group %d.\n", g);
+            }
+            free(group_argv);
+            return 1;
+        }
+    }
+    free(group_argv);
+
+    for (g = 1; g < nr_groups; g++) {
+        if (groups[g].run_opt != NULL) {
+            fprintf(stderr, "%s must be given in the first group.\n", groups[g].run_opt);
+            return 1;
+        }
+        // counters are of the whole process, sampled along the first group
+        if (groups[g].sysstat) {
+            fprintf(stderr, "--sysstat and --sysstat-interval must be given in the first group.\n");
+            return 1;
+        }
+    }
+    for (g = 0; g < nr_groups && nr_groups > 1; g++) {
+        if (groups[g].steady_state) {
+            fprintf(stderr, "Steady state detection cannot be used with multiple groups.\n");
+            return 1;
+        }
+    }
+
+    // logs are opened by parse_args, so the same file is found by inode
+    for (g = 1; g < nr_groups; g++) {
+        if (groups[g].logfile == NULL
+            || fstat(fileno(groups[g].logfile), &st1) != 0) {
+            continue;
+        }
+        for (h = 0; h < g; h++) {
+            if (groups[h].logfile != NULL
+                && fstat(fileno(groups[h].logfile), &st2) == 0
+                && st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino) {
+                fprintf(stderr, "Log file %s is given to groups %d and %d.\n",
+                        groups[g].logfile_path, h, g);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* derive metrics of @result from its counters */
+static void
+mb_result_calc(result_t *result, int multi)
+{
+    result->response_time = result->iowait_time * multi / result->io_count;
+    result->iops = result->io_count / result->exec_time;
+    result->bandwidth = result->io_bytes / result->exec_time;
+}
+
 int
 micbench_io_main(int argc, char **argv)
 {
     th_arg_t *th_args;
+    th_arg_t *th_arg;
+    int g;
     int i;
     int flags;
     struct timeval start_tv;
     result_t result;
-    meter_t *meter;
+    result_t *results;
     long common_seed;
-    double exec_time;
+    int **ra_saved; // readahead of each target before the run
 
     if (getenv("MICBENCH") == NULL) {
         fprintf(stderr, "Variable MICBENCH is not set.\n"
@@ -1383,30 +4935,77 @@ micbench_io_main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    if (parse_args(argc, argv, &option) != 0) {
+    if (mb_parse_groups(argc, argv, &groups, &nr_groups) != 0) {
         fprintf(stderr, "Argument Error.\n");
         exit(EXIT_FAILURE);
     }
+    option = groups[0];
 
     if (option.noop == true){
-        print_result_json(NULL, true);
+        if (nr_groups > 1) {
+            print_groups_json(NULL, NULL, true);
+        } else {
+            print_result_json(NULL, true);
+        }
         exit(EXIT_SUCCESS);
     }
 
-    th_args = malloc(sizeof(th_arg_t) * option.multi);
-
-    if (option.read) {
-        flags = O_RDONLY;
-    } else if (option.write) {
-        flags = O_WRONLY;
-    } else {
-        flags = O_RDWR;
+    nr_threads = 0;
+    for (g = 0; g < nr_groups; g++) {
+        if (groups[g].read) {
+            flags = O_RDONLY;
+        } else if (groups[g].write) {
+            flags = O_WRONLY;
+        } else {
+            flags = O_RDWR;
+        }
+        if (groups[g].direct) {
+            flags |= O_DIRECT;
+        }
+        if (groups[g].dsync) {
+            flags |= O_DSYNC;
+        }
+        // files are opened in the directory on each I/O
+        if (groups[g].pattern == PATTERN_SMALLFILE) {
+            flags = O_RDONLY | O_DIRECTORY;
+        }
+        groups[g].open_flags = flags;
+        nr_threads += groups[g].multi;
     }
-    if (option.direct) {
-        flags |= O_DIRECT;
+    option = groups[0];
+
+    th_args = malloc(sizeof(th_arg_t) * nr_threads);
+    meter_begin = calloc(nr_groups, sizeof(meter_t));
+    meter_end = calloc(nr_groups, sizeof(meter_t));
+    results = calloc(nr_groups, sizeof(result_t));
+    if (th_args == NULL || meter_begin == NULL || meter_end == NULL ||
+        results == NULL) {
+        perror("micbench_io_main:malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    ra_saved = calloc(nr_groups, sizeof(int *));
+    if (ra_saved == NULL) {
+        perror("micbench_io_main:malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    wals = calloc(nr_groups, sizeof(wal_t));
+    if (wals == NULL) {
+        perror("micbench_io_main:malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (g = 0; g < nr_groups; g++) {
+        if (groups[g].pattern == PATTERN_WAL) {
+            mb_wal_init(&wals[g], &groups[g]);
+        }
     }
-    option.open_flags = flags;
 
+    if (option.sysstat) {
+        for (g = 0; g < nr_groups; g++) {
+            for (i = 0; i < groups[g].nr_files; i++) {
+                mb_sysstat_add_dev(groups[g].file_path_list[i]);
+            }
+        }
+    }
 
     // initialize common seed value with /dev/urandom
     FILE *f;
@@ -1427,66 +5026,206 @@ micbench_io_main(int argc, char **argv)
         aio_tracefile = NULL;
     }
 
-    for(i = 0;i < option.multi;i++){
-        th_args[i].id          = i;
-        th_args[i].self        = malloc(sizeof(pthread_t));
-        th_args[i].common_seed = common_seed;
-        meter              = th_args[i].meter = malloc(sizeof(meter_t));
-        meter->iowait_time = 0;
-        meter->count       = 0;
+    th_arg = th_args;
+    for (g = 0; g < nr_groups; g++) {
+        for(i = 0;i < groups[g].multi;i++){
+            th_arg->id          = i;
+            th_arg->group       = g;
+            th_arg->self        = malloc(sizeof(pthread_t));
+            th_arg->common_seed = common_seed;
+            // meters are updated for each I/O; avoid false sharing
+            if (posix_memalign((void **) &th_arg->meter, CACHELINE_SIZE,
+                               sizeof(meter_t)) != 0) {
+                perror("posix_memalign failed");
+                exit(EXIT_FAILURE);
+            }
+            bzero(th_arg->meter, sizeof(meter_t));
+            th_arg->lat_hist = NULL;
+            th_arg->fileset = NULL;
+            if (groups[g].pattern == PATTERN_WAL
+                || groups[g].pattern == PATTERN_SMALLFILE) {
+                th_arg->lat_hist = malloc(sizeof(mb_hist_t));
+                mb_hist_init(th_arg->lat_hist);
+            }
+            th_arg++;
+        }
     }
 
-    GETTIMEOFDAY(&start_tv);
-    for(i = 0;i < option.multi;i++){
+    mb_epoch_init(&epoch, option.warmup, option.timeout, option.rampdown);
+    epoch.hook = mb_io_epoch_hook;
+    epoch.hook_arg = th_args;
+    nr_finished_workers = 0;
+    pthread_barrier_init(&start_barrier, NULL, nr_threads + 1);
+    for(i = 0;i < nr_threads;i++){
         pthread_create(th_args[i].self, NULL, thread_handler, &th_args[i]);
     }
 
-    for(i = 0;i < option.multi;i++){
-        pthread_join(*th_args[i].self, NULL);
+    // wait for preconditioning, which would fill page cache
+    pthread_barrier_wait(&start_barrier);
+    for (g = 0; g < nr_groups; g++) {
+        option = groups[g];
+        ra_saved[g] = NULL;
+        if (option.drop_cache || option.prefetch || option.readahead_kb >= 0) {
+            ra_saved[g] = malloc(sizeof(int) * option.nr_files);
+            mb_cache_prepare(ra_saved[g]);
+        }
+    }
+    option = groups[0];
+    GETTIMEOFDAY(&start_tv);
+    for(i = 0;i < nr_threads;i++){
+        th_args[i].common_start_tv = start_tv;
+    }
+    mb_epoch_start(&epoch);
+    pthread_barrier_wait(&start_barrier);
+    if (option.sysstat) {
+        pthread_create(&sysstat_boundary_sampler, NULL, mb_sysstat_boundary, th_args);
+    }
+    if (option.sysstat_interval > 0) {
+        pthread_create(&sysstat_sampler, NULL, mb_sysstat_sampler, th_args);
     }
-    exec_time = mb_elapsed_time_from(&start_tv);
-
-    int64_t count_sum = 0;
-    double iowait_time_sum = 0;
-    result.io_count = 0;
-    result.io_bytes = 0;
 
-    for(i = 0;i < option.multi;i++){
-        meter = th_args[i].meter;
-        count_sum += meter->count;
-        iowait_time_sum += meter->iowait_time;
+    // meters are summed up by mb_io_epoch_hook on phase changes
+    if (option.steady_state) {
+        mb_epoch_wait(&epoch, MB_EPOCH_MEASURE);
+        mb_ss_run(th_args, &meter_begin[0], &results[0]);
     }
 
-    result.io_count = count_sum;
-    result.io_bytes = count_sum * option.blk_sz;
+    for(i = 0;i < nr_threads;i++){
+        pthread_join(*th_args[i].self, NULL);
+    }
+    mb_epoch_finish(&epoch);
+    pthread_barrier_destroy(&start_barrier);
+    if (option.sysstat) {
+        pthread_join(sysstat_boundary_sampler, NULL);
+    }
+    if (option.sysstat_interval > 0) {
+        pthread_join(sysstat_sampler, NULL);
+    }
+    for (g = nr_groups - 1; g >= 0; g--) {
+        if (ra_saved[g] != NULL) {
+            option = groups[g];
+            mb_cache_restore(ra_saved[g]);
+            free(ra_saved[g]);
+        }
+    }
+    free(ra_saved);
+    option = groups[0];
+
+    bzero(&result, sizeof(result));
+    for (g = 0; g < nr_groups; g++) {
+        if (! option.steady_state) {
+            results[g].io_count = meter_end[g].count - meter_begin[g].count;
+            results[g].io_bytes = meter_end[g].bytes - meter_begin[g].bytes;
+            results[g].exec_time = mb_epoch_measured_time(&epoch);
+            results[g].iowait_time = (meter_end[g].iowait_time - meter_begin[g].iowait_time)
+                / groups[g].multi;
+            results[g].flush_count = meter_end[g].flush_count - meter_begin[g].flush_count;
+            results[g].flush_time = meter_end[g].flush_time - meter_begin[g].flush_time;
+            for (i = 0; i < MB_NR_SPACE_OPS; i++) {
+                results[g].space_count[i] = meter_end[g].space_count[i]
+                    - meter_begin[g].space_count[i];
+                results[g].space_time[i] = meter_end[g].space_time[i]
+                    - meter_begin[g].space_time[i];
+            }
+            results[g].cache_pages = meter_end[g].cache_pages - meter_begin[g].cache_pages;
+            results[g].cache_hits = meter_end[g].cache_hits - meter_begin[g].cache_hits;
+        }
+        results[g].start_time = TV2DOUBLE(epoch.measure_start_tv);
+        mb_result_calc(&results[g], groups[g].multi);
+        if (groups[g].pattern == PATTERN_WAL
+            || groups[g].pattern == PATTERN_SMALLFILE) {
+            results[g].lat_hist = malloc(sizeof(mb_hist_t));
+            mb_hist_init(results[g].lat_hist);
+            for (i = 0; i < nr_threads; i++) {
+                if (th_args[i].group == g) {
+                    mb_hist_merge(results[g].lat_hist, th_args[i].lat_hist);
+                }
+            }
+        }
 
-    result.start_time = TV2LONG(start_tv) / 1.0e6;
-    result.exec_time = exec_time;
-    result.iowait_time = iowait_time_sum / option.multi;
-    result.response_time = iowait_time_sum / count_sum;
-    result.iops = count_sum / result.exec_time;
-    result.bandwidth = count_sum * option.blk_sz / result.exec_time;
+        result.io_count += results[g].io_count;
+        result.io_bytes += results[g].io_bytes;
+        result.iowait_time += results[g].iowait_time * groups[g].multi / nr_threads;
+        result.flush_count += results[g].flush_count;
+        result.flush_time += results[g].flush_time;
+        for (i = 0; i < MB_NR_SPACE_OPS; i++) {
+            result.space_count[i] += results[g].space_count[i];
+            result.space_time[i] += results[g].space_time[i];
+        }
+        result.cache_pages += results[g].cache_pages;
+        result.cache_hits += results[g].cache_hits;
+    }
+    result.start_time = results[0].start_time;
+    result.exec_time = results[0].exec_time;
+    mb_result_calc(&result, nr_threads);
 
-    if (option.json) {
-        print_result_json(&result, false);
+    if (nr_groups == 1) {
+        if (option.json) {
+            print_result_json(&results[0], false);
+        } else {
+            print_result(&results[0], "result");
+        }
+    } else if (option.json) {
+        print_groups_json(results, &result, false);
     } else {
-        print_result(&result);
+        for (g = 0; g < nr_groups; g++) {
+            char title[64];
+
+            option = groups[g];
+            snprintf(title, sizeof(title), "result of group %d", g);
+            print_result(&results[g], title);
+        }
+        option = groups[0];
+        print_result(&result, "result of all groups");
+    }
+    if (option.sysstat && ! option.json) {
+        print_sysstat();
+    }
+    if (option.sysstat) {
+        free(sysstat_begin.devstat);
+        free(sysstat_end.devstat);
+        for (i = 0; i < nr_sysstat_samples; i++) {
+            free(sysstat_samples[i].devstat);
+        }
+        free(sysstat_samples);
+        free(sysstat_devs);
     }
 
-    for(i = 0;i < option.multi;i++){
+    for(i = 0;i < nr_threads;i++){
         free(th_args[i].meter);
         free(th_args[i].self);
+        free(th_args[i].lat_hist);
     }
     free(th_args);
-
-    if (option.affinities != NULL){
-        for(i = 0; i < option.multi; i++){
-            if (option.affinities[i] != NULL){
-                free(option.affinities[i]);
+    free(meter_begin);
+    free(meter_end);
+
+    for (g = 0; g < nr_groups; g++) {
+        option = groups[g];
+        if (option.affinities != NULL){
+            for(i = 0; i < option.multi; i++){
+                if (option.affinities[i] != NULL){
+                    free(option.affinities[i]);
+                }
             }
+            free(option.affinities);
         }
-        free(option.affinities);
+
+        if (option.replay_recs != NULL) {
+            free(option.replay_recs);
+        }
+        if (option.pattern == PATTERN_WAL) {
+            mb_wal_destroy(&wals[g]);
+        }
+        free(results[g].lat_hist);
+    }
+    free(wals);
+    option = groups[0];
+    if (option.steady_state) {
+        free(results[0].ss_round_iops);
     }
+    free(results);
+    free(groups);
 
     return 0;
 }
@@ -12,6 +12,8 @@ typedef enum {
     PATTERN_RAND,
     PATTERN_SEEKDIST,
     PATTERN_SEEKINCR,
+    PATTERN_WAL,
+    PATTERN_SMALLFILE,
 } mb_io_pattern_t;
 
 typedef enum {
@@ -22,6 +24,40 @@ typedef enum {
 #endif
 } mb_aio_engine_t;
 
+typedef enum {
+    MB_DO_READ,
+    MB_DO_WRITE,
+    MB_DO_FLUSH,
+
+    // operations on space, not counted as I/O
+    MB_DO_TRIM,     // discard or punch hole
+    MB_DO_ZERO,     // write zeroes
+    MB_DO_ALLOC,    // fallocate
+} mb_io_mode_t;
+
+#define MB_NR_SPACE_OPS 3
+#define MB_IS_SPACE_OP(mode) ((mode) >= MB_DO_TRIM)
+#define MB_SPACE_OP_IDX(mode) ((mode) - MB_DO_TRIM)
+
+typedef enum {
+    FLUSH_FSYNC,
+    FLUSH_FDATASYNC,
+    FLUSH_SYNC_FILE_RANGE,
+} mb_flush_op_t;
+
+// an I/O request loaded from an I/O activity log for replay
+typedef struct {
+    int64_t issue_usec; // relative to the first request in the log
+    int file_idx;
+    int64_t addr;       // in bytes
+    int size;           // in bytes
+    mb_io_mode_t mode;
+} mb_replay_rec_t;
+
+// steady state criteria of SNIA SSS PTS (ratio to average IOPS)
+#define MB_SS_MAX_EXCURSION       0.20
+#define MB_SS_MAX_SLOPE_EXCURSION 0.10
+
 typedef struct {
     // multiplicity of IO
     int multi;
@@ -36,6 +72,9 @@ typedef struct {
 
     mb_aio_engine_t aio_engine;
 
+    // back I/O buffers with 2MB huge pages
+    bool hugepage;
+
     // aio nr_events per threads
     int aio_nr_events;
 
@@ -46,12 +85,31 @@ typedef struct {
     char *logfile_path;
     FILE *logfile;
 
+    // I/O activity log to be replayed
+    char *replay_path;
+    bool replay_afap; // ignore original timing
+    int nr_replay_recs;
+    int replay_max_sz;
+    mb_replay_rec_t *replay_recs;
+
+    // # of sequential fill passes before random overwrite
+    int precondition;
+
+    // run in rounds until interval IOPS get steady
+    bool steady_state;
+    int ss_round;   // length of a round in sec
+    int ss_window;  // # of rounds in measurement window
+
     // thread affinity assignment
     mb_affinity_t **affinities;
 
     // timeout
     int timeout;
 
+    // periods before and after the measurement, not accounted
+    double warmup;
+    double rampdown;
+
     // block size
     char *blk_sz_str;
     int blk_sz;
@@ -63,6 +121,20 @@ typedef struct {
     // stride size of seekdist (should be much greater than on-disk read buffer)
     int64_t seekdist_stride;
 
+    // WAL mode: records of wal_rec_min to wal_rec_max bytes are
+    // appended and committed in groups by a leader thread, which
+    // waits commit_delay usec for followers before writing
+    int wal_rec_min;
+    int wal_rec_max;
+    useconds_t commit_delay;
+
+    // small file mode: each thread owns a directory of nr_small_files
+    // files of small_file_min to small_file_max bytes under the target
+    // directory, and reads or rewrites a whole file on each open
+    int nr_small_files;
+    int64_t small_file_min;
+    int64_t small_file_max;
+
     int64_t misalign;
 
     // device or file
@@ -70,12 +142,51 @@ typedef struct {
     int nr_files;
     char **file_path_list;
     int64_t *file_size_list;
+    int64_t *file_iops_list; // rate limits shared by threads (0 for unlimited)
+    int64_t *file_bw_list;   // in bytes/sec
+    bool *file_blkdev_list;
 
     // bogus computation
     long bogus_comp; // # of computation to be operated
 
     useconds_t iosleep;
 
+    // flush written files every flush_every writes and/or every
+    // flush_interval msec (0 for never)
+    int flush_every;
+    int flush_interval;
+    mb_flush_op_t flush_op;
+
+    // open files with O_DSYNC
+    bool dsync;
+
+    // page cache of buffered I/O: write back and drop cached pages of
+    // targets and/or prefetch them before the run, posix_fadvise(2)
+    // hint on each open (-1 for none), readahead of the underlying
+    // devices in KiB (-1 for unchanged), and residency of pages to be
+    // read sampled every cache_sample reads (0 for never)
+    bool drop_cache;
+    bool prefetch;
+    int fadvise;
+    int readahead_kb;
+    int cache_sample;
+
+    // ratio of trims, zeroings and allocations of a block among
+    // requests; the rest are reads and writes
+    double trim_ratio;
+    double zero_ratio;
+    double alloc_ratio;
+
+    // sample counters of devices holding targets and CPU time of
+    // workers at the start and the end of measurement, and every
+    // sysstat_interval msec (0 for never) in the run
+    bool sysstat;
+    int sysstat_interval;
+
+    // rate limits of each thread (0 for unlimited)
+    int64_t thread_iops;
+    int64_t thread_bw;      // in bytes/sec
+
     bool continue_on_error;
 
     bool json;
@@ -83,37 +194,86 @@ typedef struct {
     bool verbose;
 
     bool noop;
-} micbench_io_option_t;
 
-typedef enum {
-    MB_DO_READ,
-    MB_DO_WRITE,
-} mb_io_mode_t;
-
-typedef struct mb_res_pool_cell {
-    void *data;
-    struct mb_res_pool_cell *next;
-} mb_res_pool_cell_t;
+    // first option given which applies to the whole run, not to a
+    // group (e.g. "-t"), or NULL
+    const char *run_opt;
+} micbench_io_option_t;
 
 // resource pool
 typedef struct {
     int nr_elems;
     int nr_avail;
-    mb_res_pool_cell_t *ring; // ring buffer
-    mb_res_pool_cell_t *head;
-    mb_res_pool_cell_t *tail;
+    void **avail; // stack of available elements
 
+    // element storage owned by the pool (NULL if elemsize == 0)
     size_t elemsize;
     char *elembase;
 } mb_res_pool_t;
 
 
+// I/O buffers of a thread, allocated at once on the thread's node
+typedef struct {
+    struct iovec vec;   // whole arena
+    size_t slot_size;
+    int nr_slots;
+    bool hugepage;      // actually backed by huge pages
+} mb_iobuf_arena_t;
+
+// log shared by threads of a group in WAL mode
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    int64_t appended_lsn;   // of the last record appended
+    int64_t durable_lsn;    // records up to this are written and flushed
+    bool committing;        // a leader is writing a group
+    int64_t pending_bytes;  // of records not taken by a leader
+
+    int64_t offset;         // where the next group is written
+    int64_t ofst_min;       // in bytes
+    int64_t ofst_max;
+
+    char *buf;              // contents of groups
+} wal_t;
+
+// leading fields of /sys/dev/block/<maj:min>/stat and /proc/diskstats
+enum {
+    DS_READS,
+    DS_READ_MERGES,
+    DS_READ_SECTORS,
+    DS_READ_TICKS,
+    DS_WRITES,
+    DS_WRITE_MERGES,
+    DS_WRITE_SECTORS,
+    DS_WRITE_TICKS,
+    DS_IN_FLIGHT,
+    DS_IO_TICKS,        // in msec
+    DS_TIME_IN_QUEUE,   // in msec, weighted by # of requests
+    DS_NR_FIELDS,
+};
+
+// activity of a device between two samples of its counters
+typedef struct {
+    double read_iops;
+    double write_iops;
+    double read_merges;     // per sec
+    double write_merges;
+    double read_mbps;
+    double write_mbps;
+    double queue_depth;     // on average
+    double utilization;     // busy time / elapsed time
+} devstat_rate_t;
+
 /* wrapper of struct iocb */
 typedef struct aiom_cb {
     struct iocb iocb;
     struct timeval submit_time;
     struct timeval queue_time;
     int file_idx;
+    mb_io_mode_t mode;
+    size_t count;
+    long long offset;
     struct iovec *vec;
     int iovec_idx;
 } aiom_cb_t;
@@ -127,6 +287,7 @@ typedef struct {
 #endif
 
     mb_res_pool_t *cbpool;
+    mb_iobuf_arena_t *arena;
     struct iovec *vecs;
 
     int nr_events;
@@ -135,8 +296,17 @@ typedef struct {
 
     // # of IO completed by this AIO manager
     int64_t iocount;
+    int64_t iobytes;
     double iowait;
 
+    // flushes completed, not counted as IO
+    int64_t flushcount;
+    double flushwait;
+
+    // space operations completed, indexed by MB_SPACE_OP_IDX
+    int64_t spacecount[MB_NR_SPACE_OPS];
+    double spacewait[MB_NR_SPACE_OPS];
+
     aiom_cb_t **pending;
     struct io_event *events;
 } mb_aiom_t;
@@ -144,6 +314,13 @@ typedef struct {
 
 void mb_set_option(micbench_io_option_t *option);
 int parse_args(int argc, char **argv, micbench_io_option_t *option);
+int mb_parse_groups(int argc, char **argv,
+                    micbench_io_option_t **groups, unsigned int *nr_groups);
+
+mb_iobuf_arena_t *mb_iobuf_arena_make    (int nr_slots, size_t slot_size,
+                                          unsigned long nodemask);
+void              mb_iobuf_arena_destroy (mb_iobuf_arena_t *arena);
+void             *mb_iobuf_arena_slot    (mb_iobuf_arena_t *arena, int idx);
 
 mb_aiom_t   *mb_aiom_make           (int nr_events);
 void         mb_aiom_destroy        (mb_aiom_t *aiom);
@@ -152,16 +329,37 @@ aiom_cb_t   *mb_aiom_prep_pread     (mb_aiom_t *aiom, int fd, int file_idx,
                                      aiom_cb_t *aiom_cb, size_t count, long long offset);
 aiom_cb_t   *mb_aiom_prep_pwrite    (mb_aiom_t *aiom, int fd, int file_idx,
                                      aiom_cb_t *aiom_cb, size_t count, long long offset);
+aiom_cb_t   *mb_aiom_prep_flush     (mb_aiom_t *aiom, int fd, int file_idx,
+                                     aiom_cb_t *aiom_cb);
+aiom_cb_t   *mb_aiom_prep_space     (mb_aiom_t *aiom, int fd, int file_idx,
+                                     aiom_cb_t *aiom_cb, mb_io_mode_t mode,
+                                     size_t count, long long offset);
 int          mb_aiom_wait           (mb_aiom_t *aiom, struct timespec *timeout);
 int          mb_aiom_waitall        (mb_aiom_t *aiom);
 int          mb_aiom_nr_submittable (mb_aiom_t *aiom);
 
-mb_res_pool_t *mb_res_pool_make    (int nr_elems);
+mb_res_pool_t *mb_res_pool_make    (int nr_elems, size_t elemsize);
 void           mb_res_pool_destroy (mb_res_pool_t *pool);
 void          *mb_res_pool_pop     (mb_res_pool_t *pool);
 int            mb_res_pool_push    (mb_res_pool_t *pool, void *elem);
 int64_t        mb_res_pool_idx     (mb_res_pool_t *pool, void *elem);
 
+int mb_replay_load(const char *path, micbench_io_option_t *option);
+bool mb_ss_check(const double *iops, int nr_rounds, int window,
+                 double *excursion, double *slope_excursion);
+mb_io_mode_t mb_choose_op(struct drand48_data *rand, mb_io_mode_t mode);
+bool mb_space_op_async(mb_io_mode_t mode, int file_idx);
+
+void    mb_wal_init       (wal_t *wal, micbench_io_option_t *option);
+void    mb_wal_destroy    (wal_t *wal);
+int64_t mb_wal_append     (wal_t *wal, int rec_sz);
+int64_t mb_wal_take_group (wal_t *wal, int64_t *size, int64_t *offset);
+
+int  mb_diskstats_parse (const char *line, unsigned int maj, unsigned int min,
+                         int64_t *fields);
+void mb_devstat_rate    (const int64_t *s, const int64_t *e, double dt,
+                         devstat_rate_t *rate);
+
 #define mb_read_or_write() \
     (option.read == true ? MB_DO_READ : \
      option.write == true ? MB_DO_WRITE : \
@@ -0,0 +1,8 @@
+
+#include "micbench-lock.h"
+
+int
+main(int argc, char **argv)
+{
+    return micbench_lock_main(argc, argv);
+}
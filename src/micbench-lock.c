@@ -1,49 +1,25 @@
 #define _GNU_SOURCE
 
-#include "micbench.h"
+#include "micbench-lock.h"
 
-typedef enum {
-    TEST_SPINLOCK,
-    TEST_MUTEX,
-    TEST_MFENCE,
-} mb_testmode_t;
+const char *mode_names[TEST_NR] = {
+    "spinlock", "mutex", "mfence", "pingpong", "pingpong-cas",
+};
 
-struct {
-    // multiplicity and affinities
-    int multi;
-    mb_affinity_t **affinities;
+micbench_lock_option_t option;
 
-    // count
-    long count;
-    long critical_job_size;
-    long noncritical_job_size;
+// # of iterations per job run in warm-up and ramp-down
+#define LOCK_UNMEASURED_COUNT 1024
 
-    // mode
-    mb_testmode_t mode;
+// warm-up, measurement and ramp-down of the run
+static mb_epoch_t epoch;
+static int nr_finished_threads;
 
-    bool verbose;
-} option;
+// the responder of pingpong modes quits on this value of the flag
+#define PINGPONG_STOP (-1L)
 
-typedef struct perf_counter_rec {
-    unsigned long ops;
-    unsigned long clk;
-    double wallclocktime;
-} perf_counter_t;
-
-typedef struct {
-    int            id;
-    pthread_t     *self;
-    mb_affinity_t *affinity;
-
-    int             fd;
-    perf_counter_t  pc;
-
-    pthread_barrier_t *barrier;
-
-    pthread_mutex_t *mutex;
-    pthread_spinlock_t *slock;
-    long *sc; // shared counter
-} th_arg_t;
+// set when no pair of CPUs is left in pingpong modes
+static volatile bool pingpong_done;
 
 // prototype declarations
 uintptr_t read_tsc(void);
@@ -62,7 +38,7 @@ swap_long(long *ptr1, long *ptr2)
     }
 }
 
-void
+int
 parse_args(int argc, char **argv)
 {
     char optchar;
@@ -75,9 +51,12 @@ parse_args(int argc, char **argv)
     option.mode = TEST_SPINLOCK;
     option.critical_job_size = 10;
     option.noncritical_job_size = 1000;
+    option.warmup = 0;
+    option.rampdown = 0;
+    option.all_pairs = false;
 
     optind = 1;
-    while ((optchar = getopt(argc, argv, "+m:M:C:N:a:c:v")) != -1) {
+    while ((optchar = getopt(argc, argv, "+m:M:C:N:a:Ac:w:r:v")) != -1) {
         switch(optchar){
         case 'm': // multi
             option.multi = strtol(optarg, NULL, 10);
@@ -90,7 +69,7 @@ parse_args(int argc, char **argv)
             for(idx = optind; idx < argc; idx++){
                 if (strcmp("-m", argv[idx]) == 0) {
                     perror("-m option must be specified before -a.\n");
-                    exit(EXIT_FAILURE);
+                    return 1;
                 }
             }
             if (option.affinities == NULL){
@@ -100,30 +79,31 @@ parse_args(int argc, char **argv)
 
             if ((aff = mb_parse_affinity(NULL, optarg)) == NULL){
                 fprintf(stderr, "Invalid argument for -a: %s\n", optarg);
-                exit(EXIT_FAILURE);
+                return 1;
             }
             aff->optarg = strdup(optarg);
             option.affinities[aff->tid] = aff;
         }
             break;
+        case 'A': // all pairs
+            option.all_pairs = true;
+            break;
         case 'M': // mode
-            if (strcmp("spinlock", optarg) == 0){
-                option.mode = TEST_SPINLOCK;
-            } else if (strcmp("mutex", optarg) == 0){
-                option.mode = TEST_MUTEX;
-            } else if (strcmp("mfence", optarg) == 0){
-                option.mode = TEST_MFENCE;
-            } else {
+            for (idx = 0; idx < TEST_NR; idx++) {
+                if (strcmp(mode_names[idx], optarg) == 0) break;
+            }
+            if (idx == TEST_NR) {
                 fprintf(stderr, "No such test mode: %s\n", optarg);
-                exit(EXIT_FAILURE);
+                return 1;
             }
+            option.mode = idx;
             break;
         case 'C': // critical job size
             option.critical_job_size = strtol(optarg, NULL, 10);
             if (option.critical_job_size <= 0){
                 fprintf(stderr,
                         "-C requires positive integer but given: %s\n", optarg);
-                exit(EXIT_FAILURE);
+                return 1;
             }
             break;
         case 'N': // non critical job size
@@ -131,24 +111,68 @@ parse_args(int argc, char **argv)
             if (option.noncritical_job_size <= 0){
                 fprintf(stderr,
                         "-N requires positive integer but given: %s\n", optarg);
-                exit(EXIT_FAILURE);
+                return 1;
             }
             break;
         case 'c': // count
             option.count = strtol(optarg, NULL, 10);
             break;
+        case 'w': // warmup
+            option.warmup = strtod(optarg, NULL);
+            if (option.warmup < 0){
+                fprintf(stderr,
+                        "-w requires non-negative number but given: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r': // rampdown
+            option.rampdown = strtod(optarg, NULL);
+            if (option.rampdown < 0){
+                fprintf(stderr,
+                        "-r requires non-negative number but given: %s\n", optarg);
+                return 1;
+            }
+            break;
         case 'v': // verbose
             option.verbose = true;
             break;
         default:
             fprintf(stderr, "Unknown option '-%c'\n", optchar);
-            exit(EXIT_FAILURE);
+            return 1;
+        }
+    }
+
+    if (option.mode == TEST_PINGPONG || option.mode == TEST_PINGPONG_CAS) {
+        if (option.multi != 2) {
+            fprintf(stderr, "-M %s requires -m 2.\n", mode_names[option.mode]);
+            return 1;
+        }
+        if (option.rampdown > 0) {
+            fprintf(stderr, "-r cannot be used with -M %s.\n", mode_names[option.mode]);
+            return 1;
+        }
+        if (option.all_pairs == true && option.affinities != NULL) {
+            fprintf(stderr, "-A cannot be used with -a.\n");
+            return 1;
         }
+        // unpinned threads would measure whatever CPUs they land on
+        if (option.all_pairs == false &&
+            (option.affinities == NULL ||
+             option.affinities[0] == NULL || option.affinities[1] == NULL)) {
+            fprintf(stderr, "-M %s requires -a for both threads or -A.\n",
+                    mode_names[option.mode]);
+            return 1;
+        }
+    } else if (option.all_pairs == true) {
+        fprintf(stderr, "-A requires -M pingpong or pingpong-cas.\n");
+        return 1;
     }
+
+    return 0;
 }
 
-static void
-thread_job_spinlock(th_arg_t *arg)
+static long
+thread_job_spinlock(th_arg_t *arg, long count)
 {
     long i;
     long j;
@@ -156,7 +180,7 @@ thread_job_spinlock(th_arg_t *arg)
 
     x = 0.1;
     __asm__("# thread job start");
-    for(i = 0; i < option.count; i++){
+    for(i = 0; i < count; i++){
         pthread_spin_lock(arg->slock);
         for(j = 0; j < option.critical_job_size; j++){
             if (x > 1.0)
@@ -173,11 +197,11 @@ thread_job_spinlock(th_arg_t *arg)
         }
     }
     __asm__("# thread job end");
-    arg->pc.ops = option.count;
+    return count;
 }
 
-static void
-thread_job_mutex(th_arg_t *arg)
+static long
+thread_job_mutex(th_arg_t *arg, long count)
 {
     long i;
     long j;
@@ -185,7 +209,7 @@ thread_job_mutex(th_arg_t *arg)
 
     x = 0.1;
     __asm__("# thread job mutex start");
-    for(i = 0; i < option.count; i++){
+    for(i = 0; i < count; i++){
         pthread_mutex_lock(arg->mutex);
         for(j = 0; j < option.critical_job_size; j++){
             if (x > 1.0)
@@ -202,18 +226,18 @@ thread_job_mutex(th_arg_t *arg)
         }
     }
     __asm__("# thread job mutex end");
-    arg->pc.ops = option.count;
+    return count;
 }
 
-static void
-thread_job_mfence(th_arg_t *arg)
+static long
+thread_job_mfence(th_arg_t *arg, long count)
 {
     long i;
     volatile double x;
 
     x = 0.1;
     __asm__("# thread job mfence start");
-    for(i = 0; i < option.count; i++){
+    for(i = 0; i < count; i++){
         __asm__ volatile(
 #include "micbench-lock-mfence-inner.c"
             : "=a" (arg->sc)
@@ -222,7 +246,98 @@ thread_job_mfence(th_arg_t *arg)
 
     }
     __asm__("# thread job mfence end");
-    arg->pc.ops = option.count * 128;
+    return count * 128;
+}
+
+static long
+thread_job(th_arg_t *arg, long count)
+{
+    switch(option.mode){
+    case TEST_SPINLOCK:
+        return thread_job_spinlock(arg, count);
+    case TEST_MUTEX:
+        return thread_job_mutex(arg, count);
+    case TEST_MFENCE:
+        return thread_job_mfence(arg, count);
+    default:
+        // pingpong modes run pingpong_handler instead
+        break;
+    }
+    return 0;
+}
+
+// one round trip of the initiator: hand the line over with an odd
+// value and wait for the responder to answer with the next even one
+static inline long
+pingpong_round(volatile long *flag, long v)
+{
+    if (option.mode == TEST_PINGPONG_CAS) {
+        __sync_bool_compare_and_swap(flag, v, v + 1);
+    } else {
+        __atomic_store_n(flag, v + 1, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(flag, __ATOMIC_ACQUIRE) != v + 2)
+        ;
+    return v + 2;
+}
+
+// thread 0 initiates round trips and thread 1 responds, once for each
+// pair of CPUs the main thread pins them to
+void *
+pingpong_handler(void *arg)
+{
+    pid_t tid;
+    th_arg_t *th_arg = (th_arg_t *) arg;
+    long i;
+    long v;
+    int64_t ns0, ns1;
+    long t0, t1;
+
+    for(;;){
+        pthread_barrier_wait(th_arg->barrier);
+        if (pingpong_done) break;
+        if (th_arg->affinity != NULL){
+            tid = syscall(SYS_gettid);
+            sched_setaffinity(tid, sizeof(cpu_set_t), &th_arg->affinity->cpumask);
+        }
+        pthread_barrier_wait(th_arg->barrier);
+
+        if (th_arg->id == 0) {
+            v = 0;
+            for(i = 0; i < LOCK_UNMEASURED_COUNT ||
+                    mb_epoch_phase(&epoch) == MB_EPOCH_WARMUP; i++){
+                v = pingpong_round(th_arg->flag, v);
+            }
+            ns0 = mb_clock_nsec();
+            t0 = mb_read_tsc();
+            for(i = 0; i < option.count; i++){
+                v = pingpong_round(th_arg->flag, v);
+            }
+            t1 = mb_read_tsc();
+            ns1 = mb_clock_nsec();
+            mb_epoch_end_measure(&epoch);
+            __atomic_store_n(th_arg->flag, PINGPONG_STOP, __ATOMIC_RELEASE);
+
+            th_arg->pc.ops = option.count;
+            th_arg->pc.clk = t1 - t0;
+            th_arg->pc.wallclocktime = (ns1 - ns0) / 1.0e9;
+        } else {
+            for(;;){
+                while (((v = __atomic_load_n(th_arg->flag, __ATOMIC_ACQUIRE)) & 1) == 0)
+                    ;
+                if (v == PINGPONG_STOP) break;
+                if (option.mode == TEST_PINGPONG_CAS) {
+                    __sync_bool_compare_and_swap(th_arg->flag, v, v + 1);
+                } else {
+                    __atomic_store_n(th_arg->flag, v + 1, __ATOMIC_RELEASE);
+                }
+            }
+        }
+        // the main thread collects the results of this pair
+        pthread_barrier_wait(th_arg->barrier);
+    }
+
+    pthread_exit(NULL);
 }
 
 void *
@@ -239,27 +354,119 @@ thread_handler(void *arg)
 
     // do some jobs
     pthread_barrier_wait(th_arg->barrier);
-    t0 = mb_read_tsc();
-    switch(option.mode){
-    case TEST_SPINLOCK:
-        thread_job_spinlock(th_arg);
-        break;
-    case TEST_MUTEX:
-        thread_job_mutex(th_arg);
-        break;
-    case TEST_MFENCE:
-        thread_job_mfence(th_arg);
-        break;
+    pthread_barrier_wait(th_arg->barrier);
+    while(mb_epoch_phase(&epoch) == MB_EPOCH_WARMUP){
+        thread_job(th_arg, LOCK_UNMEASURED_COUNT);
     }
+    t0 = mb_read_tsc();
+    th_arg->pc.ops = thread_job(th_arg, option.count);
     t1 = mb_read_tsc();
 
     th_arg->pc.clk = t1 - t0;
 
+    // measurement ends when all threads are done; with ramp-down,
+    // keep contending so that stragglers are not measured alone
+    if (__sync_add_and_fetch(&nr_finished_threads, 1) == option.multi) {
+        mb_epoch_end_measure(&epoch);
+    }
+    if (option.rampdown > 0) {
+        while(mb_epoch_phase(&epoch) != MB_EPOCH_DONE){
+            thread_job(th_arg, LOCK_UNMEASURED_COUNT);
+        }
+    }
+
     pthread_exit(NULL);
 }
 
+// pin the two threads as args[].affinity says and measure round trips
+static void
+pingpong_pair(th_arg_t *args)
+{
+    *args[0].flag = 0;
+    mb_epoch_init(&epoch, option.warmup, -1, 0);
+    pthread_barrier_wait(args[0].barrier);
+    mb_epoch_start(&epoch);
+    pthread_barrier_wait(args[0].barrier);
+    pthread_barrier_wait(args[0].barrier);
+    mb_epoch_finish(&epoch);
+}
+
+// round trips between the two threads as pinned by -a, or between
+// every pair of CPUs the process may run on with -A. clk and nsec are
+// nr_cpus x nr_cpus matrices of round trip times with -A.
+static void
+run_pingpong(th_arg_t *args, int *cpus, int nr_cpus, double *clk, double *nsec)
+{
+    int a, b;
+    int i;
+
+    pingpong_done = false;
+    for(i = 0;i < option.multi;i++){
+        pthread_create(args[i].self, NULL, pingpong_handler, &args[i]);
+    }
+    if (option.all_pairs == false) {
+        pingpong_pair(args);
+        clk[0] = (double) args[0].pc.clk / args[0].pc.ops;
+        nsec[0] = args[0].pc.wallclocktime * 1.0e9 / args[0].pc.ops;
+    } else {
+        // the line bounces the same way in both directions
+        for (a = 0; a < nr_cpus; a++) {
+            clk[a * nr_cpus + a] = 0.0;
+            nsec[a * nr_cpus + a] = 0.0;
+            for (b = a + 1; b < nr_cpus; b++) {
+                CPU_ZERO(&args[0].affinity->cpumask);
+                CPU_SET(cpus[a], &args[0].affinity->cpumask);
+                CPU_ZERO(&args[1].affinity->cpumask);
+                CPU_SET(cpus[b], &args[1].affinity->cpumask);
+                pingpong_pair(args);
+                clk[a * nr_cpus + b] = clk[b * nr_cpus + a] =
+                    (double) args[0].pc.clk / args[0].pc.ops;
+                nsec[a * nr_cpus + b] = nsec[b * nr_cpus + a] =
+                    args[0].pc.wallclocktime * 1.0e9 / args[0].pc.ops;
+                if (option.verbose == true) {
+                    fprintf(stderr, "cpu%d-cpu%d: %lf clk, %lf nsec\n",
+                            cpus[a], cpus[b],
+                            clk[a * nr_cpus + b], nsec[a * nr_cpus + b]);
+                }
+            }
+        }
+    }
+    pingpong_done = true;
+    pthread_barrier_wait(args[0].barrier);
+    for(i = 0;i < option.multi;i++){
+        pthread_join(*args[i].self, NULL);
+    }
+}
+
+// the round trip matrix of -A with "-" on the diagonal
+static void
+print_pingpong_matrix(int *cpus, int nr_cpus, double *clk, double *nsec)
+{
+    int k;
+    int a, b;
+
+    printf("pingpong_columns\tcpu");
+    for (b = 0; b < nr_cpus; b++) {
+        printf("\tcpu%d", cpus[b]);
+    }
+    printf("\n");
+    for (k = 0; k < 2; k++) {
+        for (a = 0; a < nr_cpus; a++) {
+            printf("%s\t%d", (k == 0 ? "pingpong_clk" : "pingpong_nsec"), cpus[a]);
+            for (b = 0; b < nr_cpus; b++) {
+                if (a == b) {
+                    printf("\t-");
+                } else {
+                    printf("\t%lf", (k == 0 ? clk : nsec)[a * nr_cpus + b]);
+                }
+            }
+            printf("\n");
+        }
+    }
+}
+
 int
-main(int argc, char **argv)
+micbench_lock_main(int argc, char **argv)
 {
     th_arg_t *args;
     int       i;
@@ -267,20 +474,52 @@ main(int argc, char **argv)
     pthread_mutex_t *mutex;
     pthread_spinlock_t *slock;
     long *sc;
+    long *flag;
+    bool pingpong;
+    cpu_set_t cpuset;
+    int *cpus = NULL;
+    int nr_cpus = 0;
+    double *pair_clk;
+    double *pair_nsec;
 
     if (getenv("MICBENCH") == NULL) {
         fprintf(stderr, "This process may be invoked without micbench command.\n");
     }
 
-    parse_args(argc, argv);
+    if (parse_args(argc, argv) != 0) {
+        exit(EXIT_FAILURE);
+    }
 
     args = malloc(sizeof(th_arg_t) * option.multi);
     barrier = malloc(sizeof(pthread_barrier_t));
     mutex = malloc(sizeof(pthread_mutex_t));
     slock = malloc(sizeof(pthread_spinlock_t));
     sc = malloc(sizeof(long));
+    // the bounced line shares its cache line with nothing else
+    if (posix_memalign((void **) &flag, CACHELINE_SIZE, CACHELINE_SIZE) != 0) {
+        perror("posix_memalign(3) failed");
+        exit(EXIT_FAILURE);
+    }
+    pingpong = (option.mode == TEST_PINGPONG || option.mode == TEST_PINGPONG_CAS);
+    if (pingpong && option.all_pairs) {
+        if (sched_getaffinity(0, sizeof(cpuset), &cpuset) != 0) {
+            perror("sched_getaffinity(2) failed");
+            exit(EXIT_FAILURE);
+        }
+        cpus = malloc(sizeof(int) * CPU_COUNT(&cpuset));
+        for (i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &cpuset)) cpus[nr_cpus++] = i;
+        }
+        if (nr_cpus < 2) {
+            fprintf(stderr, "-A requires 2 or more CPUs.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pair_clk = malloc(sizeof(double) * (nr_cpus > 0 ? nr_cpus * nr_cpus : 1));
+    pair_nsec = malloc(sizeof(double) * (nr_cpus > 0 ? nr_cpus * nr_cpus : 1));
 
-    pthread_barrier_init(barrier, NULL, option.multi);
+    // workers and the main thread, which starts the epoch
+    pthread_barrier_init(barrier, NULL, option.multi + 1);
     pthread_mutex_init(mutex, NULL);
     pthread_spin_init(slock, PTHREAD_PROCESS_PRIVATE);
     *sc = 0;
@@ -294,8 +533,12 @@ main(int argc, char **argv)
         args[i].mutex = mutex;
         args[i].slock = slock;
         args[i].sc = sc;
+        args[i].flag = flag;
+        args[i].fd = -1;
         if (option.affinities != NULL) {
             args[i].affinity = option.affinities[i];
+        } else if (pingpong && option.all_pairs) {
+            args[i].affinity = mb_make_affinity();
         } else {
             args[i].affinity = NULL;
         }
@@ -305,12 +548,23 @@ main(int argc, char **argv)
     struct timeval end_tv;
 
     GETTIMEOFDAY(&start_tv);
-    for(i = 0;i < option.multi;i++){
-        pthread_create(args[i].self, NULL, thread_handler, &args[i]);
-    }
+    if (pingpong) {
+        run_pingpong(args, cpus, nr_cpus, pair_clk, pair_nsec);
+    } else {
+        // the measurement is open-ended; see thread_handler
+        mb_epoch_init(&epoch, option.warmup, -1, option.rampdown);
+        nr_finished_threads = 0;
+        for(i = 0;i < option.multi;i++){
+            pthread_create(args[i].self, NULL, thread_handler, &args[i]);
+        }
+        pthread_barrier_wait(barrier);
+        mb_epoch_start(&epoch);
+        pthread_barrier_wait(barrier);
 
-    for(i = 0;i < option.multi;i++){
-        pthread_join(*args[i].self, NULL);
+        for(i = 0;i < option.multi;i++){
+            pthread_join(*args[i].self, NULL);
+        }
+        mb_epoch_finish(&epoch);
     }
     GETTIMEOFDAY(&end_tv);
     pthread_barrier_destroy(barrier);
@@ -324,12 +578,17 @@ main(int argc, char **argv)
            "critical_job_size\t%ld\n"
            "noncritical_job_size\t%ld\n",
            option.multi,
-           (option.mode == TEST_SPINLOCK ? "spinlock" :
-            (option.mode == TEST_MUTEX ? "mutex" : "unknown")),
+           mode_names[option.mode],
            option.count,
            option.critical_job_size,
            option.noncritical_job_size
         );
+    if (option.warmup > 0 || option.rampdown > 0) {
+        printf("warmup_time\t%lf\n"
+               "rampdown_time\t%lf\n",
+               option.warmup,
+               option.rampdown);
+    }
     if (option.affinities != NULL) {
         for(i = 0; i < option.multi; i++){
             char *aff_str;
@@ -350,7 +609,18 @@ main(int argc, char **argv)
     }
 
     // print results
-    for(i = 0;i < option.multi;i++){
+    if (pingpong && option.all_pairs) {
+        print_pingpong_matrix(cpus, nr_cpus, pair_clk, pair_nsec);
+    } else if (pingpong) {
+        // a round trip moves the line to the responder and back
+        printf("clk_per_round_trip\t%lf\n"
+               "nsec_per_round_trip\t%lf\n"
+               "nsec_one_way\t%lf\n",
+               pair_clk[0],
+               pair_nsec[0],
+               pair_nsec[0] / 2);
+    }
+    for(i = 0;i < option.multi && pingpong == false;i++){
         long clk;
         long ops;
         double clk_per_ops;
@@ -370,7 +640,14 @@ main(int argc, char **argv)
         if (args[i].fd != -1){
             close(args[i].fd);
         }
+        if (pingpong && option.all_pairs) {
+            mb_free_affinity(args[i].affinity);
+        }
     }
+    free(flag);
+    free(cpus);
+    free(pair_clk);
+    free(pair_nsec);
 
     free(args);
 
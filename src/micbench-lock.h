@@ -0,0 +1,70 @@
+/* -*- indent-tabs-mode: nil -*- */
+
+#ifndef MICBENCH_LOCK_H
+#define MICBENCH_LOCK_H
+
+#include "micbench.h"
+
+typedef enum {
+    TEST_SPINLOCK,
+    TEST_MUTEX,
+    TEST_MFENCE,
+    TEST_PINGPONG,      // bounce a cache line with stores
+    TEST_PINGPONG_CAS,  // bounce a cache line with CAS
+    TEST_NR,
+} mb_testmode_t;
+
+extern const char *mode_names[TEST_NR];
+
+typedef struct {
+    // multiplicity and affinities
+    int multi;
+    mb_affinity_t **affinities;
+
+    // count
+    long count;
+    long critical_job_size;
+    long noncritical_job_size;
+
+    // unmeasured time before and after the measurement (in sec)
+    double warmup;
+    double rampdown;
+
+    // mode
+    mb_testmode_t mode;
+
+    // measure every pair of CPUs in pingpong modes
+    bool all_pairs;
+
+    bool verbose;
+} micbench_lock_option_t;
+
+extern micbench_lock_option_t option;
+
+typedef struct perf_counter_rec {
+    unsigned long ops;
+    unsigned long clk;
+    double wallclocktime;
+} perf_counter_t;
+
+typedef struct {
+    int            id;
+    pthread_t     *self;
+    mb_affinity_t *affinity;
+
+    int             fd;
+    perf_counter_t  pc;
+
+    pthread_barrier_t *barrier;
+
+    pthread_mutex_t *mutex;
+    pthread_spinlock_t *slock;
+    long *sc; // shared counter
+    volatile long *flag; // cache line bounced in pingpong modes
+} th_arg_t;
+
+int parse_args(int argc, char **argv);
+
+int micbench_lock_main(int argc, char **argv);
+
+#endif
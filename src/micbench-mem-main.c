@@ -0,0 +1,8 @@
+
+#include "micbench-mem.h"
+
+int
+main(int argc, char **argv)
+{
+    return micbench_mem_main(argc, argv);
+}
@@ -1,64 +1,438 @@
 #define _GNU_SOURCE
 
-#include "micbench.h"
+#include "micbench-mem.h"
 
-struct {
-    // multiplicity of memory access
-    int multi;
-    mb_affinity_t **affinities;
+#include <linux/perf_event.h>
 
-    // memory access mode
-    bool seq;
-    bool rand;
-    bool local;
-
-    // timeout
-    int timeout;
-
-    // memory access size
-    long size; // guaranteed to be multiple of 1024
-    const char *hugetlbfile;
-    long hugepage_size;
-
-    bool verbose;
-} option;
+#if defined(__x86_64__) || defined(__i386__)
+#    define MEM_SIMD_X86
+#    include <immintrin.h>
+#endif
 
-typedef struct perf_counter_rec {
-    unsigned long ops;
-    unsigned long clk;
-    double wallclocktime;
-} perf_counter_t;
+micbench_mem_option_t option;
 
-typedef struct {
-    int            id;
-    pthread_t     *self;
-    mb_affinity_t *affinity;
+static const char *pages_names[PAGES_NR] = {
+    "default", "4k", "thp", "hugetlb",
+};
 
-    long           *working_area; // working area
-    long            working_size; // size of working area
-    int             fd;
-    perf_counter_t  pc;
+#ifndef MAP_HUGE_SHIFT
+#    define MAP_HUGE_SHIFT 26
+#endif
 
-    pthread_barrier_t *barrier;
-} th_arg_t;
+const kernel_t kernels[KERNEL_NR] = {
+    {"incr", 0},
+    {"read", 1},     // sum += a[i]
+    {"write", 1},    // a[i] = s
+    {"copy", 2},     // b[i] = a[i]
+    {"scale", 2},    // b[i] = s * a[i]
+    {"add", 3},      // c[i] = a[i] + b[i]
+    {"triad", 3},    // c[i] = a[i] + s * b[i]
+};
+
+#define PMU_CACHE_EVENT(cache, op, result)                      \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static const struct {
+    const char *name;
+    uint32_t    type;
+    uint64_t    config;
+} pmu_events[PMU_NR_EVENTS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"l1d_misses", PERF_TYPE_HW_CACHE,
+     PMU_CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"llc_misses", PERF_TYPE_HW_CACHE,
+     PMU_CACHE_EVENT(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"dtlb_misses", PERF_TYPE_HW_CACHE,
+     PMU_CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    // loads served by a remote NUMA node (offcore response on x86)
+    {"node_misses", PERF_TYPE_HW_CACHE,
+     PMU_CACHE_EVENT(PERF_COUNT_HW_CACHE_NODE, PERF_COUNT_HW_CACHE_OP_READ,
+                     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+};
+
+// warm-up, measurement and ramp-down of the run
+static mb_epoch_t epoch;
+
+// heads of the chain built by thread 0 when threads share one region
+static long *shared_heads[MAX_CHAINS];
+
+// one region on each memory node in NUMA matrix mode
+static long **node_areas;
+
+// injection delay of the current point in loaded latency mode
+static volatile long inject_delay;
+
+// doubles a loader thread processes between injection delays
+#define INJECT_BLOCK_LEN (8 * CACHELINE_SIZE / sizeof(double))
+
+// 2^(k / SWEEP_STEPS) for 0 <= k < SWEEP_STEPS, so as not to need libm
+static const double sweep_factors[SWEEP_STEPS] = {
+    1.0, 1.189207115002721, 1.414213562373095, 1.681792830507429,
+};
 
 // prototype declarations
 uintptr_t read_tsc(void);
 void do_memory_stress_seq(perf_counter_t* pc, long *working_area, long working_size, pthread_barrier_t *barrier);
-void do_memory_stress_rand(perf_counter_t* pc, long *working_area, long working_size, pthread_barrier_t *barrier);
+void do_memory_stress_rand(perf_counter_t* pc, long *working_area, long working_size, int id, pthread_barrier_t *barrier);
+void do_memory_stream(perf_counter_t* pc, long *working_area, long working_size, int part, int nr_parts, pthread_barrier_t *barrier);
+void do_loaded_latency(perf_counter_t* pc, long *working_area, long working_size, int id, pthread_barrier_t *barrier);
+void do_memory_sweep(perf_counter_t* pc, long *working_area, pthread_barrier_t *barrier);
+void do_memory_granularity(perf_counter_t* pc, long *working_area, long working_size, int id, pthread_barrier_t *barrier);
+void do_numa_matrix(perf_counter_t* pc, long working_size, int id, pthread_barrier_t *barrier);
 
 // generate random number which is more than or equal to 'from' and less than 'to' - 1
 // TODO: 48bit
 
+// open the events for the calling thread, leaving them disabled
+void
+pmu_open(pmu_group_t *pmu)
+{
+    struct perf_event_attr attr;
+    int i;
+    int fd;
+
+    pmu->leader = -1;
+    for (i = 0; i < PMU_NR_EVENTS; i++) {
+        pmu->fds[i] = -1;
+        pmu->counts[i] = 0;
+        pmu->counted[i] = false;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = pmu_events[i].type;
+        attr.config = pmu_events[i].config;
+        attr.disabled = (pmu->leader == -1 ? 1 : 0);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID
+            | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, pmu->leader, 0);
+        if (fd == -1) {
+            if (option.verbose == true) {
+                fprintf(stderr, "perf_event_open(2) failed for %s: %s\n",
+                        pmu_events[i].name, strerror(errno));
+            }
+            continue;
+        }
+        if (ioctl(fd, PERF_EVENT_IOC_ID, &pmu->ids[i]) == -1) {
+            close(fd);
+            continue;
+        }
+        pmu->fds[i] = fd;
+        if (pmu->leader == -1) {
+            pmu->leader = fd;
+        }
+    }
+}
+
+void
+pmu_enable(pmu_group_t *pmu)
+{
+    if (pmu->leader != -1) {
+        ioctl(pmu->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+void
+pmu_disable(pmu_group_t *pmu)
+{
+    if (pmu->leader != -1) {
+        ioctl(pmu->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+// read the counts scaled for multiplexing and close the group
+void
+pmu_close(pmu_group_t *pmu)
+{
+    uint64_t buf[3 + 2 * PMU_NR_EVENTS];
+    uint64_t nr, enabled, running;
+    uint64_t k;
+    int i;
+
+    if (pmu->leader == -1) {
+        return;
+    }
+
+    if (read(pmu->leader, buf, sizeof(buf)) < (ssize_t) (3 * sizeof(uint64_t))) {
+        perror("failed to read perf counters");
+        goto out;
+    }
+    nr = buf[0];
+    enabled = buf[1];
+    running = buf[2];
+    if (running == 0) {
+        // the group was never scheduled onto the PMU
+        if (option.verbose == true) {
+            fprintf(stderr, "perf counters were never scheduled\n");
+        }
+        goto out;
+    }
+    for (k = 0; k < nr && k < PMU_NR_EVENTS; k++) {
+        for (i = 0; i < PMU_NR_EVENTS; i++) {
+            if (pmu->fds[i] != -1 && pmu->ids[i] == buf[4 + 2 * k]) {
+                pmu->counts[i] = (uint64_t)
+                    ((double) buf[3 + 2 * k] * enabled / running);
+                pmu->counted[i] = true;
+            }
+        }
+    }
+
+out:
+    for (i = 0; i < PMU_NR_EVENTS; i++) {
+        if (pmu->fds[i] != -1 && pmu->fds[i] != pmu->leader) {
+            close(pmu->fds[i]);
+        }
+    }
+    close(pmu->leader);
+    pmu->leader = -1;
+}
+
+// one pass of a STREAM-style kernel over [0, len) of the arrays.
+// noinline keeps the compiler from merging consecutive passes.
+static __attribute__((noinline)) double
+stream_pass_scalar(int kernel, bool nt, double *a, double *b, double *c, long len)
+{
+    const double s = STREAM_SCALAR;
+    double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+    long i;
+
+    switch (kernel) {
+    case KERNEL_READ:
+        // independent partial sums so that the add latency is hidden
+        for (i = 0; i + 4 <= len; i += 4) {
+            sum0 += a[i];
+            sum1 += a[i + 1];
+            sum2 += a[i + 2];
+            sum3 += a[i + 3];
+        }
+        for (; i < len; i++) sum0 += a[i];
+        break;
+    case KERNEL_WRITE:
+        for (i = 0; i < len; i++) a[i] = s;
+        break;
+    case KERNEL_COPY:
+        for (i = 0; i < len; i++) b[i] = a[i];
+        break;
+    case KERNEL_SCALE:
+        for (i = 0; i < len; i++) b[i] = s * a[i];
+        break;
+    case KERNEL_ADD:
+        for (i = 0; i < len; i++) c[i] = a[i] + b[i];
+        break;
+    case KERNEL_TRIAD:
+        for (i = 0; i < len; i++) c[i] = a[i] + s * b[i];
+        break;
+    }
+    return sum0 + sum1 + sum2 + sum3;
+}
+
+#ifdef MEM_SIMD_X86
+// SIMD variants of stream_pass_scalar. a, b and c must be aligned to
+// cache lines and len must be a multiple of doubles in a cache line.
+#define STREAM_STORE_LOOPS(VLEN, LOAD, STORE, ADD, MUL)                 \
+    switch (kernel) {                                                   \
+    case KERNEL_WRITE:                                                  \
+        for (i = 0; i < len; i += VLEN)                                 \
+            STORE(&a[i], s);                                            \
+        break;                                                          \
+    case KERNEL_COPY:                                                   \
+        for (i = 0; i < len; i += VLEN)                                 \
+            STORE(&b[i], LOAD(&a[i]));                                  \
+        break;                                                          \
+    case KERNEL_SCALE:                                                  \
+        for (i = 0; i < len; i += VLEN)                                 \
+            STORE(&b[i], MUL(s, LOAD(&a[i])));                          \
+        break;                                                          \
+    case KERNEL_ADD:                                                    \
+        for (i = 0; i < len; i += VLEN)                                 \
+            STORE(&c[i], ADD(LOAD(&a[i]), LOAD(&b[i])));                \
+        break;                                                          \
+    case KERNEL_TRIAD:                                                  \
+        for (i = 0; i < len; i += VLEN)                                 \
+            STORE(&c[i], ADD(LOAD(&a[i]), MUL(s, LOAD(&b[i]))));        \
+        break;                                                          \
+    }
+
+#define DEFINE_STREAM_PASS(NAME, TARGET, VEC, VLEN, LOAD, STORE, NTSTORE, \
+                           SET1, ZERO, ADD, MUL, STOREU)                \
+static __attribute__((noinline, target(TARGET))) double                 \
+NAME(int kernel, bool nt, double *a, double *b, double *c, long len)    \
+{                                                                       \
+    VEC s = SET1(STREAM_SCALAR);                                        \
+    VEC sum0 = ZERO(), sum1 = ZERO(), sum2 = ZERO(), sum3 = ZERO();     \
+    double lanes[VLEN];                                                 \
+    double sum = 0.0;                                                   \
+    long i;                                                             \
+                                                                        \
+    if (kernel == KERNEL_READ) {                                        \
+        for (i = 0; i + 4 * VLEN <= len; i += 4 * VLEN) {               \
+            sum0 = ADD(sum0, LOAD(&a[i]));                              \
+            sum1 = ADD(sum1, LOAD(&a[i + VLEN]));                       \
+            sum2 = ADD(sum2, LOAD(&a[i + 2 * VLEN]));                   \
+            sum3 = ADD(sum3, LOAD(&a[i + 3 * VLEN]));                   \
+        }                                                               \
+        for (; i < len; i += VLEN)                                      \
+            sum0 = ADD(sum0, LOAD(&a[i]));                              \
+        STOREU(lanes, ADD(ADD(sum0, sum1), ADD(sum2, sum3)));           \
+        for (i = 0; i < VLEN; i++)                                      \
+            sum += lanes[i];                                            \
+    } else if (nt) {                                                    \
+        /* streaming stores bypass the cache without read-for-ownership */ \
+        STREAM_STORE_LOOPS(VLEN, LOAD, NTSTORE, ADD, MUL);              \
+        _mm_sfence();                                                   \
+    } else {                                                            \
+        STREAM_STORE_LOOPS(VLEN, LOAD, STORE, ADD, MUL);                \
+    }                                                                   \
+    return sum;                                                         \
+}
+
+DEFINE_STREAM_PASS(stream_pass_sse2, "sse2", __m128d, 2,
+                   _mm_load_pd, _mm_store_pd, _mm_stream_pd,
+                   _mm_set1_pd, _mm_setzero_pd, _mm_add_pd, _mm_mul_pd,
+                   _mm_storeu_pd)
+DEFINE_STREAM_PASS(stream_pass_avx2, "avx2", __m256d, 4,
+                   _mm256_load_pd, _mm256_store_pd, _mm256_stream_pd,
+                   _mm256_set1_pd, _mm256_setzero_pd, _mm256_add_pd, _mm256_mul_pd,
+                   _mm256_storeu_pd)
+DEFINE_STREAM_PASS(stream_pass_avx512, "avx512f", __m512d, 8,
+                   _mm512_load_pd, _mm512_store_pd, _mm512_stream_pd,
+                   _mm512_set1_pd, _mm512_setzero_pd, _mm512_add_pd, _mm512_mul_pd,
+                   _mm512_storeu_pd)
+#endif // MEM_SIMD_X86
+
+const simd_t simds[SIMD_NR] = {
+    {"scalar", stream_pass_scalar},
+#ifdef MEM_SIMD_X86
+    {"sse2", stream_pass_sse2},
+    {"avx2", stream_pass_avx2},
+    {"avx512", stream_pass_avx512},
+#else
+    {"sse2", NULL},
+    {"avx2", NULL},
+    {"avx512", NULL},
+#endif
+};
+
+bool
+simd_supported(int simd)
+{
+    if (simds[simd].pass == NULL) {
+        return false;
+    }
+#ifdef MEM_SIMD_X86
+    // __builtin_cpu_supports() requires a string literal
+    switch (simd) {
+    case SIMD_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case SIMD_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case SIMD_AVX512:
+        return __builtin_cpu_supports("avx512f");
+    }
+#endif
+    return true;
+}
+
+#ifdef NUMA_ARCH
+// rows of the NUMA matrix are the nodes with CPUs, columns the nodes
+// with memory, which include memory-only nodes
 void
-swap_long(long *ptr1, long *ptr2)
+numa_matrix_nodes(void)
+{
+    struct bitmask *cpus;
+    int nr_nodes;
+    int node;
+    int cpu;
+
+    if (numa_available() < 0) {
+        fprintf(stderr, "NUMA is not available on this system.\n");
+        exit(EXIT_FAILURE);
+    }
+    nr_nodes = numa_max_node() + 1;
+    option.cpu_nodes = malloc(sizeof(int) * nr_nodes);
+    option.node_cpus = malloc(sizeof(cpu_set_t) * nr_nodes);
+    option.mem_nodes = malloc(sizeof(int) * nr_nodes);
+    cpus = numa_allocate_cpumask();
+    for (node = 0; node < nr_nodes; node++) {
+        if (numa_bitmask_isbitset(numa_all_nodes_ptr, node)) {
+            option.mem_nodes[option.nr_mem_nodes++] = node;
+        }
+        if (numa_node_to_cpus(node, cpus) != 0) continue;
+        CPU_ZERO(&option.node_cpus[option.nr_cpu_nodes]);
+        for (cpu = 0; cpu < (int) cpus->size && cpu < CPU_SETSIZE; cpu++) {
+            if (numa_bitmask_isbitset(cpus, cpu)) {
+                CPU_SET(cpu, &option.node_cpus[option.nr_cpu_nodes]);
+            }
+        }
+        if (CPU_COUNT(&option.node_cpus[option.nr_cpu_nodes]) > 0) {
+            option.cpu_nodes[option.nr_cpu_nodes++] = node;
+        }
+    }
+    numa_free_cpumask(cpus);
+}
+#endif
+
+// log-spaced sizes from min rounded down to cache lines, ending at max.
+// sizes must have room for SWEEP_MAX_SIZES of them.
+int
+make_sweep_sizes(long min, long max, long *sizes)
 {
-    long tmp;
-    if (ptr1 != ptr2) {
-        tmp = *ptr1;
-        *ptr1 = *ptr2;
-        *ptr2 = tmp;
+    long size;
+    int nr_sizes;
+    int k;
+
+    nr_sizes = 0;
+    for (k = 0; ; k++) {
+        size = (long) ((min << (k / SWEEP_STEPS)) * sweep_factors[k % SWEEP_STEPS]);
+        size = size / CACHELINE_SIZE * CACHELINE_SIZE;
+        if (size >= max) break;
+        if (nr_sizes > 0 && size == sizes[nr_sizes - 1]) continue;
+        sizes[nr_sizes++] = size;
     }
+    sizes[nr_sizes++] = max / CACHELINE_SIZE * CACHELINE_SIZE;
+
+    return nr_sizes;
+}
+
+// parse comma-separated granularities (in bytes) into a malloc'ed list
+// and return the number of them, or -1 unless all of them are multiples
+// of sizeof(long)
+int
+parse_granularities(const char *arg, long **list)
+{
+    char *str, *tok, *endptr;
+    long *granularities;
+    int nr;
+
+    granularities = NULL;
+    nr = 0;
+    str = strdup(arg);
+    for (tok = strtok(str, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        granularities = realloc(granularities, sizeof(long) * (nr + 1));
+        granularities[nr] = strtol(tok, &endptr, 10);
+        if (*endptr != '\0' ||
+            granularities[nr] < (long) sizeof(long) ||
+            granularities[nr] % sizeof(long) != 0) {
+            nr = 0;
+            break;
+        }
+        nr++;
+    }
+    free(str);
+    if (nr == 0) {
+        free(granularities);
+        *list = NULL;
+        return -1;
+    }
+
+    *list = granularities;
+    return nr;
 }
 
 void
@@ -69,6 +443,8 @@ parse_args(int argc, char **argv)
 
     option.multi = 1;
     option.timeout = 10;
+    option.warmup = 0;
+    option.rampdown = 0;
     option.seq = true;
     option.rand = false;
     option.local = false;
@@ -76,10 +452,30 @@ parse_args(int argc, char **argv)
     option.size = 1 << 20; // 1MB
     option.hugetlbfile = NULL;
     option.hugepage_size = 1 << 21; // 2MB
+    option.pages = PAGES_DEFAULT;
+    option.chains = 1;
+    option.delays = NULL;
+    option.nr_delays = 0;
+    option.sweep_min = 0;
+    option.sweep_sizes = NULL;
+    option.nr_sweep = 0;
+    option.granularities = NULL;
+    option.nr_granularities = 0;
+    option.numa_matrix = false;
+    option.cpu_nodes = NULL;
+    option.node_cpus = NULL;
+    option.nr_cpu_nodes = 0;
+    option.mem_nodes = NULL;
+    option.nr_mem_nodes = 0;
+    option.json = false;
+    option.kernel = KERNEL_INCR;
+    option.simd = SIMD_AUTO;
+    option.nontemporal = false;
+    option.pmu = false;
     option.verbose = false;
 
     optind = 1;
-    while ((optchar = getopt(argc, argv, "+m:t:SRLa:s:H:z:v")) != -1) {
+    while ((optchar = getopt(argc, argv, "+m:t:w:r:SRLc:l:x:g:nja:s:H:z:p:k:W:NPv")) != -1) {
         switch(optchar){
         case 'm': // multi
             option.multi = strtol(optarg, NULL, 10);
@@ -87,6 +483,20 @@ parse_args(int argc, char **argv)
         case 't': // timeout
             option.timeout = strtol(optarg, NULL, 10);
             break;
+        case 'w': // warmup
+            option.warmup = strtod(optarg, NULL);
+            if (option.warmup < 0) {
+                fprintf(stderr, "Invalid argument for -w: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r': // rampdown
+            option.rampdown = strtod(optarg, NULL);
+            if (option.rampdown < 0) {
+                fprintf(stderr, "Invalid argument for -r: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'S': // seq.
             option.seq = true;
             option.rand = false;
@@ -98,6 +508,59 @@ parse_args(int argc, char **argv)
         case 'L': // local
             option.local = true;
             break;
+        case 'c': // chains
+            option.chains = strtol(optarg, NULL, 10);
+            if (option.chains < 1 || option.chains > MAX_CHAINS) {
+                fprintf(stderr, "Invalid argument for -c: %s (1-%d)\n",
+                        optarg, MAX_CHAINS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'l': // loaded latency
+        {
+            char *str, *tok, *endptr;
+
+            str = strdup(optarg);
+            for (tok = strtok(str, ","); tok != NULL; tok = strtok(NULL, ",")) {
+                option.delays = realloc(option.delays,
+                                        sizeof(long) * (option.nr_delays + 1));
+                option.delays[option.nr_delays] = strtol(tok, &endptr, 10);
+                if (*endptr != '\0' || option.delays[option.nr_delays] < 0) {
+                    fprintf(stderr, "Invalid argument for -l: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                option.nr_delays++;
+            }
+            free(str);
+            if (option.nr_delays == 0) {
+                fprintf(stderr, "Invalid argument for -l: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+        }
+            break;
+        case 'x': // sweep
+            option.sweep_min = strtol(optarg, NULL, 10);
+            if (option.sweep_min < CACHELINE_SIZE) {
+                fprintf(stderr, "Invalid argument for -x: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'g': // granularity
+            free(option.granularities);
+            option.nr_granularities = parse_granularities(optarg,
+                                                          &option.granularities);
+            if (option.nr_granularities < 0) {
+                fprintf(stderr, "Invalid argument for -g: %s "
+                        "(multiples of %zu)\n", optarg, sizeof(long));
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'n': // NUMA matrix
+            option.numa_matrix = true;
+            break;
+        case 'j': // json print mode
+            option.json = true;
+            break;
         case 'a': // affinity
         {
             mb_affinity_t *aff;
@@ -131,6 +594,46 @@ parse_args(int argc, char **argv)
         case 'z': // hugepagesize
             option.hugepage_size = strtol(optarg, NULL, 10);
             break;
+        case 'p': // pages
+            for (idx = 0; idx < PAGES_NR; idx++) {
+                if (strcmp(pages_names[idx], optarg) == 0) break;
+            }
+            if (idx == PAGES_NR) {
+                fprintf(stderr, "Invalid argument for -p: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            option.pages = idx;
+            break;
+        case 'k': // kernel
+            for (idx = 0; idx < KERNEL_NR; idx++) {
+                if (strcmp(kernels[idx].name, optarg) == 0) break;
+            }
+            if (idx == KERNEL_NR) {
+                fprintf(stderr, "Invalid argument for -k: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            option.kernel = idx;
+            break;
+        case 'W': // SIMD width
+            if (strcmp("auto", optarg) == 0) {
+                option.simd = SIMD_AUTO;
+                break;
+            }
+            for (idx = 0; idx < SIMD_NR; idx++) {
+                if (strcmp(simds[idx].name, optarg) == 0) break;
+            }
+            if (idx == SIMD_NR) {
+                fprintf(stderr, "Invalid argument for -W: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            option.simd = idx;
+            break;
+        case 'N': // non-temporal stores
+            option.nontemporal = true;
+            break;
+        case 'P': // pmu
+            option.pmu = true;
+            break;
         case 'v': // verbose
             option.verbose = true;
             break;
@@ -139,6 +642,110 @@ parse_args(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
     }
+
+    if (option.pages != PAGES_DEFAULT && option.hugetlbfile != NULL) {
+        fprintf(stderr, "-p cannot be used with -H.\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((option.pages == PAGES_THP || option.pages == PAGES_HUGETLB) &&
+        (option.hugepage_size <= 0 ||
+         (option.hugepage_size & (option.hugepage_size - 1)) != 0)) {
+        fprintf(stderr, "-z must be a power of two.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (option.nr_granularities > 0) {
+        if (option.sweep_min > 0 || option.nr_delays > 0 || option.pmu == true ||
+            option.kernel != KERNEL_INCR) {
+            fprintf(stderr, "-g cannot be used with -x, -l, -P or -k.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (idx = 0; idx < option.nr_granularities; idx++) {
+            if (option.granularities[idx] > option.size) {
+                fprintf(stderr, "-g must not be larger than -s.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    if (option.sweep_min > 0) {
+        if (option.multi != 1 || option.nr_delays > 0 || option.pmu == true ||
+            option.kernel != KERNEL_INCR) {
+            fprintf(stderr, "-x cannot be used with -m 2 or more, -l, -P or -k.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (option.sweep_min > option.size) {
+            fprintf(stderr, "-x must not be larger than -s.\n");
+            exit(EXIT_FAILURE);
+        }
+        option.sweep_sizes = malloc(sizeof(long) * SWEEP_MAX_SIZES);
+        option.nr_sweep = make_sweep_sizes(option.sweep_min, option.size,
+                                           option.sweep_sizes);
+    }
+    if (option.json == true && option.numa_matrix == false) {
+        fprintf(stderr, "-j requires -n.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (option.numa_matrix == true) {
+        if (option.nr_granularities > 0 || option.sweep_min > 0 ||
+            option.nr_delays > 0 || option.local == true ||
+            option.affinities != NULL || option.hugetlbfile != NULL ||
+            option.pmu == true || option.rand == true) {
+            fprintf(stderr, "-n cannot be used with -g, -x, -l, -L, -a, -H, -P or -R.\n");
+            exit(EXIT_FAILURE);
+        }
+#ifdef NUMA_ARCH
+        numa_matrix_nodes();
+#else
+        fprintf(stderr, "-n requires libnuma.\n");
+        exit(EXIT_FAILURE);
+#endif
+        // threads move from node to node and share each node's region
+        if (option.kernel == KERNEL_INCR) {
+            option.kernel = KERNEL_READ;
+        }
+    }
+    if (option.nr_delays > 0) {
+        // thread 0 chases pointers, the others generate traffic in
+        // regions of their own so that they never clobber the chain
+        if (option.multi < 2) {
+            fprintf(stderr, "-l requires -m 2 or more.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (option.pmu == true) {
+            fprintf(stderr, "-P cannot be used with -l.\n");
+            exit(EXIT_FAILURE);
+        }
+        option.local = true;
+        if (option.kernel == KERNEL_INCR) {
+            option.kernel = KERNEL_READ;
+        }
+    } else if (option.rand == true && option.kernel != KERNEL_INCR) {
+        fprintf(stderr, "-k cannot be used with random access mode.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (option.chains > 1 && option.rand == false && option.nr_delays == 0 &&
+        option.numa_matrix == false) {
+        fprintf(stderr, "-c requires random access mode.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (option.simd == SIMD_AUTO) {
+        for (option.simd = SIMD_NR - 1; option.simd > SIMD_SCALAR; option.simd--) {
+            if (simd_supported(option.simd)) break;
+        }
+    } else if (simd_supported(option.simd) == false) {
+        fprintf(stderr, "%s kernels are not supported on this CPU.\n",
+                simds[option.simd].name);
+        exit(EXIT_FAILURE);
+    }
+    if (option.nontemporal == true) {
+        if (option.kernel == KERNEL_INCR || option.kernel == KERNEL_READ) {
+            fprintf(stderr, "-N requires a kernel which stores (-k write, copy, scale, add or triad).\n");
+            exit(EXIT_FAILURE);
+        }
+        if (option.simd == SIMD_SCALAR) {
+            fprintf(stderr, "-N cannot be used with scalar kernels.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 }
 
 void *
@@ -151,11 +758,44 @@ thread_handler(void *arg)
         tid = syscall(SYS_gettid);
         sched_setaffinity(tid, sizeof(cpu_set_t), &th_arg->affinity->cpumask);
     }
+    if (option.pmu == true) {
+        pmu_open(&th_arg->pc.pmu);
+    }
 
-    if (option.rand == true){
+    if (option.numa_matrix == true) {
+        do_numa_matrix(&th_arg->pc,
+                       th_arg->working_size,
+                       th_arg->id,
+                       th_arg->barrier);
+    } else if (option.nr_granularities > 0) {
+        do_memory_granularity(&th_arg->pc,
+                              th_arg->working_area,
+                              th_arg->working_size,
+                              th_arg->id,
+                              th_arg->barrier);
+    } else if (option.nr_sweep > 0) {
+        do_memory_sweep(&th_arg->pc,
+                        th_arg->working_area,
+                        th_arg->barrier);
+    } else if (option.nr_delays > 0) {
+        do_loaded_latency(&th_arg->pc,
+                          th_arg->working_area,
+                          th_arg->working_size,
+                          th_arg->id,
+                          th_arg->barrier);
+    } else if (option.kernel != KERNEL_INCR) {
+        // threads sharing one region split the arrays among themselves
+        do_memory_stream(&th_arg->pc,
+                         th_arg->working_area,
+                         th_arg->working_size,
+                         (option.local ? 0 : th_arg->id),
+                         (option.local ? 1 : option.multi),
+                         th_arg->barrier);
+    } else if (option.rand == true){
         do_memory_stress_rand(&th_arg->pc,
                               th_arg->working_area,
                               th_arg->working_size,
+                              th_arg->id,
                               th_arg->barrier);
     } else {
         do_memory_stress_seq(&th_arg->pc,
@@ -163,6 +803,7 @@ thread_handler(void *arg)
                              th_arg->working_size,
                              th_arg->barrier);
     }
+    pmu_close(&th_arg->pc.pmu);
 
     pthread_exit(NULL);
 }
@@ -175,7 +816,8 @@ do_memory_stress_seq(perf_counter_t* pc,
 {
     unsigned long iter_count;
     unsigned long i;
-    struct timeval start_tv;
+    struct timeval chunk_tv;
+    mb_epoch_phase_t phase;
     register long *ptr;
     register long *ptr_end;
 
@@ -186,13 +828,13 @@ do_memory_stress_seq(perf_counter_t* pc,
         iter_count = 1;
     }
 
-    double t = 0;
-    register long timeout = option.timeout * 1000000L;
-
+    // only chunks started in the measurement phase are counted
+    pthread_barrier_wait(barrier);
     pthread_barrier_wait(barrier);
-    GETTIMEOFDAY(&start_tv);
     if (option.size < 1024) {
-        while((t = mb_elapsed_usec_from(&start_tv)) < timeout){
+        while((phase = mb_epoch_phase(&epoch)) != MB_EPOCH_DONE){
+            GETTIMEOFDAY(&chunk_tv);
+            if (phase == MB_EPOCH_MEASURE) pmu_enable(&pc->pmu);
             t0 = mb_read_tsc();
             for(i = 0;i < iter_count;i++){
                 ptr = working_area;
@@ -203,11 +845,16 @@ do_memory_stress_seq(perf_counter_t* pc,
                 }
             }
             t1 = mb_read_tsc();
+            if (phase != MB_EPOCH_MEASURE) continue;
+            pmu_disable(&pc->pmu);
             pc->clk += t1 - t0;
             pc->ops += MEM_INNER_LOOP_SEQ_64_NUM_OPS * (working_size / MEM_INNER_LOOP_SEQ_64_REGION_SIZE) * iter_count;
+            pc->wallclocktime += mb_elapsed_time_from(&chunk_tv);
         }
     } else {
-        while((t = mb_elapsed_usec_from(&start_tv)) < timeout){
+        while((phase = mb_epoch_phase(&epoch)) != MB_EPOCH_DONE){
+            GETTIMEOFDAY(&chunk_tv);
+            if (phase == MB_EPOCH_MEASURE) pmu_enable(&pc->pmu);
             t0 = mb_read_tsc();
             for(i = 0;i < iter_count;i++){
                 ptr = working_area;
@@ -218,120 +865,978 @@ do_memory_stress_seq(perf_counter_t* pc,
                 }
             }
             t1 = mb_read_tsc();
+            if (phase != MB_EPOCH_MEASURE) continue;
+            pmu_disable(&pc->pmu);
             pc->clk += t1 - t0;
             pc->ops += MEM_INNER_LOOP_SEQ_NUM_OPS * (working_size / MEM_INNER_LOOP_SEQ_REGION_SIZE) * iter_count;
+            pc->wallclocktime += mb_elapsed_time_from(&chunk_tv);
         }
     }
-    if(option.verbose == true) fprintf(stderr, "loop end: t=%lf\n", t);
-    pc->wallclocktime = t / 1e6;
+    if(option.verbose == true) fprintf(stderr, "loop end: t=%lf\n", pc->wallclocktime);
 }
 
+// advance nr_chains pointers by steps hops each. heads are kept in
+// registers as long as the compiler can unroll the inner loop.
+static inline __attribute__((always_inline)) void
+chase(long **heads, int nr_chains, unsigned long steps)
+{
+    long *p[MAX_CHAINS];
+    unsigned long i;
+    int j;
+
+    for (j = 0; j < nr_chains; j++) p[j] = heads[j];
+    for (i = 0; i < steps; i++) {
+#pragma GCC unroll 32
+        for (j = 0; j < nr_chains; j++) {
+            p[j] = (long *) *p[j];
+        }
+    }
+    for (j = 0; j < nr_chains; j++) heads[j] = p[j];
+}
+
+#define CHASE_CASE(k) case k: chase(heads, k, steps); break;
+
 void
-do_memory_stress_rand(perf_counter_t* pc,
-                      long *working_area,
-                      long working_size,
-                      pthread_barrier_t *barrier)
+chase_chains(long **heads, int nr_chains, unsigned long steps)
 {
-    unsigned long iter_count;
-    register unsigned long i;
-    struct timeval start_tv;
-    register long *ptr;
-    long *ptr_start;
-    long *ptr_end;
-    struct drand48_data rand;
+    // dispatch to a copy of chase() specialized for each count
+    switch (nr_chains) {
+        CHASE_CASE(2) CHASE_CASE(3) CHASE_CASE(4) CHASE_CASE(5)
+        CHASE_CASE(6) CHASE_CASE(7) CHASE_CASE(8) CHASE_CASE(9)
+        CHASE_CASE(10) CHASE_CASE(11) CHASE_CASE(12) CHASE_CASE(13)
+        CHASE_CASE(14) CHASE_CASE(15) CHASE_CASE(16) CHASE_CASE(17)
+        CHASE_CASE(18) CHASE_CASE(19) CHASE_CASE(20) CHASE_CASE(21)
+        CHASE_CASE(22) CHASE_CASE(23) CHASE_CASE(24) CHASE_CASE(25)
+        CHASE_CASE(26) CHASE_CASE(27) CHASE_CASE(28) CHASE_CASE(29)
+        CHASE_CASE(30) CHASE_CASE(31) CHASE_CASE(32)
+    default:
+        chase(heads, nr_chains, steps);
+    }
+}
 
-    register uintptr_t t0, t1;
+typedef struct {
+    chain_t       *chain;
+    unsigned long  lo;
+    unsigned long  hi;
+} chain_part_t;
 
-    iter_count = KIBI;
+static void *
+chain_build_part(void *arg)
+{
+    chain_part_t *part = arg;
+    chain_t *chain = part->chain;
+    unsigned long i;
+    unsigned long p, q;
 
-    // initialize pointer loop
-    srand48_r(syscall(SYS_gettid) + time(NULL), &rand);
-    ptr_start = working_area;
-    ptr_end = working_area + (working_size / sizeof(long));
+    p = chain_perm(chain, part->lo);
+    for (i = part->lo; i < part->hi; i++) {
+        q = chain_perm(chain, (i + 1) % chain->nr_lines);
+        *chain_line(chain, p) = (long) chain_line(chain, q);
+        p = q;
+    }
 
-    for(ptr = ptr_start;ptr < ptr_end;ptr += 64 / sizeof(long)){ // assume cache line is 64B
-        *ptr = (long)(ptr + 64 / sizeof(long));
+    return NULL;
+}
+
+// lay a chain over every granularity bytes of the area with random keys
+void
+chain_init(chain_t *chain, long *area, long size, long granularity,
+           struct drand48_data *rand)
+{
+    long r1, r2;
+    int round;
+
+    chain->area = area;
+    chain->nr_lines = size / granularity;
+    chain->stride = granularity / sizeof(long);
+    for (chain->half_bits = 1;
+         (1ULL << (2 * chain->half_bits)) < chain->nr_lines;
+         chain->half_bits++)
+        ;
+    for (round = 0; round < CHAIN_ROUNDS; round++) {
+        mrand48_r(rand, &r1);
+        mrand48_r(rand, &r2);
+        chain->keys[round] = ((uint64_t) r1 << 32) ^ (uint32_t) r2;
     }
-    *(ptr_end - (64 / sizeof(long))) = (long) ptr_start;
+}
 
-    // shuffle pointer loop
-    unsigned long num_cacheline;
-    unsigned long ofst;
-    num_cacheline = working_size / 64;
+// build a random cyclic pointer chain through every granularity bytes of
+// the area and return the heads of nr_chains evenly spaced walks on it.
+// large areas are built by helper threads, which inherit the CPU
+// affinity (and so the memory node) of the calling thread. the CPUs
+// are split among option.multi callers, which may build at once.
+void
+make_chain(long *working_area, long working_size, long granularity,
+           long **heads, int nr_chains)
+{
+    struct timeval start_tv;
+    struct drand48_data rand;
+    chain_t chain;
+    chain_part_t *parts;
+    pthread_t *threads;
+    cpu_set_t cpuset;
+    unsigned long i;
+    long *ptr;
+    int nr_threads;
+    int t;
 
-    GETTIMEOFDAY(&start_tv);
-    for(i = 0; i < num_cacheline; i++){
-        long *ptr1, *ptr1_succ, *ptr2, *ptr2_succ;
-    retry:
-        ofst = mb_rand_range_ulong(&rand, 0, num_cacheline - i);
-        ptr1 = ptr_start + (i * 64 / sizeof(long));
-        ptr1_succ = (long *) *ptr1;
-        ptr2 = ptr_start + ((i + ofst) * 64 / sizeof(long));
-        ptr2_succ = (long *) *ptr2;
-
-        if (ptr1_succ == ptr2){
-            *ptr1 = (long) ptr2_succ;
-            *ptr1_succ = *ptr2_succ;
-            *ptr2_succ = (long) ptr1_succ;
-        } else {
-            *ptr1 = (long) ptr2_succ;
-            *ptr2 = (long) ptr1_succ;
-            swap_long(ptr1_succ, ptr2_succ);
+    srand48_r(syscall(SYS_gettid) + time(NULL), &rand);
+    chain_init(&chain, working_area, working_size, granularity, &rand);
+    if (chain.nr_lines < (unsigned long) nr_chains) {
+        fprintf(stderr, "Memory region is too small for %d chains.\n",
+                nr_chains);
+        exit(EXIT_FAILURE);
+    }
+
+    nr_threads = 1;
+    if (chain.nr_lines >= CHAIN_PARALLEL_LINES &&
+        sched_getaffinity(0, sizeof(cpuset), &cpuset) == 0) {
+        nr_threads = CPU_COUNT(&cpuset) / option.multi;
+        if (nr_threads < 1) {
+            nr_threads = 1;
         }
+    }
+    parts = malloc(sizeof(chain_part_t) * nr_threads);
+    threads = malloc(sizeof(pthread_t) * nr_threads);
 
-        if (ptr1 == (long*) *ptr1 ||
-            ptr2 == (long*) *ptr2 ||
-            ptr2_succ == (long*)*ptr2_succ){
-            goto retry;
+    GETTIMEOFDAY(&start_tv);
+    for (t = 0; t < nr_threads; t++) {
+        parts[t].chain = &chain;
+        parts[t].lo = chain.nr_lines * t / nr_threads;
+        parts[t].hi = chain.nr_lines * (t + 1) / nr_threads;
+        if (t > 0 && pthread_create(&threads[t], NULL, chain_build_part, &parts[t]) != 0) {
+            perror("pthread_create(3) failed");
+            exit(EXIT_FAILURE);
         }
     }
+    chain_build_part(&parts[0]);
+    for (t = 1; t < nr_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
     if(option.verbose == true) {
-        fprintf(stderr, "shuffle time: %lf\n", mb_elapsed_time_from(&start_tv));
+        fprintf(stderr, "shuffle time: %lf (%d threads)\n",
+                mb_elapsed_time_from(&start_tv), nr_threads);
     }
+    free(parts);
+    free(threads);
 
-    GETTIMEOFDAY(&start_tv);
-    // check loop
-    unsigned long counter;
-    for(counter = 1, ptr = (long *) *ptr_start;
-        ptr != ptr_start;
-        ptr = (long *) *ptr){
-        // printf("%ld\t->\t%ld\n",
-        //        ((long) ptr - (long) ptr_start) / 64,
-        //        (*ptr - (long) ptr_start) / 64);
-        counter++;
-    }
-    if (counter != num_cacheline){
-        fprintf(stderr, "initialization failed. counter=%ld\n", counter);
+    // check the beginning of the walk and that the last link closes it
+    ptr = chain_line(&chain, chain_perm(&chain, 0));
+    for (i = 1; i <= chain.nr_lines && i <= CHAIN_CHECK_LINKS; i++) {
+        ptr = (long *) *ptr;
+        if (ptr != chain_line(&chain, chain_perm(&chain, i % chain.nr_lines))) {
+            fprintf(stderr, "initialization failed. link=%lu\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    ptr = chain_line(&chain, chain_perm(&chain, chain.nr_lines - 1));
+    if ((long *) *ptr != chain_line(&chain, chain_perm(&chain, 0))) {
+        fprintf(stderr, "initialization failed. the chain is not closed\n");
         exit(EXIT_FAILURE);
     }
 
-    // go through pointer loop for evicting cache lines
-    ptr = (long *) *ptr_start;
-    while(ptr != ptr_start){
-        ptr = (long *) *ptr;
+    // the chains start at evenly spaced points of the loop, so they
+    // never catch up with each other while every step of one does not
+    // depend on the others.
+    for (t = 0; t < nr_chains; t++) {
+        heads[t] = chain_line(&chain, chain_perm(&chain, chain.nr_lines * t / nr_chains));
     }
+}
 
-    double t = 0;
+// walk the chains for one chunk and return the number of loads
+unsigned long
+walk_chains(long *working_area, long **heads, int nr_chains)
+{
+    register unsigned long i;
+    register long *ptr;
+    unsigned long iter_count;
+    unsigned long steps;
 
-    pthread_barrier_wait(barrier);
-    GETTIMEOFDAY(&start_tv);
-    while((t = mb_elapsed_time_from(&start_tv)) < option.timeout){
-        t0 = mb_read_tsc();
+    iter_count = KIBI;
+    if (nr_chains == 1) {
         ptr = working_area;
         for(i = 0;i < iter_count;i++){
             // read & write cache line 1024 times
 #include "micbench-mem-inner-rand.c"
         }
+        return iter_count * MEM_INNER_LOOP_RANDOM_NUM_OPS;
+    }
+
+    // as many loads per chunk as the single chain loop
+    steps = iter_count * MEM_INNER_LOOP_RANDOM_NUM_OPS / nr_chains;
+    chase_chains(heads, nr_chains, steps);
+    return steps * nr_chains;
+}
+
+void
+do_memory_stress_rand(perf_counter_t* pc,
+                      long *working_area,
+                      long working_size,
+                      int id,
+                      pthread_barrier_t *barrier)
+{
+    struct timeval chunk_tv;
+    mb_epoch_phase_t phase;
+    long *heads[MAX_CHAINS];
+    unsigned long nr_ops;
+
+    register uintptr_t t0, t1;
+
+    // threads sharing one region walk the chain thread 0 builds
+    if (option.local == true || id == 0) {
+        make_chain(working_area, working_size, CACHELINE_SIZE, heads, option.chains);
+    }
+    if (option.local == false && id == 0) {
+        memcpy(shared_heads, heads, sizeof(heads));
+    }
+
+    // only chunks started in the measurement phase are counted
+    pthread_barrier_wait(barrier);
+    if (option.local == false && id != 0) {
+        memcpy(heads, shared_heads, sizeof(heads));
+    }
+    pthread_barrier_wait(barrier);
+    while((phase = mb_epoch_phase(&epoch)) != MB_EPOCH_DONE){
+        GETTIMEOFDAY(&chunk_tv);
+        if (phase == MB_EPOCH_MEASURE) pmu_enable(&pc->pmu);
+        t0 = mb_read_tsc();
+        nr_ops = walk_chains(working_area, heads, option.chains);
+        t1 = mb_read_tsc();
+        if (phase != MB_EPOCH_MEASURE) continue;
+        pmu_disable(&pc->pmu);
+        pc->clk += t1 - t0;
+        pc->ops += nr_ops;
+        pc->wallclocktime += mb_elapsed_time_from(&chunk_tv);
+    }
+    printf("loop end: t=%lf\n", pc->wallclocktime);
+}
+
+// carve the arrays of the kernel out of the area, first-touch the
+// part-th of nr_parts slices of them and return the slice length
+long
+stream_arrays(long *working_area, long working_size, int part, int nr_parts,
+              double **a, double **b, double **c)
+{
+    int nr_arrays;
+    long nr_lines;
+    long array_len;
+    long lo, hi;
+    long i;
+
+    // arrays and slices start at cache line boundaries for the SIMD kernels
+    nr_arrays = kernels[option.kernel].nr_arrays;
+    nr_lines = working_size / nr_arrays / CACHELINE_SIZE;
+    array_len = nr_lines * (CACHELINE_SIZE / sizeof(double));
+    lo = nr_lines * part / nr_parts * (CACHELINE_SIZE / sizeof(double));
+    hi = nr_lines * (part + 1) / nr_parts * (CACHELINE_SIZE / sizeof(double));
+    if (hi <= lo) {
+        fprintf(stderr, "Memory region is too small for kernel %s.\n",
+                kernels[option.kernel].name);
+        exit(EXIT_FAILURE);
+    }
+    *a = (double *) working_area + lo;
+    *b = *a + array_len;
+    *c = *b + array_len;
+
+    for (i = 0; i < hi - lo; i++) {
+        (*a)[i] = 1.0;
+        if (nr_arrays > 1) (*b)[i] = 2.0;
+        if (nr_arrays > 2) (*c)[i] = 0.0;
+    }
+
+    return hi - lo;
+}
+
+void
+do_memory_stream(perf_counter_t* pc,
+                 long *working_area,
+                 long working_size,
+                 int part,
+                 int nr_parts,
+                 pthread_barrier_t *barrier)
+{
+    unsigned long iter_count;
+    unsigned long i;
+    struct timeval chunk_tv;
+    mb_epoch_phase_t phase;
+    int nr_arrays;
+    long len;
+    double *a, *b, *c;
+    volatile double sink;
+
+    uintptr_t t0, t1;
+
+    nr_arrays = kernels[option.kernel].nr_arrays;
+    len = stream_arrays(working_area, working_size, part, nr_parts, &a, &b, &c);
+
+    iter_count = GIBI / (len * nr_arrays * sizeof(double));
+    if (iter_count == 0) {
+        iter_count = 1;
+    }
+
+    // only chunks started in the measurement phase are counted
+    pthread_barrier_wait(barrier);
+    pthread_barrier_wait(barrier);
+    while((phase = mb_epoch_phase(&epoch)) != MB_EPOCH_DONE){
+        GETTIMEOFDAY(&chunk_tv);
+        if (phase == MB_EPOCH_MEASURE) pmu_enable(&pc->pmu);
+        t0 = mb_read_tsc();
+        for(i = 0;i < iter_count;i++){
+            sink = simds[option.simd].pass(option.kernel, option.nontemporal,
+                                           a, b, c, len);
+        }
         t1 = mb_read_tsc();
+        if (phase != MB_EPOCH_MEASURE) continue;
+        pmu_disable(&pc->pmu);
         pc->clk += t1 - t0;
-        pc->ops += iter_count * MEM_INNER_LOOP_RANDOM_NUM_OPS;
+        pc->ops += len * iter_count;
+        pc->bytes += len * nr_arrays * sizeof(double) * iter_count;
+        pc->wallclocktime += mb_elapsed_time_from(&chunk_tv);
+    }
+    (void) sink;
+    if(option.verbose == true) fprintf(stderr, "loop end: t=%lf\n", pc->wallclocktime);
+}
+
+// thread 0 chases pointers while the others run the kernel with
+// inject_delay clocks between blocks, once for each point of the sweep
+void
+do_loaded_latency(perf_counter_t* pc,
+                  long *working_area,
+                  long working_size,
+                  int id,
+                  pthread_barrier_t *barrier)
+{
+    struct timeval chunk_tv;
+    mb_epoch_phase_t phase;
+    long *heads[MAX_CHAINS];
+    unsigned long nr_ops;
+    long len = 0;
+    long ofst;
+    long n;
+    long delay;
+    int nr_arrays;
+    int pt;
+    double *a, *b, *c;
+    volatile double sink;
+
+    uintptr_t t0, t1;
+
+    nr_arrays = kernels[option.kernel].nr_arrays;
+    if (id == 0) {
+        make_chain(working_area, working_size, CACHELINE_SIZE, heads, option.chains);
+    } else {
+        len = stream_arrays(working_area, working_size, 0, 1, &a, &b, &c);
+    }
+
+    for (pt = 0; pt < option.nr_delays; pt++) {
+        pthread_barrier_wait(barrier);
+        pthread_barrier_wait(barrier);
+        delay = inject_delay;
+        ofst = 0;
+        while((phase = mb_epoch_phase(&epoch)) != MB_EPOCH_DONE){
+            if (id == 0) {
+                GETTIMEOFDAY(&chunk_tv);
+                t0 = mb_read_tsc();
+                nr_ops = walk_chains(working_area, heads, option.chains);
+                t1 = mb_read_tsc();
+                if (phase != MB_EPOCH_MEASURE) continue;
+                pc->clk += t1 - t0;
+                pc->ops += nr_ops;
+                pc->wallclocktime += mb_elapsed_time_from(&chunk_tv);
+                continue;
+            }
+
+            n = (len - ofst < (long) INJECT_BLOCK_LEN ? len - ofst : (long) INJECT_BLOCK_LEN);
+            sink = simds[option.simd].pass(option.kernel, option.nontemporal,
+                                           a + ofst, b + ofst, c + ofst, n);
+            if (phase == MB_EPOCH_MEASURE) {
+                pc->bytes += n * nr_arrays * sizeof(double);
+            }
+            ofst = (ofst + n < len ? ofst + n : 0);
+            if (delay > 0) {
+                t0 = mb_read_tsc();
+                while (mb_read_tsc() - t0 < (uintptr_t) delay)
+                    ;
+            }
+        }
+        // the main thread collects the results of this point
+        pthread_barrier_wait(barrier);
+    }
+    (void) sink;
+}
+
+// rebuild the chain in place for each working set size of the sweep
+// and chase it, once for each point
+void
+do_memory_sweep(perf_counter_t* pc,
+                long *working_area,
+                pthread_barrier_t *barrier)
+{
+    struct timeval chunk_tv;
+    mb_epoch_phase_t phase;
+    long *heads[MAX_CHAINS];
+    unsigned long nr_ops;
+    int pt;
+
+    uintptr_t t0, t1;
+
+    for (pt = 0; pt < option.nr_sweep; pt++) {
+        make_chain(working_area, option.sweep_sizes[pt], CACHELINE_SIZE,
+                   heads, option.chains);
+        pthread_barrier_wait(barrier);
+        pthread_barrier_wait(barrier);
+        while((phase = mb_epoch_phase(&epoch)) != MB_EPOCH_DONE){
+            GETTIMEOFDAY(&chunk_tv);
+            t0 = mb_read_tsc();
+            nr_ops = walk_chains(working_area, heads, option.chains);
+            t1 = mb_read_tsc();
+            if (phase != MB_EPOCH_MEASURE) continue;
+            pc->clk += t1 - t0;
+            pc->ops += nr_ops;
+            pc->wallclocktime += mb_elapsed_time_from(&chunk_tv);
+        }
+        // the main thread collects the results of this point
+        pthread_barrier_wait(barrier);
+    }
+}
+
+// one 8-byte load every step longs of [area, area + nr_longs) and the sum
+static __attribute__((noinline)) long
+stride_pass(long *area, long nr_longs, long step)
+{
+    long sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    long i;
+
+    for (i = 0; i + 3 * step < nr_longs; i += 4 * step) {
+        sum0 += area[i];
+        sum1 += area[i + step];
+        sum2 += area[i + 2 * step];
+        sum3 += area[i + 3 * step];
+    }
+    for (; i < nr_longs; i += step) {
+        sum0 += area[i];
+    }
+    return sum0 + sum1 + sum2 + sum3;
+}
+
+// scan the area with each stride (sequential mode) or chase a chain of
+// nodes spaced by it (random mode), once for each point
+void
+do_memory_granularity(perf_counter_t* pc,
+                      long *working_area,
+                      long working_size,
+                      int id,
+                      pthread_barrier_t *barrier)
+{
+    struct timeval chunk_tv;
+    mb_epoch_phase_t phase;
+    long *heads[MAX_CHAINS];
+    unsigned long nr_ops;
+    unsigned long iter_count;
+    unsigned long i;
+    long nr_longs;
+    long step;
+    long granularity;
+    int pt;
+    volatile long sink;
+
+    uintptr_t t0, t1;
+
+    nr_longs = working_size / sizeof(long);
+    // a shared region is not touched by the main thread, and loads from
+    // untouched anonymous memory would all hit the zero page
+    if (option.rand == false && option.local == false && id == 0) {
+        memset(working_area, 1, working_size);
+    }
+    for (pt = 0; pt < option.nr_granularities; pt++) {
+        granularity = option.granularities[pt];
+        step = granularity / sizeof(long);
+        nr_ops = (nr_longs + step - 1) / step;
+        // about as many loads per chunk as the generated random loop
+        iter_count = (MEBI / 4 + nr_ops - 1) / nr_ops;
+
+        // threads sharing one region walk the chain thread 0 builds
+        if (option.rand == true && (option.local == true || id == 0)) {
+            make_chain(working_area, working_size, granularity, heads, option.chains);
+            if (option.local == false) {
+                memcpy(shared_heads, heads, sizeof(heads));
+            }
+        }
+        pthread_barrier_wait(barrier);
+        if (option.rand == true && option.local == false && id != 0) {
+            memcpy(heads, shared_heads, sizeof(heads));
+        }
+        pthread_barrier_wait(barrier);
+        while((phase = mb_epoch_phase(&epoch)) != MB_EPOCH_DONE){
+            GETTIMEOFDAY(&chunk_tv);
+            t0 = mb_read_tsc();
+            if (option.rand == true) {
+                nr_ops = walk_chains(working_area, heads, option.chains);
+            } else {
+                for (i = 0; i < iter_count; i++) {
+                    sink = stride_pass(working_area, nr_longs, step);
+                }
+                nr_ops = (nr_longs + step - 1) / step * iter_count;
+            }
+            t1 = mb_read_tsc();
+            if (phase != MB_EPOCH_MEASURE) continue;
+            pc->clk += t1 - t0;
+            pc->ops += nr_ops;
+            // a load brings in a whole cache line at most
+            pc->bytes += nr_ops * (granularity < CACHELINE_SIZE ? granularity : CACHELINE_SIZE);
+            pc->wallclocktime += mb_elapsed_time_from(&chunk_tv);
+        }
+        // the main thread collects the results of this point
+        pthread_barrier_wait(barrier);
+    }
+    (void) sink;
+}
+
+// for each pair of a CPU node and a memory node, thread 0 chases a
+// chain in the region on the memory node (even points), then all the
+// threads run the kernel on it (odd points), every thread running on
+// the CPUs of the CPU node
+void
+do_numa_matrix(perf_counter_t* pc,
+               long working_size,
+               int id,
+               pthread_barrier_t *barrier)
+{
+    struct timeval chunk_tv;
+    mb_epoch_phase_t phase;
+    long *heads[MAX_CHAINS];
+    long *area;
+    unsigned long nr_ops;
+    unsigned long iter_count;
+    unsigned long i;
+    int nr_arrays;
+    int row, col;
+    long len;
+    double *a, *b, *c;
+    volatile double sink;
+
+    uintptr_t t0, t1;
+
+    nr_arrays = kernels[option.kernel].nr_arrays;
+    for (row = 0; row < option.nr_cpu_nodes; row++) {
+        sched_setaffinity(0, sizeof(cpu_set_t), &option.node_cpus[row]);
+        for (col = 0; col < option.nr_mem_nodes; col++) {
+            area = node_areas[col];
+
+            // the kernel of the previous point overwrote the chain
+            if (id == 0) {
+                make_chain(area, working_size, CACHELINE_SIZE, heads, option.chains);
+            }
+            pthread_barrier_wait(barrier);
+            pthread_barrier_wait(barrier);
+            while(id == 0 && (phase = mb_epoch_phase(&epoch)) != MB_EPOCH_DONE){
+                GETTIMEOFDAY(&chunk_tv);
+                t0 = mb_read_tsc();
+                nr_ops = walk_chains(area, heads, option.chains);
+                t1 = mb_read_tsc();
+                if (phase != MB_EPOCH_MEASURE) continue;
+                pc->clk += t1 - t0;
+                pc->ops += nr_ops;
+                pc->wallclocktime += mb_elapsed_time_from(&chunk_tv);
+            }
+            // the main thread collects the results of this point
+            pthread_barrier_wait(barrier);
+
+            len = stream_arrays(area, working_size, id, option.multi, &a, &b, &c);
+            iter_count = GIBI / (len * nr_arrays * sizeof(double));
+            if (iter_count == 0) {
+                iter_count = 1;
+            }
+            pthread_barrier_wait(barrier);
+            pthread_barrier_wait(barrier);
+            while((phase = mb_epoch_phase(&epoch)) != MB_EPOCH_DONE){
+                GETTIMEOFDAY(&chunk_tv);
+                t0 = mb_read_tsc();
+                for(i = 0;i < iter_count;i++){
+                    sink = simds[option.simd].pass(option.kernel, option.nontemporal,
+                                                   a, b, c, len);
+                }
+                t1 = mb_read_tsc();
+                if (phase != MB_EPOCH_MEASURE) continue;
+                pc->clk += t1 - t0;
+                pc->ops += len * iter_count;
+                pc->bytes += len * nr_arrays * sizeof(double) * iter_count;
+                pc->wallclocktime += mb_elapsed_time_from(&chunk_tv);
+            }
+            pthread_barrier_wait(barrier);
+        }
+    }
+    (void) sink;
+}
+
+// print events counted by every thread as totals and per-op rates
+void
+print_pmu(th_arg_t *args, unsigned long ops)
+{
+    uint64_t counts[PMU_NR_EVENTS];
+    bool avail[PMU_NR_EVENTS];
+    bool any;
+    int i;
+    int ev;
+
+    any = false;
+    for (ev = 0; ev < PMU_NR_EVENTS; ev++) {
+        counts[ev] = 0;
+        avail[ev] = true;
+        for (i = 0; i < option.multi; i++) {
+            if (args[i].pc.pmu.counted[ev] == false) {
+                avail[ev] = false;
+                break;
+            }
+            counts[ev] += args[i].pc.pmu.counts[ev];
+        }
+        if (avail[ev]) any = true;
+    }
+
+    if (any == false) {
+        fprintf(stderr, "Hardware performance counters are not available; "
+                "perf_* results are omitted.\n");
+        printf("perf_available\tfalse\n");
+        return;
+    }
+    printf("perf_available\ttrue\n");
+    for (ev = 0; ev < PMU_NR_EVENTS; ev++) {
+        if (avail[ev] == false) continue;
+        printf("perf_%s\t%" PRIu64 "\n"
+               "perf_%s_per_op\t%le\n",
+               pmu_events[ev].name, counts[ev],
+               pmu_events[ev].name, (ops > 0 ? (double) counts[ev] / ops : 0.0));
+    }
+    if (avail[PMU_CYCLES] && avail[PMU_INSTRUCTIONS] && counts[PMU_CYCLES] > 0) {
+        printf("perf_ipc\t%lf\n",
+               (double) counts[PMU_INSTRUCTIONS] / counts[PMU_CYCLES]);
     }
-    printf("loop end: t=%lf\n", t);
-    pc->wallclocktime = t;
 }
 
+// size in bytes of a cache described by sysfs, e.g. "48K"
+static long
+parse_cache_size(const char *str)
+{
+    char *endptr;
+    long size;
+
+    size = strtol(str, &endptr, 10);
+    switch (*endptr) {
+    case 'K': size *= KIBI; break;
+    case 'M': size *= MEBI; break;
+    case 'G': size *= GIBI; break;
+    }
+    return size;
+}
+
+// find latency plateaus of a sweep and return the number of them.
+// a plateau is a run of SWEEP_PLATEAU_POINTS or more points within
+// SWEEP_PLATEAU_RATIO of its lowest latency. points between plateaus
+// are transitions. a plateau less than SWEEP_LEVEL_RATIO slower than
+// the previous level extends it instead of starting a new one.
+// a level is the first point of its plateaus with the size of the last one.
 int
-main(int argc, char **argv)
+detect_levels(point_t *points, int nr_points, point_t *levels)
+{
+    int nr_levels;
+    int first, last;
+    double min;
+
+    nr_levels = 0;
+    for (first = 0; first < nr_points; first = last + 1) {
+        min = points[first].clk_per_op;
+        for (last = first;
+             last + 1 < nr_points && points[last + 1].clk_per_op <= min * SWEEP_PLATEAU_RATIO;
+             last++) {
+            if (points[last + 1].clk_per_op < min) min = points[last + 1].clk_per_op;
+        }
+        if (last - first + 1 < SWEEP_PLATEAU_POINTS) continue;
+
+        if (nr_levels > 0 &&
+            points[first].clk_per_op < levels[nr_levels - 1].clk_per_op * SWEEP_LEVEL_RATIO) {
+            levels[nr_levels - 1].size = points[last].size;
+            continue;
+        }
+        levels[nr_levels] = points[first];
+        levels[nr_levels].size = points[last].size;
+        nr_levels++;
+    }
+
+    return nr_levels;
+}
+
+// print the sweep table, the data and unified caches of cpu0 and the
+// levels of latency plateaus found in the table
+void
+print_sweep(point_t *points, int nr_points)
+{
+    char path[128];
+    char buf[64];
+    char names[8][16];
+    long sizes[8];
+    int nr_caches;
+    int idx;
+    int level;
+    int pt;
+    point_t *levels;
+    int nr_levels;
+    FILE *f;
+
+    printf("sweep_columns\tsize\tclk_per_op\tnsec_per_op\n");
+    for (pt = 0; pt < nr_points; pt++) {
+        printf("sweep\t%ld\t%lf\t%lf\n",
+               points[pt].size,
+               points[pt].clk_per_op,
+               points[pt].nsec_per_op);
+    }
+
+    nr_caches = 0;
+    for (idx = 0; nr_caches < 8; idx++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", idx);
+        if ((f = fopen(path, "r")) == NULL) break;
+        if (fscanf(f, "%63s", buf) != 1) buf[0] = '\0';
+        fclose(f);
+        if (strcmp(buf, "Instruction") == 0) continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", idx);
+        if ((f = fopen(path, "r")) == NULL) break;
+        if (fscanf(f, "%d", &level) != 1) level = 0;
+        fclose(f);
+        snprintf(names[nr_caches], sizeof(names[nr_caches]), "L%d%s", level,
+                 (strcmp(buf, "Data") == 0 ? "d" : ""));
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+        if ((f = fopen(path, "r")) == NULL) break;
+        if (fscanf(f, "%63s", buf) != 1) buf[0] = '\0';
+        fclose(f);
+        sizes[nr_caches] = parse_cache_size(buf);
+
+        printf("cache\t%s\t%ld\n", names[nr_caches], sizes[nr_caches]);
+        nr_caches++;
+    }
+
+    levels = malloc(sizeof(point_t) * nr_points);
+    nr_levels = detect_levels(points, nr_points, levels);
+
+    // levels are matched with the caches in order, the last one with memory
+    printf("detected_level_columns\tlevel\tmax_size\tclk_per_op\tcache\tcache_size\n");
+    for (level = 0; level < nr_levels; level++) {
+        printf("detected_level\t%d\t%ld\t%lf\t%s\t%ld\n",
+               level + 1,
+               levels[level].size,
+               levels[level].clk_per_op,
+               (level < nr_caches ? names[level] :
+                level == nr_levels - 1 ? "memory" : "-"),
+               (level < nr_caches ? sizes[level] : 0));
+    }
+    free(levels);
+}
+
+// index of the latency point of a cell of the NUMA matrix; the
+// bandwidth point of the cell follows it
+int
+numa_point(int row, int col)
+{
+    return 2 * (row * option.nr_mem_nodes + col);
+}
+
+// row and column of the cell a point of the NUMA matrix belongs to
+void
+numa_point_cell(int pt, int *row, int *col)
+{
+    *row = pt / 2 / option.nr_mem_nodes;
+    *col = pt / 2 % option.nr_mem_nodes;
+}
+
+// latency of thread 0 (even points) and bandwidth of all threads (odd
+// points) as rows of CPU nodes by columns of memory nodes
+void
+print_numa_matrix(point_t *points)
+{
+    static const char *rows[] = {
+        "numa_latency_clk", "numa_latency_nsec", "numa_bandwidth_GB_per_sec",
+    };
+    int k;
+    int row, col;
+    point_t *pt;
+
+    printf("numa_matrix_columns\tcpu_node");
+    for (col = 0; col < option.nr_mem_nodes; col++) {
+        printf("\tnode%d", option.mem_nodes[col]);
+    }
+    printf("\n");
+    for (k = 0; k < 3; k++) {
+        for (row = 0; row < option.nr_cpu_nodes; row++) {
+            printf("%s\t%d", rows[k], option.cpu_nodes[row]);
+            for (col = 0; col < option.nr_mem_nodes; col++) {
+                pt = &points[numa_point(row, col)];
+                printf("\t%lf", (k == 0 ? pt[0].clk_per_op :
+                                 k == 1 ? pt[0].nsec_per_op : pt[1].bandwidth));
+            }
+            printf("\n");
+        }
+    }
+}
+
+// a value of a JSON matrix; a point without any op has no number
+static void
+print_json_value(const char *sep, double value)
+{
+    if (isfinite(value)) {
+        printf("%s%lf", sep, value);
+    } else {
+        printf("%snull", sep);
+    }
+}
+
+// the matrices of print_numa_matrix and the parameters as a JSON object
+void
+print_numa_matrix_json(point_t *points)
+{
+    static const char *names[] = {
+        "latency_clk", "latency_nsec", "bandwidth_GB_per_sec",
+    };
+    int k;
+    int row, col;
+    point_t *pt;
+
+    printf("{\n"
+           "  \"multiplicity\": %d,\n"
+           "  \"size\": %ld,\n"
+           "  \"chains\": %d,\n"
+           "  \"kernel\": \"%s\",\n"
+           "  \"simd_width\": \"%s\",\n"
+           "  \"nontemporal\": %s,\n"
+           "  \"page_backing\": \"%s\",\n",
+           option.multi,
+           option.size,
+           option.chains,
+           kernels[option.kernel].name,
+           simds[option.simd].name,
+           (option.nontemporal ? "true" : "false"),
+           pages_names[option.pages]);
+    printf("  \"cpu_nodes\": [");
+    for (row = 0; row < option.nr_cpu_nodes; row++) {
+        printf("%s%d", (row > 0 ? ", " : ""), option.cpu_nodes[row]);
+    }
+    printf("],\n"
+           "  \"mem_nodes\": [");
+    for (col = 0; col < option.nr_mem_nodes; col++) {
+        printf("%s%d", (col > 0 ? ", " : ""), option.mem_nodes[col]);
+    }
+    printf("]");
+    for (k = 0; k < 3; k++) {
+        printf(",\n"
+               "  \"%s\": [", names[k]);
+        for (row = 0; row < option.nr_cpu_nodes; row++) {
+            printf("%s\n    [", (row > 0 ? "," : ""));
+            for (col = 0; col < option.nr_mem_nodes; col++) {
+                pt = &points[numa_point(row, col)];
+                print_json_value((col > 0 ? ", " : ""),
+                                 (k == 0 ? pt[0].clk_per_op :
+                                  k == 1 ? pt[0].nsec_per_op : pt[1].bandwidth));
+            }
+            printf("]");
+        }
+        printf("\n  ]");
+    }
+    printf("\n}\n");
+}
+
+// mmap(2) a working area. THP areas are aligned to huge pages so that
+// none of them is split at the ends, and advised as -p requests.
+long *
+map_region(size_t size, int flags, int fd, size_t align)
+{
+    char *addr;
+    char *aligned;
+    size_t extra;
+
+    extra = (option.pages == PAGES_THP ? align : 0);
+    addr = mmap(NULL, size + extra, PROT_READ|PROT_WRITE, flags, fd, 0);
+    if (addr == MAP_FAILED){
+        perror("mmap(2) failed");
+        if (option.pages == PAGES_HUGETLB) {
+            fprintf(stderr, "Reserve huge pages of %ld bytes in "
+                    "/sys/kernel/mm/hugepages/ beforehand.\n",
+                    option.hugepage_size);
+        }
+        exit(EXIT_FAILURE);
+    }
+    if (extra > 0) {
+        aligned = (char *) (((uintptr_t) addr + align - 1) & ~((uintptr_t) align - 1));
+        if (aligned > addr) {
+            munmap(addr, aligned - addr);
+        }
+        if (aligned + size < addr + size + extra) {
+            munmap(aligned + size, addr + size + extra - (aligned + size));
+        }
+        addr = aligned;
+    }
+
+    if ((option.pages == PAGES_THP &&
+         madvise(addr, size, MADV_HUGEPAGE) != 0) ||
+        (option.pages == PAGES_4K &&
+         madvise(addr, size, MADV_NOHUGEPAGE) != 0)) {
+        perror("madvise(2) failed");
+        exit(EXIT_FAILURE);
+    }
+
+    return (long *) addr;
+}
+
+// add what an smaps file reports on the mapping containing addr
+void
+parse_smaps(FILE *f, void *addr, page_usage_t *usage)
+{
+    char line[256];
+    char key[64];
+    unsigned long start, end;
+    long val;
+    bool target;
+
+    target = false;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        // mapping headers start with "start-end", no field line does
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            target = (start <= (uintptr_t) addr && (uintptr_t) addr < end);
+            continue;
+        }
+        if (target == false ||
+            sscanf(line, "%63[^:]: %ld kB", key, &val) != 2) {
+            continue;
+        }
+        if (strcmp(key, "KernelPageSize") == 0) {
+            usage->kernel_page_size = val * KIBI;
+        } else if (strcmp(key, "Rss") == 0) {
+            usage->rss += val * KIBI;
+        } else if (strcmp(key, "AnonHugePages") == 0) {
+            usage->huge_rss += val * KIBI;
+        } else if (strcmp(key, "Private_Hugetlb") == 0 ||
+                   strcmp(key, "Shared_Hugetlb") == 0) {
+            // hugetlb pages are not counted in Rss
+            usage->rss += val * KIBI;
+            usage->huge_rss += val * KIBI;
+        }
+    }
+}
+
+// add what /proc/self/smaps reports on the mapping containing addr
+void
+read_page_usage(void *addr, page_usage_t *usage)
+{
+    FILE *f;
+
+    if ((f = fopen("/proc/self/smaps", "r")) == NULL) {
+        perror("failed to open /proc/self/smaps");
+        return;
+    }
+    parse_smaps(f, addr, usage);
+    fclose(f);
+}
+
+int
+micbench_mem_main(int argc, char **argv)
 {
     th_arg_t          *args;
     long              *working_area;
@@ -349,13 +1854,18 @@ main(int argc, char **argv)
 
     args = malloc(sizeof(th_arg_t) * option.multi);
     barrier = malloc(sizeof(pthread_barrier_t));
-    pthread_barrier_init(barrier, NULL, option.multi);
+    // workers and the main thread, which starts the epoch
+    pthread_barrier_init(barrier, NULL, option.multi + 1);
 
     for(i = 0;i < option.multi;i++){
         args[i].id = i;
         args[i].self = malloc(sizeof(pthread_t));
         args[i].pc.ops = 0;
         args[i].pc.clk = 0;
+        args[i].pc.bytes = 0;
+        args[i].pc.wallclocktime = 0;
+        args[i].pc.pmu.leader = -1;
+        memset(args[i].pc.pmu.counted, 0, sizeof(args[i].pc.pmu.counted));
         args[i].barrier = barrier;
         if (option.affinities != NULL) {
             args[i].affinity = option.affinities[i];
@@ -374,6 +1884,13 @@ main(int argc, char **argv)
 
     if (option.hugetlbfile != NULL){
         align = option.hugepage_size;
+    } else if (option.pages == PAGES_HUGETLB) {
+        align = option.hugepage_size;
+        mmap_flags |= MAP_ANONYMOUS | MAP_HUGETLB
+            | ((ffsl(option.hugepage_size) - 1) << MAP_HUGE_SHIFT);
+    } else if (option.pages == PAGES_THP) {
+        align = option.hugepage_size;
+        mmap_flags |= MAP_ANONYMOUS;
     } else {
         align = PAGE_SIZE;
         mmap_flags |= MAP_ANONYMOUS;
@@ -395,16 +1912,7 @@ main(int argc, char **argv)
                 args[i].fd = -1;
             }
             args[i].working_size = option.size;
-            args[i].working_area = mmap(NULL,
-                                        mmap_size,
-                                        PROT_READ|PROT_WRITE,
-                                        mmap_flags,
-                                        args[i].fd,
-                                        0);
-            if (args[i].working_area == MAP_FAILED){
-                perror("mmap(2) failed");
-                exit(EXIT_FAILURE);
-            }
+            args[i].working_area = map_region(mmap_size, mmap_flags, args[i].fd, align);
 
             if (args[i].affinity != NULL && args[i].affinity->nodemask != 0){
 #ifdef NUMA_ARCH
@@ -443,6 +1951,32 @@ main(int argc, char **argv)
                 fprintf(stderr, "memset time: %f\n", mb_elapsed_time_from(&tv));
 
         }
+    } else if (option.numa_matrix == true) {
+        // a region bound to each memory node, shared by all the threads
+        node_areas = malloc(sizeof(long *) * option.nr_mem_nodes);
+        for (i = 0; i < option.nr_mem_nodes; i++) {
+            node_areas[i] = map_region(mmap_size, mmap_flags, -1, align);
+#ifdef NUMA_ARCH
+            struct bitmask *nodes = numa_allocate_nodemask();
+            numa_bitmask_setbit(nodes, option.mem_nodes[i]);
+            if (mbind(node_areas[i],
+                      mmap_size,
+                      MPOL_BIND,
+                      nodes->maskp,
+                      nodes->size + 1,
+                      MPOL_MF_STRICT) != 0){
+                perror("mbind(2) failed");
+                exit(EXIT_FAILURE);
+            }
+            numa_free_nodemask(nodes);
+#endif
+            memset(node_areas[i], 0, mmap_size);
+        }
+        for(i = 0;i < option.multi;i++){
+            args[i].working_size = option.size;
+            args[i].working_area = node_areas[0];
+            args[i].fd = -1;
+        }
     } else {
         if (option.hugetlbfile != NULL) {
             fd = open(option.hugetlbfile, O_CREAT | O_RDWR, 0755);
@@ -455,16 +1989,7 @@ main(int argc, char **argv)
             fd = -1;
         }
 
-        working_area = mmap(NULL,
-                            mmap_size,
-                            PROT_READ|PROT_WRITE,
-                            mmap_flags,
-                            fd,
-                            0);
-        if (working_area == MAP_FAILED){
-            printf("Cannot allocate memory\n");
-            exit(EXIT_FAILURE);
-        }
+        working_area = map_region(mmap_size, mmap_flags, fd, align);
 
         /*
           http://www.gossamer-threads.com/lists/linux/kernel/461213
@@ -504,6 +2029,12 @@ main(int argc, char **argv)
 #endif
         }
 
+        // fault in the pages requested by -p; otherwise untouched areas
+        // are read from the zero page and never get backed at all
+        if (option.pages != PAGES_DEFAULT) {
+            memset(working_area, 0, mmap_size);
+        }
+
         for(i = 0;i < option.multi;i++){
             args[i].working_size = option.size;
             args[i].working_area = working_area;
@@ -514,15 +2045,106 @@ main(int argc, char **argv)
     struct timeval start_tv;
     struct timeval end_tv;
 
+    point_t *points = NULL;
+    int nr_points;
+    int pt;
+    int row, col;
+
+    nr_points = (option.numa_matrix ? numa_point(option.nr_cpu_nodes, 0) :
+                 option.nr_granularities > 0 ? option.nr_granularities :
+                 option.nr_sweep > 0 ? option.nr_sweep : option.nr_delays);
+
     GETTIMEOFDAY(&start_tv);
     for(i = 0;i < option.multi;i++){
         pthread_create(args[i].self, NULL, thread_handler, &args[i]);
     }
+    if (nr_points > 0) {
+        points = malloc(sizeof(point_t) * nr_points);
+        for (pt = 0; pt < nr_points; pt++) {
+            inject_delay = (option.nr_delays > 0 ? option.delays[pt] : 0);
+            mb_epoch_init(&epoch, option.warmup, option.timeout, option.rampdown);
+            pthread_barrier_wait(barrier);
+            mb_epoch_start(&epoch);
+            pthread_barrier_wait(barrier);
+            pthread_barrier_wait(barrier);
+            mb_epoch_finish(&epoch);
+
+            points[pt].delay = inject_delay;
+            points[pt].size = (option.nr_sweep > 0 ? option.sweep_sizes[pt] : option.size);
+            points[pt].granularity = (option.nr_granularities > 0 ?
+                                      option.granularities[pt] : CACHELINE_SIZE);
+            points[pt].cpu_node = -1;
+            points[pt].mem_node = -1;
+            if (option.numa_matrix) {
+                numa_point_cell(pt, &row, &col);
+                points[pt].cpu_node = option.cpu_nodes[row];
+                points[pt].mem_node = option.mem_nodes[col];
+            }
+            if (option.nr_delays > 0 || (option.numa_matrix && pt % 2 == 0)) {
+                // thread 0 chases, the others load or idle
+                points[pt].clk_per_op = (double) args[0].pc.clk / args[0].pc.ops;
+                points[pt].nsec_per_op = args[0].pc.wallclocktime * 1.0e9 / args[0].pc.ops;
+                points[pt].ops_per_sec = args[0].pc.ops / args[0].pc.wallclocktime;
+                points[pt].bandwidth = 0.0;
+                for(i = 1;i < option.multi;i++){
+                    points[pt].bandwidth += args[i].pc.bytes;
+                }
+                points[pt].bandwidth /= mb_epoch_measured_time(&epoch) * GIBI;
+            } else {
+                unsigned long ops = 0, clk = 0, bytes = 0;
+                double wallclocktime = 0.0;
+
+                for(i = 0;i < option.multi;i++){
+                    ops += args[i].pc.ops;
+                    clk += args[i].pc.clk;
+                    bytes += args[i].pc.bytes;
+                    wallclocktime += args[i].pc.wallclocktime;
+                }
+                points[pt].clk_per_op = (double) clk / ops;
+                points[pt].nsec_per_op = wallclocktime * 1.0e9 / ops;
+                wallclocktime /= option.multi;
+                points[pt].ops_per_sec = ops / wallclocktime;
+                points[pt].bandwidth = bytes / wallclocktime / GIBI;
+            }
+            for(i = 0;i < option.multi;i++){
+                args[i].pc.ops = 0;
+                args[i].pc.clk = 0;
+                args[i].pc.bytes = 0;
+                args[i].pc.wallclocktime = 0;
+            }
+            if (option.verbose == true) {
+                fprintf(stderr, "delay %ld, size %ld, granularity %ld, nodes %d-%d: %lf GB/s, %lf clk\n",
+                        points[pt].delay, points[pt].size, points[pt].granularity,
+                        points[pt].cpu_node, points[pt].mem_node,
+                        points[pt].bandwidth, points[pt].clk_per_op);
+            }
+        }
+    } else {
+        mb_epoch_init(&epoch, option.warmup, option.timeout, option.rampdown);
+        pthread_barrier_wait(barrier);
+        mb_epoch_start(&epoch);
+        pthread_barrier_wait(barrier);
+    }
 
     for(i = 0;i < option.multi;i++){
         pthread_join(*args[i].self, NULL);
     }
     GETTIMEOFDAY(&end_tv);
+
+    // pages actually obtained, which THP may or may not have promoted
+    page_usage_t usage = {0, 0, 0};
+    if (option.numa_matrix == true) {
+        for (i = 0; i < option.nr_mem_nodes; i++) {
+            read_page_usage(node_areas[i], &usage);
+        }
+    } else {
+        for(i = 0;i < (option.local ? option.multi : 1);i++){
+            read_page_usage(args[i].working_area, &usage);
+        }
+    }
+    if (nr_points == 0) {
+        mb_epoch_finish(&epoch);
+    }
     pthread_barrier_destroy(barrier);
     free(barrier);
 
@@ -532,10 +2154,12 @@ main(int argc, char **argv)
 
     unsigned long ops = 0;
     unsigned long clk = 0;
+    unsigned long bytes = 0;
     double wallclocktime = 0.0;
     for(i = 0;i < option.multi;i++){
         ops += args[i].pc.ops;
         clk += args[i].pc.clk;
+        bytes += args[i].pc.bytes;
         wallclocktime += args[i].pc.wallclocktime;
     }
 
@@ -543,6 +2167,12 @@ main(int argc, char **argv)
     double rt = ((double)clk)/ops;
     double tp = ops / wallclocktime;
 
+    if (option.json == true) {
+        print_numa_matrix_json(points);
+        free(points);
+        goto cleanup;
+    }
+
     // print summary
     printf("access_pattern\t%s\n"
            "multiplicity\t%d\n"
@@ -550,25 +2180,109 @@ main(int argc, char **argv)
            "page_size\t%ld\n"
            "size\t%ld\n"
            "use_hugepages\t%s\n"
+           "page_backing\t%s\n"
+           "kernel_page_size\t%ld\n"
+           "rss\t%ld\n"
+           "huge_page_rss\t%ld\n"
+           "huge_page_ratio\t%lf\n"
            ,
-           (option.seq ? "sequential" : "random"),
+           (option.numa_matrix ? "numa_matrix" :
+            option.nr_granularities > 0 ? (option.rand ? "random" : "sequential") :
+            option.nr_sweep > 0 ? "sweep" :
+            option.nr_delays > 0 ? "loaded_latency" :
+            option.seq ? "sequential" : "random"),
            option.multi,
            (option.local ? "true" : "false"),
            PAGE_SIZE,
            option.size,
-           (option.hugetlbfile == NULL ? "false" : "true")
+           (option.hugetlbfile == NULL && option.pages != PAGES_THP &&
+            option.pages != PAGES_HUGETLB ? "false" : "true"),
+           (option.hugetlbfile != NULL ? "hugetlbfile" : pages_names[option.pages]),
+           usage.kernel_page_size,
+           usage.rss,
+           usage.huge_rss,
+           (usage.rss > 0 ? (double) usage.huge_rss / usage.rss : 0.0)
         );
-    if (option.hugetlbfile != NULL) {
-        printf("hugetlbfile\t%s\n"
-               "hugepage_size\t%ld\n",
-               option.hugetlbfile,
-               option.hugepage_size);
+    if (option.hugetlbfile != NULL || option.pages == PAGES_THP ||
+        option.pages == PAGES_HUGETLB) {
+        if (option.hugetlbfile != NULL) {
+            printf("hugetlbfile\t%s\n", option.hugetlbfile);
+        }
+        printf("hugepage_size\t%ld\n", option.hugepage_size);
+    }
+    if (option.warmup > 0 || option.rampdown > 0) {
+        printf("warmup_time\t%lf\n"
+               "rampdown_time\t%lf\n",
+               option.warmup,
+               option.rampdown);
+    }
+    if (option.rand == true || option.nr_delays > 0 || option.nr_sweep > 0 ||
+        option.numa_matrix == true) {
+        printf("chains\t%d\n", option.chains);
     }
-    if (option.seq == true) {
+    if (option.kernel != KERNEL_INCR && option.nr_sweep == 0) {
+        printf("kernel\t%s\n"
+               "simd_width\t%s\n"
+               "nontemporal\t%s\n"
+               "array_size\t%ld\n",
+               kernels[option.kernel].name,
+               simds[option.simd].name,
+               (option.nontemporal ? "true" : "false"),
+               option.size / kernels[option.kernel].nr_arrays
+               / CACHELINE_SIZE * CACHELINE_SIZE);
+    } else if (option.seq == true && nr_points == 0) {
         printf("stride_size\t%d\n",
                MEM_INNER_LOOP_SEQ_STRIDE_SIZE);
     }
 
+    if (option.nr_delays > 0) {
+        // latency of thread 0 against the traffic of the others
+        printf("total_exec_time\t%lf\n"
+               "loaded_latency_columns\tdelay_clk\tGB_per_sec\tclk_per_op\tnsec_per_op\n",
+               TV2DOUBLE(end_tv) - TV2DOUBLE(start_tv));
+        for (pt = 0; pt < option.nr_delays; pt++) {
+            printf("loaded_latency\t%ld\t%lf\t%lf\t%lf\n",
+                   points[pt].delay,
+                   points[pt].bandwidth,
+                   points[pt].clk_per_op,
+                   points[pt].nsec_per_op);
+        }
+        free(points);
+        free(option.delays);
+        goto cleanup;
+    }
+    if (option.numa_matrix == true) {
+        printf("total_exec_time\t%lf\n",
+               TV2DOUBLE(end_tv) - TV2DOUBLE(start_tv));
+        print_numa_matrix(points);
+        free(points);
+        goto cleanup;
+    }
+    if (option.nr_granularities > 0) {
+        printf("total_exec_time\t%lf\n"
+               "granularity_columns\tgranularity\tops_per_sec\tclk_per_op\tnsec_per_op\tGB_per_sec\n",
+               TV2DOUBLE(end_tv) - TV2DOUBLE(start_tv));
+        for (pt = 0; pt < option.nr_granularities; pt++) {
+            printf("granularity\t%ld\t%le\t%lf\t%lf\t%lf\n",
+                   points[pt].granularity,
+                   points[pt].ops_per_sec,
+                   points[pt].clk_per_op,
+                   points[pt].nsec_per_op,
+                   points[pt].bandwidth);
+        }
+        free(points);
+        free(option.granularities);
+        goto cleanup;
+    }
+    if (option.nr_sweep > 0) {
+        printf("total_exec_time\t%lf\n",
+               TV2DOUBLE(end_tv) - TV2DOUBLE(start_tv));
+        print_sweep(points, option.nr_sweep);
+        free(points);
+        free(option.sweep_sizes);
+        goto cleanup;
+    }
+
     printf("total_ops\t%ld\n"
            "total_clk\t%ld\n"
            "exec_time\t%lf\n"
@@ -582,16 +2296,36 @@ main(int argc, char **argv)
            rt,
            TV2DOUBLE(end_tv) - TV2DOUBLE(start_tv)
         );
-    if (option.seq == true) {
+    if (option.chains > 1) {
+        // latency each chain sees, with the other chains in flight
+        printf("clk_per_chain_op\t%le\n", rt * option.chains);
+    }
+    if (option.kernel != KERNEL_INCR) {
+        printf("total_bytes\t%ld\n"
+               "GB_per_sec\t%lf\n",
+               bytes,
+               bytes / wallclocktime / 1024 / 1024 / 1024);
+    } else if (option.seq == true) {
         printf("GB_per_sec\t%lf\n",
                tp * MEM_INNER_LOOP_SEQ_STRIDE_SIZE / 1024 / 1024 / 1024);
     }
+    if (option.pmu == true) {
+        print_pmu(args, ops);
+    }
 
-
+cleanup:
     if (option.local == true){
         for(i = 0;i < option.multi;i++){
             munmap(args[i].working_area, mmap_size);
         }
+    } else if (option.numa_matrix == true) {
+        for (i = 0; i < option.nr_mem_nodes; i++) {
+            munmap(node_areas[i], mmap_size);
+        }
+        free(node_areas);
+        free(option.cpu_nodes);
+        free(option.node_cpus);
+        free(option.mem_nodes);
     } else {
         munmap(args[0].working_area, mmap_size);
     }
@@ -0,0 +1,271 @@
+/* -*- indent-tabs-mode: nil -*- */
+
+#ifndef MICBENCH_MEM_H
+#define MICBENCH_MEM_H
+
+#include "micbench.h"
+
+typedef struct {
+    // multiplicity of memory access
+    int multi;
+    mb_affinity_t **affinities;
+
+    // memory access mode
+    bool seq;
+    bool rand;
+    bool local;
+
+    // independent pointer chains walked by each thread in random mode
+    int chains;
+
+    // injection delays (in clocks) swept in loaded latency mode
+    long *delays;
+    int nr_delays;
+
+    // working set sizes swept from sweep_min up to size
+    long sweep_min;
+    long *sweep_sizes;
+    int nr_sweep;
+
+    // strides of sequential mode or spacings of chained nodes in random
+    // mode (in bytes) swept in granularity mode
+    long *granularities;
+    int nr_granularities;
+
+    // NUMA matrix mode: nodes with CPUs (rows) and nodes with memory
+    // (columns) of the matrix
+    bool numa_matrix;
+    int *cpu_nodes;
+    cpu_set_t *node_cpus;
+    int nr_cpu_nodes;
+    int *mem_nodes;
+    int nr_mem_nodes;
+    bool json;
+
+    // timeout
+    int timeout;
+
+    // unmeasured time before and after the measurement (in sec)
+    double warmup;
+    double rampdown;
+
+    // memory access size
+    long size; // guaranteed to be multiple of 1024
+    const char *hugetlbfile;
+    long hugepage_size;
+    int pages;
+
+    // bandwidth kernel of the sequential mode
+    int kernel;
+    int simd;
+    bool nontemporal;
+
+    // count hardware events with perf_event_open(2)
+    bool pmu;
+
+    bool verbose;
+} micbench_mem_option_t;
+
+extern micbench_mem_option_t option;
+
+// page backing of anonymous working areas
+enum {
+    PAGES_DEFAULT = 0,  // whatever the system THP policy gives
+    PAGES_4K,           // madvise(MADV_NOHUGEPAGE)
+    PAGES_THP,          // madvise(MADV_HUGEPAGE) on a huge page aligned area
+    PAGES_HUGETLB,      // MAP_HUGETLB with pages of hugepage_size
+    PAGES_NR,
+};
+
+// pages backing working areas as /proc/self/smaps reports (in bytes)
+typedef struct {
+    long kernel_page_size;
+    long rss;
+    long huge_rss;      // part of rss in THP or hugetlb pages
+} page_usage_t;
+
+// kernels of the sequential mode. "incr" is the generated scan & increment
+// loop; the others are STREAM-style kernels on arrays of double.
+enum {
+    KERNEL_INCR = 0,
+    KERNEL_READ,
+    KERNEL_WRITE,
+    KERNEL_COPY,
+    KERNEL_SCALE,
+    KERNEL_ADD,
+    KERNEL_TRIAD,
+    KERNEL_NR,
+};
+
+typedef struct {
+    const char *name;
+    // arrays touched by the kernel; each element of them is read or
+    // written exactly once per pass, so it also gives bytes per element
+    int         nr_arrays;
+} kernel_t;
+
+extern const kernel_t kernels[KERNEL_NR];
+
+#define STREAM_SCALAR 3.0
+
+#define MAX_CHAINS 32
+
+// construction of pointer chains (see make_chain)
+#define CHAIN_ROUNDS 4
+#define CHAIN_PARALLEL_LINES (1UL << 18)
+#define CHAIN_CHECK_LINKS (1UL << 16)
+
+// vector widths of the STREAM-style kernels
+enum {
+    SIMD_AUTO = -1,     // widest one the CPU supports
+    SIMD_SCALAR = 0,    // plain C loops as compiled
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_AVX512,
+    SIMD_NR,
+};
+
+typedef double (*stream_pass_t)(int kernel, bool nt,
+                                double *a, double *b, double *c, long len);
+
+typedef struct {
+    const char    *name;
+    stream_pass_t  pass;    // NULL if not built for this architecture
+} simd_t;
+
+extern const simd_t simds[SIMD_NR];
+
+// hardware events counted as one perf_event_open(2) group per thread
+enum {
+    PMU_CYCLES = 0,
+    PMU_INSTRUCTIONS,
+    PMU_L1D_MISSES,
+    PMU_LLC_MISSES,
+    PMU_DTLB_MISSES,
+    PMU_NODE_MISSES,
+    PMU_NR_EVENTS,
+};
+
+typedef struct {
+    int      leader;               // -1 if no counter could be opened
+    int      fds[PMU_NR_EVENTS];   // -1 for events the CPU does not expose
+    uint64_t ids[PMU_NR_EVENTS];
+    uint64_t counts[PMU_NR_EVENTS];
+    bool     counted[PMU_NR_EVENTS];
+} pmu_group_t;
+
+typedef struct perf_counter_rec {
+    unsigned long ops;
+    unsigned long clk;
+    unsigned long bytes;
+    double wallclocktime;
+    pmu_group_t pmu;
+} perf_counter_t;
+
+typedef struct {
+    int            id;
+    pthread_t     *self;
+    mb_affinity_t *affinity;
+
+    long           *working_area; // working area
+    long            working_size; // size of working area
+    int             fd;
+    perf_counter_t  pc;
+
+    pthread_barrier_t *barrier;
+} th_arg_t;
+
+// a random cyclic pointer chain through every cache line (or every
+// node of another size) of an area.
+// line perm(i) points to line perm(i + 1 mod nr_lines), where perm is a
+// keyed Feistel permutation of the line indices. being a bijection, it
+// always gives a single cycle, and any range of links can be built
+// without looking at the others.
+typedef struct {
+    long          *area;
+    unsigned long  nr_lines;
+    long           stride;      // in longs
+    int            half_bits;
+    uint64_t       keys[CHAIN_ROUNDS];
+} chain_t;
+
+// splitmix64 finalizer
+static inline uint64_t
+chain_mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline unsigned long
+chain_perm(chain_t *chain, unsigned long x)
+{
+    uint64_t mask = (1ULL << chain->half_bits) - 1;
+    uint64_t l, r, t;
+    int round;
+
+    // walk the cycle of the permutation on [0, 4^half_bits) until it
+    // comes back into [0, nr_lines)
+    do {
+        l = x >> chain->half_bits;
+        r = x & mask;
+        for (round = 0; round < CHAIN_ROUNDS; round++) {
+            t = r;
+            r = l ^ (chain_mix(r ^ chain->keys[round]) & mask);
+            l = t;
+        }
+        x = (l << chain->half_bits) | r;
+    } while (x >= chain->nr_lines);
+
+    return x;
+}
+
+static inline long *
+chain_line(chain_t *chain, unsigned long idx)
+{
+    return chain->area + idx * chain->stride;
+}
+
+// points per doubling of the working set size in sweep mode, and the
+// most points a sweep of sizes up to 2^64 can have
+#define SWEEP_STEPS 4
+#define SWEEP_MAX_SIZES (SWEEP_STEPS * 64 + 1)
+
+// latency plateau detection in sweep mode (see print_sweep)
+#define SWEEP_PLATEAU_RATIO 1.35
+#define SWEEP_PLATEAU_POINTS 3
+#define SWEEP_LEVEL_RATIO 1.5
+
+// a point of loaded latency, sweep, granularity or NUMA matrix mode
+typedef struct {
+    long   delay;
+    long   size;
+    long   granularity;
+    int    cpu_node;
+    int    mem_node;
+    double bandwidth;   // GB/s (of the loader threads in loaded latency mode)
+    double ops_per_sec;
+    double clk_per_op;  // (of the chasing thread in loaded latency mode)
+    double nsec_per_op;
+} point_t;
+
+bool  simd_supported      (int simd);
+int   parse_granularities (const char *arg, long **list);
+void  parse_args          (int argc, char **argv);
+long  stream_arrays       (long *working_area, long working_size, int part,
+                           int nr_parts, double **a, double **b, double **c);
+void  chase_chains        (long **heads, int nr_chains, unsigned long steps);
+void  chain_init          (chain_t *chain, long *area, long size,
+                           long granularity, struct drand48_data *rand);
+void  make_chain          (long *working_area, long working_size,
+                           long granularity, long **heads, int nr_chains);
+int   make_sweep_sizes    (long min, long max, long *sizes);
+int   detect_levels       (point_t *points, int nr_points, point_t *levels);
+void  parse_smaps         (FILE *f, void *addr, page_usage_t *usage);
+int   numa_point          (int row, int col);
+void  numa_point_cell     (int pt, int *row, int *col);
+
+int micbench_mem_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,8 @@
+
+#include "micbench-meta.h"
+
+int
+main(int argc, char **argv)
+{
+    return micbench_meta_main(argc, argv);
+}
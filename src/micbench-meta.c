@@ -0,0 +1,595 @@
+#define _GNU_SOURCE
+
+#include "micbench-meta.h"
+
+#include <dirent.h>
+#include <limits.h>
+
+const char *meta_op_names[NR_META_OPS] = {
+    "create", "open", "stat", "rename", "unlink", "readdir",
+};
+
+micbench_meta_option_t option;
+
+// warm-up, measurement and ramp-down of the run
+static mb_epoch_t epoch;
+
+/* parse "create=1,stat=4,..." into option.weights */
+int
+parse_mix(const char *arg)
+{
+    char *str;
+    char *entry;
+    char *saveptr;
+    char *val;
+    char *endptr;
+    int op;
+
+    for (op = 0; op < NR_META_OPS; op++) {
+        option.weights[op] = 0;
+    }
+    str = strdup(arg);
+    for (entry = strtok_r(str, ",", &saveptr); entry != NULL;
+         entry = strtok_r(NULL, ",", &saveptr)) {
+        if ((val = strchr(entry, '=')) == NULL) {
+            goto error;
+        }
+        *val++ = '\0';
+        for (op = 0; op < NR_META_OPS; op++) {
+            if (strcmp(entry, meta_op_names[op]) == 0) {
+                break;
+            }
+        }
+        if (op == NR_META_OPS) {
+            goto error;
+        }
+        option.weights[op] = strtol(val, &endptr, 10);
+        if (endptr == val || *endptr != '\0' || option.weights[op] < 0) {
+            goto error;
+        }
+    }
+    free(str);
+    return 0;
+
+error:
+    free(str);
+    return -1;
+}
+
+void
+parse_args(int argc, char **argv)
+{
+    char optchar;
+    int idx;
+    int op;
+
+    option.multi = 1;
+    option.affinities = NULL;
+    option.depth = 2;
+    option.fanout = 16;
+    option.nr_files = 1000;
+    option.file_size = 0;
+    option.timeout = 10;
+    option.warmup = 0;
+    option.rampdown = 0;
+    option.verbose = false;
+    parse_mix("create=1,open=1,stat=4,rename=1,unlink=1,readdir=1");
+
+    optind = 1;
+    while ((optchar = getopt(argc, argv, "+m:a:d:f:n:s:x:t:w:r:v")) != -1) {
+        switch(optchar){
+        case 'm': // multi
+            option.multi = strtol(optarg, NULL, 10);
+            break;
+        case 'a': // affinity
+        {
+            mb_affinity_t *aff;
+
+            // check for -m option
+            for(idx = optind; idx < argc; idx++){
+                if (strcmp("-m", argv[idx]) == 0) {
+                    fprintf(stderr, "-m option must be specified before -a.\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if (option.affinities == NULL){
+                option.affinities = malloc(sizeof(mb_affinity_t *) * option.multi);
+                bzero(option.affinities, sizeof(mb_affinity_t *) * option.multi);
+            }
+
+            if ((aff = mb_parse_affinity(NULL, optarg)) == NULL){
+                fprintf(stderr, "Invalid argument for -a: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            aff->optarg = strdup(optarg);
+            option.affinities[aff->tid] = aff;
+        }
+            break;
+        case 'd': // depth of directory tree
+            option.depth = strtol(optarg, NULL, 10);
+            if (option.depth < 0){
+                fprintf(stderr,
+                        "-d requires non-negative integer but given: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f': // fanout of directory tree
+            option.fanout = strtol(optarg, NULL, 10);
+            if (option.fanout <= 0){
+                fprintf(stderr,
+                        "-f requires positive integer but given: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'n': // # of files of each thread
+            option.nr_files = strtol(optarg, NULL, 10);
+            if (option.nr_files < 0){
+                fprintf(stderr,
+                        "-n requires non-negative integer but given: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's': // file size
+            option.file_size = strtol(optarg, NULL, 10);
+            if (option.file_size < 0){
+                fprintf(stderr,
+                        "-s requires non-negative integer but given: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'x': // operation mix
+            if (parse_mix(optarg) != 0){
+                fprintf(stderr, "Invalid argument for -x: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 't': // timeout
+            option.timeout = strtol(optarg, NULL, 10);
+            if (option.timeout <= 0){
+                fprintf(stderr,
+                        "-t requires positive integer but given: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'w': // warmup
+            option.warmup = strtod(optarg, NULL);
+            if (option.warmup < 0){
+                fprintf(stderr,
+                        "-w requires non-negative number but given: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r': // rampdown
+            option.rampdown = strtod(optarg, NULL);
+            if (option.rampdown < 0){
+                fprintf(stderr,
+                        "-r requires non-negative number but given: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'v': // verbose
+            option.verbose = true;
+            break;
+        default:
+            fprintf(stderr, "Unknown option '-%c'\n", optchar);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "Root directory is not specified.\n");
+        exit(EXIT_FAILURE);
+    }
+    option.root = argv[optind];
+
+    option.weight_sum = 0;
+    for (op = 0; op < NR_META_OPS; op++) {
+        option.weight_sum += option.weights[op];
+    }
+    if (option.weight_sum == 0) {
+        fprintf(stderr, "No operation is specified by -x.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    option.nr_leaves = 1;
+    for (idx = 0; idx < option.depth; idx++) {
+        option.nr_leaves *= option.fanout;
+    }
+}
+
+/* path of the @leaf-th leaf directory, or the @level-th ancestor of it */
+void
+leaf_path(char *buf, size_t size, long leaf, int level)
+{
+    int n;
+    int i;
+    long divisor;
+
+    n = snprintf(buf, size, "%s", option.root);
+    divisor = option.nr_leaves;
+    for (i = 0; i < level; i++) {
+        divisor /= option.fanout;
+        n += snprintf(buf + n, size - n, "/d%ld", leaf / divisor % option.fanout);
+    }
+}
+
+/* files are spread over leaves; names are unique among threads */
+void
+file_path(char *buf, size_t size, int tid, long file)
+{
+    int n;
+
+    leaf_path(buf, size, file % option.nr_leaves, option.depth);
+    n = strlen(buf);
+    snprintf(buf + n, size - n, "/f%d-%ld", tid, file);
+}
+
+/* create directories of the tree which do not exist yet */
+static void
+make_tree(void)
+{
+    char path[PATH_MAX];
+    long leaf;
+    long stride;
+    int level;
+
+    stride = option.nr_leaves;
+    for (level = 1; level <= option.depth; level++) {
+        stride /= option.fanout;
+        for (leaf = 0; leaf < option.nr_leaves; leaf += stride) {
+            leaf_path(path, sizeof(path), leaf, level);
+            if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+                perror("make_tree:mkdir(2) failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+/* remove directories of the tree, leaves first */
+static void
+remove_tree(void)
+{
+    char path[PATH_MAX];
+    long leaf;
+    long stride;
+    int level;
+
+    stride = 1;
+    for (level = option.depth; level >= 1; level--) {
+        for (leaf = 0; leaf < option.nr_leaves; leaf += stride) {
+            leaf_path(path, sizeof(path), leaf, level);
+            if (rmdir(path) == -1 && option.verbose) {
+                perror("remove_tree:rmdir(2) failed");
+            }
+        }
+        stride *= option.fanout;
+    }
+}
+
+static void
+add_file(th_arg_t *arg, long file)
+{
+    if (arg->nr_files == arg->files_cap) {
+        arg->files_cap = (arg->files_cap == 0 ? 1024 : arg->files_cap * 2);
+        arg->files = realloc(arg->files, sizeof(long) * arg->files_cap);
+        if (arg->files == NULL) {
+            perror("add_file:realloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    arg->files[arg->nr_files++] = file;
+}
+
+static void
+do_create(th_arg_t *arg, char *buf)
+{
+    char path[PATH_MAX];
+    long file;
+    int fd;
+
+    file = arg->next_file++;
+    file_path(path, sizeof(path), arg->id, file);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644)) == -1) {
+        perror("do_create:open(2) failed");
+        exit(EXIT_FAILURE);
+    }
+    if (option.file_size > 0) {
+        mb_writeall(fd, buf, option.file_size, false);
+    }
+    close(fd);
+    add_file(arg, file);
+}
+
+/* do an operation and return its latency in nsec */
+static int64_t
+do_meta_op(th_arg_t *arg, mb_meta_op_t op, struct drand48_data *rand, char *buf)
+{
+    char path[PATH_MAX];
+    char newpath[PATH_MAX];
+    struct stat statbuf;
+    struct dirent *dent;
+    DIR *dir;
+    long idx;
+    long file;
+    int fd;
+    int64_t t0;
+
+    t0 = mb_clock_nsec();
+    switch (op) {
+    case META_CREATE:
+        do_create(arg, buf);
+        break;
+    case META_OPEN:
+        idx = mb_rand_range_long(rand, 0, arg->nr_files);
+        file_path(path, sizeof(path), arg->id, arg->files[idx]);
+        if ((fd = open(path, O_RDONLY)) == -1) {
+            perror("do_meta_op:open(2) failed");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+        break;
+    case META_STAT:
+        idx = mb_rand_range_long(rand, 0, arg->nr_files);
+        file_path(path, sizeof(path), arg->id, arg->files[idx]);
+        if (stat(path, &statbuf) == -1) {
+            perror("do_meta_op:stat(2) failed");
+            exit(EXIT_FAILURE);
+        }
+        break;
+    case META_RENAME:
+        // move to another leaf in most cases
+        idx = mb_rand_range_long(rand, 0, arg->nr_files);
+        file = arg->next_file++;
+        file_path(path, sizeof(path), arg->id, arg->files[idx]);
+        file_path(newpath, sizeof(newpath), arg->id, file);
+        if (rename(path, newpath) == -1) {
+            perror("do_meta_op:rename(2) failed");
+            exit(EXIT_FAILURE);
+        }
+        arg->files[idx] = file;
+        break;
+    case META_UNLINK:
+        idx = mb_rand_range_long(rand, 0, arg->nr_files);
+        file_path(path, sizeof(path), arg->id, arg->files[idx]);
+        if (unlink(path) == -1) {
+            perror("do_meta_op:unlink(2) failed");
+            exit(EXIT_FAILURE);
+        }
+        arg->files[idx] = arg->files[--arg->nr_files];
+        break;
+    case META_READDIR:
+        leaf_path(path, sizeof(path),
+                  mb_rand_range_long(rand, 0, option.nr_leaves), option.depth);
+        if ((dir = opendir(path)) == NULL) {
+            perror("do_meta_op:opendir(3) failed");
+            exit(EXIT_FAILURE);
+        }
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+            ;
+        }
+        closedir(dir);
+        break;
+    default:
+        break;
+    }
+
+    return mb_clock_nsec() - t0;
+}
+
+mb_meta_op_t
+choose_op(th_arg_t *arg, struct drand48_data *rand)
+{
+    long r;
+    int op;
+
+    r = mb_rand_range_long(rand, 0, option.weight_sum);
+    for (op = 0; op < NR_META_OPS; op++) {
+        if ((r -= option.weights[op]) < 0) {
+            break;
+        }
+    }
+    // operations on existing files need some
+    if (arg->nr_files == 0 && op != META_READDIR) {
+        op = META_CREATE;
+    }
+    return op;
+}
+
+void *
+thread_handler(void *arg)
+{
+    pid_t tid;
+    th_arg_t *th_arg = (th_arg_t *) arg;
+    struct drand48_data rand;
+    char *buf;
+    char path[PATH_MAX];
+    mb_meta_op_t op;
+    int64_t latency;
+    long i;
+
+    if (th_arg->affinity != NULL){
+        tid = syscall(SYS_gettid);
+        sched_setaffinity(tid, sizeof(cpu_set_t), &th_arg->affinity->cpumask);
+    }
+    srand48_r(th_arg->id, &rand);
+    buf = calloc(1, option.file_size + 1);
+
+    // populate the tree
+    for (i = 0; i < option.nr_files; i++) {
+        do_create(th_arg, buf);
+    }
+
+    pthread_barrier_wait(th_arg->barrier);
+    pthread_barrier_wait(th_arg->barrier);
+    while (mb_epoch_phase(&epoch) != MB_EPOCH_DONE) {
+        op = choose_op(th_arg, &rand);
+        latency = do_meta_op(th_arg, op, &rand, buf);
+        if (mb_epoch_phase(&epoch) == MB_EPOCH_MEASURE) {
+            mb_hist_add(&th_arg->hists[op], latency);
+        }
+    }
+
+    // clean up files of this thread
+    for (i = 0; i < th_arg->nr_files; i++) {
+        file_path(path, sizeof(path), th_arg->id, th_arg->files[i]);
+        unlink(path);
+    }
+    free(buf);
+
+    pthread_exit(NULL);
+}
+
+int
+micbench_meta_main(int argc, char **argv)
+{
+    th_arg_t *args;
+    int       i;
+    int       op;
+    pthread_barrier_t *barrier;
+    mb_hist_t *hists;
+    int64_t total_ops;
+    double exec_time;
+
+    if (getenv("MICBENCH") == NULL) {
+        fprintf(stderr, "Variable MICBENCH is not set.\n"
+                "This process should be invoked via \"micbench\" command.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    parse_args(argc, argv);
+    make_tree();
+
+    args = malloc(sizeof(th_arg_t) * option.multi);
+    barrier = malloc(sizeof(pthread_barrier_t));
+    // workers and the main thread, which starts the epoch
+    pthread_barrier_init(barrier, NULL, option.multi + 1);
+
+    for(i = 0;i < option.multi;i++){
+        args[i].id = i;
+        args[i].self = malloc(sizeof(pthread_t));
+        args[i].files = NULL;
+        args[i].nr_files = 0;
+        args[i].files_cap = 0;
+        args[i].next_file = 0;
+        for (op = 0; op < NR_META_OPS; op++) {
+            mb_hist_init(&args[i].hists[op]);
+        }
+        args[i].barrier = barrier;
+        if (option.affinities != NULL) {
+            args[i].affinity = option.affinities[i];
+        } else {
+            args[i].affinity = NULL;
+        }
+    }
+
+    mb_epoch_init(&epoch, option.warmup, option.timeout, option.rampdown);
+    for(i = 0;i < option.multi;i++){
+        pthread_create(args[i].self, NULL, thread_handler, &args[i]);
+    }
+    pthread_barrier_wait(barrier);
+    mb_epoch_start(&epoch);
+    pthread_barrier_wait(barrier);
+
+    for(i = 0;i < option.multi;i++){
+        pthread_join(*args[i].self, NULL);
+    }
+    mb_epoch_finish(&epoch);
+    pthread_barrier_destroy(barrier);
+    free(barrier);
+    remove_tree();
+
+    hists = malloc(sizeof(mb_hist_t) * NR_META_OPS);
+    total_ops = 0;
+    for (op = 0; op < NR_META_OPS; op++) {
+        mb_hist_init(&hists[op]);
+        for(i = 0;i < option.multi;i++){
+            mb_hist_merge(&hists[op], &args[i].hists[op]);
+        }
+        total_ops += hists[op].count;
+    }
+    exec_time = mb_epoch_measured_time(&epoch);
+
+    // print summary
+    printf("multiplicity\t%d\n"
+           "root\t%s\n"
+           "depth\t%d\n"
+           "fanout\t%d\n"
+           "files_per_thread\t%ld\n"
+           "file_size\t%ld\n",
+           option.multi,
+           option.root,
+           option.depth,
+           option.fanout,
+           option.nr_files,
+           option.file_size
+        );
+    for (op = 0; op < NR_META_OPS; op++) {
+        printf("weight_%s\t%d\n", meta_op_names[op], option.weights[op]);
+    }
+    if (option.warmup > 0 || option.rampdown > 0) {
+        printf("warmup_time\t%lf\n"
+               "rampdown_time\t%lf\n",
+               option.warmup,
+               option.rampdown);
+    }
+    if (option.affinities != NULL) {
+        for(i = 0; i < option.multi; i++){
+            char *aff_str;
+            if (option.affinities[i] != NULL){
+                aff_str = mb_affinity_to_string(option.affinities[i]);
+            } else {
+                aff_str = NULL;
+            }
+            printf("affinity_%d\t%s\n",
+                   i,
+                   (aff_str != NULL ? aff_str : "none"));
+            if (aff_str != NULL)
+                free(aff_str);
+        }
+    }
+
+    // print results; latency in usec
+    printf("total_ops\t%" PRId64 "\n"
+           "exec_time\t%lf\n"
+           "ops_per_sec\t%lf\n",
+           total_ops,
+           exec_time,
+           total_ops / exec_time);
+    for (op = 0; op < NR_META_OPS; op++) {
+        mb_hist_t *hist = &hists[op];
+        const char *name = meta_op_names[op];
+
+        if (hist->count == 0) continue;
+        printf("%s_ops\t%" PRId64 "\n"
+               "%s_ops_per_sec\t%lf\n"
+               "%s_lat_avg\t%lf\n"
+               "%s_lat_p50\t%lf\n"
+               "%s_lat_p90\t%lf\n"
+               "%s_lat_p99\t%lf\n"
+               "%s_lat_p999\t%lf\n"
+               "%s_lat_max\t%lf\n",
+               name, hist->count,
+               name, hist->count / exec_time,
+               name, (double) hist->sum / hist->count / 1000.0,
+               name, mb_hist_percentile(hist, 50) / 1000.0,
+               name, mb_hist_percentile(hist, 90) / 1000.0,
+               name, mb_hist_percentile(hist, 99) / 1000.0,
+               name, mb_hist_percentile(hist, 99.9) / 1000.0,
+               name, hist->max / 1000.0);
+    }
+
+    if (option.affinities != NULL){
+        for(i = 0;i < option.multi;i++){
+            mb_free_affinity(option.affinities[i]);
+        }
+    }
+    for(i = 0;i < option.multi;i++){
+        free(args[i].self);
+        free(args[i].files);
+    }
+    free(args);
+    free(hists);
+
+    return 0;
+}
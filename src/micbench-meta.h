@@ -0,0 +1,79 @@
+/* -*- indent-tabs-mode: nil -*- */
+
+#ifndef MICBENCH_META_H
+#define MICBENCH_META_H
+
+#include "micbench.h"
+
+typedef enum {
+    META_CREATE,
+    META_OPEN,
+    META_STAT,
+    META_RENAME,
+    META_UNLINK,
+    META_READDIR,
+    NR_META_OPS,
+} mb_meta_op_t;
+
+extern const char *meta_op_names[NR_META_OPS];
+
+typedef struct {
+    // multiplicity and affinities
+    int multi;
+    mb_affinity_t **affinities;
+
+    // directory tree: fanout subdirectories for each of depth levels
+    // under root; files are placed in leaf directories
+    const char *root;
+    int depth;
+    int fanout;
+    long nr_leaves;
+
+    // files created by each thread before measurement
+    long nr_files;
+
+    // bytes written to a file on create
+    long file_size;
+
+    // relative frequency of each operation
+    int weights[NR_META_OPS];
+    int weight_sum;
+
+    // timeout
+    int timeout;
+
+    // unmeasured time before and after the measurement (in sec)
+    double warmup;
+    double rampdown;
+
+    bool verbose;
+} micbench_meta_option_t;
+
+extern micbench_meta_option_t option;
+
+typedef struct {
+    int            id;
+    pthread_t     *self;
+    mb_affinity_t *affinity;
+
+    // ids of files of this thread which exist now
+    long *files;
+    long  nr_files;
+    long  files_cap;
+    long  next_file;    // id of a file to be created next
+
+    // operations and their latency in nsec in measurement
+    mb_hist_t hists[NR_META_OPS];
+
+    pthread_barrier_t *barrier;
+} th_arg_t;
+
+int          parse_mix  (const char *arg);
+void         parse_args (int argc, char **argv);
+void         leaf_path  (char *buf, size_t size, long leaf, int level);
+void         file_path  (char *buf, size_t size, int tid, long file);
+mb_meta_op_t choose_op  (th_arg_t *arg, struct drand48_data *rand);
+
+int micbench_meta_main(int argc, char **argv);
+
+#endif
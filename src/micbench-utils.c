@@ -262,3 +262,301 @@ finally:
     close(fd);
     return size;
 }
+
+/* monotonic clock in nsec */
+int64_t
+mb_clock_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec) * 1000000000L + ts.tv_nsec;
+}
+
+// sleeping is not precise; spin for the last part of a wait
+#define MB_SPIN_NSEC 50000
+
+void
+mb_sleep_until_nsec(int64_t nsec)
+{
+    struct timespec ts;
+    int64_t sleep_until;
+
+    sleep_until = nsec - MB_SPIN_NSEC;
+    if (sleep_until > mb_clock_nsec()) {
+        ts.tv_sec = sleep_until / 1000000000L;
+        ts.tv_nsec = sleep_until % 1000000000L;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    }
+    while (mb_clock_nsec() < nsec) {
+        sched_yield();
+    }
+}
+
+/* @rate <= 0 means unlimited */
+void
+mb_tbucket_init(mb_tbucket_t *tb, double rate, double burst_ns)
+{
+    tb->ns_per_unit = (rate > 0 ? 1.0e9 / rate : 0);
+    tb->burst_ns = burst_ns;
+    tb->tat = mb_clock_nsec();
+}
+
+/* nsec to wait until the next request may start */
+int64_t
+mb_tbucket_delay(mb_tbucket_t *tb, int64_t now)
+{
+    if (tb->ns_per_unit == 0 || tb->tat <= now) {
+        return 0;
+    }
+    return (int64_t) (tb->tat - now) + 1;
+}
+
+/* charge a request of @cost units started at @now */
+void
+mb_tbucket_take(mb_tbucket_t *tb, int64_t cost, int64_t now)
+{
+    if (tb->ns_per_unit == 0) {
+        return;
+    }
+    if (tb->tat < now - tb->burst_ns) {
+        tb->tat = now - tb->burst_ns;
+    }
+    tb->tat += cost * tb->ns_per_unit;
+}
+
+void
+mb_hist_init(mb_hist_t *hist)
+{
+    bzero(hist, sizeof(mb_hist_t));
+}
+
+static int
+mb_hist_bucket(int64_t value)
+{
+    int msb;
+
+    if (value < MB_HIST_NR_SUB) {
+        return value;
+    }
+    msb = 63 - __builtin_clzll(value);
+    return (msb - MB_HIST_SUB_BITS + 1) * MB_HIST_NR_SUB
+        + ((value >> (msb - MB_HIST_SUB_BITS)) & (MB_HIST_NR_SUB - 1));
+}
+
+/* largest value that falls into bucket @idx */
+static int64_t
+mb_hist_bucket_max(int idx)
+{
+    int shift;
+
+    if (idx < MB_HIST_NR_SUB) {
+        return idx;
+    }
+    shift = idx / MB_HIST_NR_SUB - 1;
+    return (int64_t) ((((uint64_t) MB_HIST_NR_SUB + idx % MB_HIST_NR_SUB + 1) << shift) - 1);
+}
+
+void
+mb_hist_add(mb_hist_t *hist, int64_t value)
+{
+    if (value < 0) {
+        value = 0;
+    }
+    if (hist->count == 0 || value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    hist->count++;
+    hist->sum += value;
+    hist->buckets[mb_hist_bucket(value)]++;
+}
+
+void
+mb_hist_merge(mb_hist_t *dst, const mb_hist_t *src)
+{
+    int i;
+
+    if (src->count == 0) {
+        return;
+    }
+    if (dst->count == 0 || src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    for (i = 0; i < MB_HIST_NR_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+/* upper bound of the bucket where @percent of values are at or below */
+int64_t
+mb_hist_percentile(const mb_hist_t *hist, double percent)
+{
+    int64_t rank;
+    int64_t seen;
+    int64_t value;
+    int i;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    rank = (int64_t) (hist->count * percent / 100.0 + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    seen = 0;
+    for (i = 0; i < MB_HIST_NR_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    value = mb_hist_bucket_max(i);
+    if (value > hist->max) {
+        value = hist->max;
+    }
+    if (value < hist->min) {
+        value = hist->min;
+    }
+    return value;
+}
+
+void
+mb_epoch_init(mb_epoch_t *epoch, double warmup, double measure, double rampdown)
+{
+    epoch->phase = MB_EPOCH_WARMUP;
+    epoch->warmup = warmup;
+    epoch->measure = measure;
+    epoch->rampdown = rampdown;
+    epoch->hook = NULL;
+    epoch->hook_arg = NULL;
+    pthread_mutex_init(&epoch->mutex, NULL);
+    pthread_cond_init(&epoch->cond, NULL);
+}
+
+static void
+__mb_epoch_set_phase(mb_epoch_t *epoch, mb_epoch_phase_t phase)
+{
+    // called with epoch->mutex held
+    if (phase == MB_EPOCH_MEASURE) {
+        GETTIMEOFDAY(&epoch->measure_start_tv);
+    } else if (phase == MB_EPOCH_RAMPDOWN) {
+        GETTIMEOFDAY(&epoch->measure_end_tv);
+    }
+    if (epoch->hook != NULL) {
+        epoch->hook(phase, epoch->hook_arg);
+    }
+    epoch->phase = phase;
+    pthread_cond_broadcast(&epoch->cond);
+}
+
+/* sleep @sec seconds while the phase is @phase; sleep forever if @sec < 0 */
+static void
+__mb_epoch_sleep(mb_epoch_t *epoch, mb_epoch_phase_t phase, double sec)
+{
+    struct timeval now;
+    struct timespec abstime;
+    long usec;
+
+    GETTIMEOFDAY(&now);
+    usec = TV2LONG(now) + (long) (sec * 1.0e6);
+    abstime.tv_sec = usec / 1000000;
+    abstime.tv_nsec = (usec % 1000000) * 1000;
+
+    while (epoch->phase == phase) {
+        if (sec < 0) {
+            pthread_cond_wait(&epoch->cond, &epoch->mutex);
+        } else if (pthread_cond_timedwait(&epoch->cond, &epoch->mutex,
+                                          &abstime) == ETIMEDOUT) {
+            break;
+        }
+    }
+}
+
+static void *
+__mb_epoch_timekeeper(void *arg)
+{
+    mb_epoch_t *epoch = arg;
+
+    pthread_mutex_lock(&epoch->mutex);
+    __mb_epoch_sleep(epoch, MB_EPOCH_WARMUP, epoch->warmup);
+    if (epoch->phase == MB_EPOCH_WARMUP) {
+        __mb_epoch_set_phase(epoch, MB_EPOCH_MEASURE);
+    }
+    __mb_epoch_sleep(epoch, MB_EPOCH_MEASURE, epoch->measure);
+    if (epoch->phase == MB_EPOCH_MEASURE) {
+        __mb_epoch_set_phase(epoch, MB_EPOCH_RAMPDOWN);
+    }
+    __mb_epoch_sleep(epoch, MB_EPOCH_RAMPDOWN, epoch->rampdown);
+    if (epoch->phase == MB_EPOCH_RAMPDOWN) {
+        __mb_epoch_set_phase(epoch, MB_EPOCH_DONE);
+    }
+    pthread_mutex_unlock(&epoch->mutex);
+
+    return NULL;
+}
+
+/* start warm-up, or measurement if no warm-up */
+void
+mb_epoch_start(mb_epoch_t *epoch)
+{
+    pthread_mutex_lock(&epoch->mutex);
+    epoch->phase = MB_EPOCH_WARMUP;
+    if (epoch->warmup <= 0) {
+        __mb_epoch_set_phase(epoch, MB_EPOCH_MEASURE);
+    }
+    pthread_mutex_unlock(&epoch->mutex);
+    if (pthread_create(&epoch->timekeeper, NULL, __mb_epoch_timekeeper, epoch) != 0) {
+        perror("mb_epoch_start:pthread_create failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* block until the phase reaches @phase */
+void
+mb_epoch_wait(mb_epoch_t *epoch, mb_epoch_phase_t phase)
+{
+    pthread_mutex_lock(&epoch->mutex);
+    while (epoch->phase < phase) {
+        pthread_cond_wait(&epoch->cond, &epoch->mutex);
+    }
+    pthread_mutex_unlock(&epoch->mutex);
+}
+
+/* end the measurement now and start ramp-down */
+void
+mb_epoch_end_measure(mb_epoch_t *epoch)
+{
+    pthread_mutex_lock(&epoch->mutex);
+    if (epoch->phase == MB_EPOCH_WARMUP) {
+        __mb_epoch_set_phase(epoch, MB_EPOCH_MEASURE);
+    }
+    if (epoch->phase == MB_EPOCH_MEASURE) {
+        __mb_epoch_set_phase(epoch, MB_EPOCH_RAMPDOWN);
+    }
+    pthread_mutex_unlock(&epoch->mutex);
+}
+
+/* wait for the timekeeper to finish and release resources */
+void
+mb_epoch_finish(mb_epoch_t *epoch)
+{
+    pthread_join(epoch->timekeeper, NULL);
+    pthread_cond_destroy(&epoch->cond);
+    pthread_mutex_destroy(&epoch->mutex);
+}
+
+/* length of the measurement phase in sec */
+double
+mb_epoch_measured_time(mb_epoch_t *epoch)
+{
+    return TV2DOUBLE(epoch->measure_end_tv) - TV2DOUBLE(epoch->measure_start_tv);
+}
@@ -22,6 +22,8 @@
 #include <inttypes.h>
 #include <string.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 #include <linux/fs.h>
 
 typedef struct {
@@ -80,6 +82,92 @@ int           mb_rand_buf         (struct drand48_data* rand, char *buf, int buf
 
 int64_t mb_getsize(const char *path);
 
+int64_t mb_clock_nsec       (void);
+void    mb_sleep_until_nsec (int64_t nsec);
+
+/*
+ * Token bucket pacing requests at a given rate (units per second).
+ * A request may start when tat, the time its predecessors are paid
+ * off, has come. Time lost by late wakeups is credited up to
+ * burst_ns so that the average rate is kept.
+ */
+typedef struct {
+    double ns_per_unit; // 0 if unlimited
+    double burst_ns;
+    double tat;         // in nsec of mb_clock_nsec()
+} mb_tbucket_t;
+
+void    mb_tbucket_init  (mb_tbucket_t *tb, double rate, double burst_ns);
+int64_t mb_tbucket_delay (mb_tbucket_t *tb, int64_t now);
+void    mb_tbucket_take  (mb_tbucket_t *tb, int64_t cost, int64_t now);
+
+/*
+ * Log-linear histogram of non-negative values. Values below
+ * MB_HIST_NR_SUB are exact; larger ones fall into one of
+ * MB_HIST_NR_SUB buckets per power of 2, i.e. within 1/16 of error.
+ */
+#define MB_HIST_SUB_BITS   4
+#define MB_HIST_NR_SUB     (1 << MB_HIST_SUB_BITS)
+#define MB_HIST_NR_BUCKETS ((64 - MB_HIST_SUB_BITS + 1) * MB_HIST_NR_SUB)
+
+typedef struct {
+    int64_t count;
+    int64_t sum;
+    int64_t min;
+    int64_t max;
+    int64_t buckets[MB_HIST_NR_BUCKETS];
+} mb_hist_t;
+
+void    mb_hist_init       (mb_hist_t *hist);
+void    mb_hist_add        (mb_hist_t *hist, int64_t value);
+void    mb_hist_merge      (mb_hist_t *dst, const mb_hist_t *src);
+int64_t mb_hist_percentile (const mb_hist_t *hist, double percent);
+
+typedef enum {
+    MB_EPOCH_WARMUP,
+    MB_EPOCH_MEASURE,
+    MB_EPOCH_RAMPDOWN,
+    MB_EPOCH_DONE,
+} mb_epoch_phase_t;
+
+/*
+ * Shared epoch of a run. A timekeeper thread advances the phase;
+ * workers keep running until MB_EPOCH_DONE and account results only
+ * in MB_EPOCH_MEASURE.
+ */
+typedef struct {
+    volatile mb_epoch_phase_t phase;
+
+    double warmup;      // in sec
+    double measure;     // in sec, < 0 for until mb_epoch_end_measure
+    double rampdown;    // in sec
+
+    struct timeval measure_start_tv;
+    struct timeval measure_end_tv;
+
+    // called on entering each phase, before workers can see it
+    void (*hook)(mb_epoch_phase_t phase, void *arg);
+    void *hook_arg;
+
+    pthread_t timekeeper;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} mb_epoch_t;
+
+void   mb_epoch_init          (mb_epoch_t *epoch, double warmup,
+                               double measure, double rampdown);
+void   mb_epoch_start         (mb_epoch_t *epoch);
+void   mb_epoch_wait          (mb_epoch_t *epoch, mb_epoch_phase_t phase);
+void   mb_epoch_end_measure   (mb_epoch_t *epoch);
+void   mb_epoch_finish        (mb_epoch_t *epoch);
+double mb_epoch_measured_time (mb_epoch_t *epoch);
+
+static inline mb_epoch_phase_t
+mb_epoch_phase(mb_epoch_t *epoch)
+{
+    return epoch->phase;
+}
+
 /*
   <set> := <consecutive_set> | <consecutive_set> '+' <set>
   <consective_set> := <single_set> | <range_set>
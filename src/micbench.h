@@ -45,6 +45,7 @@
 
 #define NPROCESSOR (sysconf(_SC_NPROCESSORS_ONLN))
 #define PAGE_SIZE (sysconf(_SC_PAGESIZE))
+#define CACHELINE_SIZE 64
 
 #include "micbench-utils.h"
 
@@ -5,7 +5,10 @@
 
 /* ---- variables ---- */
 static micbench_io_option_t option;
+static micbench_io_option_t *groups;
+static unsigned int nr_groups;
 static gchar *dummy_file;
+static const gchar *dummy_dir;
 static char *argv[1024];
 static mb_aiom_t *aiom;
 static mb_res_pool_t *cbpool;
@@ -31,7 +34,28 @@ void test_parse_args_aio_engine(void);
 void test_parse_args_aio_engine_io_uring(void);
 void test_parse_args_aio_nr_events(void);
 void test_parse_args_aio_trace(void);
+void test_parse_args_replay(void);
+void test_mb_parse_groups(void);
+void test_mb_parse_groups_single_group_opts(void);
+void test_mb_parse_groups_run_opts(void);
+void test_mb_parse_groups_logfile(void);
+void test_parse_args_steady_state(void);
+void test_mb_ss_check(void);
+void test_parse_args_warmup_rampdown(void);
+void test_parse_args_thread_limits(void);
+void test_parse_args_flush(void);
+void test_parse_args_dsync(void);
+void test_parse_args_wal(void);
+void test_mb_wal_group(void);
+void test_parse_args_small_files(void);
+void test_parse_args_page_cache(void);
+void test_parse_args_sysstat(void);
+void test_mb_diskstats_parse(void);
+void test_mb_devstat_rate(void);
 void test_mb_read_or_write(void);
+void test_parse_args_space_ops(void);
+void test_mb_choose_op(void);
+void test_mb_space_op_async(void);
 
 void test_mb_aiom_make(void);
 
@@ -51,9 +75,16 @@ void test_mb_res_pool_make(void);
 void test_mb_res_pool_destroy(void);
 void test_mb_res_pool_push_and_pop(void);
 void test_mb_res_pool_consistent(void);
+void test_mb_res_pool_storage(void);
+void test_mb_res_pool_idx(void);
+void test_mb_res_pool_stack(void);
+void test_mb_res_pool_overhead(void);
 
 /* ---- utility function prototypes ---- */
 static int argc(void);
+static int split_args(const char *args);
+static int parse(const char *args);
+static int parse_groups(const char *args);
 static void my_free_hook(void *ptr, const void *caller);
 static void __mb_assert_will_free(const char *fname, int lineno, const char *exp,
                                   void *ptr, ...);
@@ -90,6 +121,7 @@ cut_setup(void)
 {
     cut_set_fixture_data_dir(mb_test_get_fixtures_dir(), NULL);
     dummy_file = (char *) cut_build_fixture_path("1MB.sparse", NULL);
+    dummy_dir = mb_test_get_fixtures_dir();
 
     freed_list = NULL;
     will_free_list = NULL;
@@ -137,6 +169,43 @@ argc(void)
     return ret;
 }
 
+// split args at spaces into argv, where FILE stands for dummy_file and
+// DIR for dummy_dir.
+// getopt(3) may still point into the arguments of the previous parse,
+// so they are copied every time and never freed.
+static int
+split_args(const char *args)
+{
+    char *buf;
+    char *arg;
+    int nr_args;
+
+    bzero(argv, sizeof(argv));
+    argv[0] = "./dummy";
+    nr_args = 1;
+    buf = strdup(args);
+    for (arg = strtok(buf, " "); arg != NULL; arg = strtok(NULL, " ")) {
+        argv[nr_args++] = (strcmp(arg, "FILE") == 0 ? dummy_file
+                           : strcmp(arg, "DIR") == 0 ? (char *) dummy_dir
+                           : arg);
+    }
+    return nr_args;
+}
+
+static int
+parse(const char *args)
+{
+    int nr_args = split_args(args);
+    return parse_args(nr_args, argv, &option);
+}
+
+static int
+parse_groups(const char *args)
+{
+    int nr_args = split_args(args);
+    return mb_parse_groups(nr_args, argv, &groups, &nr_groups);
+}
+
 static void
 my_free_hook(void *ptr, const void *caller)
 {
@@ -210,29 +279,27 @@ mb_check_will_not_free(void)
 static void
 mb_assert_res_pool_valid(mb_res_pool_t *pool)
 {
-    mb_res_pool_cell_t *cell;
     GHashTable *table;
+    void *data;
+    int i;
 
     table = g_hash_table_new(g_direct_hash, g_direct_equal);
 
-    if (pool->nr_avail == 0) {
-        return;
-    }
-    cell = pool->head;
-    do {
-        // check duplication of cell->data
-        if (g_hash_table_lookup(table, cell->data) != NULL) {
+    for(i = 0; i < pool->nr_avail; i++) {
+        data = pool->avail[i];
+
+        // check duplication of data
+        if (g_hash_table_lookup(table, data) != NULL) {
             cut_fail("duplicated pointer in the pool");
         }
-        g_hash_table_insert(table, cell->data, cell->data);
+        g_hash_table_insert(table, data, data);
 
         // check NULL
-        if (cell->data == NULL) {
+        if (data == NULL) {
             cut_fail("NULL pointer in the pool");
         }
-
-        cell = cell->next;
-    } while(cell != pool->tail->next);
+    }
+    g_hash_table_destroy(table);
 }
 
 /* ---- mocked function bodies ---- */
@@ -410,6 +477,579 @@ test_parse_args_aio_trace_fail(void)
     cut_assert_not_equal_int(0, parse_args(argc(), argv, &option));
 }
 
+void
+test_parse_args_replay(void)
+{
+    argv[argc()] = "--replay";
+    argv[argc()] = (char *) cut_build_fixture_path("iologfile", NULL);
+    argv[argc()] = "--replay-afap";
+    argv[argc()] = dummy_file;
+    cut_assert_equal_int(0, parse_args(argc(), argv, &option));
+    cut_assert_true(option.replay_afap);
+    cut_assert_equal_int(3, option.nr_replay_recs);
+    cut_assert_equal_int(8192, option.replay_max_sz);
+
+    // mixture of reads and writes
+    cut_assert_false(option.read);
+    cut_assert_false(option.write);
+
+    // sorted by issue time, relative to the first request
+    cut_assert_equal_int_least64(0, option.replay_recs[0].issue_usec);
+    cut_assert_equal_int_least64(100, option.replay_recs[1].issue_usec);
+    cut_assert_equal_int_least64(300, option.replay_recs[2].issue_usec);
+
+    cut_assert_equal_int(0, option.replay_recs[0].file_idx);
+    cut_assert_equal_int_least64(4096, option.replay_recs[1].addr);
+    cut_assert_equal_int(8192, option.replay_recs[1].size);
+    cut_assert_equal_int(MB_DO_READ, option.replay_recs[1].mode);
+    cut_assert_equal_int(MB_DO_WRITE, option.replay_recs[2].mode);
+}
+
+void
+test_mb_parse_groups(void)
+{
+    cut_assert_equal_int(0, parse_groups("-m 2 FILE"));
+    cut_assert_equal_int(1, nr_groups);
+    cut_assert_equal_int(2, groups[0].multi);
+
+    cut_assert_equal_int(0, parse_groups("-t 10 -W -m 2 FILE : -R -b 8192 FILE FILE : -M 0.5 FILE"));
+    cut_assert_equal_int(3, nr_groups);
+    cut_assert_equal_int(10, groups[0].timeout);
+    cut_assert_true(groups[0].write);
+    cut_assert_equal_int(2, groups[0].multi);
+    cut_assert_equal_int(PATTERN_SEQ, groups[0].pattern);
+    cut_assert_equal_int(1, groups[0].nr_files);
+    cut_assert_true(groups[1].read);
+    cut_assert_equal_int(1, groups[1].multi);
+    cut_assert_equal_int(PATTERN_RAND, groups[1].pattern);
+    cut_assert_equal_int(8192, groups[1].blk_sz);
+    cut_assert_equal_int(2, groups[1].nr_files);
+    cut_assert_equal_double(0.5, 0.0001, groups[2].rwmix);
+    cut_assert_equal_int(4 * KIBI, groups[2].blk_sz);
+
+    // every group needs its own files
+    cut_assert_not_equal_int(0, parse_groups("FILE : -W"));
+    cut_assert_not_equal_int(0, parse_groups("FILE :"));
+    cut_assert_not_equal_int(0, parse_groups("-W FILE : -Q FILE"));
+}
+
+void
+test_mb_parse_groups_single_group_opts(void)
+{
+    // steady state detection with a single group only
+    cut_assert_equal_int(0, parse_groups("-t 60 --steady-state FILE"));
+    cut_assert_true(groups[0].steady_state);
+    cut_assert_not_equal_int(0, parse_groups("-t 60 --steady-state FILE : FILE"));
+    cut_assert_not_equal_int(0, parse_groups("-t 60 FILE : --steady-state FILE"));
+
+    // sysstat in the first group only
+    cut_assert_equal_int(0, parse_groups("--sysstat FILE : FILE"));
+    cut_assert_true(groups[0].sysstat);
+    cut_assert_equal_int(0, parse_groups("--sysstat-interval 100 FILE : -W FILE"));
+    cut_assert_equal_int(100, groups[0].sysstat_interval);
+    cut_assert_not_equal_int(0, parse_groups("FILE : --sysstat FILE"));
+    cut_assert_not_equal_int(0, parse_groups("FILE : FILE : --sysstat-interval 100 FILE"));
+}
+
+void
+test_mb_parse_groups_run_opts(void)
+{
+    const char *opts[] = {"-t 10", "--warmup 1", "--rampdown 1", "-j", "-N",
+                          "-A -T tracefile", NULL};
+    char args[256];
+    int i;
+
+    for (i = 0; opts[i] != NULL; i++) {
+        // taken from the first group
+        snprintf(args, sizeof(args), "%s -A FILE : -A FILE", opts[i]);
+        cut_assert_equal_int(0, parse_groups(args), cut_message("%s", args));
+
+        // rejected in the others
+        snprintf(args, sizeof(args), "-A FILE : %s -A FILE", opts[i]);
+        cut_assert_not_equal_int(0, parse_groups(args), cut_message("%s", args));
+        snprintf(args, sizeof(args), "-A FILE : -A FILE : -A %s FILE", opts[i]);
+        cut_assert_not_equal_int(0, parse_groups(args), cut_message("%s", args));
+    }
+
+    // also in a cluster of short options
+    cut_assert_not_equal_int(0, parse_groups("FILE : -RNd FILE"));
+    cut_assert_not_equal_int(0, parse_groups("FILE : -Wt 10 FILE"));
+}
+
+void
+test_mb_parse_groups_logfile(void)
+{
+    char log1[] = "/tmp/test-micbench-io.XXXXXX";
+    char log2[] = "/tmp/test-micbench-io.XXXXXX";
+    char args[256];
+
+    close(mkstemp(log1));
+    close(mkstemp(log2));
+
+    snprintf(args, sizeof(args), "-l %s FILE : -l %s FILE", log1, log2);
+    cut_assert_equal_int(0, parse_groups(args));
+    cut_assert_equal_string(log1, groups[0].logfile_path);
+    cut_assert_equal_string(log2, groups[1].logfile_path);
+    fclose(groups[0].logfile);
+    fclose(groups[1].logfile);
+
+    // the same log in two groups
+    snprintf(args, sizeof(args), "-l %s FILE : FILE : -l %s FILE", log1, log1);
+    cut_assert_not_equal_int(0, parse_groups(args));
+    fclose(groups[0].logfile);
+    fclose(groups[2].logfile);
+
+    // also through another path
+    snprintf(args, sizeof(args), "-l %s FILE : -l /tmp/../tmp/%s FILE", log1, log1 + 5);
+    cut_assert_not_equal_int(0, parse_groups(args));
+    fclose(groups[0].logfile);
+    fclose(groups[1].logfile);
+
+    unlink(log1);
+    unlink(log2);
+}
+
+void
+test_parse_args_steady_state(void)
+{
+    argv[1] = "-t";
+    argv[2] = "60";
+    argv[3] = "--steady-state";
+    argv[4] = "--ss-round";
+    argv[5] = "5";
+    argv[6] = "--ss-window";
+    argv[7] = "4";
+    argv[8] = dummy_file;
+    cut_assert_equal_int(0, parse_args(9, argv, &option));
+    cut_assert_true(option.steady_state);
+    cut_assert_equal_int(5, option.ss_round);
+    cut_assert_equal_int(4, option.ss_window);
+
+    // the window just fits in the timeout
+    argv[2] = "20";
+    cut_assert_equal_int(0, parse_args(9, argv, &option));
+
+    // --ss-round * --ss-window exceeds the timeout
+    argv[2] = "19";
+    cut_assert_not_equal_int(0, parse_args(9, argv, &option));
+    argv[2] = "60";
+    argv[5] = "16";
+    cut_assert_not_equal_int(0, parse_args(9, argv, &option));
+
+    // a round must be positive and a window must have 2 rounds or more
+    argv[5] = "0";
+    cut_assert_not_equal_int(0, parse_args(9, argv, &option));
+    argv[5] = "5";
+    argv[7] = "1";
+    cut_assert_not_equal_int(0, parse_args(9, argv, &option));
+
+    // the window is not checked without --steady-state
+    argv[1] = "-t";
+    argv[2] = "10";
+    argv[3] = "--ss-round";
+    argv[4] = "5";
+    argv[5] = "--ss-window";
+    argv[6] = "4";
+    argv[7] = dummy_file;
+    cut_assert_equal_int(0, parse_args(8, argv, &option));
+    cut_assert_false(option.steady_state);
+}
+
+void
+test_mb_ss_check(void)
+{
+    double excursion;
+    double slope_excursion;
+
+    // fresh-out-of-box drop, then steady
+    double iops[] = {3000, 1500, 1000, 1050, 980, 1020, 1000};
+    cut_assert_false(mb_ss_check(iops, 3, 5, &excursion, &slope_excursion));
+    cut_assert_false(mb_ss_check(iops, 5, 5, &excursion, &slope_excursion));
+    cut_assert_false(mb_ss_check(iops, 6, 5, &excursion, &slope_excursion));
+    cut_assert_true(mb_ss_check(iops, 7, 5, &excursion, &slope_excursion));
+    cut_assert_equal_double(0.0693, 0.0001, excursion);
+    cut_assert_equal_double(0.0119, 0.0001, slope_excursion);
+
+    // within the range, but steadily declining
+    double declining[] = {1090, 1060, 1030, 1000, 970};
+    cut_assert_false(mb_ss_check(declining, 5, 5, &excursion, &slope_excursion));
+    cut_assert_equal_double(0.1165, 0.0001, excursion);
+    cut_assert_equal_double(0.1165, 0.0001, slope_excursion);
+}
+
+void
+test_parse_args_warmup_rampdown(void)
+{
+    argv[1] = "-t";
+    argv[2] = "10";
+    argv[3] = "--warmup";
+    argv[4] = "2.5";
+    argv[5] = "--rampdown";
+    argv[6] = "1";
+    argv[7] = dummy_file;
+    cut_assert_equal_int(0, parse_args(8, argv, &option));
+    cut_assert_equal_double(2.5, 0.0001, option.warmup);
+    cut_assert_equal_double(1.0, 0.0001, option.rampdown);
+
+    // negative windows
+    argv[4] = "-1";
+    cut_assert_not_equal_int(0, parse_args(8, argv, &option));
+    argv[4] = "2.5";
+    argv[6] = "-0.5";
+    cut_assert_not_equal_int(0, parse_args(8, argv, &option));
+
+    // unmeasured windows as long as the timeout or longer
+    argv[4] = "6";
+    argv[6] = "4";
+    cut_assert_not_equal_int(0, parse_args(8, argv, &option));
+    argv[4] = "12";
+    argv[6] = "0";
+    cut_assert_not_equal_int(0, parse_args(8, argv, &option));
+    argv[4] = "5.5";
+    argv[6] = "4";
+    cut_assert_equal_int(0, parse_args(8, argv, &option));
+}
+
+void
+test_parse_args_thread_limits(void)
+{
+    argv[1] = "--thread-iops";
+    argv[2] = "20000";
+    argv[3] = "--thread-bw";
+    argv[4] = "209715200";
+    argv[5] = dummy_file;
+    cut_assert_equal_int(0, parse_args(6, argv, &option));
+    cut_assert_equal_int(20000, option.thread_iops);
+    cut_assert_equal_int(209715200, option.thread_bw);
+
+    // malformed limits
+    argv[2] = "abc";
+    cut_assert_not_equal_int(0, parse_args(6, argv, &option));
+    argv[2] = "100x";
+    cut_assert_not_equal_int(0, parse_args(6, argv, &option));
+    argv[2] = "";
+    cut_assert_not_equal_int(0, parse_args(6, argv, &option));
+    argv[2] = "20000";
+    argv[4] = "200mb";
+    cut_assert_not_equal_int(0, parse_args(6, argv, &option));
+    argv[4] = "1.5";
+    cut_assert_not_equal_int(0, parse_args(6, argv, &option));
+
+    // negative limits
+    argv[4] = "-1";
+    cut_assert_not_equal_int(0, parse_args(6, argv, &option));
+    argv[2] = "-100";
+    argv[4] = "209715200";
+    cut_assert_not_equal_int(0, parse_args(6, argv, &option));
+}
+
+void
+test_parse_args_flush(void)
+{
+    cut_assert_equal_int(0, parse("-W FILE"));
+    cut_assert_equal_int(0, option.flush_every);
+    cut_assert_equal_int(0, option.flush_interval);
+    cut_assert_equal_int(FLUSH_FSYNC, option.flush_op);
+
+    cut_assert_equal_int(0, parse("-W --fsync-every 8 --flush-op fdatasync FILE"));
+    cut_assert_equal_int(8, option.flush_every);
+    cut_assert_equal_int(FLUSH_FDATASYNC, option.flush_op);
+    cut_assert_equal_int(0, parse("-M 0.5 --fsync-interval 100 FILE"));
+    cut_assert_equal_int(100, option.flush_interval);
+    cut_assert_equal_int(FLUSH_FSYNC, option.flush_op);
+    cut_assert_equal_int(0, parse("-W --fsync-every 8 --flush-op sync_file_range FILE"));
+    cut_assert_equal_int(FLUSH_SYNC_FILE_RANGE, option.flush_op);
+
+    // nothing to flush in read-only mode
+    cut_assert_not_equal_int(0, parse("--fsync-every 8 FILE"));
+    cut_assert_not_equal_int(0, parse("--fsync-interval 100 --flush-op fdatasync FILE"));
+
+    // libaio has no sync_file_range(2)
+    cut_assert_not_equal_int(0, parse("-W -A --fsync-every 8 --flush-op sync_file_range FILE"));
+    cut_assert_not_equal_int(0, parse("-W -A -g libaio --fsync-interval 10 --flush-op sync_file_range FILE"));
+    cut_assert_equal_int(0, parse("-W -A --fsync-every 8 --flush-op fdatasync FILE"));
+
+    cut_assert_not_equal_int(0, parse("-W --fsync-every -1 FILE"));
+    cut_assert_not_equal_int(0, parse("-W --fsync-interval -1 FILE"));
+    cut_assert_not_equal_int(0, parse("-W --fsync-every 8 --flush-op msync FILE"));
+}
+
+void
+test_parse_args_dsync(void)
+{
+    cut_assert_equal_int(0, parse("-W FILE"));
+    cut_assert_false(option.dsync);
+
+    cut_assert_equal_int(0, parse("-W --dsync FILE"));
+    cut_assert_true(option.dsync);
+    cut_assert_equal_int(0, parse("-M 0.3 --dsync FILE"));
+    cut_assert_true(option.dsync);
+    cut_assert_equal_int(0, parse("-W -A --dsync FILE"));
+    cut_assert_true(option.dsync);
+
+    // on top of a flush cadence
+    cut_assert_equal_int(0, parse("-W --dsync --fsync-every 4 FILE"));
+    cut_assert_true(option.dsync);
+    cut_assert_equal_int(4, option.flush_every);
+
+    // nothing is written in read-only mode
+    cut_assert_not_equal_int(0, parse("--dsync FILE"));
+}
+
+void
+test_parse_args_wal(void)
+{
+    cut_assert_equal_int(0, parse("--wal FILE"));
+    cut_assert_equal_int(PATTERN_WAL, option.pattern);
+    cut_assert_equal_int(512, option.wal_rec_min);
+    cut_assert_equal_int(512, option.wal_rec_max);
+    cut_assert_equal_int(0, option.commit_delay);
+
+    // a log is only appended and committed with fdatasync by default
+    cut_assert_false(option.read);
+    cut_assert_true(option.write);
+    cut_assert_equal_int(FLUSH_FDATASYNC, option.flush_op);
+    cut_assert_equal_int(0, parse("--wal --flush-op fsync FILE"));
+    cut_assert_equal_int(FLUSH_FSYNC, option.flush_op);
+
+    cut_assert_equal_int(0, parse("--wal --wal-record 128,4096 --commit-delay 100 -m 8 FILE"));
+    cut_assert_equal_int(128, option.wal_rec_min);
+    cut_assert_equal_int(4096, option.wal_rec_max);
+    cut_assert_equal_int(100, option.commit_delay);
+    cut_assert_not_equal_int(0, parse("--wal --wal-record 4096,128 FILE"));
+    cut_assert_not_equal_int(0, parse("--wal --wal-record 0 FILE"));
+    cut_assert_not_equal_int(0, parse("--wal --wal-record 128x FILE"));
+
+    // exactly one log
+    cut_assert_not_equal_int(0, parse("--wal FILE FILE"));
+
+    // the log area holds a group of a record of each thread and padding
+    cut_assert_equal_int(0, parse("--wal --wal-record 4096 -m 255 FILE"));
+    cut_assert_not_equal_int(0, parse("--wal --wal-record 4096 -m 256 FILE"));
+    cut_assert_equal_int(0, parse("--wal -s 2 -e 4 FILE"));
+    cut_assert_not_equal_int(0, parse("--wal -s 2 -e 3 FILE"));
+
+    cut_assert_not_equal_int(0, parse("--wal -A FILE"));
+    cut_assert_not_equal_int(0, parse("--wal -t 60 --steady-state FILE"));
+    cut_assert_not_equal_int(0, parse("--wal --fsync-every 4 FILE"));
+}
+
+void
+test_mb_wal_group(void)
+{
+    wal_t wal;
+    int64_t size;
+    int64_t offset;
+
+    cut_assert_equal_int(0, parse("--wal -b 4096 -s 1 -e 4 --wal-record 100,300 -m 4 FILE"));
+    mb_set_option(&option);
+    mb_wal_init(&wal, &option);
+    cut_assert_equal_int(4096, wal.ofst_min);
+    cut_assert_equal_int(4 * 4096, wal.ofst_max);
+
+    // records appended meanwhile make up a group
+    cut_assert_equal_int(1, mb_wal_append(&wal, 100));
+    cut_assert_equal_int(2, mb_wal_append(&wal, 200));
+    cut_assert_equal_int(3, mb_wal_append(&wal, 300));
+    cut_assert_equal_int(3, mb_wal_take_group(&wal, &size, &offset));
+    cut_assert_equal_int(600, size);
+    cut_assert_equal_int(4096, offset);
+    cut_assert_equal_int(0, wal.pending_bytes);
+
+    // the next group follows it
+    cut_assert_equal_int(4, mb_wal_append(&wal, 50));
+    cut_assert_equal_int(4, mb_wal_take_group(&wal, &size, &offset));
+    cut_assert_equal_int(50, size);
+    cut_assert_equal_int(4096 + 600, offset);
+
+    // a group not fitting in the rest of the area goes back to the start
+    wal.offset = 4 * 4096 - 100;
+    mb_wal_append(&wal, 100);
+    mb_wal_take_group(&wal, &size, &offset);
+    cut_assert_equal_int(4 * 4096 - 100, offset);
+    mb_wal_append(&wal, 100);
+    cut_assert_equal_int(6, mb_wal_take_group(&wal, &size, &offset));
+    cut_assert_equal_int(4096, offset);
+    cut_assert_equal_int(4096 + 100, wal.offset);
+
+    // groups are padded to blocks with O_DIRECT
+    option.direct = true;
+    mb_set_option(&option);
+    mb_wal_append(&wal, 300);
+    mb_wal_append(&wal, 300);
+    cut_assert_equal_int(8, mb_wal_take_group(&wal, &size, &offset));
+    cut_assert_equal_int(4096, size);
+    cut_assert_equal_int(4096 + 100, offset);
+
+    mb_wal_destroy(&wal);
+}
+
+void
+test_parse_args_small_files(void)
+{
+    cut_assert_equal_int(0, parse("--small-files 100 DIR"));
+    cut_assert_equal_int(PATTERN_SMALLFILE, option.pattern);
+    cut_assert_equal_int(100, option.nr_small_files);
+    cut_assert_equal_int(4 * KIBI, option.small_file_min);
+    cut_assert_equal_int(4 * KIBI, option.small_file_max);
+
+    cut_assert_equal_int(0, parse("--small-files 100 --small-file-size 512,65536 DIR"));
+    cut_assert_equal_int(512, option.small_file_min);
+    cut_assert_equal_int(65536, option.small_file_max);
+    cut_assert_equal_int(0, parse("--small-files 100 --small-file-size 8192 DIR"));
+    cut_assert_equal_int(8192, option.small_file_min);
+    cut_assert_equal_int(8192, option.small_file_max);
+    cut_assert_equal_int(0, parse("--small-files 100 --small-file-size 4096,4096 DIR"));
+
+    // the file set size bounds
+    cut_assert_not_equal_int(0, parse("--small-files 0 DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files -1 DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files 10x DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files 100 --small-file-size 0 DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files 100 --small-file-size 65536,512 DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files 100 --small-file-size 512, DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files 100 --small-file-size 4k DIR"));
+
+    // exactly one directory
+    cut_assert_not_equal_int(0, parse("--small-files 100 FILE"));
+    cut_assert_not_equal_int(0, parse("--small-files 100 DIR DIR"));
+
+    // files are opened asynchronously by io_uring only
+    cut_assert_not_equal_int(0, parse("--small-files 100 -A DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files 100 -A -g libaio DIR"));
+#ifdef HAVE_IO_URING
+    cut_assert_equal_int(0, parse("--small-files 100 -A -g io_uring DIR"));
+    cut_assert_true(option.aio);
+    cut_assert_equal_int(AIO_IOURING, option.aio_engine);
+#endif
+
+    cut_assert_not_equal_int(0, parse("--small-files 100 --precondition 1 DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files 100 --fsync-every 4 DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files 100 --trim-ratio 0.5 DIR"));
+}
+
+void
+test_parse_args_page_cache(void)
+{
+    cut_assert_equal_int(0, parse("FILE"));
+    cut_assert_false(option.drop_cache);
+    cut_assert_false(option.prefetch);
+    cut_assert_equal_int(-1, option.fadvise);
+    cut_assert_equal_int(-1, option.readahead_kb);
+    cut_assert_equal_int(0, option.cache_sample);
+
+    cut_assert_equal_int(0, parse("--drop-cache FILE"));
+    cut_assert_true(option.drop_cache);
+    cut_assert_equal_int(0, parse("--prefetch FILE"));
+    cut_assert_true(option.prefetch);
+
+    cut_assert_equal_int(0, parse("--fadvise normal FILE"));
+    cut_assert_equal_int(POSIX_FADV_NORMAL, option.fadvise);
+    cut_assert_equal_int(0, parse("--fadvise random FILE"));
+    cut_assert_equal_int(POSIX_FADV_RANDOM, option.fadvise);
+    cut_assert_equal_int(0, parse("--fadvise sequential FILE"));
+    cut_assert_equal_int(POSIX_FADV_SEQUENTIAL, option.fadvise);
+    cut_assert_equal_int(0, parse("--fadvise noreuse FILE"));
+    cut_assert_equal_int(POSIX_FADV_NOREUSE, option.fadvise);
+    cut_assert_not_equal_int(0, parse("--fadvise willneed FILE"));
+
+    cut_assert_equal_int(0, parse("--readahead 0 FILE"));
+    cut_assert_equal_int(0, option.readahead_kb);
+    cut_assert_equal_int(0, parse("--readahead 128 FILE"));
+    cut_assert_equal_int(128, option.readahead_kb);
+    cut_assert_not_equal_int(0, parse("--readahead -1 FILE"));
+    cut_assert_not_equal_int(0, parse("--readahead 128k FILE"));
+
+    // residency is sampled on reads
+    cut_assert_equal_int(0, parse("--cache-sample 100 FILE"));
+    cut_assert_equal_int(100, option.cache_sample);
+    cut_assert_equal_int(0, parse("-M 0.5 --cache-sample 100 FILE"));
+    cut_assert_equal_int(100, option.cache_sample);
+    cut_assert_not_equal_int(0, parse("-W --cache-sample 100 FILE"));
+    cut_assert_not_equal_int(0, parse("--cache-sample -1 FILE"));
+    cut_assert_not_equal_int(0, parse("--cache-sample many FILE"));
+
+    cut_assert_not_equal_int(0, parse("--small-files 100 --drop-cache DIR"));
+    cut_assert_not_equal_int(0, parse("--small-files 100 --readahead 128 DIR"));
+}
+
+void
+test_parse_args_sysstat(void)
+{
+    cut_assert_equal_int(0, parse("FILE"));
+    cut_assert_false(option.sysstat);
+    cut_assert_equal_int(0, option.sysstat_interval);
+
+    cut_assert_equal_int(0, parse("--sysstat FILE"));
+    cut_assert_true(option.sysstat);
+    cut_assert_equal_int(0, option.sysstat_interval);
+
+    // an interval implies --sysstat
+    cut_assert_equal_int(0, parse("--sysstat-interval 100 FILE"));
+    cut_assert_true(option.sysstat);
+    cut_assert_equal_int(100, option.sysstat_interval);
+    cut_assert_not_equal_int(0, parse("--sysstat-interval -1 FILE"));
+    cut_assert_not_equal_int(0, parse("--sysstat-interval 100ms FILE"));
+}
+
+void
+test_mb_diskstats_parse(void)
+{
+    int64_t fields[DS_NR_FIELDS];
+    const char *line =
+        "   8       0 sda 1200 30 96000 500 800 20 64000 900 2 1300 1450 0 0 0 0\n";
+
+    cut_assert_equal_int(-1, mb_diskstats_parse(line, 8, 1, fields));
+    cut_assert_equal_int(-1, mb_diskstats_parse(line, 259, 0, fields));
+    cut_assert_equal_int(-1, mb_diskstats_parse("", 8, 0, fields));
+
+    cut_assert_equal_int(0, mb_diskstats_parse(line, 8, 0, fields));
+    cut_assert_equal_int(1200, fields[DS_READS]);
+    cut_assert_equal_int(30, fields[DS_READ_MERGES]);
+    cut_assert_equal_int(96000, fields[DS_READ_SECTORS]);
+    cut_assert_equal_int(500, fields[DS_READ_TICKS]);
+    cut_assert_equal_int(800, fields[DS_WRITES]);
+    cut_assert_equal_int(20, fields[DS_WRITE_MERGES]);
+    cut_assert_equal_int(64000, fields[DS_WRITE_SECTORS]);
+    cut_assert_equal_int(900, fields[DS_WRITE_TICKS]);
+    cut_assert_equal_int(2, fields[DS_IN_FLIGHT]);
+    cut_assert_equal_int(1300, fields[DS_IO_TICKS]);
+    cut_assert_equal_int(1450, fields[DS_TIME_IN_QUEUE]);
+
+    // fields missing in the line are zero
+    cut_assert_equal_int(0, mb_diskstats_parse(" 8 1 sda1 5 6 7\n", 8, 1, fields));
+    cut_assert_equal_int(5, fields[DS_READS]);
+    cut_assert_equal_int(7, fields[DS_READ_SECTORS]);
+    cut_assert_equal_int(0, fields[DS_READ_TICKS]);
+    cut_assert_equal_int(0, fields[DS_TIME_IN_QUEUE]);
+}
+
+void
+test_mb_devstat_rate(void)
+{
+    int64_t s[DS_NR_FIELDS] = {1000, 10, 8000, 100, 500, 5, 4000, 50, 0, 1000, 2000};
+    int64_t e[DS_NR_FIELDS] = {3000, 30, 2056000, 300, 1500, 25, 1052576, 150, 4, 2500, 8000};
+    devstat_rate_t rate;
+
+    mb_devstat_rate(s, e, 2.0, &rate);
+    cut_assert_equal_double(1000.0, 0.001, rate.read_iops);
+    cut_assert_equal_double(500.0, 0.001, rate.write_iops);
+    cut_assert_equal_double(10.0, 0.001, rate.read_merges);
+    cut_assert_equal_double(10.0, 0.001, rate.write_merges);
+    // 2048000 and 1048576 sectors of 512 bytes
+    cut_assert_equal_double(500.0, 0.001, rate.read_mbps);
+    cut_assert_equal_double(256.0, 0.001, rate.write_mbps);
+    // 6000 msec in queue and 1500 msec busy in 2 sec
+    cut_assert_equal_double(3.0, 0.001, rate.queue_depth);
+    cut_assert_equal_double(0.75, 0.001, rate.utilization);
+
+    // idle device
+    mb_devstat_rate(e, e, 1.0, &rate);
+    cut_assert_equal_double(0.0, 0.001, rate.read_iops);
+    cut_assert_equal_double(0.0, 0.001, rate.write_mbps);
+    cut_assert_equal_double(0.0, 0.001, rate.utilization);
+}
+
 void
 test_mb_read_or_write(void)
 {
@@ -469,6 +1109,119 @@ test_mb_read_or_write(void)
     cut_assert_equal_double(1.0, 0.001, write_ratio);
 }
 
+void
+test_parse_args_space_ops(void)
+{
+    argv[1] = "-W";
+    argv[2] = "--trim-ratio";
+    argv[3] = "0.2";
+    argv[4] = "--zero-ratio";
+    argv[5] = "0.1";
+    argv[6] = dummy_file;
+    cut_assert_equal_int(0, parse_args(7, argv, &option));
+    cut_assert_equal_double(0.2, 0.0001, option.trim_ratio);
+    cut_assert_equal_double(0.1, 0.0001, option.zero_ratio);
+    cut_assert_equal_double(0.0, 0.0001, option.alloc_ratio);
+
+    // space operations need write or mix mode
+    argv[1] = "--trim-ratio";
+    argv[2] = "0.2";
+    argv[3] = dummy_file;
+    cut_assert_not_equal_int(0, parse_args(4, argv, &option));
+
+    // ratios must sum up to 1.0 or less
+    argv[1] = "-W";
+    argv[2] = "--trim-ratio";
+    argv[3] = "0.6";
+    argv[4] = "--alloc-ratio";
+    argv[5] = "0.6";
+    argv[6] = dummy_file;
+    cut_assert_not_equal_int(0, parse_args(7, argv, &option));
+}
+
+void
+test_mb_choose_op(void)
+{
+    struct drand48_data rand;
+    int counts[MB_DO_ALLOC + 1];
+    int i;
+
+    srand48_r(0, &rand);
+
+    // no space operations: always the given mode
+    argv[1] = "-W";
+    argv[2] = dummy_file;
+    cut_assert_equal_int(0, parse_args(3, argv, &option));
+    mb_set_option(&option);
+    for (i = 0; i < 1000; i++) {
+        cut_assert_equal_int(MB_DO_WRITE, mb_choose_op(&rand, MB_DO_WRITE));
+    }
+
+    argv[1] = "-W";
+    argv[2] = "--trim-ratio";
+    argv[3] = "0.2";
+    argv[4] = "--zero-ratio";
+    argv[5] = "0.1";
+    argv[6] = "--alloc-ratio";
+    argv[7] = "0.3";
+    argv[8] = dummy_file;
+    cut_assert_equal_int(0, parse_args(9, argv, &option));
+    mb_set_option(&option);
+    bzero(counts, sizeof(counts));
+    for (i = 0; i < 100000; i++) {
+        counts[mb_choose_op(&rand, MB_DO_WRITE)]++;
+    }
+    cut_assert_equal_int(0, counts[MB_DO_READ]);
+    cut_assert_equal_double(0.2, 0.01, counts[MB_DO_TRIM] / 100000.0);
+    cut_assert_equal_double(0.1, 0.01, counts[MB_DO_ZERO] / 100000.0);
+    cut_assert_equal_double(0.3, 0.01, counts[MB_DO_ALLOC] / 100000.0);
+    cut_assert_equal_double(0.4, 0.01, counts[MB_DO_WRITE] / 100000.0);
+
+    // space operations only
+    argv[1] = "-W";
+    argv[2] = "--zero-ratio";
+    argv[3] = "1.0";
+    argv[4] = dummy_file;
+    cut_assert_equal_int(0, parse_args(5, argv, &option));
+    mb_set_option(&option);
+    for (i = 0; i < 1000; i++) {
+        cut_assert_equal_int(MB_DO_ZERO, mb_choose_op(&rand, MB_DO_WRITE));
+    }
+}
+
+void
+test_mb_space_op_async(void)
+{
+    // libaio has no space operations
+    argv[1] = "-W";
+    argv[2] = "-A";
+    argv[3] = "-g";
+    argv[4] = "libaio";
+    argv[5] = "--trim-ratio";
+    argv[6] = "0.5";
+    argv[7] = dummy_file;
+    cut_assert_equal_int(0, parse_args(8, argv, &option));
+    mb_set_option(&option);
+    cut_assert_false(mb_space_op_async(MB_DO_TRIM, 0));
+    cut_assert_false(mb_space_op_async(MB_DO_ZERO, 0));
+    cut_assert_false(mb_space_op_async(MB_DO_ALLOC, 0));
+
+#ifdef HAVE_IO_URING
+    argv[4] = "io_uring";
+    cut_assert_equal_int(0, parse_args(8, argv, &option));
+    mb_set_option(&option);
+    cut_assert_true(mb_space_op_async(MB_DO_TRIM, 0));
+    cut_assert_true(mb_space_op_async(MB_DO_ZERO, 0));
+    cut_assert_true(mb_space_op_async(MB_DO_ALLOC, 0));
+
+    // discard of block devices is only available as ioctl(2)
+    option.file_blkdev_list[0] = true;
+    mb_set_option(&option);
+    cut_assert_false(mb_space_op_async(MB_DO_TRIM, 0));
+    cut_assert_true(mb_space_op_async(MB_DO_ZERO, 0));
+#endif
+}
+
 void
 test_mb_aiom_make(void)
 {
@@ -505,10 +1258,13 @@ test_mb_aiom_destroy(void)
     mb_assert_will_free(aiom->pending);
     mb_assert_will_free(aiom->events);
     mb_assert_will_free(aiom->cbpool);
+    mb_assert_will_free(aiom->cbpool->avail);
+    mb_assert_will_free(aiom->cbpool->elembase);
 
+    // iocbs are in the storage of the pool, not freed one by one
     for(i = 0; i < 64; i++) {
         iocb = mb_res_pool_pop(aiom->cbpool);
-        mb_assert_will_free(iocb);
+        mb_assert_will_not_free(iocb);
         mb_res_pool_push(aiom->cbpool, iocb);
     }
 
@@ -680,7 +1436,7 @@ test_mb_aiom_submit_pread(void)
                              MOCK_ARG_SKIP, NULL,
                              NULL);
     // pick to-be-used iocb
-    struct iocb *head = aiom->cbpool->head->data;
+    struct iocb *head = aiom->cbpool->avail[aiom->cbpool->nr_avail - 1];
 
     cut_assert_equal_int(0, aiom->nr_inflight);
 
@@ -714,7 +1470,7 @@ test_mb_aiom_submit_pwrite(void)
                              MOCK_ARG_INT, 1,
                              MOCK_ARG_SKIP, NULL,
                              NULL);
-    struct iocb *head = aiom->cbpool->head->data;
+    struct iocb *head = aiom->cbpool->avail[aiom->cbpool->nr_avail - 1];
 
     cut_assert_equal_int(0, aiom->nr_inflight);
 
@@ -864,35 +1620,24 @@ test_mb_aiom_iocount(void)
 void
 test_mb_res_pool_make(void)
 {
-    cbpool = mb_res_pool_make(64);
+    cbpool = mb_res_pool_make(64, 0);
     cut_assert_not_null(cbpool);
-    cut_assert_not_null(cbpool->ring);
-    cut_assert_not_null(cbpool->head);
-    cut_assert_not_null(cbpool->tail);
-    cut_assert_equal_int(64, cbpool->size);
-    cut_assert_equal_pointer(cbpool->ring, cbpool->head);
-    cut_assert_false(cbpool->ring == cbpool->tail);
-
-    // check it is a ring
-    int i;
-    mb_res_pool_cell_t *cell;
-    for(cell = cbpool->ring, i = 0; i < 64; cell = cell->next, i++){}
-    cut_assert_equal_pointer(cbpool->ring, cell);
+    cut_assert_not_null(cbpool->avail);
+    cut_assert_null(cbpool->elembase);
+    cut_assert_equal_int(64, cbpool->nr_elems);
 
-    // initially a pool is empty
+    // initially a pool without storage is empty
     cut_assert_equal_int(0, cbpool->nr_avail);
 }
 
 void
 test_mb_res_pool_destroy(void)
 {
-    mb_res_pool_cell_t *cell;
     mb_res_pool_t *pool;
     void *ptr;
     int i;
 
-    pool = mb_res_pool_make(64);
-    cell = pool->ring;
+    pool = mb_res_pool_make(64, 0);
 
     // populate some data
     for(i = 0; i < 8; i++) {
@@ -902,11 +1647,7 @@ test_mb_res_pool_destroy(void)
     }
 
     mb_assert_will_free(pool);
-    mb_assert_will_free(pool->ring);
-    cell = pool->ring->next;
-    for(; cell != pool->ring; cell = cell->next) {
-        mb_assert_will_free(cell);
-    }
+    mb_assert_will_free(pool->avail);
 
     mb_res_pool_destroy(pool);
 }
@@ -917,7 +1658,7 @@ test_mb_res_pool_push_and_pop(void)
     int i;
     struct iocb *iocb;
 
-    cbpool = mb_res_pool_make(64);
+    cbpool = mb_res_pool_make(64, 0);
 
     for(i = 0; i < 64; i++) {
         iocb = malloc(sizeof(struct iocb));
@@ -947,12 +1688,11 @@ test_mb_res_pool_push_and_pop(void)
 void
 test_mb_res_pool_consistent(void)
 {
-    mb_res_pool_cell_t *cell;
     mb_res_pool_t *pool;
     void *ptr[64];
     int i;
 
-    pool = mb_res_pool_make(64);
+    pool = mb_res_pool_make(64, 0);
 
     mb_assert_res_pool_valid(pool);
 
@@ -979,3 +1719,250 @@ test_mb_res_pool_consistent(void)
 
     mb_res_pool_destroy(pool);
 }
+
+void
+test_mb_res_pool_storage(void)
+{
+    void *elem;
+    void *prev;
+    int i;
+
+    cbpool = mb_res_pool_make(64, sizeof(aiom_cb_t));
+    cut_assert_not_null(cbpool->elembase);
+    cut_assert_equal_int(0, cbpool->elemsize % CACHELINE_SIZE);
+    cut_assert(cbpool->elemsize >= sizeof(aiom_cb_t));
+
+    // a pool with storage is initially full
+    cut_assert_equal_int(64, cbpool->nr_avail);
+    mb_assert_res_pool_valid(cbpool);
+
+    for(prev = NULL, i = 0; i < 64; i++) {
+        elem = mb_res_pool_pop(cbpool);
+        cut_assert_not_null(elem);
+        cut_assert_equal_int(0, (uintptr_t) elem % CACHELINE_SIZE);
+        if (prev != NULL) {
+            cut_assert_equal_int(cbpool->elemsize, (char *) elem - (char *) prev);
+        }
+        prev = elem;
+    }
+    cut_assert_null(mb_res_pool_pop(cbpool));
+
+    // the most recently pushed element is reused first
+    cut_assert_equal_int(0, mb_res_pool_push(cbpool, prev));
+    cut_assert_equal_pointer(prev, mb_res_pool_pop(cbpool));
+}
+
+void
+test_mb_res_pool_idx(void)
+{
+    char *elem;
+    char other;
+    int i;
+
+    cbpool = mb_res_pool_make(16, sizeof(aiom_cb_t));
+
+    for(i = 0; i < 16; i++) {
+        elem = mb_res_pool_pop(cbpool);
+        cut_assert_equal_int(i, mb_res_pool_idx(cbpool, elem));
+    }
+
+    cut_assert_equal_int(-1, mb_res_pool_idx(cbpool, elem + 1));
+    cut_assert_equal_int(-1, mb_res_pool_idx(cbpool, elem + cbpool->elemsize));
+    cut_assert_equal_int(-1, mb_res_pool_idx(cbpool, &other));
+    mb_res_pool_destroy(cbpool);
+
+    // a pool without storage has no index
+    cbpool = mb_res_pool_make(16, 0);
+    mb_res_pool_push(cbpool, &other);
+    cut_assert_equal_int(-1, mb_res_pool_idx(cbpool, &other));
+}
+
+void
+test_mb_res_pool_stack(void)
+{
+    void *elems[64];
+    void *elem;
+    int i, j;
+
+    cbpool = mb_res_pool_make(64, sizeof(aiom_cb_t));
+
+    // no slot is handed out twice until the pool runs out
+    for(i = 0; i < 64; i++) {
+        elems[i] = mb_res_pool_pop(cbpool);
+        cut_assert_not_null(elems[i]);
+        for(j = 0; j < i; j++) {
+            cut_assert_not_equal_intptr((intptr_t) elems[j], (intptr_t) elems[i],
+                                        cut_message("slot %d handed out again as %d", j, i));
+        }
+    }
+    cut_assert_equal_int(0, cbpool->nr_avail);
+    cut_assert_null(mb_res_pool_pop(cbpool));
+    cut_assert_null(mb_res_pool_pop(cbpool));
+
+    // elements come back in LIFO order
+    for(i = 0; i < 8; i++) {
+        cut_assert_equal_int(0, mb_res_pool_push(cbpool, elems[i]));
+    }
+    for(i = 7; i >= 0; i--) {
+        cut_assert_equal_pointer(elems[i], mb_res_pool_pop(cbpool));
+    }
+    cut_assert_null(mb_res_pool_pop(cbpool));
+
+    // a pushed element can be popped again right away, at any depth
+    for(i = 0; i < 64; i++) {
+        cut_assert_equal_int(0, mb_res_pool_push(cbpool, elems[i]));
+        elem = mb_res_pool_pop(cbpool);
+        cut_assert_equal_pointer(elems[i], elem);
+        cut_assert_equal_int(0, mb_res_pool_push(cbpool, elem));
+    }
+    cut_assert_equal_int(64, cbpool->nr_avail);
+    mb_assert_res_pool_valid(cbpool);
+}
+
+/* the previous implementation of mb_res_pool_t: a ring of malloc'ed cells */
+typedef struct ring_pool_cell {
+    void *data;
+    struct ring_pool_cell *next;
+} ring_pool_cell_t;
+
+typedef struct {
+    int nr_elems;
+    int nr_avail;
+    ring_pool_cell_t *head;
+    ring_pool_cell_t *tail;
+} ring_pool_t;
+
+static __attribute__((noinline)) void *
+ring_pool_pop(ring_pool_t *pool)
+{
+    void *ret;
+    if (pool->nr_avail == 0) {
+        return NULL;
+    }
+    ret = pool->head->data;
+    pool->head = pool->head->next;
+    pool->nr_avail --;
+
+    return ret;
+}
+
+static __attribute__((noinline)) int
+ring_pool_push(ring_pool_t *pool, void *elem)
+{
+    if (pool->nr_avail == pool->nr_elems) {
+        return -1;
+    }
+    pool->tail = pool->tail->next;
+    pool->tail->data = elem;
+    pool->nr_avail ++;
+
+    return 0;
+}
+
+/*
+ * Emulate I/O submission and completion at queue depth @depth: pop
+ * elements, touch them as mb_aiom_prep_pread does, and push them back.
+ */
+#define POOL_BENCH_TOUCH(elem)                          \
+    memset((elem), 0, sizeof(struct iocb))
+#define POOL_BENCH_SLACK 1.1
+
+static double
+ring_pool_bench(int nr_elems, int depth, int nr_loops)
+{
+    ring_pool_cell_t *cells[nr_elems];
+    void *elems[nr_elems];
+    ring_pool_t pool;
+    struct timeval start;
+    double elapsed;
+    int i, j;
+
+    // cells and elements are allocated one by one as mb_aiom_make did
+    for(i = 0; i < nr_elems; i++) {
+        cells[i] = malloc(sizeof(ring_pool_cell_t));
+        elems[i] = malloc(sizeof(aiom_cb_t));
+    }
+    for(i = 0; i < nr_elems; i++) {
+        cells[i]->data = elems[i];
+        cells[i]->next = cells[(i + 1) % nr_elems];
+    }
+    pool.nr_elems = pool.nr_avail = nr_elems;
+    pool.head = cells[0];
+    pool.tail = cells[nr_elems - 1];
+
+    GETTIMEOFDAY(&start);
+    for(i = 0; i < nr_loops; i++) {
+        for(j = 0; j < depth; j++) {
+            elems[j] = ring_pool_pop(&pool);
+            POOL_BENCH_TOUCH(elems[j]);
+        }
+        for(j = 0; j < depth; j++) {
+            ring_pool_push(&pool, elems[j]);
+        }
+    }
+
+    elapsed = mb_elapsed_time_from(&start);
+
+    for(i = 0; i < nr_elems; i++) {
+        free(ring_pool_pop(&pool));
+    }
+    for(i = 0; i < nr_elems; i++) {
+        free(cells[i]);
+    }
+
+    return elapsed;
+}
+
+static double
+res_pool_bench(mb_res_pool_t *pool, int depth, int nr_loops)
+{
+    struct timeval start;
+    void *elems[depth];
+    int i, j;
+
+    GETTIMEOFDAY(&start);
+    for(i = 0; i < nr_loops; i++) {
+        for(j = 0; j < depth; j++) {
+            elems[j] = mb_res_pool_pop(pool);
+            POOL_BENCH_TOUCH(elems[j]);
+        }
+        for(j = 0; j < depth; j++) {
+            mb_res_pool_push(pool, elems[j]);
+        }
+    }
+
+    return mb_elapsed_time_from(&start);
+}
+
+void
+test_mb_res_pool_overhead(void)
+{
+    int nr_elems = 16384;
+    int depth = 8;
+    int nr_loops = 200000;
+    double ring_time;
+    double pool_time;
+    int i;
+
+    cbpool = mb_res_pool_make(nr_elems, sizeof(aiom_cb_t));
+
+    // take the best of a few runs to suppress noise
+    ring_time = pool_time = 1.0e9;
+    for(i = 0; i < 5; i++) {
+        ring_time = MIN(ring_time, ring_pool_bench(nr_elems, depth, nr_loops));
+        pool_time = MIN(pool_time, res_pool_bench(cbpool, depth, nr_loops));
+    }
+
+    cut_notify("pop+push per I/O: ring %.2f nsec, array %.2f nsec",
+               ring_time * 1.0e9 / depth / nr_loops,
+               pool_time * 1.0e9 / depth / nr_loops);
+
+    // timings are only reported by default since they depend on the
+    // load of the machine. set MB_TEST_TIMING to check them.
+    if (getenv("MB_TEST_TIMING") != NULL) {
+        cut_assert(pool_time < ring_time * POOL_BENCH_SLACK,
+                   cut_message("array pool (%f sec) is slower than ring pool (%f sec)",
+                               pool_time, ring_time));
+    }
+    mb_assert_res_pool_valid(cbpool);
+}
@@ -0,0 +1,127 @@
+#include "micbench-test.h"
+
+#include <micbench-lock.h>
+
+/* ---- variables ---- */
+static char *argv[32];
+
+/* ---- test function prototypes ---- */
+void test_mode_names(void);
+void test_parse_args_defaults(void);
+void test_parse_args_modes(void);
+void test_parse_args_pingpong(void);
+void test_parse_args_pingpong_conflicts(void);
+
+/* ---- utility function prototypes ---- */
+static int parse(const char *args);
+
+/* ---- setup/teardown ---- */
+void
+cut_setup(void)
+{
+    bzero(&option, sizeof(option));
+}
+
+/* ---- test function bodies ---- */
+void
+test_mode_names(void)
+{
+    cut_assert_equal_int(5, TEST_NR);
+    cut_assert_equal_string("spinlock", mode_names[TEST_SPINLOCK]);
+    cut_assert_equal_string("mutex", mode_names[TEST_MUTEX]);
+    cut_assert_equal_string("mfence", mode_names[TEST_MFENCE]);
+    cut_assert_equal_string("pingpong", mode_names[TEST_PINGPONG]);
+    cut_assert_equal_string("pingpong-cas", mode_names[TEST_PINGPONG_CAS]);
+}
+
+void
+test_parse_args_defaults(void)
+{
+    cut_assert_equal_int(0, parse(""));
+    cut_assert_equal_int(1, option.multi);
+    cut_assert_null(option.affinities);
+    cut_assert_equal_int(TEST_SPINLOCK, option.mode);
+    cut_assert_equal_int(2 << 20, option.count);
+    cut_assert_equal_int(10, option.critical_job_size);
+    cut_assert_equal_int(1000, option.noncritical_job_size);
+    cut_assert_false(option.all_pairs);
+    cut_assert_false(option.verbose);
+}
+
+void
+test_parse_args_modes(void)
+{
+    int mode;
+    char buf[64];
+
+    for (mode = TEST_SPINLOCK; mode <= TEST_MFENCE; mode++) {
+        snprintf(buf, sizeof(buf), "-m 4 -M %s", mode_names[mode]);
+        cut_assert_equal_int(0, parse(buf));
+        cut_assert_equal_int(mode, option.mode);
+        cut_assert_equal_int(4, option.multi);
+    }
+
+    cut_assert_equal_int(1, parse("-M ticketlock"));
+    cut_assert_equal_int(1, parse("-C 0"));
+    cut_assert_equal_int(1, parse("-N -1"));
+    cut_assert_equal_int(1, parse("-w -1"));
+}
+
+void
+test_parse_args_pingpong(void)
+{
+    cut_assert_equal_int(0, parse("-m 2 -M pingpong -a 0:1:1 -a 1:01:1"));
+    cut_assert_equal_int(TEST_PINGPONG, option.mode);
+    cut_assert_not_null(option.affinities);
+    cut_assert_not_null(option.affinities[0]);
+    cut_assert_not_null(option.affinities[1]);
+    cut_assert_false(option.all_pairs);
+
+    cut_assert_equal_int(0, parse("-m 2 -M pingpong-cas -A -w 0.5"));
+    cut_assert_equal_int(TEST_PINGPONG_CAS, option.mode);
+    cut_assert_null(option.affinities);
+    cut_assert_true(option.all_pairs);
+}
+
+void
+test_parse_args_pingpong_conflicts(void)
+{
+    // exactly two threads bounce the line
+    cut_assert_equal_int(1, parse("-M pingpong -A"));
+    cut_assert_equal_int(1, parse("-m 3 -M pingpong-cas -A"));
+
+    // the responder cannot keep running after the measurement
+    cut_assert_equal_int(1, parse("-m 2 -M pingpong -A -r 1"));
+
+    // -A picks the CPUs by itself
+    cut_assert_equal_int(1, parse("-m 2 -M pingpong -A -a 0:1:1 -a 1:01:1"));
+
+    // -A is for pingpong modes only
+    cut_assert_equal_int(1, parse("-m 2 -A"));
+    cut_assert_equal_int(1, parse("-m 2 -M mutex -A"));
+
+    // both threads have to be pinned without -A
+    cut_assert_equal_int(1, parse("-m 2 -M pingpong"));
+    cut_assert_equal_int(1, parse("-m 2 -M pingpong -a 0:1:1"));
+    cut_assert_equal_int(1, parse("-m 2 -M pingpong-cas -a 1:01:1"));
+}
+
+/* ---- utility function bodies ---- */
+
+// split args at spaces and give them to parse_args(). getopt(3) may
+// still point into the arguments of the previous call, so they are
+// copied to a new buffer every time and never freed.
+static int
+parse(const char *args)
+{
+    char *buf;
+    int argc;
+
+    buf = strdup(args);
+    argv[0] = "micbench-lock";
+    argc = 1;
+    for (argv[argc] = strtok(buf, " "); argv[argc] != NULL;
+         argv[++argc] = strtok(NULL, " "))
+        ;
+    return parse_args(argc, argv);
+}
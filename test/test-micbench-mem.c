@@ -0,0 +1,595 @@
+#include "micbench-test.h"
+
+#include <micbench-mem.h>
+
+/* ---- variables ---- */
+#define TEST_LEN 64
+
+// an anonymous mapping partly in THP, a hugetlb mapping and a file
+static const char *smaps_text =
+    "7f0000000000-7f0000400000 rw-p 00000000 00:00 0 \n"
+    "Size:               4096 kB\n"
+    "KernelPageSize:        4 kB\n"
+    "MMUPageSize:           4 kB\n"
+    "Rss:                3072 kB\n"
+    "Anonymous:          3072 kB\n"
+    "AnonHugePages:      2048 kB\n"
+    "Shared_Hugetlb:        0 kB\n"
+    "Private_Hugetlb:       0 kB\n"
+    "THPeligible:    1\n"
+    "VmFlags: rd wr mr mw me ac hg\n"
+    "7f0000400000-7f0000c00000 rw-s 00000000 00:0f 1234   /mnt/huge/file\n"
+    "Size:               8192 kB\n"
+    "KernelPageSize:     2048 kB\n"
+    "MMUPageSize:        2048 kB\n"
+    "Rss:                   0 kB\n"
+    "AnonHugePages:         0 kB\n"
+    "Shared_Hugetlb:     4096 kB\n"
+    "Private_Hugetlb:    2048 kB\n"
+    "VmFlags: rd wr sh mr mw me ms de ht\n"
+    "7fff00000000-7fff00001000 r--p 00000000 08:01 42   /usr/lib/libc.so.6\n"
+    "Size:                  4 kB\n"
+    "KernelPageSize:        4 kB\n"
+    "Rss:                   4 kB\n"
+    "VmFlags: rd mr mw me\n";
+
+static double *a;
+static double *b;
+static double *c;
+
+static char *argv[32];
+
+/* ---- test function prototypes ---- */
+void test_stream_pass_scalar(void);
+void test_stream_pass_simd(void);
+void test_stream_arrays(void);
+void test_make_chain_heads(void);
+void test_chain_perm_bijection(void);
+void test_make_chain_single_cycle(void);
+void test_parse_args_loaded_latency(void);
+void test_make_sweep_sizes(void);
+void test_parse_args_sweep(void);
+void test_detect_levels(void);
+void test_parse_granularities(void);
+void test_parse_args_granularity(void);
+void test_parse_smaps(void);
+void test_numa_point(void);
+
+/* ---- utility function prototypes ---- */
+static void fill_arrays(void);
+static void parse(const char *args);
+static void assert_single_cycle(long nr_lines, long granularity);
+static int set_points(point_t *points, const double *clks, int nr_points);
+static void smaps_usage(void *addr, page_usage_t *usage);
+
+/* ---- setup/teardown ---- */
+void
+cut_setup(void)
+{
+    bzero(&option, sizeof(option));
+    option.multi = 1;
+
+    // the SIMD kernels need cache line aligned arrays
+    cut_assert_equal_int(0, posix_memalign((void **) &a, CACHELINE_SIZE,
+                                           3 * TEST_LEN * sizeof(double)));
+    b = a + TEST_LEN;
+    c = b + TEST_LEN;
+}
+
+void
+cut_teardown(void)
+{
+    free(a);
+}
+
+/* ---- test function bodies ---- */
+void
+test_stream_pass_scalar(void)
+{
+    stream_pass_t pass = simds[SIMD_SCALAR].pass;
+    long i;
+
+    cut_assert_not_null(pass);
+
+    // a[i] = i, b[i] = 2 * i, c[i] = -1
+    fill_arrays();
+    cut_assert_equal_double(TEST_LEN * (TEST_LEN - 1) / 2.0, 0.0,
+                            pass(KERNEL_READ, false, a, b, c, TEST_LEN));
+    // odd length leaves a remainder after the partial sums
+    cut_assert_equal_double(6 * 7 / 2.0, 0.0,
+                            pass(KERNEL_READ, false, a, b, c, 7));
+
+    fill_arrays();
+    pass(KERNEL_WRITE, false, a, b, c, TEST_LEN);
+    for (i = 0; i < TEST_LEN; i++) {
+        cut_assert_equal_double(STREAM_SCALAR, 0.0, a[i]);
+        cut_assert_equal_double(2.0 * i, 0.0, b[i]);
+    }
+
+    fill_arrays();
+    pass(KERNEL_COPY, false, a, b, c, TEST_LEN);
+    for (i = 0; i < TEST_LEN; i++) {
+        cut_assert_equal_double((double) i, 0.0, b[i]);
+    }
+
+    fill_arrays();
+    pass(KERNEL_SCALE, false, a, b, c, TEST_LEN);
+    for (i = 0; i < TEST_LEN; i++) {
+        cut_assert_equal_double(STREAM_SCALAR * i, 0.0, b[i]);
+    }
+
+    fill_arrays();
+    pass(KERNEL_ADD, false, a, b, c, TEST_LEN);
+    for (i = 0; i < TEST_LEN; i++) {
+        cut_assert_equal_double(3.0 * i, 0.0, c[i]);
+    }
+
+    fill_arrays();
+    pass(KERNEL_TRIAD, false, a, b, c, TEST_LEN);
+    for (i = 0; i < TEST_LEN; i++) {
+        cut_assert_equal_double(i + STREAM_SCALAR * 2.0 * i, 0.0, c[i]);
+        cut_assert_equal_double((double) i, 0.0, a[i]);
+    }
+}
+
+void
+test_stream_pass_simd(void)
+{
+    double expected[3 * TEST_LEN];
+    double sum, expected_sum;
+    int simd;
+    int kernel;
+    int nt;
+
+    for (simd = SIMD_SSE2; simd < SIMD_NR; simd++) {
+        if (! simd_supported(simd)) {
+            continue;
+        }
+        for (kernel = KERNEL_READ; kernel < KERNEL_NR; kernel++) {
+            for (nt = 0; nt < 2; nt++) {
+                fill_arrays();
+                expected_sum = simds[SIMD_SCALAR].pass(kernel, false,
+                                                       a, b, c, TEST_LEN);
+                memcpy(expected, a, sizeof(expected));
+
+                fill_arrays();
+                sum = simds[simd].pass(kernel, nt, a, b, c, TEST_LEN);
+                cut_assert_equal_double(expected_sum, 0.0, sum,
+                                        cut_message("%s %s nt=%d",
+                                                    simds[simd].name,
+                                                    kernels[kernel].name, nt));
+                cut_assert_equal_int(0, memcmp(expected, a, sizeof(expected)),
+                                     cut_message("%s %s nt=%d",
+                                                 simds[simd].name,
+                                                 kernels[kernel].name, nt));
+            }
+        }
+    }
+}
+
+void
+test_stream_arrays(void)
+{
+    long area[3 * 4 * CACHELINE_SIZE / sizeof(long)]
+        __attribute__((aligned(CACHELINE_SIZE)));
+    double *sa, *sb, *sc;
+    long lines_len = CACHELINE_SIZE / sizeof(double);
+    long len;
+
+    // triad splits the area into three arrays of 4 cache lines
+    option.kernel = KERNEL_TRIAD;
+    len = stream_arrays(area, sizeof(area), 0, 1, &sa, &sb, &sc);
+    cut_assert_equal_int(4 * lines_len, len);
+    cut_assert_equal_pointer(area, sa);
+    cut_assert_equal_pointer(sa + 4 * lines_len, sb);
+    cut_assert_equal_pointer(sb + 4 * lines_len, sc);
+    cut_assert_equal_double(1.0, 0.0, sa[len - 1]);
+    cut_assert_equal_double(2.0, 0.0, sb[len - 1]);
+    cut_assert_equal_double(0.0, 0.0, sc[len - 1]);
+
+    // slices of two parts start at cache lines
+    len = stream_arrays(area, sizeof(area), 1, 2, &sa, &sb, &sc);
+    cut_assert_equal_int(2 * lines_len, len);
+    cut_assert_equal_pointer((double *) area + 2 * lines_len, sa);
+    cut_assert_equal_pointer(sa + 4 * lines_len, sb);
+
+    // read uses the whole area as one array
+    option.kernel = KERNEL_READ;
+    len = stream_arrays(area, sizeof(area), 0, 1, &sa, &sb, &sc);
+    cut_assert_equal_int(12 * lines_len, len);
+}
+
+void
+test_make_chain_heads(void)
+{
+    long *area;
+    long *heads[4];
+    long *next[4];
+    long *ptr;
+    long nr_lines = 1024;
+    long i;
+    int t;
+
+    area = malloc(nr_lines * CACHELINE_SIZE);
+    make_chain(area, nr_lines * CACHELINE_SIZE, CACHELINE_SIZE, heads, 4);
+
+    // each head reaches the next one after a quarter of the loop
+    for (t = 0; t < 4; t++) {
+        ptr = heads[t];
+        for (i = 0; i < nr_lines / 4; i++) {
+            ptr = (long *) *ptr;
+            if (i + 1 < nr_lines / 4) {
+                cut_assert_not_equal_intptr((intptr_t) heads[(t + 1) % 4],
+                                            (intptr_t) ptr);
+            }
+        }
+        cut_assert_equal_pointer(heads[(t + 1) % 4], ptr);
+    }
+
+    // chase_chains advances all of them at once
+    memcpy(next, heads, sizeof(heads));
+    chase_chains(next, 4, nr_lines / 4);
+    for (t = 0; t < 4; t++) {
+        cut_assert_equal_pointer(heads[(t + 1) % 4], next[t]);
+    }
+
+    free(area);
+}
+
+void
+test_chain_perm_bijection(void)
+{
+    const long nr_lines_list[] = {1, 2, 3, 4, 5, 17, 1000, 4096, 5000};
+    struct drand48_data rand_data;
+    chain_t chain;
+    char *seen;
+    unsigned long idx;
+    unsigned long i;
+    int n;
+    int seed;
+
+    for (n = 0; n < sizeof(nr_lines_list) / sizeof(long); n++) {
+        for (seed = 0; seed < 4; seed++) {
+            srand48_r(seed, &rand_data);
+            chain_init(&chain, NULL, nr_lines_list[n] * CACHELINE_SIZE,
+                       CACHELINE_SIZE, &rand_data);
+            cut_assert_equal_int(nr_lines_list[n], chain.nr_lines);
+            cut_assert_true((1UL << (2 * chain.half_bits)) >= chain.nr_lines);
+
+            // every line index is hit exactly once
+            seen = calloc(chain.nr_lines, 1);
+            for (i = 0; i < chain.nr_lines; i++) {
+                idx = chain_perm(&chain, i);
+                cut_assert_operator_int(idx, <, chain.nr_lines);
+                cut_assert_equal_int(0, seen[idx],
+                                     cut_message("nr_lines=%ld seed=%d i=%lu",
+                                                 nr_lines_list[n], seed, i));
+                seen[idx] = 1;
+            }
+            free(seen);
+        }
+    }
+}
+
+void
+test_make_chain_single_cycle(void)
+{
+    assert_single_cycle(1, CACHELINE_SIZE);
+    assert_single_cycle(3, CACHELINE_SIZE);
+    assert_single_cycle(1000, CACHELINE_SIZE);
+    assert_single_cycle(4096, CACHELINE_SIZE);
+    // nodes of other sizes than a cache line
+    assert_single_cycle(1000, sizeof(long));
+    assert_single_cycle(100, 4096);
+    // built by helper threads in parts
+    assert_single_cycle(CHAIN_PARALLEL_LINES + 3, sizeof(long));
+}
+
+void
+test_parse_args_loaded_latency(void)
+{
+    parse("-m 3 -l 0,100,2000");
+    cut_assert_equal_int(3, option.nr_delays);
+    cut_assert_equal_int(0, option.delays[0]);
+    cut_assert_equal_int(100, option.delays[1]);
+    cut_assert_equal_int(2000, option.delays[2]);
+    // loaders get their own regions and the read kernel by default
+    cut_assert_true(option.local);
+    cut_assert_equal_int(KERNEL_READ, option.kernel);
+
+    parse("-m 2 -l 50 -k triad -c 4");
+    cut_assert_equal_int(1, option.nr_delays);
+    cut_assert_equal_int(KERNEL_TRIAD, option.kernel);
+    cut_assert_equal_int(4, option.chains);
+}
+
+void
+test_make_sweep_sizes(void)
+{
+    long sizes[SWEEP_MAX_SIZES];
+    int nr_sizes;
+    int i;
+
+    // SWEEP_STEPS points per doubling, ending at max
+    nr_sizes = make_sweep_sizes(4096, 65536, sizes);
+    cut_assert_equal_int(4 * SWEEP_STEPS + 1, nr_sizes);
+    cut_assert_equal_int(4096, sizes[0]);
+    cut_assert_equal_int(8192, sizes[SWEEP_STEPS]);
+    cut_assert_equal_int(16384, sizes[2 * SWEEP_STEPS]);
+    cut_assert_equal_int(65536, sizes[nr_sizes - 1]);
+    for (i = 1; i < nr_sizes; i++) {
+        cut_assert_operator_int(sizes[i - 1], <, sizes[i]);
+        cut_assert_equal_int(0, sizes[i] % CACHELINE_SIZE);
+    }
+
+    // sizes rounded to the same cache lines are measured once
+    nr_sizes = make_sweep_sizes(64, 1000, sizes);
+    cut_assert_equal_int(64, sizes[0]);
+    cut_assert_equal_int(128, sizes[1]);
+    cut_assert_equal_int(960, sizes[nr_sizes - 1]);
+    for (i = 1; i < nr_sizes; i++) {
+        cut_assert_operator_int(sizes[i - 1], <, sizes[i]);
+        cut_assert_equal_int(0, sizes[i] % CACHELINE_SIZE);
+    }
+
+    // min == max
+    nr_sizes = make_sweep_sizes(4096, 4096, sizes);
+    cut_assert_equal_int(1, nr_sizes);
+    cut_assert_equal_int(4096, sizes[0]);
+
+    // the largest sweep fits in SWEEP_MAX_SIZES
+    nr_sizes = make_sweep_sizes(CACHELINE_SIZE, 1L << 62, sizes);
+    cut_assert_operator_int(nr_sizes, <=, SWEEP_MAX_SIZES);
+    cut_assert_true(sizes[nr_sizes - 1] == 1L << 62);
+}
+
+void
+test_parse_args_sweep(void)
+{
+    parse("-x 4096 -s 65536");
+    cut_assert_equal_int(4096, option.sweep_min);
+    cut_assert_equal_int(4 * SWEEP_STEPS + 1, option.nr_sweep);
+    cut_assert_equal_int(4096, option.sweep_sizes[0]);
+    cut_assert_equal_int(65536, option.sweep_sizes[option.nr_sweep - 1]);
+}
+
+void
+test_detect_levels(void)
+{
+    point_t points[16];
+    point_t levels[16];
+    int nr_points;
+    int nr_levels;
+
+    // L1, L2, a transition, L3 and a point too short to be a plateau
+    const double three_levels[] = {
+        4, 4, 4, 4, 12, 12, 12, 20, 40, 40, 40, 41, 100,
+    };
+    // a plateau less than SWEEP_LEVEL_RATIO slower extends the level
+    const double extended[] = {
+        4, 4, 4, 5.5, 5.5, 5.5, 12, 12, 12,
+    };
+    // no plateau long enough
+    const double no_level[] = {
+        4, 4, 12, 12, 40,
+    };
+
+    nr_points = set_points(points, three_levels,
+                           sizeof(three_levels) / sizeof(double));
+    nr_levels = detect_levels(points, nr_points, levels);
+    cut_assert_equal_int(3, nr_levels);
+    cut_assert_equal_double(4, 0.0, levels[0].clk_per_op);
+    cut_assert_equal_int(4, levels[0].size);
+    cut_assert_equal_double(12, 0.0, levels[1].clk_per_op);
+    cut_assert_equal_int(7, levels[1].size);
+    cut_assert_equal_double(40, 0.0, levels[2].clk_per_op);
+    cut_assert_equal_int(12, levels[2].size);
+
+    nr_points = set_points(points, extended, sizeof(extended) / sizeof(double));
+    nr_levels = detect_levels(points, nr_points, levels);
+    cut_assert_equal_int(2, nr_levels);
+    cut_assert_equal_double(4, 0.0, levels[0].clk_per_op);
+    cut_assert_equal_int(6, levels[0].size);
+    cut_assert_equal_double(12, 0.0, levels[1].clk_per_op);
+    cut_assert_equal_int(9, levels[1].size);
+
+    nr_points = set_points(points, no_level, sizeof(no_level) / sizeof(double));
+    cut_assert_equal_int(0, detect_levels(points, nr_points, levels));
+}
+
+void
+test_parse_granularities(void)
+{
+    long *list;
+
+    cut_assert_equal_int(3, parse_granularities("8,64,4096", &list));
+    cut_assert_equal_int(8, list[0]);
+    cut_assert_equal_int(64, list[1]);
+    cut_assert_equal_int(4096, list[2]);
+    free(list);
+
+    cut_assert_equal_int(1, parse_granularities("16", &list));
+    cut_assert_equal_int(16, list[0]);
+    free(list);
+
+    // at least and multiples of sizeof(long)
+    cut_assert_equal_int(-1, parse_granularities("4", &list));
+    cut_assert_null(list);
+    cut_assert_equal_int(-1, parse_granularities("8,12", &list));
+    cut_assert_null(list);
+    cut_assert_equal_int(-1, parse_granularities("0", &list));
+    cut_assert_equal_int(-1, parse_granularities("-8", &list));
+    cut_assert_equal_int(-1, parse_granularities("8,64b", &list));
+    cut_assert_equal_int(-1, parse_granularities("", &list));
+    cut_assert_equal_int(-1, parse_granularities(",", &list));
+}
+
+void
+test_parse_args_granularity(void)
+{
+    parse("-g 8,64 -s 4096");
+    cut_assert_equal_int(2, option.nr_granularities);
+    cut_assert_equal_int(8, option.granularities[0]);
+    cut_assert_equal_int(64, option.granularities[1]);
+
+    // the last -g wins
+    parse("-g 8,64 -g 128");
+    cut_assert_equal_int(1, option.nr_granularities);
+    cut_assert_equal_int(128, option.granularities[0]);
+}
+
+void
+test_parse_smaps(void)
+{
+    page_usage_t usage;
+
+    bzero(&usage, sizeof(usage));
+    smaps_usage((void *) 0x7f0000123000, &usage);
+    cut_assert_equal_int(4 * KIBI, usage.kernel_page_size);
+    cut_assert_equal_int(3072 * KIBI, usage.rss);
+    cut_assert_equal_int(2048 * KIBI, usage.huge_rss);
+
+    // hugetlb pages are added to rss as well
+    bzero(&usage, sizeof(usage));
+    smaps_usage((void *) 0x7f0000400000, &usage);
+    cut_assert_equal_int(2048 * KIBI, usage.kernel_page_size);
+    cut_assert_equal_int(6144 * KIBI, usage.rss);
+    cut_assert_equal_int(6144 * KIBI, usage.huge_rss);
+
+    // usage of several areas adds up
+    smaps_usage((void *) 0x7fff00000fff, &usage);
+    cut_assert_equal_int(4 * KIBI, usage.kernel_page_size);
+    cut_assert_equal_int(6148 * KIBI, usage.rss);
+    cut_assert_equal_int(6144 * KIBI, usage.huge_rss);
+
+    // no mapping contains the address
+    bzero(&usage, sizeof(usage));
+    smaps_usage((void *) 0x7f0000c00000, &usage);
+    cut_assert_equal_int(0, usage.kernel_page_size);
+    cut_assert_equal_int(0, usage.rss);
+    cut_assert_equal_int(0, usage.huge_rss);
+}
+
+void
+test_numa_point(void)
+{
+    int row, col;
+    int r, c;
+    int cell;
+
+    option.nr_cpu_nodes = 2;
+    option.nr_mem_nodes = 3;
+
+    // cells in the order do_numa_matrix measures them, each followed by
+    // its bandwidth point
+    cell = 0;
+    for (row = 0; row < option.nr_cpu_nodes; row++) {
+        for (col = 0; col < option.nr_mem_nodes; col++) {
+            cut_assert_equal_int(2 * cell, numa_point(row, col));
+
+            numa_point_cell(numa_point(row, col), &r, &c);
+            cut_assert_equal_int(row, r);
+            cut_assert_equal_int(col, c);
+            numa_point_cell(numa_point(row, col) + 1, &r, &c);
+            cut_assert_equal_int(row, r);
+            cut_assert_equal_int(col, c);
+            cell++;
+        }
+    }
+    cut_assert_equal_int(12, numa_point(option.nr_cpu_nodes, 0));
+
+    option.nr_cpu_nodes = 1;
+    option.nr_mem_nodes = 1;
+    cut_assert_equal_int(0, numa_point(0, 0));
+    cut_assert_equal_int(2, numa_point(option.nr_cpu_nodes, 0));
+}
+
+/* ---- utility function bodies ---- */
+static void
+fill_arrays(void)
+{
+    long i;
+
+    for (i = 0; i < TEST_LEN; i++) {
+        a[i] = i;
+        b[i] = 2.0 * i;
+        c[i] = -1.0;
+    }
+}
+
+// split args at spaces and give them to parse_args(). getopt(3) may
+// still point into the arguments of the previous call, so they are
+// copied to a new buffer every time and never freed.
+static void
+parse(const char *args)
+{
+    char *buf;
+    int argc;
+
+    buf = strdup(args);
+    argv[0] = "micbench-mem";
+    argc = 1;
+    for (argv[argc] = strtok(buf, " "); argv[argc] != NULL;
+         argv[++argc] = strtok(NULL, " "))
+        ;
+    parse_args(argc, argv);
+}
+
+// points of sizes 1, 2, ... with latencies clks
+static int
+set_points(point_t *points, const double *clks, int nr_points)
+{
+    int i;
+
+    for (i = 0; i < nr_points; i++) {
+        bzero(&points[i], sizeof(point_t));
+        points[i].size = i + 1;
+        points[i].clk_per_op = clks[i];
+    }
+
+    return nr_points;
+}
+
+// the chain through nr_lines nodes comes back to the head after visiting
+// each of them once
+static void
+assert_single_cycle(long nr_lines, long granularity)
+{
+    long *area;
+    long *heads[1];
+    long *ptr;
+    char *seen;
+    long idx;
+    long i;
+
+    area = malloc(nr_lines * granularity);
+    seen = calloc(nr_lines, 1);
+    make_chain(area, nr_lines * granularity, granularity, heads, 1);
+
+    ptr = heads[0];
+    for (i = 0; i < nr_lines; i++) {
+        idx = (ptr - area) / (granularity / sizeof(long));
+        cut_assert_equal_int(0, (ptr - area) % (granularity / sizeof(long)));
+        cut_assert_operator_int(idx, <, nr_lines);
+        cut_assert_equal_int(0, seen[idx],
+                             cut_message("nr_lines=%ld granularity=%ld link=%ld",
+                                         nr_lines, granularity, i));
+        seen[idx] = 1;
+        ptr = (long *) *ptr;
+    }
+    cut_assert_equal_pointer(heads[0], ptr);
+
+    free(seen);
+    free(area);
+}
+
+static void
+smaps_usage(void *addr, page_usage_t *usage)
+{
+    FILE *f;
+
+    f = fmemopen((void *) smaps_text, strlen(smaps_text), "r");
+    cut_assert_not_null(f);
+    parse_smaps(f, addr, usage);
+    fclose(f);
+}
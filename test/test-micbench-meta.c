@@ -0,0 +1,174 @@
+#include "micbench-test.h"
+
+#include <micbench-meta.h>
+
+/* ---- variables ---- */
+static th_arg_t th_arg;
+static struct drand48_data rand_data;
+
+/* ---- test function prototypes ---- */
+void test_parse_mix(void);
+void test_choose_op(void);
+void test_choose_op_no_files(void);
+void test_leaf_path(void);
+void test_file_path(void);
+
+/* ---- utility function prototypes ---- */
+static void set_mix(const char *mix);
+static void set_tree(const char *root, int depth, int fanout);
+
+/* ---- setup/teardown ---- */
+void
+cut_setup(void)
+{
+    bzero(&th_arg, sizeof(th_arg));
+    srand48_r(0, &rand_data);
+}
+
+/* ---- test function bodies ---- */
+void
+test_parse_mix(void)
+{
+    cut_assert_equal_int(0, parse_mix("stat=4,unlink=1"));
+    cut_assert_equal_int(0, option.weights[META_CREATE]);
+    cut_assert_equal_int(0, option.weights[META_OPEN]);
+    cut_assert_equal_int(4, option.weights[META_STAT]);
+    cut_assert_equal_int(0, option.weights[META_RENAME]);
+    cut_assert_equal_int(1, option.weights[META_UNLINK]);
+    cut_assert_equal_int(0, option.weights[META_READDIR]);
+
+    cut_assert_equal_int(0, parse_mix("create=1,open=2,stat=3,rename=4,unlink=5,readdir=6"));
+    cut_assert_equal_int(1, option.weights[META_CREATE]);
+    cut_assert_equal_int(6, option.weights[META_READDIR]);
+
+    cut_assert_equal_int(-1, parse_mix("stat"));
+    cut_assert_equal_int(-1, parse_mix("chmod=1"));
+    cut_assert_equal_int(-1, parse_mix("stat=-1"));
+    cut_assert_equal_int(-1, parse_mix("stat="));
+    cut_assert_equal_int(-1, parse_mix("stat=abc"));
+    cut_assert_equal_int(-1, parse_mix("stat=5x"));
+    cut_assert_equal_int(-1, parse_mix("stat=4,unlink=1.5"));
+    cut_assert_equal_int(0, parse_mix("stat=0,unlink=3"));
+    cut_assert_equal_int(0, option.weights[META_STAT]);
+    cut_assert_equal_int(3, option.weights[META_UNLINK]);
+}
+
+void
+test_choose_op(void)
+{
+    int counts[NR_META_OPS];
+    int i;
+
+    set_mix("stat=3,unlink=1");
+    th_arg.nr_files = 10;
+    bzero(counts, sizeof(counts));
+    for (i = 0; i < 100000; i++) {
+        counts[choose_op(&th_arg, &rand_data)]++;
+    }
+    cut_assert_equal_int(0, counts[META_CREATE]);
+    cut_assert_equal_int(0, counts[META_OPEN]);
+    cut_assert_equal_int(0, counts[META_RENAME]);
+    cut_assert_equal_int(0, counts[META_READDIR]);
+    cut_assert_equal_double(0.75, 0.01, counts[META_STAT] / 100000.0);
+    cut_assert_equal_double(0.25, 0.01, counts[META_UNLINK] / 100000.0);
+
+    set_mix("readdir=1");
+    for (i = 0; i < 1000; i++) {
+        cut_assert_equal_int(META_READDIR, choose_op(&th_arg, &rand_data));
+    }
+}
+
+void
+test_choose_op_no_files(void)
+{
+    int counts[NR_META_OPS];
+    int i;
+
+    // operations on existing files turn into creates
+    set_mix("stat=1,readdir=1");
+    th_arg.nr_files = 0;
+    bzero(counts, sizeof(counts));
+    for (i = 0; i < 100000; i++) {
+        counts[choose_op(&th_arg, &rand_data)]++;
+    }
+    cut_assert_equal_int(0, counts[META_STAT]);
+    cut_assert_equal_double(0.5, 0.01, counts[META_CREATE] / 100000.0);
+    cut_assert_equal_double(0.5, 0.01, counts[META_READDIR] / 100000.0);
+}
+
+void
+test_leaf_path(void)
+{
+    char buf[64];
+    char prev[64];
+    long leaf;
+
+    set_tree("/root", 2, 4);
+    cut_assert_equal_int(16, option.nr_leaves);
+
+    leaf_path(buf, sizeof(buf), 6, 2);
+    cut_assert_equal_string("/root/d1/d2", buf);
+    leaf_path(buf, sizeof(buf), 6, 1);
+    cut_assert_equal_string("/root/d1", buf);
+    leaf_path(buf, sizeof(buf), 6, 0);
+    cut_assert_equal_string("/root", buf);
+    leaf_path(buf, sizeof(buf), 15, 2);
+    cut_assert_equal_string("/root/d3/d3", buf);
+
+    // leaves are distinct and in order
+    prev[0] = '\0';
+    for (leaf = 0; leaf < option.nr_leaves; leaf++) {
+        leaf_path(buf, sizeof(buf), leaf, 2);
+        cut_assert_operator_int(0, <, strcmp(buf, prev));
+        strcpy(prev, buf);
+    }
+
+    // no directory under the root
+    set_tree("/root", 0, 4);
+    cut_assert_equal_int(1, option.nr_leaves);
+    leaf_path(buf, sizeof(buf), 0, 0);
+    cut_assert_equal_string("/root", buf);
+}
+
+void
+test_file_path(void)
+{
+    char buf[64];
+
+    set_tree("/root", 2, 4);
+    file_path(buf, sizeof(buf), 3, 17);
+    cut_assert_equal_string("/root/d0/d1/f3-17", buf);
+    file_path(buf, sizeof(buf), 0, 6);
+    cut_assert_equal_string("/root/d1/d2/f0-6", buf);
+
+    set_tree("/root", 0, 4);
+    file_path(buf, sizeof(buf), 1, 5);
+    cut_assert_equal_string("/root/f1-5", buf);
+}
+
+/* ---- utility function bodies ---- */
+static void
+set_mix(const char *mix)
+{
+    int op;
+
+    cut_assert_equal_int(0, parse_mix(mix));
+    option.weight_sum = 0;
+    for (op = 0; op < NR_META_OPS; op++) {
+        option.weight_sum += option.weights[op];
+    }
+}
+
+static void
+set_tree(const char *root, int depth, int fanout)
+{
+    int i;
+
+    option.root = root;
+    option.depth = depth;
+    option.fanout = fanout;
+    option.nr_leaves = 1;
+    for (i = 0; i < depth; i++) {
+        option.nr_leaves *= fanout;
+    }
+}
@@ -9,6 +9,9 @@
 /* ---- test function prototypes ---- */
 void test_getsize(void);
 void test_parse_affinity(void);
+void test_mb_epoch(void);
+void test_mb_tbucket(void);
+void test_mb_hist(void);
 
 /* ---- setup/teardown ---- */
 void
@@ -58,3 +61,113 @@ test_parse_affinity(void)
     cut_assert_equal_int(8, affinity.cpumask.__bits[0]);
     cut_assert_equal_int(2, affinity.nodemask);
 }
+
+static int epoch_hook_calls[MB_EPOCH_DONE + 1];
+
+static void
+epoch_hook(mb_epoch_phase_t phase, void *arg)
+{
+    epoch_hook_calls[phase]++;
+}
+
+void
+test_mb_epoch(void)
+{
+    mb_epoch_t epoch;
+    double t;
+
+    // timed phases
+    bzero(epoch_hook_calls, sizeof(epoch_hook_calls));
+    mb_epoch_init(&epoch, 0.1, 0.2, 0.1);
+    epoch.hook = epoch_hook;
+    mb_epoch_start(&epoch);
+    cut_assert_equal_int(MB_EPOCH_WARMUP, mb_epoch_phase(&epoch));
+    mb_epoch_wait(&epoch, MB_EPOCH_DONE);
+    mb_epoch_finish(&epoch);
+    cut_assert_equal_int(1, epoch_hook_calls[MB_EPOCH_MEASURE]);
+    cut_assert_equal_int(1, epoch_hook_calls[MB_EPOCH_RAMPDOWN]);
+    cut_assert_equal_int(1, epoch_hook_calls[MB_EPOCH_DONE]);
+    t = mb_epoch_measured_time(&epoch);
+    cut_assert_true(t >= 0.19 && t < 0.3, cut_message("measured: %lf", t));
+
+    // no warm-up and open-ended measurement
+    mb_epoch_init(&epoch, 0, -1, 0);
+    mb_epoch_start(&epoch);
+    cut_assert_equal_int(MB_EPOCH_MEASURE, mb_epoch_phase(&epoch));
+    usleep(100000);
+    mb_epoch_end_measure(&epoch);
+    mb_epoch_wait(&epoch, MB_EPOCH_DONE);
+    mb_epoch_finish(&epoch);
+    t = mb_epoch_measured_time(&epoch);
+    cut_assert_true(t >= 0.09 && t < 0.2, cut_message("measured: %lf", t));
+}
+
+void
+test_mb_tbucket(void)
+{
+    mb_tbucket_t tb;
+    int64_t now;
+
+    // 1000 units/sec: 1 msec per unit
+    mb_tbucket_init(&tb, 1000, 2000000);
+    now = tb.tat;
+    cut_assert_equal_int(0, mb_tbucket_delay(&tb, now));
+    mb_tbucket_take(&tb, 1, now);
+    cut_assert_equal_int(1000001, mb_tbucket_delay(&tb, now));
+    mb_tbucket_take(&tb, 3, now + 1000000);
+    cut_assert_equal_int(3000001, mb_tbucket_delay(&tb, now + 1000000));
+
+    // idle time is credited up to the burst
+    now += 100000000;
+    mb_tbucket_take(&tb, 1, now);
+    cut_assert_equal_int(0, mb_tbucket_delay(&tb, now));
+    mb_tbucket_take(&tb, 1, now);
+    cut_assert_equal_int(0, mb_tbucket_delay(&tb, now));
+    mb_tbucket_take(&tb, 1, now);
+    cut_assert_equal_int(1000001, mb_tbucket_delay(&tb, now));
+
+    // unlimited
+    mb_tbucket_init(&tb, 0, 0);
+    mb_tbucket_take(&tb, 1000, tb.tat);
+    cut_assert_equal_int(0, mb_tbucket_delay(&tb, tb.tat));
+}
+
+void
+test_mb_hist(void)
+{
+    mb_hist_t hist;
+    mb_hist_t other;
+    int64_t v;
+
+    mb_hist_init(&hist);
+    cut_assert_equal_int(0, mb_hist_percentile(&hist, 50));
+
+    // small values are exact
+    for (v = 1; v <= 10; v++) {
+        mb_hist_add(&hist, v);
+    }
+    cut_assert_equal_int(5, mb_hist_percentile(&hist, 50));
+    cut_assert_equal_int(9, mb_hist_percentile(&hist, 90));
+    cut_assert_equal_int(10, mb_hist_percentile(&hist, 100));
+    cut_assert_equal_int(1, mb_hist_percentile(&hist, 0));
+
+    // larger ones are within 1/16
+    mb_hist_init(&hist);
+    for (v = 1; v <= 100000; v++) {
+        mb_hist_add(&hist, v);
+    }
+    cut_assert_true(labs(mb_hist_percentile(&hist, 50) - 50000) <= 50000 / 16);
+    cut_assert_true(labs(mb_hist_percentile(&hist, 99) - 99000) <= 99000 / 16);
+    cut_assert_equal_int(100000, mb_hist_percentile(&hist, 100));
+    cut_assert_equal_int(100000, hist.count);
+    cut_assert_equal_int_least64(5000050000L, hist.sum);
+
+    // merged histogram is of all values
+    mb_hist_init(&other);
+    mb_hist_add(&other, 1000000000);
+    mb_hist_merge(&hist, &other);
+    cut_assert_equal_int(100001, hist.count);
+    cut_assert_equal_int(1, hist.min);
+    cut_assert_equal_int_least64(1000000000, hist.max);
+    cut_assert_equal_int_least64(1000000000, mb_hist_percentile(&hist, 100));
+}